@@ -0,0 +1,380 @@
+#include "alias.h"
+#include "subst.h"
+#include "procsubst.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* write */
+#include <stdlib.h>       /* qsort */
+
+/* Open-addressed by name. Names, values and words live in the pool
+   for the rest of the session, so a parsed command may point into it. */
+static Alias table[ALIAS_SLOTS];
+static int num_used = ZERO_VALUE;
+static char pool[ALIAS_POOL_LEN];
+static int pool_used = ZERO_VALUE;
+
+/* ---
+Function Name: define_alias
+
+Purpose:
+    Defines or redefines an alias. The value is split into words here,
+    once; a $(...), <(...) or >(...) stays one word.
+
+Input:
+    name  - alias name
+    value - the command it stands for
+
+Output:
+    ALIAS_OK, ALIAS_BAD_VALUE if the value holds '|', ';' or '&', or
+    ALIAS_FULL if the table or the pool is full.
+--- */
+int define_alias(const char *name, const char *value)
+{
+    char *words[ALIAS_MAX_WORDS];
+    int pool_mark = pool_used;
+
+    int count = split_value(value, words);
+    if (count < ZERO_VALUE) {
+        pool_used = pool_mark;
+        return -count;
+    }
+
+    Alias *alias = find_slot(name, TRUE_VALUE);
+    char **kept = (char **)pool_alloc(count * (int)sizeof(char *));
+    const char *text = pool_copy(value, mystrlen(value));
+    const char *copy = (alias && alias->name) ? alias->name : pool_copy(name, mystrlen(name));
+    if (!alias || !kept || !text || !copy) {
+        pool_used = pool_mark;
+        return ALIAS_FULL;
+    }
+
+    for (int i = ZERO_VALUE; i < count; i++) kept[i] = words[i];
+    if (!alias->name) num_used++;
+    alias->name = copy;
+    alias->text = text;
+    alias->words = kept;
+    alias->num_words = count;
+    alias->removed = ZERO_VALUE;
+    return ALIAS_OK;
+}
+
+/* ---
+Function Name: remove_alias
+
+Purpose:
+    Removes an alias ('unalias name').
+
+Input:
+    name - alias name
+
+Output:
+    Returns 1, or 0 if there is no such alias.
+--- */
+int remove_alias(const char *name)
+{
+    Alias *alias = find_slot(name, ZERO_VALUE);
+    if (!alias) return ZERO_VALUE;
+    alias->removed = TRUE_VALUE;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: clear_aliases
+
+Purpose:
+    Removes every alias ('unalias -a').
+
+Input:
+    None
+
+Output:
+    None
+--- */
+void clear_aliases(void)
+{
+    for (int i = ZERO_VALUE; i < ALIAS_SLOTS; i++) table[i].name = NULL;
+    num_used = ZERO_VALUE;
+}
+
+/* ---
+Function Name: find_alias
+
+Purpose:
+    Looks up the alias of a command name. With no aliases defined it
+    returns at once, so plain commands pay nothing.
+
+Input:
+    name - first word of a command
+
+Output:
+    The alias, or NULL.
+--- */
+const Alias *find_alias(const char *name)
+{
+    if (num_used == ZERO_VALUE) return NULL;
+    return find_slot(name, ZERO_VALUE);
+}
+
+/* ---
+Function Name: print_alias
+
+Purpose:
+    Prints one alias as "alias name='value'".
+
+Input:
+    alias - the alias
+
+Output:
+    Writes the line to standard output.
+--- */
+void print_alias(const Alias *alias)
+{
+    write(STDOUT_FILENO, ALIAS_PRINT_PREFIX, mystrlen(ALIAS_PRINT_PREFIX));
+    write(STDOUT_FILENO, alias->name, mystrlen(alias->name));
+    write(STDOUT_FILENO, ALIAS_PRINT_OPEN, mystrlen(ALIAS_PRINT_OPEN));
+    write(STDOUT_FILENO, alias->text, mystrlen(alias->text));
+    write(STDOUT_FILENO, ALIAS_PRINT_CLOSE, mystrlen(ALIAS_PRINT_CLOSE));
+}
+
+/* ---
+Function Name: print_aliases
+
+Purpose:
+    Lists every alias, sorted by name ('alias').
+
+Input:
+    None
+
+Output:
+    Writes the list to standard output.
+--- */
+void print_aliases(void)
+{
+    const Alias *sorted[ALIAS_SLOTS];
+    int count = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; i < ALIAS_SLOTS; i++) {
+        if (table[i].name && !table[i].removed) sorted[count++] = &table[i];
+    }
+    qsort(sorted, count, sizeof(sorted[ZERO_VALUE]), compare_aliases);
+    for (int i = ZERO_VALUE; i < count; i++) print_alias(sorted[i]);
+}
+
+/* ---
+Function Name: save_aliases
+
+Purpose:
+    Writes the table and the pool to a startup snapshot.
+
+Input:
+    w - snapshot writer
+
+Output:
+    None
+--- */
+void save_aliases(SnapWriter *w)
+{
+    snap_write_int(w, num_used);
+    snap_write(w, table, sizeof(table));
+    snap_write_pool(w, pool);
+    snap_write_int(w, pool_used);
+    snap_write(w, pool, pool_used);
+}
+
+/* ---
+Function Name: load_aliases
+
+Purpose:
+    Restores the aliases from a startup snapshot: the table and pool
+    are copied back and their pointers moved to where the pool lies
+    now, so no value is split again.
+
+Input:
+    r - snapshot reader
+
+Output:
+    Returns 1, or 0 if the image is damaged (no aliases are defined).
+--- */
+int load_aliases(SnapReader *r)
+{
+    clear_aliases();
+    int used = snap_read_count(r, MAX_ALIASES);
+    if (used < ZERO_VALUE || !snap_read(r, table, sizeof(table))) {
+        clear_aliases();
+        return ZERO_VALUE;
+    }
+    SnapPool moved = snap_read_pool(r, pool);
+    int bytes = snap_read_count(r, ALIAS_POOL_LEN);
+    if (bytes < ZERO_VALUE || !snap_read(r, pool, bytes)) {
+        clear_aliases();
+        return ZERO_VALUE;
+    }
+
+    for (int i = ZERO_VALUE; i < ALIAS_SLOTS; i++) {
+        Alias *alias = &table[i];
+        if (!alias->name) continue;
+        alias->name = snap_relocate(alias->name, &moved);
+        alias->text = snap_relocate(alias->text, &moved);
+        alias->words = snap_relocate(alias->words, &moved);
+        for (int k = ZERO_VALUE; k < alias->num_words; k++)
+            alias->words[k] = snap_relocate(alias->words[k], &moved);
+    }
+    num_used = used;
+    pool_used = bytes;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: find_slot
+
+Purpose:
+    Probes the table for a name.
+
+Input:
+    name       - alias name
+    for_insert - non-zero to get a slot to define the name in
+
+Output:
+    The live alias of that name. Otherwise NULL for a lookup, or for an
+    insert the name's removed slot, another removed slot on its probe
+    run or a fresh one; NULL if the table is full.
+--- */
+static Alias *find_slot(const char *name, int for_insert)
+{
+    unsigned int mask = ALIAS_SLOTS - TRUE_VALUE;
+    unsigned int h = hash_alias(name) & mask;
+    Alias *reusable = NULL;
+
+    for (int probes = ZERO_VALUE; probes < ALIAS_SLOTS; probes++, h = (h + TRUE_VALUE) & mask) {
+        Alias *slot = &table[h];
+        if (!slot->name) {
+            if (!for_insert) return NULL;
+            if (reusable) return reusable;
+            return num_used < MAX_ALIASES ? slot : NULL;
+        }
+        if (mystrcmp(slot->name, name) == ZERO_VALUE)
+            return (for_insert || !slot->removed) ? slot : NULL;
+        if (slot->removed && !reusable) reusable = slot;
+    }
+    return for_insert ? reusable : NULL;
+}
+
+/* ---
+Function Name: hash_alias
+
+Purpose:
+    Hashes an alias name (FNV-1a).
+
+Input:
+    name - alias name
+
+Output:
+    The hash.
+--- */
+static unsigned int hash_alias(const char *name)
+{
+    unsigned int h = ALIAS_FNV_OFFSET_BASIS;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= ALIAS_FNV_PRIME;
+    }
+    return h;
+}
+
+/* ---
+Function Name: split_value
+
+Purpose:
+    Splits an alias value into words copied to the pool, the way
+    parse_stage() splits a command.
+
+Input:
+    value - alias value
+    words - ALIAS_MAX_WORDS slots
+
+Output:
+    Number of words, or -ALIAS_BAD_VALUE / -ALIAS_FULL.
+--- */
+static int split_value(const char *value, char **words)
+{
+    int count = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE;;) {
+        while (value[i] == ALIAS_SPACE_CHAR || value[i] == ALIAS_TAB_CHAR) i++;
+        if (value[i] == NULL_CHAR) return count;
+
+        int start = i;
+        for (char c; (c = value[i]) != NULL_CHAR && c != ALIAS_SPACE_CHAR && c != ALIAS_TAB_CHAR;) {
+            if (c == ALIAS_PIPE_CHAR || c == ALIAS_SEPARATOR_CHAR || c == ALIAS_BACKGROUND_CHAR ||
+                c == ALIAS_NEWLINE_CHAR)
+                return -ALIAS_BAD_VALUE;
+            if ((c == SUBST_START_CHAR || c == PROC_INPUT_CHAR || c == PROC_OUTPUT_CHAR) &&
+                value[i + TRUE_VALUE] == SUBST_OPEN_CHAR)
+                i = substitution_end(value, i);
+            else
+                i++;
+        }
+
+        if (count == ALIAS_MAX_WORDS) return -ALIAS_FULL;
+        words[count] = pool_copy(value + start, i - start);
+        if (!words[count++]) return -ALIAS_FULL;
+    }
+}
+
+/* ---
+Function Name: pool_copy
+
+Purpose:
+    Copies a string into the pool.
+
+Input:
+    text, len - the string
+
+Output:
+    The copy, or NULL if the pool is full.
+--- */
+static char *pool_copy(const char *text, int len)
+{
+    char *copy = pool_alloc(len + TRUE_VALUE);
+    if (!copy) return NULL;
+    for (int i = ZERO_VALUE; i < len; i++) copy[i] = text[i];
+    copy[len] = NULL_CHAR;
+    return copy;
+}
+
+/* ---
+Function Name: pool_alloc
+
+Purpose:
+    Allocates from the pool, pointer-aligned.
+
+Input:
+    size - bytes
+
+Output:
+    The block, or NULL if it does not fit.
+--- */
+static char *pool_alloc(int size)
+{
+    int start = (pool_used + (int)sizeof(char *) - TRUE_VALUE) & ~((int)sizeof(char *) - TRUE_VALUE);
+    if (start + size > ALIAS_POOL_LEN) return NULL;
+    pool_used = start + size;
+    return pool + start;
+}
+
+/* ---
+Function Name: compare_aliases
+
+Purpose:
+    qsort() comparison of two aliases by name.
+
+Input:
+    a, b - pointers to Alias pointers
+
+Output:
+    Negative, zero or positive.
+--- */
+static int compare_aliases(const void *a, const void *b)
+{
+    return mystrcmp((*(const Alias * const *)a)->name, (*(const Alias * const *)b)->name);
+}
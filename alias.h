@@ -0,0 +1,70 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include "snapio.h"
+
+/* SIZES */
+#define ALIAS_SLOTS             128     /* power of two */
+#define MAX_ALIASES             96      /* keeps probe runs short */
+#define ALIAS_MAX_WORDS         64
+#define ALIAS_POOL_LEN          (1 << 16)
+#define ALIAS_MAX_DEPTH         16      /* alias of an alias of ... */
+
+/* HASHING CONSTANTS */
+#define ALIAS_FNV_OFFSET_BASIS  2166136261u
+#define ALIAS_FNV_PRIME         16777619u
+
+/* CHARACTERS */
+#define ALIAS_SPACE_CHAR        ' '
+#define ALIAS_TAB_CHAR          '\t'
+#define ALIAS_PIPE_CHAR         '|'
+#define ALIAS_SEPARATOR_CHAR    ';'
+#define ALIAS_BACKGROUND_CHAR   '&'
+#define ALIAS_NEWLINE_CHAR      '\n'
+
+/* OUTPUT */
+#define ALIAS_PRINT_PREFIX      "alias "
+#define ALIAS_PRINT_OPEN        "='"
+#define ALIAS_PRINT_CLOSE       "'\n"
+
+/* define_alias() RESULTS */
+#define ALIAS_OK                0
+#define ALIAS_FULL              1
+#define ALIAS_BAD_VALUE         2       /* a pipeline or a list */
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define NULL_CHAR               '\0'
+
+/* ONE ALIAS
+   The value is split into words when the alias is defined, so using
+   it copies no text and tokenizes nothing. */
+typedef struct
+{
+    const char *name;           /* NULL for a slot never used */
+    const char *text;           /* the value as given, for listing */
+    char **words;
+    int num_words;
+    int removed;                /* left by 'unalias', keeps probe runs intact */
+} Alias;
+
+/* FUNCTION DECLARATIONS */
+int define_alias(const char *name, const char *value);
+int remove_alias(const char *name);
+void clear_aliases(void);
+const Alias *find_alias(const char *name);
+void print_alias(const Alias *alias);
+void print_aliases(void);
+void save_aliases(SnapWriter *w);
+int load_aliases(SnapReader *r);
+
+/* STATIC HELPER FUNCTIONS */
+static Alias *find_slot(const char *name, int for_insert);
+static unsigned int hash_alias(const char *name);
+static int split_value(const char *value, char **words);
+static char *pool_copy(const char *text, int len);
+static char *pool_alloc(int size);
+static int compare_aliases(const void *a, const void *b);
+
+#endif
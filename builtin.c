@@ -1,19 +1,128 @@
+#define _GNU_SOURCE    /* cpu_set_t in stagetune.h */
 #include "builtin.h"
 #include "mystring.h"
 #include "myheap.h"
 #include "jobs.h"
+#include "pathcache.h"
+#include "runjob.h"
+#include "trace.h"
+#include "mysh.h"
+#include "jobsched.h"
+#include "parallel.h"
+#include "errors.h"
+#include "jobtable.h"
+#include "jobwait.h"
+#include "subst.h"
+#include "shellvars.h"
+#include "alias.h"
+#include "coproc.h"
 
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/wait.h>
-#include <termios.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
 
-Job jobs[MAX_JOBS];
-int num_jobs = ZERO_VALUE;
-int last_exit_status = ZERO_VALUE;
-int shell_pgid = ZERO_VALUE;
-struct termios shell_tmodes;
+/* SIGNAL NAMES ACCEPTED BY 'kill' */
+static const SignalName signal_names[] = {
+    { "HUP",  SIGHUP },  { "INT",  SIGINT },  { "QUIT", SIGQUIT },
+    { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+    { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+    { "CHLD", SIGCHLD }, { "CONT", SIGCONT }, { "STOP", SIGSTOP },
+    { "TSTP", SIGTSTP }, { "TTIN", SIGTTIN }, { "TTOU", SIGTTOU }
+};
+#define NUM_SIGNAL_NAMES ((int)(sizeof(signal_names) / sizeof(signal_names[0])))
+
+/* Variables set by 'export' and 'for', see set_shell_variable() */
+static char shell_vars[MAX_SHELL_VARS][SHELL_VAR_LEN];
+static int num_shell_vars = ZERO_VALUE;
+
+/* The environment array the shell runs with, see copy_environment() */
+static char **environment = NULL;
+static int env_capacity = ZERO_VALUE;
+
+/* BUILTIN DISPATCH TABLE */
+/* Builtins that change the shell's own state run in a subshell when
+   used in $(...), so that 'x=$(cd /tmp)' leaves the shell where it was */
+static const Builtin builtins[] = {
+    { CMD_EXIT,   handle_exit,    BUILTIN_SUBSHELL },
+    { CMD_CD,     handle_cd,      BUILTIN_SUBSHELL },
+    { CMD_EXPORT, handle_export,  BUILTIN_SUBSHELL },
+    { CMD_JOBS,   handle_jobs,    BUILTIN_IN_PROCESS },
+    { CMD_FG,     builtin_fg,     BUILTIN_SUBSHELL },
+    { CMD_BG,     builtin_bg,     BUILTIN_SUBSHELL },
+    { CMD_HASH,   handle_hash,    BUILTIN_IN_PROCESS },
+    { CMD_SET,    handle_set,     BUILTIN_SUBSHELL },
+    { CMD_PARALLEL, handle_parallel, BUILTIN_IN_PROCESS },
+    { CMD_WAIT,   handle_wait,    BUILTIN_SUBSHELL },
+    { CMD_KILL,   handle_kill,    BUILTIN_IN_PROCESS },
+    { CMD_DISOWN, handle_disown,  BUILTIN_SUBSHELL },
+    { CMD_ULIMIT, handle_ulimit,  BUILTIN_SUBSHELL },
+    { CMD_HISTORY, handle_history, BUILTIN_IN_PROCESS },
+    { CMD_LOCAL,  handle_local,   BUILTIN_SUBSHELL },
+    { CMD_ALIAS,  handle_alias,   BUILTIN_SUBSHELL },
+    { CMD_UNALIAS, handle_unalias, BUILTIN_SUBSHELL },
+    { CMD_COPROC, handle_coproc,  BUILTIN_SUBSHELL }
+};
+
+/* ---
+Function Name: find_builtin
+
+Purpose:
+    Looks a command name up in the builtin table.
+    
+Input:
+    name - command name
+    
+Output:
+    Index of the builtin, or NOT_BUILTIN if name is not a builtin.
+--- */
+int find_builtin(const char *name) {
+    if (!name) return NOT_BUILTIN;
+    for (int i = INITIAL_INDEX; i < NUM_BUILTINS; i++) {
+        if (mystrcmp(builtins[i].name, name) == STRINGS_MATCH)
+            return i;
+    }
+    return NOT_BUILTIN;
+}
+
+/* ---
+Function Name: run_builtin
+
+Purpose:
+    Runs a builtin found by find_builtin() inside the shell process.
+    
+Input:
+    index - builtin table index
+    argv - argument list
+    envp - environment variables
+    
+Output:
+    Exit status of the builtin.
+--- */
+int run_builtin(int index, char **argv, char *envp[]) {
+    return builtins[index].handler(argv, envp);
+}
+
+/* ---
+Function Name: builtin_runs_in_process
+
+Purpose:
+    Tells command substitution whether a builtin only produces output
+    (jobs, history, ...) and can run inside the shell, or changes the
+    shell's state (cd, exit, ...) and needs a subshell.
+    
+Input:
+    index - builtin table index
+    
+Output:
+    Non-zero if the builtin can run in-process.
+--- */
+int builtin_runs_in_process(int index) {
+    return builtins[index].in_process;
+}
 
 /* ---
 Function Name: get_env_value
@@ -53,13 +162,16 @@ Input:
     
 Output:
     Changes current directory, prints error on failure.
+    Returns 0 on success, 1 on failure.
 --- */
-void handle_cd(char **argv, char *envp[]) {
+int handle_cd(char **argv, char *envp[]) {
     const char *dir = argv[JOB_OFFSET_INDEX];
     if (!dir) dir = get_env_value(HOME_ENV_NAME, envp);
     if (!dir || chdir(dir) < ZERO_VALUE) {
         write(STDERR_FILENO, CD_ERROR_MSG, CD_ERROR_MSG_LEN);
+        return BUILTIN_FAILURE;
     }
+    return BUILTIN_SUCCESS;
 }
 
 
@@ -96,13 +208,17 @@ Purpose:
     
 Input:
     argv - argument list
+    envp - environment variables (unused)
     
 Output:
-    Exits the shell process with the provided status.
+    Exits the shell process with the provided status, or with the status
+    of the last command when none is given.
 --- */
-void handle_exit(char **argv) {
-    int status = DEF_EXIT_STATUS;
+int handle_exit(char **argv, char *envp[]) {
+    (void)envp;
+    int status = last_exit_status;
     if (argv[JOB_OFFSET_INDEX]) status = myatoi(argv[JOB_OFFSET_INDEX]);
+    trace_close();
     free_all();
     _exit(status);
 }
@@ -118,62 +234,22 @@ Input:
     envp - environment variable array
     
 Output:
-    Adds or updates the environment variable.
+    Adds or updates the environment variable. Returns 0, or 1 if the
+    argument is not of the form VAR=value.
 --- */
-void handle_export(char **argv, char *envp[]) {
-    if (!argv[JOB_OFFSET_INDEX]) return;
+int handle_export(char **argv, char *envp[]) {
+    if (!argv[JOB_OFFSET_INDEX]) return BUILTIN_SUCCESS;
 
     int i = INITIAL_INDEX;
     while (argv[JOB_OFFSET_INDEX][i] && argv[1][i] != ENV_ASSIGN_CHAR) i++;
-    if (!argv[JOB_OFFSET_INDEX][i]) return;
-
-    argv[JOB_OFFSET_INDEX][i] = ENV_TERMINATOR_NULL;
-    char *var = argv[JOB_OFFSET_INDEX];
-    char *val = argv[JOB_OFFSET_INDEX] + i + JOB_OFFSET_INDEX;
-
-    for (int e = INITIAL_INDEX; envp[e]; e++) {
-        int j = INITIAL_INDEX;
-        while (envp[e][j] && var[j] && envp[e][j] == var[j]) j++;
-        if (envp[e][j] == ENV_ASSIGN_CHAR && var[j] == ENV_TERMINATOR_NULL) {
-            int len = mystrlen(var) + mystrlen(val) + ENV_STRING_EXTRA;
-            char *new_entry = alloc(len);
-            if (!new_entry) return;
-            mystrcpy(new_entry, var);
-            mystrcat(new_entry, ASSIGN_EQUAL);
-            mystrcat(new_entry, val);
-            envp[e] = new_entry;
-            return;
-        }
-    }
+    if (!argv[JOB_OFFSET_INDEX][i] || i >= VAR_NAME_LEN) return BUILTIN_FAILURE;
 
-    for (int e = INITIAL_INDEX; envp[e]; e++) {
-        if (!envp[e + JOB_OFFSET_INDEX]) {
-            int len = mystrlen(var) + mystrlen(val) + ENV_STRING_EXTRA;
-            char *new_entry = alloc(len);
-            if (!new_entry) return;
-            mystrcpy(new_entry, var);
-            mystrcat(new_entry, ASSIGN_EQUAL);
-            mystrcat(new_entry, val);
-            envp[e + JOB_OFFSET_INDEX] = new_entry;
-            envp[e + ENV_STRING_EXTRA] = NULL;
-            return;
-        }
-    }
+    char var[VAR_NAME_LEN];
+    for (int j = INITIAL_INDEX; j < i; j++) var[j] = argv[JOB_OFFSET_INDEX][j];
+    var[i] = ENV_TERMINATOR_NULL;
+    const char *val = argv[JOB_OFFSET_INDEX] + i + JOB_OFFSET_INDEX;
 
-// Append new variable if not found
-    for (int e = ZERO_VALUE; envp[e]; e++) {
-        if (!envp[e + JOB_OFFSET_INDEX]) {
-            int len = mystrlen(var) + mystrlen(val) + ENV_STRING_EXTRA;
-            char *new_entry = alloc(len);
-            if (!new_entry) return;
-            mystrcpy(new_entry, var);
-            mystrcat(new_entry, ASSIGN_EQUAL);
-            mystrcat(new_entry, val);
-            envp[e + JOB_OFFSET_INDEX] = new_entry;
-            envp[e + ENV_STRING_EXTRA] = NULL;
-            return;
-        }
-    }
+    return set_shell_variable(var, val, envp) ? BUILTIN_SUCCESS : BUILTIN_FAILURE;
 }
 
 /* ---
@@ -221,144 +297,1673 @@ void int_to_str(int n, char *buf) {
 Function Name: expand_variables
 
 Purpose:
-    Expands $VAR and $? in argument list.
+    Expands $VAR, ${VAR}, $?, $PIPESTATUS and ${PIPESTATUS[n]} inside
+    the arguments of one pipeline stage ("out_$i.txt" works as well as
+    "$i"). ${PIPESTATUS[@]} expands to one argument per stage of the
+    last pipeline. Arguments containing $(...) are replaced by the words
+    of the command's output (see substitute_command()). Expanded words
+    are copied to the heap, so values longer than the original token
+    are safe and the token itself is never modified.
     
 Input:
-    argv - argument list
+    cmd - command whose arguments are expanded
+    envp - environment variables
+    
+Output:
+    Modifies cmd->argv and cmd->argc in place. Returns 0 if a command
+    substitution produced more arguments than fit (already reported),
+    1 otherwise.
+--- */
+int expand_variables(Command *cmd, char *envp[]) {
+    for (int i = INITIAL_INDEX; i < (int)cmd->argc; i++) {
+        if (has_substitution(cmd->argv[i])) {
+            int next = substitute_command(cmd, i, envp);
+            if (next < ZERO_VALUE) return FALSE;
+            i = next - JOB_OFFSET_INDEX;
+            continue;
+        }
+
+        if (mystrcmp(cmd->argv[i], VAR_PIPESTATUS_ALL) == STRINGS_MATCH ||
+            mystrcmp(cmd->argv[i], VAR_PIPESTATUS_STAR) == STRINGS_MATCH) {
+            i = splice_pipe_status(cmd, i) - JOB_OFFSET_INDEX;
+            continue;
+        }
+        if (mystrcmp(cmd->argv[i], VAR_PARAMS_ALL) == STRINGS_MATCH ||
+            mystrcmp(cmd->argv[i], VAR_PARAMS_STAR) == STRINGS_MATCH) {
+            i = splice_positional(cmd, i) - JOB_OFFSET_INDEX;
+            continue;
+        }
+        cmd->argv[i] = expand_word(cmd->argv[i], envp);
+    }
+    return TRUE;
+}
+
+/* ---
+Function Name: expand_redirections
+
+Purpose:
+    Resolves '<&N' and '>&N' (paths "&N", see parse_stage()) now that
+    variables can be expanded, so '>&${NAME[1]}' reaches a coprocess.
+    The descriptor becomes the job's in_fd or out_fd, which its first
+    stage reads or its last stage writes, as with a pipe.
+    
+Input:
+    job  - parsed job
+    envp - environment variables
+    
+Output:
+    Returns 1, or 0 if a word is not an open descriptor (reported).
+--- */
+int expand_redirections(Job *job, char *envp[]) {
+    if (job->infile_path && job->infile_path[INITIAL_INDEX] == FD_REDIRECT_CHAR) {
+        job->in_fd = redirection_fd(job->infile_path + JOB_OFFSET_INDEX, envp);
+        job->infile_path = NULL;
+        if (job->in_fd == NO_FD) return FALSE;
+    }
+    if (job->outfile_path && job->outfile_path[INITIAL_INDEX] == FD_REDIRECT_CHAR) {
+        job->out_fd = redirection_fd(job->outfile_path + JOB_OFFSET_INDEX, envp);
+        job->outfile_path = NULL;
+        if (job->out_fd == NO_FD) return FALSE;
+    }
+    return TRUE;
+}
+
+/* ---
+Function Name: redirection_fd
+
+Purpose:
+    Expands the word of a '<&N' or '>&N' redirection and checks that
+    it names a descriptor open in the shell.
+    
+Input:
+    word - text after the '&'
+    envp - environment variables
+    
+Output:
+    The descriptor, or NO_FD (reported).
+--- */
+static int redirection_fd(char *word, char *envp[]) {
+    char *text = expand_word(word, envp);
+    int i = INITIAL_INDEX;
+    while (text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR) i++;
+
+    if (i == INITIAL_INDEX || i > FD_TEXT_MAX_DIGITS || text[i] != NULL_CHAR ||
+        fcntl(myatoi(text), F_GETFD) < ZERO_VALUE) {
+        write(STDERR_FILENO, text, mystrlen(text));
+        print_error(ERR_BAD_FD);
+        return NO_FD;
+    }
+    return myatoi(text);
+}
+
+/* ---
+Function Name: expand_word
+
+Purpose:
+    Replaces every variable reference in a word by its value.
+    
+Input:
+    word - argument
     envp - environment variables
     
 Output:
-    Modifies argv in place with expanded values.
+    Heap copy of the expanded word; unset variables expand to an empty
+    string. Returns word unchanged if it has no references, or if the
+    heap is exhausted.
+--- */
+static char *expand_word(char *word, char *envp[]) {
+    char result[VAR_WORD_LEN];
+    int len = INITIAL_INDEX;
+    int expanded = FALSE;
+
+    for (int i = INITIAL_INDEX; word[i];) {
+        if (word[i] != TOKEN_$ || !starts_variable_name(word[i + JOB_OFFSET_INDEX])) {
+            if (len < VAR_WORD_LEN - JOB_OFFSET_INDEX) result[len++] = word[i];
+            i++;
+            continue;
+        }
+
+        char name[VAR_NAME_LEN];
+        char buf[INT_BUFFER_LEN];
+        i = read_variable_name(word, i + JOB_OFFSET_INDEX, name);
+        const char *val = variable_value(name, envp, buf);
+        for (int k = INITIAL_INDEX; val[k] && len < VAR_WORD_LEN - JOB_OFFSET_INDEX; k++)
+            result[len++] = val[k];
+        expanded = TRUE;
+    }
+    if (!expanded) return word;
+    result[len] = NULL_CHAR;
+
+    char *copy = alloc(len + JOB_OFFSET_INDEX);
+    if (!copy) return word;
+    return mystrcpy(copy, result);
+}
+
+/* ---
+Function Name: starts_variable_name
+
+Purpose:
+    Tells whether the character after a '$' starts a reference, so a
+    lone '$' (or "$.") stays literal.
+    
+Input:
+    c - character after the '$'
+    
+Output:
+    Non-zero if it does.
+--- */
+static int starts_variable_name(char c) {
+    return c == OPEN_BRACE_CHAR || c == EXIT_STATUS_CHAR || is_special_param(c) || is_name_char(c);
+}
+
+/* ---
+Function Name: is_name_char
+
+Purpose:
+    Tells whether a character may appear in a variable name.
+    
+Input:
+    c - character
+    
+Output:
+    Non-zero for letters, digits and '_'.
+--- */
+int is_name_char(char c) {
+    return (c >= LOWER_A_CHAR && c <= LOWER_Z_CHAR) || (c >= UPPER_A_CHAR && c <= UPPER_Z_CHAR) ||
+           (c >= ZERO_CHAR && c <= NINE_CHAR) || c == UNDERSCORE_CHAR;
+}
+
+/* ---
+Function Name: read_variable_name
+
+Purpose:
+    Reads the name of one reference: {anything}, ?, #, @, *, a single
+    digit, or a run of name characters, with a trailing [n] after
+    PIPESTATUS.
+    
+Input:
+    word - argument
+    i    - index just past the '$'
+    name - output buffer of VAR_NAME_LEN bytes
+    
+Output:
+    Fills name; returns the index just past the reference.
 --- */
-void expand_variables(char **argv, char *envp[]) {
-    for (int i = INITIAL_INDEX; argv[i]; i++) {
-        if (argv[i][INITIAL_INDEX] == TOKEN_$) {
-            if (mystrcmp(argv[i], VAR_EXIT_STATUS) == STRINGS_MATCH) {
-                char buf[INT_BUFFER_LEN];
-                int_to_str(last_exit_status, buf);
-                mystrcpy(argv[i], buf);
-            } else {
-                char *val = get_env_value(argv[i] + JOB_OFFSET_INDEX, envp);
-                if (val) mystrcpy(argv[i], val);
-                else argv[i][INITIAL_INDEX] = NULL_CHAR;
+static int read_variable_name(const char *word, int i, char *name) {
+    int n = INITIAL_INDEX;
+
+    if (word[i] == OPEN_BRACE_CHAR) {
+        i++;
+        while (word[i] && word[i] != CLOSE_BRACE_CHAR) {
+            if (n < VAR_NAME_LEN - JOB_OFFSET_INDEX) name[n++] = word[i];
+            i++;
+        }
+        if (word[i] == CLOSE_BRACE_CHAR) i++;
+    } else if (word[i] == EXIT_STATUS_CHAR || is_special_param(word[i]) ||
+               (word[i] >= ZERO_CHAR && word[i] <= NINE_CHAR)) {
+        name[n++] = word[i++];
+    } else {
+        while (is_name_char(word[i])) {
+            if (n < VAR_NAME_LEN - JOB_OFFSET_INDEX) name[n++] = word[i];
+            i++;
+        }
+        name[n] = NULL_CHAR;
+        if (mystrcmp(name, VAR_PIPESTATUS_NAME) == STRINGS_MATCH && word[i] == OPEN_BRACKET_CHAR) {
+            while (word[i] && word[i - JOB_OFFSET_INDEX] != CLOSE_BRACKET_CHAR) {
+                if (n < VAR_NAME_LEN - JOB_OFFSET_INDEX) name[n++] = word[i];
+                i++;
             }
         }
     }
+    name[n] = NULL_CHAR;
+    return i;
 }
 
 /* ---
-Function Name: handle_jobs
+Function Name: variable_value
 
 Purpose:
-  Displays a list of active jobs currently stored in the global
-  jobs array. Each entry shows the job number, state, and command.
+    Looks up the value of one variable name. Coprocess descriptors
+    (${NAME[1]}), positional parameters and the locals of running
+    functions come before the environment.
+    
+Input:
+    name - variable name without '$' or braces
+    envp - environment variables
+    buf  - INT_BUFFER_LEN bytes for numeric values
+    
+Output:
+    The value, or an empty string if it is unset.
+--- */
+static const char *variable_value(const char *name, char *envp[], char *buf) {
+    const char *val = NULL;
+
+    if (mystrcmp(name, VAR_EXIT_STATUS_NAME) == STRINGS_MATCH) {
+        int_to_str(last_exit_status, buf);
+        val = buf;
+    } else if (pipe_status_index(name) >= ZERO_VALUE) {
+        int index = pipe_status_index(name);
+        if (index < num_pipe_status) {
+            int_to_str(pipe_status[index], buf);
+            val = buf;
+        }
+    } else {
+        val = coproc_value(name, buf);
+        if (!val) val = scope_value(name, buf);
+        if (!val) val = get_env_value(name, envp);
+    }
+    return val ? val : EMPTY_STRING;
+}
+
+/* ---
+Function Name: copy_environment
+
+Purpose:
+    Gives the shell an environment array of its own. The one main()
+    receives is the kernel's, with the auxiliary vector right after its
+    terminating NULL, so set_shell_variable() cannot append to it. The
+    copy has room for MAX_SHELL_VARS more names; the strings are shared.
+
+Input:
+    envp - environment main() received
+
+Output:
+    The copy, or envp itself if it cannot be allocated (new names then
+    cannot be set).
+--- */
+char **copy_environment(char *envp[])
+{
+    int count = INITIAL_INDEX;
+    while (envp[count]) count++;
+
+    int capacity = count + MAX_SHELL_VARS + JOB_OFFSET_INDEX;
+    char **copy = mmap(NULL, capacity * sizeof(char *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       ANONYMOUS_MAP_FD, ZERO_VALUE);
+    if (copy == MAP_FAILED) return envp;
+
+    for (int e = INITIAL_INDEX; e <= count; e++) copy[e] = envp[e];
+    environment = copy;
+    env_capacity = capacity;
+    return copy;
+}
+
+/* ---
+Function Name: set_shell_variable
+
+Purpose:
+    Sets a variable for 'export' and 'for' loops. A 'local' of that
+    name in a running function is set instead, if there is one.
+    Otherwise the "NAME=value" entry is kept in a fixed slot rather than on
+    the heap, so it outlives the command line that set it; a variable
+    set again reuses its slot.
+    
+Input:
+    name  - variable name
+    value - new value
+    envp  - environment variables
+    
+Output:
+    Adds or updates the entry in envp (or the local). Returns 0 if the
+    slots are full, the entry is too long, or the name is new and envp
+    is not the array from copy_environment().
+--- */
+int set_shell_variable(const char *name, const char *value, char *envp[]) {
+    int local = set_scoped_variable(name, value);
+    if (local != SCOPE_NOT_LOCAL) return local == SCOPE_SET;
+
+    int name_len = mystrlen(name);
+    if (name_len + mystrlen(value) + ENV_STRING_EXTRA > SHELL_VAR_LEN) return FALSE;
+
+    int e = INITIAL_INDEX;
+    for (; envp[e]; e++) {
+        int j = INITIAL_INDEX;
+        while (j < name_len && envp[e][j] == name[j]) j++;
+        if (j == name_len && envp[e][j] == ENV_ASSIGN_CHAR) break;
+    }
+
+    /* a new name is appended, which only the shell's own copy has room for */
+    if (!envp[e] && (envp != environment || e + JOB_OFFSET_INDEX >= env_capacity)) return FALSE;
+
+    char *slot = NULL;
+    if (envp[e] >= shell_vars[INITIAL_INDEX] && envp[e] < shell_vars[MAX_SHELL_VARS - JOB_OFFSET_INDEX] + SHELL_VAR_LEN)
+        slot = envp[e];
+    else if (num_shell_vars < MAX_SHELL_VARS)
+        slot = shell_vars[num_shell_vars++];
+    if (!slot) return FALSE;
+
+    mystrcpy(slot, name);
+    mystrcat(slot, ASSIGN_EQUAL);
+    mystrcat(slot, value);
+    if (!envp[e]) envp[e + JOB_OFFSET_INDEX] = NULL;
+    envp[e] = slot;
+    return TRUE;
+}
+
+/* ---
+Function Name: save_shell_variables
+
+Purpose:
+    Writes the variables set by 'export' and 'for' to a startup
+    snapshot, as NAME=value strings.
 
 Input:
-  argv - argument vector from user input (unused).
+    w - snapshot writer
 
 Output:
-  Writes the job list to standard output.
+    None
+--- */
+void save_shell_variables(SnapWriter *w)
+{
+    snap_write_int(w, num_shell_vars);
+    for (int i = INITIAL_INDEX; i < num_shell_vars; i++) {
+        int len = mystrlen(shell_vars[i]);
+        snap_write_int(w, len);
+        snap_write(w, shell_vars[i], len);
+    }
+}
+
+/* ---
+Function Name: load_shell_variables
+
+Purpose:
+    Sets the variables saved by save_shell_variables() again.
+
+Input:
+    r    - snapshot reader
+    envp - environment variables
 
+Output:
+    Returns 1, or 0 if the image is damaged.
 --- */
-void handle_jobs(char **argv)
+int load_shell_variables(SnapReader *r, char *envp[])
 {
-    (void)argv;  /* avoid unused warning */
+    int count = snap_read_count(r, MAX_SHELL_VARS);
+    for (int i = INITIAL_INDEX; i < count; i++) {
+        char var[SHELL_VAR_LEN];
+        int len = snap_read_count(r, SHELL_VAR_LEN - JOB_OFFSET_INDEX);
+        if (len < INITIAL_INDEX || !snap_read(r, var, len)) return FALSE;
+        var[len] = NULL_CHAR;
+
+        int eq = INITIAL_INDEX;
+        while (var[eq] && var[eq] != ENV_ASSIGN_CHAR) eq++;
+        if (var[eq] != ENV_ASSIGN_CHAR) return FALSE;
+        var[eq] = NULL_CHAR;
+        set_shell_variable(var, var + eq + JOB_OFFSET_INDEX, envp);
+    }
+    return count >= INITIAL_INDEX;
+}
+
+/* ---
+Function Name: pipe_status_index
+
+Purpose:
+    Recognises "PIPESTATUS" (element 0) and "PIPESTATUS[n]".
+    
+Input:
+    name - variable name without '$' or braces
+    
+Output:
+    The element index, or -1 if name is not a PIPESTATUS reference.
+--- */
+static int pipe_status_index(const char *name) {
+    int len = mystrlen(VAR_PIPESTATUS_NAME);
+    for (int i = INITIAL_INDEX; i < len; i++) {
+        if (name[i] != VAR_PIPESTATUS_NAME[i]) return NOT_PIPESTATUS;
+    }
+    if (name[len] == NULL_CHAR) return ZERO_VALUE;
+    if (name[len] != OPEN_BRACKET_CHAR) return NOT_PIPESTATUS;
+
+    int index = ZERO_VALUE, i = len + JOB_OFFSET_INDEX;
+    if (name[i] < ZERO_CHAR || name[i] > NINE_CHAR) return NOT_PIPESTATUS;
+    while (name[i] >= ZERO_CHAR && name[i] <= NINE_CHAR)
+        index = index * DECIMAL_BASE + (name[i++] - ZERO_CHAR);
+    if (name[i] != CLOSE_BRACKET_CHAR || name[i + JOB_OFFSET_INDEX] != NULL_CHAR)
+        return NOT_PIPESTATUS;
+    return index;
+}
+
+/* ---
+Function Name: splice_positional
+
+Purpose:
+    Replaces argument 'pos' ("$@" or "$*") with one argument per
+    positional parameter of the running function.
+    
+Input:
+    cmd - command being expanded
+    pos - index of the argument
+    
+Output:
+    Returns the index just past the inserted arguments.
+--- */
+static int splice_positional(Command *cmd, int pos) {
+    int count = make_room(cmd, pos, positional_count());
+    for (int k = INITIAL_INDEX; k < count; k++)
+        cmd->argv[pos + k] = positional_param(k + JOB_OFFSET_INDEX);
+    return pos + count;
+}
+
+/* ---
+Function Name: make_room
+
+Purpose:
+    Shifts the arguments after 'pos' so that argument 'pos' becomes
+    'count' arguments (none if count is 0), as far as MAX_ARGS allows.
+    
+Input:
+    cmd   - command being expanded
+    pos   - index of the argument being replaced
+    count - arguments wanted in its place
+    
+Output:
+    Returns the number of arguments to fill in from 'pos'.
+--- */
+static int make_room(Command *cmd, int pos, int count) {
+    if ((int)cmd->argc - JOB_OFFSET_INDEX + count > MAX_ARGS)
+        count = MAX_ARGS - cmd->argc + JOB_OFFSET_INDEX;
+
+    /* shift the tail (including the NULL terminator) to make room */
+    int shift = count - JOB_OFFSET_INDEX;
+    if (shift > ZERO_VALUE) {
+        for (int i = cmd->argc; i > pos; i--)
+            cmd->argv[i + shift] = cmd->argv[i];
+    } else if (shift < ZERO_VALUE) {
+        for (int i = pos + JOB_OFFSET_INDEX; i <= (int)cmd->argc; i++)
+            cmd->argv[i + shift] = cmd->argv[i];
+    }
+    cmd->argc += shift;
+    return count;
+}
+
+/* ---
+Function Name: splice_pipe_status
 
-    for (int jobIndex = INITIAL_INDEX; jobIndex < num_jobs; jobIndex++)
-    {
-        if (jobs[jobIndex].num_stages > ZERO_VALUE)
-        {
-	  const char *state;
+Purpose:
+    Replaces argument 'pos' with one argument per PIPESTATUS element.
+    
+Input:
+    cmd - command being expanded
+    pos - index of the ${PIPESTATUS[@]} argument
+    
+Output:
+    Returns the index just past the inserted arguments.
+--- */
+static int splice_pipe_status(Command *cmd, int pos) {
+    int count = make_room(cmd, pos, num_pipe_status);
+    for (int k = INITIAL_INDEX; k < count; k++) {
+        char buf[INT_BUFFER_LEN];
+        int_to_str(pipe_status[k], buf);
+        char *copy = alloc(mystrlen(buf) + JOB_OFFSET_INDEX);
+        cmd->argv[pos + k] = copy ? mystrcpy(copy, buf) : EMPTY_STRING;
+    }
+    return pos + count;
+}
 
-	  if (jobs[jobIndex].background) {
-	    state = STATUS_RUNNING_TEXT;
-	  } else {
-	    state = STATUS_DONE_TEXT;
-	  }
+/* ---
+Function Name: handle_jobs
+
+Purpose:
+  Displays a list of active jobs currently stored in the job table,
+  followed by jobs waiting in the scheduler queue. Each
+  entry shows the job number, state, and command. With job specs
+  ('jobs %1 %-') only those jobs are listed.
+  'jobs -j N' sets the number of queued background jobs run at once;
+  'jobs -j' prints it.
 
-	    write(STDOUT_FILENO, MSG_JOB_PREFIX, mystrlen(MSG_JOB_PREFIX));
+Input:
+  argv - argument vector from user input.
+  envp - environment variables (unused).
 
-            char idBuffer[JOB_DISPLAY_WIDTH];
-            myitoa(jobIndex + JOB_ID_OFFSET, idBuffer);
-            write(STDOUT_FILENO, idBuffer, mystrlen(idBuffer));
+Output:
+  Writes the job list or limit to standard output. Returns 0.
 
-            write(STDOUT_FILENO, MSG_JOB_SUFFIX, mystrlen(MSG_JOB_SUFFIX));
-            write(STDOUT_FILENO, state, mystrlen(state));
-            write(STDOUT_FILENO, TERMINAL_TAB_CHAR, mystrlen(TERMINAL_TAB_CHAR));
+--- */
+int handle_jobs(char **argv, char *envp[])
+{
+    (void)envp;
 
-            /* print command name for first stage */
-            write(STDOUT_FILENO, jobs[jobIndex].pipeline[INITIAL_INDEX].argv[INITIAL_INDEX],
-                  mystrlen(jobs[jobIndex].pipeline[INITIAL_INDEX].argv[INITIAL_INDEX]));
+    if (argv[JOB_OFFSET_INDEX] && mystrcmp(argv[JOB_OFFSET_INDEX], JOBS_LIMIT_OPTION) == STRINGS_MATCH) {
+        char *limit = argv[JOB_OFFSET_INDEX + JOB_OFFSET_INDEX];
+        if (limit) {
+            sched_set_limit(myatoi(limit));
+        } else {
+            char buf[INT_BUFFER_LEN];
+            int_to_str(sched_get_limit(), buf);
+            write(STDOUT_FILENO, buf, mystrlen(buf));
             write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
         }
+        return BUILTIN_SUCCESS;
     }
+
+    if (argv[JOB_OFFSET_INDEX]) {
+        int status = BUILTIN_SUCCESS;
+        for (int i = JOB_OFFSET_INDEX; argv[i]; i++) {
+            JobEntry *entry = find_job_arg(BUILTIN_NAME_JOBS, argv[i]);
+            if (entry) print_job_status(entry);
+            else status = BUILTIN_FAILURE;
+        }
+        return status;
+    }
+
+    print_jobs();
+    sched_print_queue();
+    return BUILTIN_SUCCESS;
 }
 
 /* ---
 Function Name: builtin_fg
 
 Purpose:
-    Brings the most recent background job to the foreground.
+    Brings a job ('fg [%job]', default the current job) to the
+    foreground: gives its process group the terminal, resumes it if
+    stopped and waits until every process of the pipeline has exited or
+    the job stops again.
     
 Input:
-    argv - unused argument list
+    argv - argument list
+    envp - environment variables (unused)
     
 Output:
     Transfers terminal control and waits for job completion.
+    Returns the job's exit status, or 1 if there is no job.
 --- */
-void builtin_fg(char **argv) {
-    if (num_jobs == NO_JOBS) return;
-    Job *job = &jobs[num_jobs - JOB_OFFSET_INDEX];
-    if (job->pgid <= INVALID_PGID) return;
+int builtin_fg(char **argv, char *envp[]) {
+    (void)envp;
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    JobEntry *entry = find_job_arg(BUILTIN_NAME_FG, argv[JOB_OFFSET_INDEX]);
+    if (!entry) {
+        sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+        return BUILTIN_FAILURE;
+    }
+
+    write(STDOUT_FILENO, entry->command, mystrlen(entry->command));
+    write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
 
     /* Move job to foreground */
-    tcsetpgrp(STDIN_FILENO, job->pgid);
+    signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(STDIN_FILENO, entry->pgid);
 
     /* Resume stopped job */
-    kill(-job->pgid, SIGCONT);
-    job->background = FALSE;
+    if (job_state(entry) == PROC_STOPPED)
+        killpg(entry->pgid, SIGCONT);
+    mark_job_running(entry);
 
-    int status;
-    while (waitpid(-job->pgid, &status, WUNTRACED) > ZERO_VALUE) {
-        if (WIFSTOPPED(status)) {
-	    write(STDOUT_FILENO, MSG_FG_STOPPED, mystrlen(MSG_FG_STOPPED));
-            return;
-        }
-        if (WIFSIGNALED(status) || WIFEXITED(status))
-            break;
-    }
+    int exit_status = wait_for_job_entry(entry);
 
     /* Restore terminal control to shell */
     tcsetpgrp(STDIN_FILENO, shell_pgid);
+    signal(SIGTTOU, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return exit_status;
 }
 
 /* ---
-Function Name: builtin_bg
+Function Name: wait_for_job_entry
 
 Purpose:
-    Resumes the most recent stopped job in the background.
+    Waits for all processes of a foreground job. Caller blocks SIGCHLD.
     
 Input:
-    argv - unused argument list
+    entry - job to wait for
     
 Output:
-    Sends SIGCONT to the job’s process group.
+    Removes the job once it is done, or reports it if it stopped.
+    Returns the job's exit status (128 + signal if stopped).
 --- */
-void builtin_bg(char **argv) {
-    if (num_jobs == NO_JOBS) return;
-    Job *job = &jobs[num_jobs - JOB_OFFSET_INDEX];
-    if (job->pgid <= INVALID_PGID) return;
+static int wait_for_job_entry(JobEntry *entry) {
+    int status;
+    int stop_status = ZERO_VALUE;
 
-    /* Resume stopped job in background */
-    kill(-job->pgid, SIGCONT);
-    job->background = TRUE;
+    while (job_state(entry) == PROC_RUNNING) {
+        struct rusage usage;
+        int pid = wait4(-entry->pgid, &status, WUNTRACED, &usage);
+        if (pid < ZERO_VALUE) {
+            if (errno == EINTR) continue;
+            /* nothing left in the group: treat remaining members as done */
+            for (int k = ZERO_VALUE; k < entry->num_procs; k++) {
+                if (entry->state[k] == PROC_RUNNING) entry->state[k] = PROC_DONE;
+            }
+            break;
+        }
+        if (WIFSTOPPED(status))
+            stop_status = wait_status_to_exit_code(status);
+        else
+            sched_child_exited(pid);
+        trace_proc_reaped(pid, status, &usage);
+        update_job_status(pid, status);
+    }
+
+    if (job_state(entry) == PROC_STOPPED) {
+        touch_job(entry);
+        print_job_status(entry);
+        return stop_status;
+    }
+
+    int exit_status = job_exit_status(entry);
+    remove_job(entry);
+    return exit_status;
+}
+
+/* ---
+Function Name: builtin_bg
+
+Purpose:
+    Resumes stopped jobs in the background ('bg [%job ...]', default
+    the current job).
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Sends SIGCONT to each job's process group. Returns 0, or 1 if a job
+    does not exist.
+--- */
+int builtin_bg(char **argv, char *envp[]) {
+    (void)envp;
+    int status = BUILTIN_SUCCESS;
+    int i = JOB_OFFSET_INDEX;
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    do {
+        JobEntry *entry = find_job_arg(BUILTIN_NAME_BG, argv[i]);
+        if (!entry) {
+            status = BUILTIN_FAILURE;
+            continue;
+        }
+
+        /* Resume stopped job in background */
+        killpg(entry->pgid, SIGCONT);
+        mark_job_running(entry);
+        print_job_status(entry);
+    } while (argv[i] && argv[++i]);
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return status;
+}
+
+/* ---
+Function Name: handle_hash
+
+Purpose:
+    Implements the 'hash' builtin. With '-r' forgets every remembered
+    command location; with no arguments lists them.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Clears or prints the PATH lookup cache. Returns 0.
+--- */
+int handle_hash(char **argv, char *envp[]) {
+    (void)envp;
+    if (argv[JOB_OFFSET_INDEX] && mystrcmp(argv[JOB_OFFSET_INDEX], HASH_RESET_OPTION) == STRINGS_MATCH) {
+        clear_command_cache();
+        return BUILTIN_SUCCESS;
+    }
+    print_command_cache();
+    return BUILTIN_SUCCESS;
+}
+
+/* ---
+Function Name: handle_set
+
+Purpose:
+    Implements the 'set' builtin for shell options. Supported forms:
+      set -o pipefail   enable pipefail
+      set +o pipefail   disable pipefail
+      set -o            list options and their state
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Updates or prints shell options. Returns 0, or 1 for an unknown option.
+--- */
+int handle_set(char **argv, char *envp[]) {
+    (void)envp;
+    char *flag = argv[JOB_OFFSET_INDEX];
+    char *option = flag ? argv[JOB_OFFSET_INDEX + JOB_OFFSET_INDEX] : NULL;
+
+    if (!flag || (mystrcmp(flag, SET_ENABLE_OPTION) == STRINGS_MATCH && !option)) {
+        write(STDOUT_FILENO, OPTION_PIPEFAIL, mystrlen(OPTION_PIPEFAIL));
+        write(STDOUT_FILENO, TERMINAL_TAB_CHAR, mystrlen(TERMINAL_TAB_CHAR));
+        const char *state = pipefail_enabled ? OPTION_ON_TEXT : OPTION_OFF_TEXT;
+        write(STDOUT_FILENO, state, mystrlen(state));
+        write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
+        return BUILTIN_SUCCESS;
+    }
+
+    if (option && mystrcmp(option, OPTION_PIPEFAIL) == STRINGS_MATCH) {
+        if (mystrcmp(flag, SET_ENABLE_OPTION) == STRINGS_MATCH) {
+            pipefail_enabled = TRUE;
+            return BUILTIN_SUCCESS;
+        }
+        if (mystrcmp(flag, SET_DISABLE_OPTION) == STRINGS_MATCH) {
+            pipefail_enabled = FALSE;
+            return BUILTIN_SUCCESS;
+        }
+    }
+
+    write(STDERR_FILENO, SET_ERROR_MSG, mystrlen(SET_ERROR_MSG));
+    return BUILTIN_FAILURE;
+}
+
+/* ---
+Function Name: handle_parallel
+
+Purpose:
+    Implements the 'parallel' builtin:
+      parallel [-j N] [-k] [-a file] command [args...]
+    Runs the command once per line of stdin (or of file) on up to N
+    concurrent jobs, N defaulting to the 'jobs -j' limit. "{}" in an
+    argument is replaced by the line, otherwise the line is appended.
+    -k prints each job's output in input order instead of as it finishes.
+    
+Input:
+    argv - argument list
+    envp - environment variables
+    
+Output:
+    Runs the jobs. Returns the number of failed jobs (capped at 101), or
+    1 for a usage error.
+--- */
+int handle_parallel(char **argv, char *envp[]) {
+    return parallel_from(argv, STDIN_FILENO, envp);
+}
+
+/* ---
+Function Name: find_parallel_stage
+
+Purpose:
+    Finds a 'parallel' stage in a job, which run_command() must give to
+    run_parallel_job() rather than run as a program.
+    
+Input:
+    job - parsed job
+    
+Output:
+    Index of the first stage that is 'parallel', or NO_PARALLEL_STAGE.
+--- */
+int find_parallel_stage(Job *job) {
+    for (int i = INITIAL_INDEX; i < (int)job->num_stages; i++) {
+        char *name = job->pipeline[i].argv[INITIAL_INDEX];
+        if (name && mystrcmp(name, CMD_PARALLEL) == STRINGS_MATCH) return i;
+    }
+    return NO_PARALLEL_STAGE;
+}
+
+/* ---
+Function Name: run_parallel_job
+
+Purpose:
+    Runs a job whose last stage is 'parallel'. Its lines come from the
+    stages before it, started as a job of their own with stdout on a
+    pipe (like 'seq 5 | xargs'), or else from '<&N' or '< file'; only a
+    bare 'parallel' reads the shell's standard input. The outputs go
+    to '>&N' or '> file' if given. 'parallel' anywhere but last is
+    rejected, since it would read nothing.
+    
+Input:
+    job  - parsed job with a 'parallel' stage (see find_parallel_stage())
+    envp - environment variables
+    
+Output:
+    Status of the 'parallel' builtin, or 1 if the job cannot be set up.
+    The stages before it have been waited for.
+--- */
+int run_parallel_job(Job *job, char *envp[]) {
+    int last = job->num_stages - JOB_OFFSET_INDEX;
+    if (find_parallel_stage(job) != last) {
+        write(STDERR_FILENO, PARALLEL_STAGE_MSG, mystrlen(PARALLEL_STAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    int input_fd = job->in_fd;
+    int opened_input = NO_FD;
+    if (last == INITIAL_INDEX && input_fd == NO_FD && job->infile_path) {
+        input_fd = opened_input = open(job->infile_path, O_RDONLY | O_CLOEXEC);
+        if (input_fd < ZERO_VALUE) {
+            write(STDERR_FILENO, job->infile_path, mystrlen(job->infile_path));
+            print_error(ERR_FILE_NOT_FOUND);
+            return BUILTIN_FAILURE;
+        }
+    }
+
+    int output_fd = job->out_fd;
+    int opened_output = NO_FD;
+    if (output_fd == NO_FD && job->outfile_path) {
+        output_fd = opened_output = open(job->outfile_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_PERMISSIONS);
+        if (output_fd < ZERO_VALUE) {
+            if (opened_input != NO_FD) close(opened_input);
+            write(STDERR_FILENO, job->outfile_path, mystrlen(job->outfile_path));
+            print_error(ERR_FILE_NOT_FOUND);
+            return BUILTIN_FAILURE;
+        }
+    }
+
+    /* the producer's stages are reaped below, or by run_parallel() if
+       they end while it waits; the handler must not take them */
+    sigset_t chld_mask, prev_mask, child_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+    child_mask = prev_mask;
+    sigdelset(&child_mask, SIGCHLD);
 
-    write(STDOUT_FILENO, MSG_BG_RUNNING_PREFIX, mystrlen(MSG_BG_RUNNING_PREFIX));
-    char buf[JOB_DISPLAY_WIDTH];
-    myitoa(num_jobs, buf);
-    write(STDOUT_FILENO, buf, mystrlen(buf));
-    write(STDOUT_FILENO, MSG_BG_RUNNING_SUFFIX, mystrlen(MSG_BG_RUNNING_SUFFIX));
-    write(STDOUT_FILENO, job->pipeline[INITIAL_INDEX].argv[INITIAL_INDEX],
-          mystrlen(job->pipeline[INITIAL_INDEX].argv[INITIAL_INDEX]));
+    Job producer = *job;
+    int status = BUILTIN_FAILURE;
+    int started = FALSE;
+    if (last > INITIAL_INDEX) {
+        int lines[PIPE_FD_COUNT];
+        if (pipe2(lines, O_CLOEXEC) < ZERO_VALUE) {
+            print_error(ERR_PIPE_FAIL);
+            input_fd = NO_FD;
+        } else {
+            producer.num_stages = last;
+            producer.background = TRUE;     /* never hand it the terminal */
+            producer.outfile_path = NULL;
+            producer.out_fd = lines[PIPE_WRITE_INDEX];
+            started = spawn_job(&producer, envp, &child_mask);
+            close(lines[PIPE_WRITE_INDEX]);
+            input_fd = started ? lines[PIPE_READ_INDEX] : NO_FD;
+            if (!started) close(lines[PIPE_READ_INDEX]);
+            else trace_job_end(&producer);
+        }
+    } else if (input_fd == NO_FD) {
+        input_fd = STDIN_FILENO;
+    }
+
+    if (input_fd != NO_FD) {
+        int saved_output = NO_FD;
+        if (output_fd != NO_FD) {
+            saved_output = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, ZERO_VALUE);
+            dup2(output_fd, STDOUT_FILENO);
+        }
+        status = parallel_from(job->pipeline[last].argv, input_fd, envp);
+        if (saved_output != NO_FD) {
+            dup2(saved_output, STDOUT_FILENO);
+            close(saved_output);
+        }
+    }
+
+    if (started) {
+        /* a producer still writing gets SIGPIPE ('-a file' reads elsewhere) */
+        close(input_fd);
+        for (int i = INITIAL_INDEX; i < (int)producer.num_stages; i++) {
+            int pid_status;
+            struct rusage usage;
+            int reaped;
+            while ((reaped = wait4(producer.pids[i], &pid_status, ZERO_VALUE, &usage)) < ZERO_VALUE && errno == EINTR)
+                continue;
+            if (reaped == producer.pids[i]) trace_proc_reaped(reaped, pid_status, &usage);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    if (opened_input != NO_FD) close(opened_input);
+    if (opened_output != NO_FD) close(opened_output);
+    return status;
+}
+
+/* ---
+Function Name: parallel_from
+
+Purpose:
+    Parses the options of 'parallel' and runs it (see run_parallel()).
+    
+Input:
+    argv     - argument list
+    input_fd - descriptor to read the lines from unless -a is given
+    envp     - environment variables
+    
+Output:
+    Returns the number of failed jobs (capped at 101), or 1 for a usage
+    error.
+--- */
+static int parallel_from(char **argv, int input_fd, char *envp[]) {
+    int workers = sched_get_limit();
+    int keep_order = FALSE;
+    int given_fd = input_fd;
+    int i = JOB_OFFSET_INDEX;
+
+    while (argv[i] && argv[i][INITIAL_INDEX] == NEGATIVE_SIGN) {
+        if (mystrcmp(argv[i], PARALLEL_JOBS_OPTION) == STRINGS_MATCH && argv[i + JOB_OFFSET_INDEX]) {
+            workers = myatoi(argv[i + JOB_OFFSET_INDEX]);
+            i += PARALLEL_OPTION_ARGS;
+        } else if (mystrcmp(argv[i], PARALLEL_ORDER_OPTION) == STRINGS_MATCH) {
+            keep_order = TRUE;
+            i++;
+        } else if (mystrcmp(argv[i], PARALLEL_INPUT_OPTION) == STRINGS_MATCH && argv[i + JOB_OFFSET_INDEX]) {
+            if (input_fd != given_fd) close(input_fd);
+            input_fd = open(argv[i + JOB_OFFSET_INDEX], O_RDONLY | O_CLOEXEC);
+            if (input_fd < ZERO_VALUE) {
+                write(STDERR_FILENO, argv[i + JOB_OFFSET_INDEX], mystrlen(argv[i + JOB_OFFSET_INDEX]));
+                print_error(ERR_FILE_NOT_FOUND);
+                return BUILTIN_FAILURE;
+            }
+            i += PARALLEL_OPTION_ARGS;
+        } else {
+            break;
+        }
+    }
+
+    if (!argv[i]) {
+        if (input_fd != given_fd) close(input_fd);
+        write(STDERR_FILENO, PARALLEL_USAGE_MSG, mystrlen(PARALLEL_USAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    int status = run_parallel(&argv[i], workers, keep_order, input_fd, envp);
+    if (input_fd != given_fd) close(input_fd);
+    return status;
+}
+
+/* ---
+Function Name: handle_wait
+
+Purpose:
+    Implements the 'wait' builtin:
+      wait [-n] [-t seconds] [%job|pid ...]
+    With no operands, waits for every background job, including those
+    still queued by the scheduler. With operands, waits for the given
+    jobs and returns the status of the last one. -n returns as soon as
+    any one of them finishes; -t gives up after the timeout (fractions
+    such as 0.5 are allowed).
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Exit status of the waited job, 0 after waiting for every job,
+    124 on timeout, 130 if interrupted, or 127 if there is no such job.
+--- */
+int handle_wait(char **argv, char *envp[]) {
+    (void)envp;
+    JobEntry *targets[MAX_ARGS];
+    int count = ZERO_VALUE;
+    int wait_any = FALSE;
+    int timeout_ms = NO_TIMEOUT;
+    int missing = FALSE;
+    int i = JOB_OFFSET_INDEX;
+
+    for (; argv[i] && argv[i][INITIAL_INDEX] == NEGATIVE_SIGN; i++) {
+        if (mystrcmp(argv[i], WAIT_ANY_OPTION) == STRINGS_MATCH) {
+            wait_any = TRUE;
+        } else if (mystrcmp(argv[i], WAIT_TIMEOUT_OPTION) == STRINGS_MATCH && argv[i + JOB_OFFSET_INDEX]) {
+            timeout_ms = parse_timeout_ms(argv[++i]);
+            if (timeout_ms < ZERO_VALUE) break;
+        } else {
+            break;
+        }
+    }
+    if (argv[i] && argv[i][INITIAL_INDEX] == NEGATIVE_SIGN) {
+        write(STDERR_FILENO, WAIT_USAGE_MSG, mystrlen(WAIT_USAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    for (; argv[i] && count < MAX_ARGS; i++) {
+        JobEntry *entry = find_job_arg(BUILTIN_NAME_WAIT, argv[i]);
+        if (!entry) {
+            missing = TRUE;
+            continue;
+        }
+        targets[count++] = entry;
+    }
+    if (missing && count == ZERO_VALUE) return WAIT_NO_CHILD_STATUS;
+
+    int exit_status;
+    int result = wait_for_jobs(targets, count, wait_any, timeout_ms, &exit_status);
+    if (result == WAIT_TIMED_OUT) return WAIT_TIMEOUT_STATUS;
+    if (result == WAIT_INTERRUPTED) return WAIT_SIGINT_STATUS;
+    if (result == WAIT_NO_JOBS) return WAIT_NO_CHILD_STATUS;
+    return exit_status;
+}
+
+/* ---
+Function Name: parse_timeout_ms
+
+Purpose:
+    Converts a timeout in seconds, optionally with a fraction
+    ("2", "0.25"), to milliseconds.
+    
+Input:
+    text - timeout text
+    
+Output:
+    Milliseconds, or -1 if text is not a valid timeout.
+--- */
+static int parse_timeout_ms(const char *text) {
+    int ms = ZERO_VALUE;
+    int i = INITIAL_INDEX;
+
+    if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return NO_TIMEOUT;
+    while (text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR)
+        ms = ms * DECIMAL_BASE + (text[i++] - ZERO_CHAR);
+    ms *= MS_PER_SECOND;
+
+    if (text[i] == DECIMAL_POINT_CHAR) {
+        int scale = MS_PER_SECOND / DECIMAL_BASE;
+        for (i++; text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR; i++) {
+            ms += (text[i] - ZERO_CHAR) * scale;
+            scale /= DECIMAL_BASE;
+        }
+    }
+    return (text[i] == NULL_CHAR) ? ms : NO_TIMEOUT;
+}
+
+/* ---
+Function Name: handle_kill
+
+Purpose:
+    Implements the 'kill' builtin:
+      kill [-s sig | -sig] %job|pid ...
+      kill -l
+    A job spec signals the job's whole process group; a stopped job is
+    also sent SIGCONT so it can act on the signal. Signals may be given
+    by name (TERM, SIGTERM) or number; the default is SIGTERM.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Sends the signals. Returns 0, or 1 if any target failed.
+--- */
+int handle_kill(char **argv, char *envp[]) {
+    (void)envp;
+    int sig = SIGTERM;
+    int i = JOB_OFFSET_INDEX;
+
+    if (argv[i] && mystrcmp(argv[i], KILL_LIST_OPTION) == STRINGS_MATCH) {
+        print_signal_names();
+        return BUILTIN_SUCCESS;
+    }
+
+    if (argv[i] && mystrcmp(argv[i], KILL_SIGNAL_OPTION) == STRINGS_MATCH && argv[i + JOB_OFFSET_INDEX]) {
+        sig = signal_from_name(argv[i + JOB_OFFSET_INDEX]);
+        if (sig == NO_SIGNAL) {
+            print_builtin_error(BUILTIN_NAME_KILL, argv[i + JOB_OFFSET_INDEX], INVALID_SIGNAL_MSG);
+            return BUILTIN_FAILURE;
+        }
+        i += PARALLEL_OPTION_ARGS;
+    } else if (argv[i] && argv[i][INITIAL_INDEX] == NEGATIVE_SIGN) {
+        sig = signal_from_name(argv[i] + JOB_OFFSET_INDEX);
+        if (sig == NO_SIGNAL) {
+            print_builtin_error(BUILTIN_NAME_KILL, argv[i], INVALID_SIGNAL_MSG);
+            return BUILTIN_FAILURE;
+        }
+        i++;
+    }
+
+    if (!argv[i]) {
+        write(STDERR_FILENO, KILL_USAGE_MSG, mystrlen(KILL_USAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    int status = BUILTIN_SUCCESS;
+    for (; argv[i]; i++) {
+        if (argv[i][INITIAL_INDEX] == JOB_SPEC_CHAR) {
+            JobEntry *entry = find_job_arg(BUILTIN_NAME_KILL, argv[i]);
+            if (!entry || killpg(entry->pgid, sig) < ZERO_VALUE) {
+                status = BUILTIN_FAILURE;
+                continue;
+            }
+            if (job_state(entry) == PROC_STOPPED && sig != SIGCONT && sig != SIGSTOP && sig != SIGTSTP)
+                killpg(entry->pgid, SIGCONT);
+            continue;
+        }
+
+        int pid = myatoi(argv[i]);
+        if (pid <= ZERO_VALUE || kill(pid, sig) < ZERO_VALUE) {
+            print_builtin_error(BUILTIN_NAME_KILL, argv[i], NO_SUCH_PROCESS_MSG);
+            status = BUILTIN_FAILURE;
+        }
+    }
+    return status;
+}
+
+/* ---
+Function Name: handle_disown
+
+Purpose:
+    Implements the 'disown' builtin:
+      disown [-a] [%job ...]
+    Removes jobs (default the current job, -a every job) from the job
+    table without signalling them; they keep running but are no longer
+    listed, reported or resumable.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Updates the job table. Returns 0, or 1 if a job does not exist.
+--- */
+int handle_disown(char **argv, char *envp[]) {
+    (void)envp;
+    int status = BUILTIN_SUCCESS;
+    int i = JOB_OFFSET_INDEX;
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    if (argv[i] && mystrcmp(argv[i], DISOWN_ALL_OPTION) == STRINGS_MATCH) {
+        JobEntry *all[MAX_JOBS];
+        int count = collect_jobs(all);
+        for (int k = INITIAL_INDEX; k < count; k++)
+            remove_job(all[k]);
+    } else {
+        do {
+            JobEntry *entry = find_job_arg(BUILTIN_NAME_DISOWN, argv[i]);
+            if (entry) remove_job(entry);
+            else status = BUILTIN_FAILURE;
+        } while (argv[i] && argv[++i]);
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return status;
+}
+
+/* ---
+Function Name: find_job_arg
+
+Purpose:
+    Resolves a builtin's job spec operand with resolve_job_spec(), or
+    picks the current job when there is none, reporting failures as
+    "name: spec: no such job".
+    
+Input:
+    name - builtin name for messages
+    spec - job spec, or NULL for the current job
+    
+Output:
+    The job, or NULL after printing an error.
+--- */
+static JobEntry *find_job_arg(const char *name, const char *spec) {
+    if (!spec) {
+        JobEntry *current = most_recent_job();
+        if (!current) print_builtin_error(name, NULL, NO_CURRENT_JOB_MSG);
+        return current;
+    }
+
+    JobEntry *entry;
+    int result = resolve_job_spec(spec, &entry);
+    if (result == JOB_SPEC_AMBIGUOUS)
+        print_builtin_error(name, spec, AMBIGUOUS_JOB_MSG);
+    else if (result == JOB_SPEC_NOT_FOUND)
+        print_builtin_error(name, spec, NO_SUCH_JOB_MSG);
+    return entry;
+}
+
+/* ---
+Function Name: print_builtin_error
+
+Purpose:
+    Writes "name: subject: message" (or "name: message") to stderr.
+    
+Input:
+    name    - builtin name
+    subject - offending operand, or NULL
+    msg     - message starting with ": " and ending with a newline
+    
+Output:
+    Writes the message to standard error.
+--- */
+static void print_builtin_error(const char *name, const char *subject, const char *msg) {
+    write(STDERR_FILENO, name, mystrlen(name));
+    if (subject) {
+        write(STDERR_FILENO, MSG_NAME_SEPARATOR, mystrlen(MSG_NAME_SEPARATOR));
+        write(STDERR_FILENO, subject, mystrlen(subject));
+    }
+    write(STDERR_FILENO, msg, mystrlen(msg));
+}
+
+/* ---
+Function Name: signal_from_name
+
+Purpose:
+    Converts a signal name ("TERM", "SIGTERM") or number ("15") to a
+    signal number.
+    
+Input:
+    name - signal text
+    
+Output:
+    The signal number, or NO_SIGNAL if it is not recognised.
+--- */
+static int signal_from_name(const char *name) {
+    if (name[INITIAL_INDEX] >= ZERO_CHAR && name[INITIAL_INDEX] <= NINE_CHAR) {
+        int number = ZERO_VALUE;
+        for (int i = INITIAL_INDEX; name[i]; i++) {
+            if (name[i] < ZERO_CHAR || name[i] > NINE_CHAR) return NO_SIGNAL;
+            number = number * DECIMAL_BASE + (name[i] - ZERO_CHAR);
+        }
+        return (number < NSIG) ? number : NO_SIGNAL;
+    }
+
+    int k = INITIAL_INDEX;
+    while (k < SIGNAL_PREFIX_LEN && name[k] == SIGNAL_NAME_PREFIX[k]) k++;
+    if (k == SIGNAL_PREFIX_LEN) name += SIGNAL_PREFIX_LEN;
+
+    for (int i = INITIAL_INDEX; i < NUM_SIGNAL_NAMES; i++) {
+        if (mystrcmp(signal_names[i].name, name) == STRINGS_MATCH)
+            return signal_names[i].number;
+    }
+    return NO_SIGNAL;
+}
+
+/* ---
+Function Name: print_signal_names
+
+Purpose:
+    Lists the signal names 'kill' accepts ('kill -l').
+    
+Input:
+    None
+    
+Output:
+    Writes "number<TAB>NAME" lines to standard output.
+--- */
+static void print_signal_names(void) {
+    for (int i = INITIAL_INDEX; i < NUM_SIGNAL_NAMES; i++) {
+        char buf[INT_BUFFER_LEN];
+        int_to_str(signal_names[i].number, buf);
+        write(STDOUT_FILENO, buf, mystrlen(buf));
+        write(STDOUT_FILENO, TERMINAL_TAB_CHAR, mystrlen(TERMINAL_TAB_CHAR));
+        write(STDOUT_FILENO, signal_names[i].name, mystrlen(signal_names[i].name));
+        write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
+    }
+}
+
+/* ---
+Function Name: handle_ulimit
+
+Purpose:
+    Implements the 'ulimit' builtin for the shell itself, so the limits
+    apply to every command started afterwards:
+      ulimit                 print the file size limit
+      ulimit -a              print every limit
+      ulimit -n              print one limit
+      ulimit -n 4096 ...     set soft limits ("unlimited" allowed)
+    Followed by a command ("ulimit -n 64 cmd") it is instead a stage
+    prefix that limits only that command; see parse_stage_tuning().
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Prints or updates the shell's resource limits. Returns 0, or 1 for
+    an invalid option or a limit that cannot be set.
+--- */
+int handle_ulimit(char **argv, char *envp[]) {
+    (void)envp;
+
+    if (!argv[JOB_OFFSET_INDEX]) {
+        print_ulimit(find_ulimit_resource(ULIMIT_DEFAULT_FLAG), FALSE);
+        return BUILTIN_SUCCESS;
+    }
+    if (mystrcmp(argv[JOB_OFFSET_INDEX], ULIMIT_ALL_OPTION) == STRINGS_MATCH) {
+        const UlimitResource *res;
+        for (int i = INITIAL_INDEX; (res = ulimit_resource_at(i)); i++)
+            print_ulimit(res, TRUE);
+        return BUILTIN_SUCCESS;
+    }
+
+    for (int i = JOB_OFFSET_INDEX; argv[i]; i++) {
+        const UlimitResource *res = NULL;
+        if (argv[i][INITIAL_INDEX] == NEGATIVE_SIGN && mystrlen(argv[i]) == ULIMIT_OPTION_LEN)
+            res = find_ulimit_resource(argv[i][ULIMIT_FLAG_INDEX]);
+        if (!res) {
+            write(STDERR_FILENO, ULIMIT_USAGE_MSG, mystrlen(ULIMIT_USAGE_MSG));
+            return BUILTIN_FAILURE;
+        }
+
+        char *value = argv[i + JOB_OFFSET_INDEX];
+        if (!value || value[INITIAL_INDEX] == NEGATIVE_SIGN) {
+            print_ulimit(res, FALSE);
+            continue;
+        }
+
+        struct rlimit rl;
+        rlim_t limit;
+        if (!parse_rlimit_value(value, res, &limit)) {
+            write(STDERR_FILENO, ULIMIT_USAGE_MSG, mystrlen(ULIMIT_USAGE_MSG));
+            return BUILTIN_FAILURE;
+        }
+        getrlimit(res->resource, &rl);
+        rl.rlim_cur = limit;
+        if (rl.rlim_max != RLIM_INFINITY && (limit == RLIM_INFINITY || limit > rl.rlim_max))
+            rl.rlim_max = limit;
+        if (setrlimit(res->resource, &rl) < ZERO_VALUE) {
+            write(STDERR_FILENO, ULIMIT_SET_FAIL_MSG, mystrlen(ULIMIT_SET_FAIL_MSG));
+            return BUILTIN_FAILURE;
+        }
+        i++;
+    }
+    return BUILTIN_SUCCESS;
+}
+
+/* ---
+Function Name: print_ulimit
+
+Purpose:
+    Prints one soft resource limit in the resource's unit.
+    
+Input:
+    res       - resource
+    with_name - non-zero to prefix "name (-x) " as 'ulimit -a' does
+    
+Output:
+    Writes the line to standard output.
+--- */
+static void print_ulimit(const UlimitResource *res, int with_name) {
+    struct rlimit rl;
+    char text[RLIMIT_TEXT_LEN];
+    getrlimit(res->resource, &rl);
+
+    if (with_name) {
+        char flag[ULIMIT_OPTION_LEN] = { res->flag, NULL_CHAR };
+        write(STDOUT_FILENO, res->name, mystrlen(res->name));
+        write(STDOUT_FILENO, ULIMIT_OPTION_OPEN, mystrlen(ULIMIT_OPTION_OPEN));
+        write(STDOUT_FILENO, flag, mystrlen(flag));
+        write(STDOUT_FILENO, ULIMIT_OPTION_CLOSE, mystrlen(ULIMIT_OPTION_CLOSE));
+    }
+
+    if (rl.rlim_cur == RLIM_INFINITY) {
+        mystrcpy(text, ULIMIT_UNLIMITED_TEXT);
+    } else {
+        unsigned long long value = rl.rlim_cur / res->unit;
+        char digits[RLIMIT_TEXT_LEN];
+        int n = INITIAL_INDEX, k = INITIAL_INDEX;
+        do {
+            digits[n++] = ZERO_CHAR + (int)(value % DECIMAL_BASE);
+            value /= DECIMAL_BASE;
+        } while (value > ZERO_VALUE);
+        while (n > INITIAL_INDEX) text[k++] = digits[--n];
+        text[k] = NULL_CHAR;
+    }
+    write(STDOUT_FILENO, text, mystrlen(text));
     write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
 }
+
+/* ---
+Function Name: handle_history
+
+Purpose:
+    Implements the 'history' builtin:
+      history           list every entry with its number
+      history N         list the last N entries
+      history -f TEXT   list the entries containing TEXT
+      history -c        clear the history
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Prints or clears the history. Returns 0, or 1 for invalid arguments.
+--- */
+int handle_history(char **argv, char *envp[]) {
+    (void)envp;
+    char *arg = argv[JOB_OFFSET_INDEX];
+    long count = history_count();
+
+    if (!arg) {
+        for (long n = TRUE_VALUE; n <= count; n++) print_history_entry(n);
+        return BUILTIN_SUCCESS;
+    }
+    if (mystrcmp(arg, HISTORY_CLEAR_OPTION) == STRINGS_MATCH && !argv[JOB_OFFSET_INDEX + JOB_OFFSET_INDEX]) {
+        history_clear();
+        return BUILTIN_SUCCESS;
+    }
+    if (mystrcmp(arg, HISTORY_FIND_OPTION) == STRINGS_MATCH && argv[JOB_OFFSET_INDEX + JOB_OFFSET_INDEX]) {
+        /* newest match first, then keep stepping back */
+        char *text = argv[JOB_OFFSET_INDEX + JOB_OFFSET_INDEX];
+        long matches[MAX_ARGS];
+        int found = ZERO_VALUE;
+        for (long n = history_find_substring(text, count + TRUE_VALUE); n != NO_ENTRY && found < MAX_ARGS;
+             n = history_find_substring(text, n))
+            matches[found++] = n;
+        while (found > ZERO_VALUE) print_history_entry(matches[--found]);
+        return BUILTIN_SUCCESS;
+    }
+
+    int last = ZERO_VALUE;
+    for (int i = INITIAL_INDEX; arg[i]; i++) {
+        if (arg[i] < ZERO_CHAR || arg[i] > NINE_CHAR) {
+            write(STDERR_FILENO, HISTORY_USAGE_MSG, mystrlen(HISTORY_USAGE_MSG));
+            return BUILTIN_FAILURE;
+        }
+        last = last * DECIMAL_BASE + (arg[i] - ZERO_CHAR);
+    }
+    for (long n = (last < count) ? count - last + TRUE_VALUE : TRUE_VALUE; n <= count; n++)
+        print_history_entry(n);
+    return BUILTIN_SUCCESS;
+}
+
+/* ---
+Function Name: print_history_entry
+
+Purpose:
+    Prints one history entry as "  NUM  command".
+    
+Input:
+    n - entry number
+    
+Output:
+    Writes the line to standard output.
+--- */
+static void print_history_entry(long n) {
+    int len;
+    const char *text = history_entry(n, &len);
+    if (!text) return;
+
+    char num[RLIMIT_TEXT_LEN];
+    myitoa((int)n, num);
+    for (int pad = mystrlen(num); pad < HISTORY_NUMBER_WIDTH; pad++)
+        write(STDOUT_FILENO, HISTORY_PAD_TEXT, mystrlen(HISTORY_PAD_TEXT));
+    write(STDOUT_FILENO, num, mystrlen(num));
+    write(STDOUT_FILENO, HISTORY_NUMBER_GAP, mystrlen(HISTORY_NUMBER_GAP));
+    write(STDOUT_FILENO, text, len);
+    write(STDOUT_FILENO, JOB_NEWLINE_CHAR, mystrlen(JOB_NEWLINE_CHAR));
+}
+
+/* ---
+Function Name: handle_local
+
+Purpose:
+    Implements the 'local' builtin: 'local NAME[=value] ...' gives the
+    running function its own variables, which hide any of the same
+    name until it returns. A name without a value starts out empty.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Returns 0, or 1 outside a function or if a variable does not fit.
+--- */
+int handle_local(char **argv, char *envp[]) {
+    (void)envp;
+    if (scope_depth() == ZERO_VALUE) {
+        print_builtin_error(CMD_LOCAL, NULL, LOCAL_OUTSIDE_MSG);
+        return BUILTIN_FAILURE;
+    }
+
+    int status = BUILTIN_SUCCESS;
+    for (int a = JOB_OFFSET_INDEX; argv[a]; a++) {
+        char name[VAR_NAME_LEN];
+        int i = INITIAL_INDEX;
+        while (is_name_char(argv[a][i]) && i < VAR_NAME_LEN - JOB_OFFSET_INDEX) {
+            name[i] = argv[a][i];
+            i++;
+        }
+        name[i] = NULL_CHAR;
+        const char *value = argv[a][i] == ENV_ASSIGN_CHAR ? argv[a] + i + JOB_OFFSET_INDEX : EMPTY_STRING;
+
+        if (i == INITIAL_INDEX || (argv[a][i] && argv[a][i] != ENV_ASSIGN_CHAR)) {
+            print_builtin_error(CMD_LOCAL, argv[a], LOCAL_NAME_MSG);
+            status = BUILTIN_FAILURE;
+        } else if (!define_local(name, value)) {
+            print_builtin_error(CMD_LOCAL, name, LOCAL_FULL_MSG);
+            status = BUILTIN_FAILURE;
+        }
+    }
+    return status;
+}
+
+/* ---
+Function Name: handle_alias
+
+Purpose:
+    Implements the 'alias' builtin:
+      alias                 list every alias
+      alias NAME            print one alias
+      alias NAME=VALUE ...  define aliases
+    The shell has no quoting, so a quoted value ("ll='ls -l'") reaches
+    this builtin split into words; they are joined again and the
+    quotes taken off here.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Returns 0, or 1 if a name is not an alias or a value is not
+    accepted.
+--- */
+int handle_alias(char **argv, char *envp[]) {
+    (void)envp;
+    if (!argv[JOB_OFFSET_INDEX]) {
+        print_aliases();
+        return BUILTIN_SUCCESS;
+    }
+
+    char text[ALIAS_TEXT_LEN];
+    int len = INITIAL_INDEX;
+    for (int a = JOB_OFFSET_INDEX; argv[a]; a++) {
+        if (a > JOB_OFFSET_INDEX && len < ALIAS_TEXT_LEN - JOB_OFFSET_INDEX) text[len++] = ALIAS_JOIN_CHAR;
+        for (int k = INITIAL_INDEX; argv[a][k] && len < ALIAS_TEXT_LEN - JOB_OFFSET_INDEX; k++)
+            text[len++] = argv[a][k];
+    }
+    text[len] = NULL_CHAR;
+
+    int status = BUILTIN_SUCCESS;
+    for (int i = INITIAL_INDEX; text[i];) {
+        if (text[i] == ALIAS_JOIN_CHAR) {
+            i++;
+            continue;
+        }
+        char *name = text + i;
+        while (text[i] && text[i] != ENV_ASSIGN_CHAR && text[i] != ALIAS_JOIN_CHAR) i++;
+
+        if (text[i] != ENV_ASSIGN_CHAR) {
+            char end = text[i];
+            text[i] = NULL_CHAR;
+            const Alias *alias = find_alias(name);
+            if (alias) print_alias(alias);
+            else print_builtin_error(CMD_ALIAS, name, ALIAS_NOT_FOUND_MSG);
+            if (!alias) status = BUILTIN_FAILURE;
+            if (end) i++;
+            continue;
+        }
+
+        text[i++] = NULL_CHAR;
+        char stop = ALIAS_JOIN_CHAR;
+        if (text[i] == SINGLE_QUOTE_CHAR || text[i] == DOUBLE_QUOTE_CHAR) stop = text[i++];
+        char *value = text + i;
+        while (text[i] && text[i] != stop) i++;
+        if (text[i]) text[i++] = NULL_CHAR;
+
+        int result = name[INITIAL_INDEX] ? define_alias(name, value) : ALIAS_BAD_VALUE;
+        if (result == ALIAS_BAD_VALUE) print_builtin_error(CMD_ALIAS, name, ALIAS_BAD_VALUE_MSG);
+        else if (result == ALIAS_FULL) print_builtin_error(CMD_ALIAS, name, ALIAS_FULL_MSG);
+        if (result != ALIAS_OK) status = BUILTIN_FAILURE;
+    }
+    return status;
+}
+
+/* ---
+Function Name: handle_unalias
+
+Purpose:
+    Implements the 'unalias' builtin: 'unalias NAME ...' removes
+    aliases, 'unalias -a' all of them.
+    
+Input:
+    argv - argument list
+    envp - environment variables (unused)
+    
+Output:
+    Returns 0, or 1 if a name is not an alias.
+--- */
+int handle_unalias(char **argv, char *envp[]) {
+    (void)envp;
+    if (!argv[JOB_OFFSET_INDEX]) {
+        write(STDERR_FILENO, UNALIAS_USAGE_MSG, mystrlen(UNALIAS_USAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    int status = BUILTIN_SUCCESS;
+    for (int a = JOB_OFFSET_INDEX; argv[a]; a++) {
+        if (mystrcmp(argv[a], UNALIAS_ALL_OPTION) == STRINGS_MATCH) {
+            clear_aliases();
+        } else if (!remove_alias(argv[a])) {
+            print_builtin_error(CMD_UNALIAS, argv[a], ALIAS_NOT_FOUND_MSG);
+            status = BUILTIN_FAILURE;
+        }
+    }
+    return status;
+}
+
+/* ---
+Function Name: handle_coproc
+
+Purpose:
+    Implements the 'coproc' builtin: 'coproc NAME command [args]'
+    starts the command with its standard input and output connected
+    to the shell (see start_coproc()). '>&${NAME[1]}' then sends a
+    command's output to it and '<&${NAME[0]}' reads its replies.
+    
+Input:
+    argv - argument list
+    envp - environment variables
+    
+Output:
+    Returns 0, or 1 if the name is not valid or the coprocess cannot
+    be started.
+--- */
+int handle_coproc(char **argv, char *envp[]) {
+    const char *name = argv[JOB_OFFSET_INDEX];
+    if (!name || !argv[COPROC_COMMAND_INDEX]) {
+        write(STDERR_FILENO, COPROC_USAGE_MSG, mystrlen(COPROC_USAGE_MSG));
+        return BUILTIN_FAILURE;
+    }
+
+    int i = INITIAL_INDEX;
+    while (is_name_char(name[i])) i++;
+    if (i == INITIAL_INDEX || name[i] != NULL_CHAR) {
+        print_builtin_error(CMD_COPROC, name, LOCAL_NAME_MSG);
+        return BUILTIN_FAILURE;
+    }
+    if (!start_coproc(name, argv + COPROC_COMMAND_INDEX, envp)) {
+        print_builtin_error(CMD_COPROC, name, COPROC_START_MSG);
+        return BUILTIN_FAILURE;
+    }
+    return BUILTIN_SUCCESS;
+}
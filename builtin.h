@@ -2,11 +2,13 @@
 #define BUILTIN_H
 
 #include "jobs.h"
+#include "jobtable.h"
+#include "stagetune.h"
+#include "history.h"
+#include "snapio.h"
 
 /* GLOBAL VARIABLES */
 extern int last_exit_status;
-extern Job jobs[MAX_JOBS];
-extern int num_jobs;
 
 /* GENERAL CONSTANTS */
 #define INITIAL_INDEX           0
@@ -30,6 +32,30 @@ extern int num_jobs;
 #define ASSIGN_EQUAL            "="
 #define ENV_STRING_EXTRA        2
 #define VAR_EXIT_STATUS         "$?"
+#define VAR_EXIT_STATUS_NAME    "?"
+#define VAR_PIPESTATUS_NAME     "PIPESTATUS"
+#define VAR_PIPESTATUS_ALL      "${PIPESTATUS[@]}"
+#define VAR_PIPESTATUS_STAR     "${PIPESTATUS[*]}"
+#define VAR_PARAMS_ALL          "$@"
+#define VAR_PARAMS_STAR         "$*"
+#define NOT_PIPESTATUS          -1
+#define VAR_NAME_LEN            128
+#define VAR_WORD_LEN            MAX_ARGS
+#define EXIT_STATUS_CHAR        '?'
+#define UNDERSCORE_CHAR         '_'
+#define LOWER_A_CHAR            'a'
+#define LOWER_Z_CHAR            'z'
+#define UPPER_A_CHAR            'A'
+#define UPPER_Z_CHAR            'Z'
+#define MAX_SHELL_VARS          64
+#define SHELL_VAR_LEN           1024
+#define ANONYMOUS_MAP_FD        -1      /* mmap() fd for MAP_ANONYMOUS */
+#define OPEN_BRACE_CHAR         '{'
+#define CLOSE_BRACE_CHAR        '}'
+#define OPEN_BRACKET_CHAR       '['
+#define CLOSE_BRACKET_CHAR      ']'
+#define NINE_CHAR               '9'
+#define EMPTY_STRING            ""
 #define DEF_EXIT_STATUS         0
 #define TOKEN_$                 '$'
 #define STRINGS_MATCH           0
@@ -40,35 +66,191 @@ extern int num_jobs;
 #define INVALID_PGID            0
 #define JOB_OFFSET_INDEX        1
 #define JOB_DISPLAY_WIDTH       8
-#define JOB_ID_OFFSET           1
 
 /* OUTPUT FORMATTING */
 #define TERMINAL_TAB_CHAR       "\t"
 #define JOB_NEWLINE_CHAR        "\n"
 #define JOB_STRING_END          '\0'
-#define STATUS_RUNNING_TEXT     "Running"
-#define STATUS_DONE_TEXT        "Done"
-#define STATUS_STOPPED_TEXT     "Stopped"
-#define MSG_JOB_PREFIX          "["
-#define MSG_JOB_SUFFIX          "] "
-#define MSG_FG_STOPPED          "[FG stopped]\n"
-#define MSG_BG_RUNNING_PREFIX   "["
-#define MSG_BG_RUNNING_SUFFIX   "] Running \t"
+
+/* JOBS OPTIONS */
+#define JOBS_LIMIT_OPTION       "-j"
+
+/* WAIT OPTIONS */
+#define WAIT_ANY_OPTION         "-n"
+#define WAIT_TIMEOUT_OPTION     "-t"
+#define DECIMAL_POINT_CHAR      '.'
+#define MS_PER_SECOND           1000
+#define WAIT_TIMEOUT_STATUS     124
+#define WAIT_NO_CHILD_STATUS    127
+#define WAIT_SIGINT_STATUS      130
+
+/* KILL / DISOWN OPTIONS */
+#define KILL_LIST_OPTION        "-l"
+#define KILL_SIGNAL_OPTION      "-s"
+#define SIGNAL_NAME_PREFIX      "SIG"
+#define SIGNAL_PREFIX_LEN       3
+#define NO_SIGNAL               -1
+#define DISOWN_ALL_OPTION       "-a"
+#define BUILTIN_NAME_FG         "fg"
+#define BUILTIN_NAME_BG         "bg"
+#define BUILTIN_NAME_JOBS       "jobs"
+#define BUILTIN_NAME_KILL       "kill"
+#define BUILTIN_NAME_DISOWN     "disown"
+#define BUILTIN_NAME_WAIT       "wait"
+
+/* ULIMIT OPTIONS */
+#define ULIMIT_ALL_OPTION       "-a"
+#define ULIMIT_DEFAULT_FLAG     'f'
+#define ULIMIT_FLAG_INDEX       1
+#define ULIMIT_OPTION_LEN       2
+#define ULIMIT_OPTION_OPEN      " (-"
+#define ULIMIT_OPTION_CLOSE     ") "
+#define ULIMIT_UNLIMITED_TEXT   "unlimited"
+#define RLIMIT_TEXT_LEN         24
+
+/* PARALLEL OPTIONS */
+#define PARALLEL_JOBS_OPTION    "-j"
+#define PARALLEL_ORDER_OPTION   "-k"
+#define PARALLEL_INPUT_OPTION   "-a"
+#define PARALLEL_OPTION_ARGS    2
+#define NO_PARALLEL_STAGE       -1
+#define PIPE_FD_COUNT           2
+#define PIPE_READ_INDEX         0
+#define PIPE_WRITE_INDEX        1
+
+/* HASH OPTIONS */
+#define HASH_RESET_OPTION       "-r"
+
+/* HISTORY OPTIONS */
+#define HISTORY_CLEAR_OPTION    "-c"
+#define HISTORY_FIND_OPTION     "-f"
+#define HISTORY_NUMBER_WIDTH    5
+#define HISTORY_NUMBER_GAP      "  "
+#define HISTORY_PAD_TEXT        " "
+
+/* ALIAS OPTIONS */
+#define ALIAS_TEXT_LEN          MAX_ARGS
+#define ALIAS_JOIN_CHAR         ' '
+#define SINGLE_QUOTE_CHAR       '\''
+#define DOUBLE_QUOTE_CHAR       '"'
+#define UNALIAS_ALL_OPTION      "-a"
+
+/* COPROC AND DESCRIPTOR REDIRECTIONS */
+#define COPROC_COMMAND_INDEX    2       /* coproc NAME command ... */
+#define FD_TEXT_MAX_DIGITS      9       /* longer would overflow an int */
+
+/* SET OPTIONS */
+#define SET_ENABLE_OPTION       "-o"
+#define SET_DISABLE_OPTION      "+o"
+#define OPTION_PIPEFAIL         "pipefail"
+#define OPTION_ON_TEXT          "on"
+#define OPTION_OFF_TEXT         "off"
+
+/* BUILTIN DISPATCH */
+#define NOT_BUILTIN             -1
+#define BUILTIN_IN_PROCESS      1
+#define BUILTIN_SUBSHELL        0
+#define NUM_BUILTINS            ((int)(sizeof(builtins) / sizeof(builtins[0])))
+#define BUILTIN_SUCCESS         0
+#define BUILTIN_FAILURE         1
 
 /* ERROR MESSAGES */
 #define CD_ERROR_MSG            "cd: failed\n"
 #define CD_ERROR_MSG_LEN        11
+#define PARALLEL_USAGE_MSG      "parallel: usage: parallel [-j N] [-k] [-a file] command [args...]\n"
+#define PARALLEL_STAGE_MSG      "parallel: must be the last stage of a pipeline\n"
+#define MSG_NAME_SEPARATOR      ": "
+#define NO_CURRENT_JOB_MSG      ": no current job\n"
+#define NO_SUCH_JOB_MSG         ": no such job\n"
+#define AMBIGUOUS_JOB_MSG       ": ambiguous job spec\n"
+#define NO_SUCH_PROCESS_MSG     ": no such process\n"
+#define KILL_USAGE_MSG          "kill: usage: kill [-s sig | -sig] %job|pid ...\n"
+#define INVALID_SIGNAL_MSG      ": invalid signal specification\n"
+#define WAIT_USAGE_MSG          "wait: usage: wait [-n] [-t seconds] [%job|pid ...]\n"
+#define ULIMIT_USAGE_MSG        "ulimit: usage: ulimit [-a] [-c|-d|-f|-l|-n|-s|-t|-u|-v [limit]] [command]\n"
+#define ULIMIT_SET_FAIL_MSG     "ulimit: cannot modify limit\n"
+#define HISTORY_USAGE_MSG       "history: usage: history [-c] [-f text] [n]\n"
+#define SET_ERROR_MSG           "set: usage: set [-o|+o] pipefail\n"
+#define LOCAL_OUTSIDE_MSG       ": can only be used in a function\n"
+#define LOCAL_NAME_MSG          ": not a valid name\n"
+#define LOCAL_FULL_MSG          ": too many local variables\n"
+#define ALIAS_NOT_FOUND_MSG     ": not found\n"
+#define ALIAS_BAD_VALUE_MSG     ": value must be a single command\n"
+#define ALIAS_FULL_MSG          ": too many aliases\n"
+#define UNALIAS_USAGE_MSG       "unalias: usage: unalias [-a] name ...\n"
+#define COPROC_USAGE_MSG        "coproc: usage: coproc NAME command [args...]\n"
+#define COPROC_START_MSG        ": cannot start coprocess\n"
+
+/* BUILTIN TABLE ENTRY */
+typedef int (*BuiltinHandler)(char **argv, char *envp[]);
+
+typedef struct
+{
+    const char *name;
+    BuiltinHandler handler;
+    int in_process;     /* safe to run inside the shell for $(...) */
+} Builtin;
+
+/* SIGNAL NAME TABLE ENTRY (kill) */
+typedef struct
+{
+    const char *name;
+    int number;
+} SignalName;
 
 /* FUNCTION DECLARATIONS */
-void handle_cd(char **argv, char *envp[]);
-void handle_exit(char **argv);
-void handle_export(char **argv, char *envp[]);
-void expand_variables(char **argv, char *envp[]);
-void handle_jobs(char **argv);
-void builtin_fg(char **argv);
-void builtin_bg(char **argv);
+int find_builtin(const char *name);
+int run_builtin(int index, char **argv, char *envp[]);
+int builtin_runs_in_process(int index);
+int handle_cd(char **argv, char *envp[]);
+int handle_exit(char **argv, char *envp[]);
+int handle_export(char **argv, char *envp[]);
+int expand_variables(Command *cmd, char *envp[]);
+int expand_redirections(Job *job, char *envp[]);
+char **copy_environment(char *envp[]);
+int set_shell_variable(const char *name, const char *value, char *envp[]);
+void save_shell_variables(SnapWriter *w);
+int load_shell_variables(SnapReader *r, char *envp[]);
+int handle_jobs(char **argv, char *envp[]);
+int builtin_fg(char **argv, char *envp[]);
+int builtin_bg(char **argv, char *envp[]);
+int handle_hash(char **argv, char *envp[]);
+int handle_set(char **argv, char *envp[]);
+int handle_parallel(char **argv, char *envp[]);
+int find_parallel_stage(Job *job);
+int run_parallel_job(Job *job, char *envp[]);
+int handle_wait(char **argv, char *envp[]);
+int handle_kill(char **argv, char *envp[]);
+int handle_disown(char **argv, char *envp[]);
+int handle_ulimit(char **argv, char *envp[]);
+int handle_history(char **argv, char *envp[]);
+int handle_local(char **argv, char *envp[]);
+int handle_alias(char **argv, char *envp[]);
+int handle_unalias(char **argv, char *envp[]);
+int handle_coproc(char **argv, char *envp[]);
+int is_name_char(char c);
 
 int myatoi(const char *s);
 void int_to_str(int n, char *buf);
 
+/* STATIC HELPER FUNCTIONS */
+static int wait_for_job_entry(JobEntry *entry);
+static int parse_timeout_ms(const char *text);
+static JobEntry *find_job_arg(const char *name, const char *spec);
+static void print_builtin_error(const char *name, const char *subject, const char *msg);
+static int signal_from_name(const char *name);
+static void print_signal_names(void);
+static void print_ulimit(const UlimitResource *res, int with_name);
+static void print_history_entry(long n);
+static char *expand_word(char *word, char *envp[]);
+static int starts_variable_name(char c);
+static int read_variable_name(const char *word, int i, char *name);
+static int redirection_fd(char *word, char *envp[]);
+static int parallel_from(char **argv, int input_fd, char *envp[]);
+static const char *variable_value(const char *name, char *envp[], char *buf);
+static int pipe_status_index(const char *name);
+static int splice_pipe_status(Command *cmd, int pos);
+static int splice_positional(Command *cmd, int pos);
+static int make_room(Command *cmd, int pos, int count);
+
 #endif
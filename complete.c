@@ -0,0 +1,186 @@
+#include "complete.h"
+#include "pathcache.h"
+#include "mystring.h"
+
+#include <stdlib.h>       /* qsort */
+#include <dirent.h>       /* opendir, readdir */
+#include <fcntl.h>        /* AT_* */
+#include <sys/stat.h>     /* fstatat */
+
+/* The shell's environment, for PATH */
+static char **completion_envp = NULL;
+
+/* ---
+Function Name: set_completion_env
+
+Purpose:
+    Tells completion which environment to take PATH from. The array is
+    the shell's own, so later 'export PATH=...' changes are seen.
+
+Input:
+    envp - environment variables
+
+Output:
+    Stores the pointer.
+--- */
+void set_completion_env(char *envp[])
+{
+    completion_envp = envp;
+}
+
+/* ---
+Function Name: find_completions
+
+Purpose:
+    Lists the completions of a word. In command position a word without
+    '/' is completed from the PATH executable index; anything else is
+    completed as a file path.
+
+Input:
+    word             - word text (not null-terminated)
+    len              - length of word
+    command_position - non-zero if the word is a command name
+    out              - receives the candidates, sorted
+
+Output:
+    Fills out; out->total is 0 if nothing matches.
+--- */
+void find_completions(const char *word, int len, int command_position, Completions *out)
+{
+    out->total = ZERO_VALUE;
+    out->count = ZERO_VALUE;
+    out->pool_used = ZERO_VALUE;
+    out->suffix = NO_SUFFIX;
+
+    int has_slash = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < len; i++) {
+        if (word[i] == PATH_SEPARATOR_CHAR) has_slash = TRUE_VALUE;
+    }
+
+    if (command_position && !has_slash && completion_envp)
+        complete_command(word, len, out);
+    else
+        complete_file(word, len, out);
+
+    if (out->total == TRUE_VALUE)
+        out->suffix = out->items[ZERO_VALUE].is_dir ? DIR_SUFFIX_CHAR : WORD_SUFFIX_CHAR;
+}
+
+/* ---
+Function Name: complete_command
+
+Purpose:
+    Finds the executables on PATH starting with word: one binary search
+    in the index, which is rebuilt only for directories whose mtime
+    changed since the last Tab.
+
+Input:
+    word - prefix
+    len  - length of prefix
+    out  - candidates
+
+Output:
+    Fills out.
+--- */
+static void complete_command(const char *word, int len, Completions *out)
+{
+    refresh_path_index(completion_envp);
+
+    int first;
+    out->total = find_path_index_prefix(word, len, &first);
+    out->typed_len = len;
+    for (int i = ZERO_VALUE; i < out->total && i < MAX_COMPLETIONS; i++) {
+        out->items[i].name = path_index_name(first + i);
+        out->items[i].is_dir = ZERO_VALUE;
+        out->count++;
+    }
+}
+
+/* ---
+Function Name: complete_file
+
+Purpose:
+    Finds the entries of the word's directory that start with its last
+    component. Hidden files are offered only if that component starts
+    with '.'. Only matching entries whose type the directory listing
+    does not give are stat()ed.
+
+Input:
+    word - path prefix, e.g. "src/ma"
+    len  - length of word
+    out  - candidates
+
+Output:
+    Fills out.
+--- */
+static void complete_file(const char *word, int len, Completions *out)
+{
+    char dir_path[COMPLETION_PATH_LEN];
+    int slash = len - TRUE_VALUE;
+    while (slash >= ZERO_VALUE && word[slash] != PATH_SEPARATOR_CHAR) slash--;
+
+    if (slash < ZERO_VALUE) {
+        mystrcpy(dir_path, CURRENT_DIR_TEXT);
+    } else {
+        int dir_len = (slash == ZERO_VALUE) ? TRUE_VALUE : slash;
+        if (dir_len >= COMPLETION_PATH_LEN) return;
+        for (int i = ZERO_VALUE; i < dir_len; i++) dir_path[i] = word[i];
+        dir_path[dir_len] = NULL_CHAR;
+    }
+
+    const char *base = word + slash + TRUE_VALUE;
+    int base_len = len - slash - TRUE_VALUE;
+    out->typed_len = base_len;
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+
+    struct dirent *d;
+    while ((d = readdir(dir))) {
+        if (d->d_name[ZERO_VALUE] == HIDDEN_NAME_CHAR &&
+            (base_len == ZERO_VALUE || base[ZERO_VALUE] != HIDDEN_NAME_CHAR))
+            continue;
+        if (mystrcmp(d->d_name, CURRENT_DIR_TEXT) == ZERO_VALUE) continue;
+
+        int i = ZERO_VALUE;
+        while (i < base_len && d->d_name[i] == base[i]) i++;
+        if (i < base_len) continue;
+
+        out->total++;
+        int name_len = mystrlen(d->d_name) + TRUE_VALUE;
+        if (out->count == MAX_COMPLETIONS || out->pool_used + name_len > COMPLETION_POOL_LEN) continue;
+
+        int is_dir = (d->d_type == DT_DIR);
+        if (d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = fstatat(dirfd(dir), d->d_name, &st, ZERO_VALUE) == ZERO_VALUE && S_ISDIR(st.st_mode);
+        }
+
+        char *copy = out->pool + out->pool_used;
+        mystrcpy(copy, d->d_name);
+        out->pool_used += name_len;
+        out->items[out->count].name = copy;
+        out->items[out->count].is_dir = is_dir;
+        out->count++;
+    }
+    closedir(dir);
+
+    qsort(out->items, out->count, sizeof(Candidate), compare_candidates);
+}
+
+/* ---
+Function Name: compare_candidates
+
+Purpose:
+    qsort() order for file candidates: by name.
+
+Input:
+    a, b - Candidate pointers
+
+Output:
+    Negative, zero or positive.
+--- */
+static int compare_candidates(const void *a, const void *b)
+{
+    return mystrcmp(((const Candidate *)a)->name, ((const Candidate *)b)->name);
+}
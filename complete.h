@@ -0,0 +1,50 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+/* SIZES */
+#define MAX_COMPLETIONS         1024
+#define COMPLETION_POOL_LEN     65536
+#define COMPLETION_PATH_LEN     1024
+
+/* CHARACTERS */
+#define CURRENT_DIR_TEXT        "."
+#define PATH_SEPARATOR_CHAR     '/'
+#define HIDDEN_NAME_CHAR        '.'
+#define WORD_SUFFIX_CHAR        ' '
+#define DIR_SUFFIX_CHAR         '/'
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define NULL_CHAR               '\0'
+#define NO_SUFFIX               '\0'
+
+/* ONE CANDIDATE */
+typedef struct
+{
+    const char *name;
+    int is_dir;
+} Candidate;
+
+/* CANDIDATES FOR THE WORD BEING COMPLETED */
+typedef struct
+{
+    int total;                      /* all matches (may exceed count) */
+    int count;                      /* matches stored in items */
+    int typed_len;                  /* how much of each name is already typed */
+    Candidate items[MAX_COMPLETIONS];
+    char suffix;                    /* to append after a single match */
+    char pool[COMPLETION_POOL_LEN]; /* file names */
+    int pool_used;
+} Completions;
+
+/* FUNCTION DECLARATIONS */
+void set_completion_env(char *envp[]);
+void find_completions(const char *word, int len, int command_position, Completions *out);
+
+/* STATIC HELPER FUNCTIONS */
+static void complete_command(const char *word, int len, Completions *out);
+static void complete_file(const char *word, int len, Completions *out);
+static int compare_candidates(const void *a, const void *b);
+
+#endif
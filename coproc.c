@@ -0,0 +1,215 @@
+#define _GNU_SOURCE    /* pipe2 */
+#include "coproc.h"
+#include "jobs.h"
+#include "runjob.h"
+#include "trace.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* pipe2, close */
+#include <fcntl.h>        /* O_CLOEXEC */
+#include <signal.h>       /* sigprocmask */
+
+/* Running coprocesses, by name. A slot's pipes stay open after its
+   helper exits, so output it left in the pipe can still be read; they
+   are closed when the name is used for a new coprocess. */
+static Coproc coprocs[MAX_COPROCS];
+
+/* ---
+Function Name: start_coproc
+
+Purpose:
+    Starts a helper process ('coproc NAME cmd') whose standard input
+    and output are pipes held by the shell. The helper is spawned like
+    any one-stage job (see spawn_job()), in the background, so it
+    keeps running across commands and a script can query it many
+    times without starting a process per query. A coprocess already
+    called NAME has its pipes closed first, which ends it if it
+    stops at end of input.
+
+Input:
+    name - coprocess name, already checked to be a variable name
+    argv - the helper's command and arguments, null-terminated
+    envp - environment variables
+
+Output:
+    Returns 1, or 0 if there are too many coprocesses or the pipes or
+    process cannot be created.
+--- */
+int start_coproc(const char *name, char **argv, char *envp[])
+{
+    if (mystrlen(name) >= COPROC_NAME_LEN) return ZERO_VALUE;
+
+    Coproc *coproc = find_coproc(name);
+    if (coproc) close_coproc(coproc);
+    for (int i = ZERO_VALUE; !coproc && i < MAX_COPROCS; i++) {
+        if (coprocs[i].name[ZERO_VALUE] == NULL_CHAR) coproc = &coprocs[i];
+    }
+    if (!coproc) return ZERO_VALUE;
+
+    int to_helper[2], from_helper[2];
+    if (pipe2(to_helper, O_CLOEXEC) < ZERO_VALUE) return ZERO_VALUE;
+    if (pipe2(from_helper, O_CLOEXEC) < ZERO_VALUE) {
+        close(to_helper[PIPE_READ_END]);
+        close(to_helper[PIPE_WRITE_END]);
+        return ZERO_VALUE;
+    }
+
+    Job job;
+    job.num_stages = TRUE_VALUE;
+    job.background = TRUE_VALUE;
+    job.pgid = ZERO_VALUE;
+    job.infile_path = NULL;
+    job.outfile_path = NULL;
+    job.num_pass_fds = ZERO_VALUE;
+    job.in_fd = to_helper[PIPE_READ_END];
+    job.out_fd = from_helper[PIPE_WRITE_END];
+    Command *cmd = &job.pipeline[ZERO_VALUE];
+    for (cmd->argc = ZERO_VALUE; argv[cmd->argc]; cmd->argc++) cmd->argv[cmd->argc] = argv[cmd->argc];
+    cmd->argv[cmd->argc] = NULL;
+
+    /* record the PID before the SIGCHLD handler can see it exit */
+    sigset_t chld_mask, prev_mask, child_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+    child_mask = prev_mask;
+    sigdelset(&child_mask, SIGCHLD);
+
+    int started = spawn_job(&job, envp, &child_mask);
+    close(to_helper[PIPE_READ_END]);
+    close(from_helper[PIPE_WRITE_END]);
+    if (started) {
+        mystrcpy(coproc->name, name);
+        coproc->pid = job.pids[ZERO_VALUE];
+        coproc->read_fd = from_helper[PIPE_READ_END];
+        coproc->write_fd = to_helper[PIPE_WRITE_END];
+    } else {
+        close(from_helper[PIPE_READ_END]);
+        close(to_helper[PIPE_WRITE_END]);
+    }
+    if (started) trace_job_end(&job);
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return started;
+}
+
+/* ---
+Function Name: coproc_value
+
+Purpose:
+    Gives the variables of a coprocess: ${NAME[0]} (or $NAME), the
+    descriptor to read its output from; ${NAME[1]}, the descriptor to
+    write its input to; and $NAME_PID while it runs.
+
+Input:
+    name - variable name without '$' or braces
+    buf  - INT_BUFFER_LEN bytes for the number
+
+Output:
+    The value, or NULL if name is none of these.
+--- */
+const char *coproc_value(const char *name, char *buf)
+{
+    for (int i = ZERO_VALUE; i < MAX_COPROCS; i++) {
+        const Coproc *coproc = &coprocs[i];
+        if (coproc->name[ZERO_VALUE] == NULL_CHAR) continue;
+
+        int len = ZERO_VALUE;
+        while (coproc->name[len] && name[len] == coproc->name[len]) len++;
+        if (coproc->name[len] != NULL_CHAR) continue;
+
+        int value;
+        if (name[len] == NULL_CHAR || suffix_at(name, len, COPROC_READ_SUFFIX))
+            value = coproc->read_fd;
+        else if (suffix_at(name, len, COPROC_WRITE_SUFFIX))
+            value = coproc->write_fd;
+        else if (suffix_at(name, len, COPROC_PID_SUFFIX) && coproc->pid != NO_COPROC_PID)
+            value = coproc->pid;
+        else
+            continue;
+        myitoa(value, buf);
+        return buf;
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: coproc_exited
+
+Purpose:
+    Notes that a reaped child was a coprocess. Called from the SIGCHLD
+    handler, so it only clears the PID.
+
+Input:
+    pid - reaped child
+
+Output:
+    None
+--- */
+void coproc_exited(int pid)
+{
+    for (int i = ZERO_VALUE; i < MAX_COPROCS; i++) {
+        if (coprocs[i].pid == pid) coprocs[i].pid = NO_COPROC_PID;
+    }
+}
+
+/* ---
+Function Name: find_coproc
+
+Purpose:
+    Finds a coprocess by name.
+
+Input:
+    name - name
+
+Output:
+    The slot, or NULL.
+--- */
+static Coproc *find_coproc(const char *name)
+{
+    for (int i = ZERO_VALUE; i < MAX_COPROCS; i++) {
+        if (coprocs[i].name[ZERO_VALUE] != NULL_CHAR && mystrcmp(coprocs[i].name, name) == ZERO_VALUE)
+            return &coprocs[i];
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: close_coproc
+
+Purpose:
+    Closes the shell's ends of a coprocess's pipes and frees its slot.
+    The helper sees end of input; it is reaped like any child.
+
+Input:
+    coproc - slot in use
+
+Output:
+    None
+--- */
+static void close_coproc(Coproc *coproc)
+{
+    close(coproc->read_fd);
+    close(coproc->write_fd);
+    coproc->name[ZERO_VALUE] = NULL_CHAR;
+    coproc->pid = NO_COPROC_PID;
+}
+
+/* ---
+Function Name: suffix_at
+
+Purpose:
+    Tells whether a variable name ends, from len on, with exactly the
+    given suffix.
+
+Input:
+    name   - variable name
+    len    - where the suffix should start
+    suffix - "[0]", "[1]" or "_PID"
+
+Output:
+    Non-zero if it does.
+--- */
+static int suffix_at(const char *name, int len, const char *suffix)
+{
+    return mystrcmp(name + len, suffix) == ZERO_VALUE;
+}
@@ -0,0 +1,46 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+/* SIZES */
+#define MAX_COPROCS             16
+#define COPROC_NAME_LEN         64
+
+/* VARIABLES ('coproc NAME cmd' sets ${NAME[0]}, ${NAME[1]}, $NAME_PID) */
+#define COPROC_READ_SUFFIX      "[0]"   /* the shell reads the helper's stdout */
+#define COPROC_WRITE_SUFFIX     "[1]"   /* the shell writes the helper's stdin */
+#define COPROC_PID_SUFFIX       "_PID"
+
+/* PIPE ENDS */
+#define PIPE_READ_END           0
+#define PIPE_WRITE_END          1
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define NO_COPROC_PID           0
+
+/* ONE COPROCESS
+   The shell's ends of its two pipes are close-on-exec: commands reach
+   them only through '>&${NAME[1]}' and '<&${NAME[0]}', so no other
+   process holds the helper's stdin open by accident. */
+typedef struct
+{
+    char name[COPROC_NAME_LEN]; /* empty for a free slot */
+    int pid;                    /* NO_COPROC_PID once it has exited */
+    int read_fd;
+    int write_fd;
+} Coproc;
+
+/* FUNCTION DECLARATIONS */
+int start_coproc(const char *name, char **argv, char *envp[]);
+const char *coproc_value(const char *name, char *buf);
+void coproc_exited(int pid);
+
+/* STATIC HELPER FUNCTIONS */
+static Coproc *find_coproc(const char *name);
+static void close_coproc(Coproc *coproc);
+static int suffix_at(const char *name, int len, const char *suffix);
+
+#endif
@@ -17,6 +17,19 @@ enum ErrorCode {
     ERR_EXEC_FAIL,
     ERR_FILE_NOT_FOUND,
     ERR_INVALID_INPUT,
+    ERR_TRACE_OPEN,
+    ERR_QUEUE_FULL,
+    ERR_LIMIT_USAGE,
+    ERR_CGROUP_UNAVAILABLE,
+    ERR_PREFIX_USAGE,
+    ERR_TUNING_FAIL,
+    ERR_HISTORY_EVENT,
+    ERR_FLOW_SYNTAX,
+    ERR_FLOW_EOF,
+    ERR_FLOW_TOO_LARGE,
+    ERR_FUNCTION_DEPTH,
+    ERR_COMMAND_STRING,
+    ERR_BAD_FD,
     NUM_ERRORS
 };
 
@@ -28,7 +41,20 @@ static const char *error_messages[NUM_ERRORS] = {
     [ERR_FORK_FAIL]      = "Error: fork failed\n",
     [ERR_EXEC_FAIL]      = "Error: execution failed\n",
     [ERR_FILE_NOT_FOUND] = ": file not found\n",
-    [ERR_INVALID_INPUT]  = "Error: invalid input\n"
+    [ERR_INVALID_INPUT]  = "Error: invalid input\n",
+    [ERR_TRACE_OPEN]     = "Error: cannot open trace file\n",
+    [ERR_QUEUE_FULL]     = "Error: job queue is full\n",
+    [ERR_LIMIT_USAGE]    = "limit: usage: limit [mem=SIZE] [cpu=PERCENT] [pids=N] command\n",
+    [ERR_CGROUP_UNAVAILABLE] = "Warning: cgroup v2 limits unavailable, running without them\n",
+    [ERR_PREFIX_USAGE]   = "Error: invalid nice, affinity or ulimit prefix\n",
+    [ERR_TUNING_FAIL]    = "Error: cannot apply ulimit or affinity settings\n",
+    [ERR_HISTORY_EVENT]  = "Error: history event not found\n",
+    [ERR_FLOW_SYNTAX]    = "Error: syntax error in if, while, for, case or function\n",
+    [ERR_FLOW_EOF]       = "Error: unexpected end of input in if, while, for, case or function\n",
+    [ERR_FLOW_TOO_LARGE] = "Error: compound command too large\n",
+    [ERR_FUNCTION_DEPTH] = "Error: functions nested too deeply\n",
+    [ERR_COMMAND_STRING] = "mysh: -c: option requires an argument\n",
+    [ERR_BAD_FD]         = ": bad file descriptor\n"
 };
 
 /* FUNCTION DECLARATIONS */
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE    /* tee, splice, pipe2 */
+#include "fanout.h"
+#include "mystring.h"
+#include "errors.h"
+
+#include <unistd.h>       /* read, write, lseek, _exit */
+#include <fcntl.h>        /* open, tee, splice, pipe2 */
+#include <errno.h>
+#include <sys/stat.h>     /* fstat */
+#include <dirent.h>       /* opendir, readdir */
+
+/* ---
+Function Name: is_fanout_stage
+
+Purpose:
+    Tells whether a pipeline stage is a 'tee' the shell can run itself:
+    plain file names, optionally '-a'. Other options, or a path such as
+    /usr/bin/tee, run the program as usual.
+
+Input:
+    argv - the stage's arguments, after any tuning prefix
+
+Output:
+    Non-zero if run_fanout_stage() may be used for it.
+--- */
+int is_fanout_stage(char **argv)
+{
+    if (!argv[ZERO_VALUE] || mystrcmp(argv[ZERO_VALUE], FANOUT_COMMAND) != ZERO_VALUE) return ZERO_VALUE;
+
+    int files = ZERO_VALUE;
+    for (int a = TRUE_VALUE; argv[a]; a++) {
+        if (mystrcmp(argv[a], FANOUT_APPEND_OPTION) == ZERO_VALUE) continue;
+        if (argv[a][ZERO_VALUE] == FANOUT_OPTION_CHAR) return ZERO_VALUE;
+        files++;
+    }
+    return files < MAX_FANOUT_SINKS;
+}
+
+/* ---
+Function Name: run_fanout_stage
+
+Purpose:
+    Runs a 'tee' stage in the forked stage process. Its standard input
+    is duplicated to standard output and to every file named, inside
+    the kernel: tee(2) and splice(2) pass page references between
+    pipes, so unlike /usr/bin/tee no byte is read into or written from
+    user space (except to a sink splice(2) cannot write, such as a
+    terminal). A full sink holds up the others, as with tee.
+
+Input:
+    argv - stage arguments accepted by is_fanout_stage()
+
+Output:
+    Exits with 0, or 1 if a file could not be opened or written.
+    Returns only if standard input is not a pipe (tee(2) needs one),
+    for the caller to exec the tee program instead.
+--- */
+void run_fanout_stage(char **argv)
+{
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) < ZERO_VALUE || !S_ISFIFO(st.st_mode)) return;
+    close_exec_fds();
+
+    FanoutSink sinks[MAX_FANOUT_SINKS];
+    int status = FANOUT_SUCCESS;
+    int num_sinks = open_sinks(argv, sinks, &status);
+    if (num_sinks == ERROR_CODE) _exit(FANOUT_FAILURE);
+
+    long moved;
+    while ((moved = fanout_round(sinks, num_sinks)) > ZERO_VALUE)
+        continue;
+    if (moved < ZERO_VALUE) status = FANOUT_FAILURE;
+    for (int i = ZERO_VALUE; i < num_sinks; i++) {
+        if (!sinks[i].alive) status = FANOUT_FAILURE;
+    }
+    _exit(status);
+}
+
+/* ---
+Function Name: close_exec_fds
+
+Purpose:
+    Closes what an exec would: every close-on-exec descriptor the stage
+    inherited from the shell. Otherwise the stage would hold the write
+    end of its own input pipe (and never see end of input), the read
+    end of its output pipe, and the shell's coprocess pipes.
+
+Input:
+    None
+
+Output:
+    None
+--- */
+static void close_exec_fds(void)
+{
+    DIR *dir = opendir(OPEN_FDS_DIR);
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        int fd = ZERO_VALUE;
+        int i = ZERO_VALUE;
+        for (; name[i] >= ZERO_CHAR && name[i] <= NINE_CHAR; i++) fd = fd * DECIMAL_BASE + (name[i] - ZERO_CHAR);
+
+        int flags = (i > ZERO_VALUE && name[i] == NULL_CHAR && fd != dirfd(dir)) ? fcntl(fd, F_GETFD) : ERROR_CODE;
+        if (flags >= ZERO_VALUE && (flags & FD_CLOEXEC)) close(fd);
+    }
+    closedir(dir);
+}
+
+/* ---
+Function Name: open_sinks
+
+Purpose:
+    Opens the files of a 'tee' stage and gives every sink (standard
+    output first) its scratch pipe. splice(2) cannot write to a file
+    opened O_APPEND, so for '-a' the file is opened at its end instead.
+
+Input:
+    argv   - stage arguments
+    sinks  - MAX_FANOUT_SINKS entries to fill
+    status - set to 1 if a file cannot be opened (it is skipped)
+
+Output:
+    Number of sinks, or -1 if a scratch pipe cannot be created.
+--- */
+static int open_sinks(char **argv, FanoutSink *sinks, int *status)
+{
+    int append = ZERO_VALUE;
+    for (int a = TRUE_VALUE; argv[a]; a++) {
+        if (mystrcmp(argv[a], FANOUT_APPEND_OPTION) == ZERO_VALUE) append = TRUE_VALUE;
+    }
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? ZERO_VALUE : O_TRUNC);
+
+    int num_sinks = ZERO_VALUE;
+    sinks[num_sinks++].fd = STDOUT_FILENO;
+    for (int a = TRUE_VALUE; argv[a]; a++) {
+        if (mystrcmp(argv[a], FANOUT_APPEND_OPTION) == ZERO_VALUE) continue;
+
+        int fd = open(argv[a], flags, FANOUT_FILE_MODE);
+        if (fd < ZERO_VALUE) {
+            write(STDERR_FILENO, argv[a], mystrlen(argv[a]));
+            print_error(ERR_FILE_NOT_FOUND);
+            *status = FANOUT_FAILURE;
+            continue;
+        }
+        if (append) lseek(fd, ZERO_VALUE, SEEK_END);
+        sinks[num_sinks++].fd = fd;
+    }
+
+    /* all scratch pipes keep the default size, so each holds what the
+       others do (see fanout_round()) */
+    for (int i = ZERO_VALUE; i < num_sinks; i++) {
+        if (pipe2(sinks[i].scratch, O_CLOEXEC) < ZERO_VALUE) {
+            print_error(ERR_PIPE_FAIL);
+            return ERROR_CODE;
+        }
+        sinks[i].alive = TRUE_VALUE;
+    }
+    return num_sinks;
+}
+
+/* ---
+Function Name: fanout_round
+
+Purpose:
+    Passes what is in the input pipe on to every live sink. The input's
+    head is duplicated with tee(2) into the scratch pipes of all sinks
+    but the last, and moved with splice(2) into the last one's, which
+    consumes it. The scratch pipes are empty and the same size, so each
+    takes the same bytes. Each scratch pipe is then emptied into its
+    sink.
+
+Input:
+    sinks     - sinks from open_sinks()
+    num_sinks - how many
+
+Output:
+    Bytes passed on; 0 at end of input or once every sink has failed;
+    -1 if the input cannot be read.
+--- */
+static long fanout_round(FanoutSink *sinks, int num_sinks)
+{
+    int live[MAX_FANOUT_SINKS];
+    int num_live = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < num_sinks; i++) {
+        if (sinks[i].alive) live[num_live++] = i;
+    }
+    if (num_live == ZERO_VALUE) return ZERO_VALUE;
+
+    long len = FANOUT_ROUND_LEN;
+    for (int k = ZERO_VALUE; k < num_live; k++) {
+        int scratch = sinks[live[k]].scratch[PIPE_WRITE_END];
+        ssize_t got;
+        do {
+            got = (k < num_live - TRUE_VALUE)
+                ? tee(STDIN_FILENO, scratch, len, ZERO_VALUE)
+                : splice(STDIN_FILENO, NULL, scratch, NULL, len, SPLICE_F_MOVE);
+        } while (got < ZERO_VALUE && errno == EINTR);
+
+        if (got <= ZERO_VALUE) return got < ZERO_VALUE ? ERROR_CODE : ZERO_VALUE;
+        if (k > ZERO_VALUE && got != len) return ERROR_CODE;
+        len = got;
+    }
+
+    for (int k = ZERO_VALUE; k < num_live; k++) {
+        FanoutSink *sink = &sinks[live[k]];
+        if (drain_scratch(sink, len)) continue;
+        sink->alive = ZERO_VALUE;
+        close(sink->scratch[PIPE_READ_END]);
+        close(sink->scratch[PIPE_WRITE_END]);
+    }
+    return len;
+}
+
+/* ---
+Function Name: drain_scratch
+
+Purpose:
+    Empties a sink's scratch pipe into the sink with splice(2).
+
+Input:
+    sink - live sink
+    len  - bytes in its scratch pipe
+
+Output:
+    Returns 1, or 0 if the sink cannot be written.
+--- */
+static int drain_scratch(FanoutSink *sink, long len)
+{
+    while (len > ZERO_VALUE) {
+        ssize_t n = splice(sink->scratch[PIPE_READ_END], NULL, sink->fd, NULL, len, SPLICE_F_MOVE);
+        if (n < ZERO_VALUE && errno == EINTR) continue;
+        if (n < ZERO_VALUE && errno == EINVAL) return copy_scratch(sink, len);
+        if (n <= ZERO_VALUE) return ZERO_VALUE;
+        len -= n;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: copy_scratch
+
+Purpose:
+    Empties a scratch pipe with read() and write(), for a sink that
+    splice(2) does not support.
+
+Input:
+    sink - live sink
+    len  - bytes left in its scratch pipe
+
+Output:
+    Returns 1, or 0 if the sink cannot be written.
+--- */
+static int copy_scratch(FanoutSink *sink, long len)
+{
+    static char buf[FANOUT_COPY_LEN];
+
+    while (len > ZERO_VALUE) {
+        ssize_t got = read(sink->scratch[PIPE_READ_END], buf, len < FANOUT_COPY_LEN ? len : FANOUT_COPY_LEN);
+        if (got < ZERO_VALUE && errno == EINTR) continue;
+        if (got <= ZERO_VALUE) return ZERO_VALUE;
+        len -= got;
+        for (ssize_t done = ZERO_VALUE; done < got;) {
+            ssize_t n = write(sink->fd, buf + done, got - done);
+            if (n < ZERO_VALUE && errno == EINTR) continue;
+            if (n <= ZERO_VALUE) return ZERO_VALUE;
+            done += n;
+        }
+    }
+    return TRUE_VALUE;
+}
@@ -0,0 +1,55 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+/* COMMAND AND OPTIONS */
+#define FANOUT_COMMAND          "tee"
+#define FANOUT_APPEND_OPTION    "-a"
+#define FANOUT_OPTION_CHAR      '-'
+
+/* SIZES */
+#define MAX_FANOUT_SINKS        16      /* stdout and up to 15 files */
+#define FANOUT_ROUND_LEN        (1 << 30)   /* tee(2) stops at the pipe's contents */
+#define FANOUT_COPY_LEN         65536   /* fallback buffer, see drain_scratch() */
+
+/* FILES */
+#define FANOUT_FILE_MODE        0644
+#define OPEN_FDS_DIR            "/proc/self/fd"
+
+/* EXIT STATUSES */
+#define FANOUT_SUCCESS          0
+#define FANOUT_FAILURE          1
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define PIPE_READ_END           0
+#define PIPE_WRITE_END          1
+#define NULL_CHAR               '\0'
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define DECIMAL_BASE            10
+
+/* ONE DESTINATION
+   Each round the input's bytes are duplicated (tee(2)) or moved
+   (splice(2)) into the sink's own scratch pipe, then spliced from there
+   to the sink, so only page references are copied. */
+typedef struct
+{
+    int fd;             /* stdout or a file named on the command line */
+    int scratch[2];     /* empty pipe between rounds */
+    int alive;          /* cleared after a write error */
+} FanoutSink;
+
+/* FUNCTION DECLARATIONS */
+int is_fanout_stage(char **argv);
+void run_fanout_stage(char **argv);
+
+/* STATIC HELPER FUNCTIONS */
+static void close_exec_fds(void);
+static int open_sinks(char **argv, FanoutSink *sinks, int *status);
+static long fanout_round(FanoutSink *sinks, int num_sinks);
+static int drain_scratch(FanoutSink *sink, long len);
+static int copy_scratch(FanoutSink *sink, long len);
+
+#endif
@@ -0,0 +1,1795 @@
+#define _GNU_SOURCE    /* cpu_set_t in stagetune.h */
+#include "flow.h"
+#include "getjob.h"
+#include "runjob.h"
+#include "builtin.h"
+#include "stagetune.h"
+#include "jobsched.h"
+#include "jobtable.h"
+#include "trace.h"
+#include "subst.h"
+#include "procsubst.h"
+#include "pathglob.h"
+#include "signal.h"
+#include "shellvars.h"
+#include "errors.h"
+#include "myheap.h"
+#include "mystring.h"
+
+static const FlowKeyword keywords[] = {
+    { KEYWORD_IF,    WORD_IF },    { KEYWORD_THEN,  WORD_THEN },
+    { KEYWORD_ELIF,  WORD_ELIF },  { KEYWORD_ELSE,  WORD_ELSE },
+    { KEYWORD_FI,    WORD_FI },    { KEYWORD_WHILE, WORD_WHILE },
+    { KEYWORD_UNTIL, WORD_UNTIL }, { KEYWORD_DO,    WORD_DO },
+    { KEYWORD_DONE,  WORD_DONE },  { KEYWORD_FOR,   WORD_FOR },
+    { KEYWORD_CASE,  WORD_CASE },  { KEYWORD_ESAC,  WORD_ESAC },
+    { KEYWORD_BREAK, WORD_BREAK }, { KEYWORD_CONTINUE, WORD_CONTINUE },
+    { KEYWORD_RETURN, WORD_RETURN },
+    { KEYWORD_GROUP_OPEN, WORD_GROUP_OPEN }, { KEYWORD_GROUP_CLOSE, WORD_GROUP_CLOSE }
+};
+#define NUM_KEYWORDS ((int)(sizeof(keywords) / sizeof(keywords[0])))
+
+static FlowProgram prog;
+static FlowLibrary library;
+static FlowCompiler comp;
+static FlowRuntime vm;
+
+/* Set while the last line of 'mysh -c' runs, see set_exec_last() */
+static int exec_last = ZERO_VALUE;
+
+/* ---
+Function Name: flow_starts
+
+Purpose:
+    Checks whether a command line starts a compound command or a
+    function definition.
+
+Input:
+    line - command line
+
+Output:
+    Non-zero if its first word is if, while, until, for, case or '{',
+    or it starts with "name()".
+--- */
+int flow_starts(const char *line)
+{
+    int i = ZERO_VALUE;
+    while (line[i] == SPACE_CHAR || line[i] == TAB_CHAR) i++;
+
+    for (int k = ZERO_VALUE; k < NUM_KEYWORDS; k++) {
+        enum FlowWord word = keywords[k].word;
+        if (word != WORD_IF && word != WORD_WHILE && word != WORD_UNTIL &&
+            word != WORD_FOR && word != WORD_CASE && word != WORD_GROUP_OPEN)
+            continue;
+
+        int n = mystrlen(keywords[k].text);
+        int j = ZERO_VALUE;
+        while (j < n && line[i + j] == keywords[k].text[j]) j++;
+        char after = line[i + j];
+        if (j == n && (after == SPACE_CHAR || after == TAB_CHAR || after == NULL_CHAR ||
+                       after == COMMAND_SEPARATOR_CHAR))
+            return TRUE_VALUE;
+    }
+
+    int name_end;
+    return definition_at(line, i, &name_end) != ERROR_CODE;
+}
+
+/* ---
+Function Name: compile_flow
+
+Purpose:
+    Compiles a compound command (and the commands after it on the same
+    lines) into a program for run_flow(). While an if, loop or case is
+    still open, more lines are read and the whole text is compiled
+    again. Each command is tokenized here, once; only the expansion of
+    its words is left for the time it runs. Function bodies go to the
+    library; what a failed compile added there is taken back.
+
+Input:
+    line      - first line
+    read_more - reads the next line into a MAX_ARGS buffer; returns 1,
+                0 at the end of input or -1 if the line was cancelled
+
+Output:
+    Marks the program ready, or reports the error and leaves nothing
+    to run.
+--- */
+void compile_flow(const char *line, int (*read_more)(char *buffer))
+{
+    prog.ready = ZERO_VALUE;
+    comp.source_len = mystrlen(line);
+    if (comp.source_len >= FLOW_SOURCE_LEN) {
+        print_error(ERR_FLOW_TOO_LARGE);
+        return;
+    }
+    mystrcpy(comp.source, line);
+    mark_library(&comp.library_mark);
+
+    char *mark = heap_mark();
+    for (;;) {
+        heap_release(mark);
+        int result = compile_program();
+        if (result == FLOW_OK) {
+            prog.ready = TRUE_VALUE;
+            return;
+        }
+        if (result == FLOW_ERROR) {
+            restore_library(&comp.library_mark);
+            print_error(comp.error);
+            set_exit_status(FLOW_FAILURE_STATUS);
+            return;
+        }
+
+        char more[MAX_ARGS];
+        int got = read_more(more);
+        if (got <= ZERO_VALUE) {
+            restore_library(&comp.library_mark);
+            if (got == ZERO_VALUE) print_error(ERR_FLOW_EOF);
+            return;
+        }
+
+        int len = mystrlen(more);
+        if (comp.source_len + len + TRUE_VALUE >= FLOW_SOURCE_LEN) {
+            restore_library(&comp.library_mark);
+            print_error(ERR_FLOW_TOO_LARGE);
+            return;
+        }
+        comp.source[comp.source_len++] = LINE_SEPARATOR_CHAR;
+        mystrcpy(comp.source + comp.source_len, more);
+        comp.source_len += len;
+    }
+}
+
+/* ---
+Function Name: flow_pending
+
+Purpose:
+    Tells main() that the last line read was compiled into a program.
+
+Input:
+    None
+
+Output:
+    Non-zero if run_flow() has a program to run.
+--- */
+int flow_pending(void)
+{
+    return prog.ready;
+}
+
+/* ---
+Function Name: run_flow
+
+Purpose:
+    Runs the compiled program. Commands go through run_command() like
+    lines typed at the prompt; conditions test $?. A 'for' list or
+    'case' word is expanded when the loop or case is entered, onto the
+    interpreter's own memory, since every command clears the heap.
+    Ctrl+C (at the shell, or killing a command) stops the program.
+
+Input:
+    envp - environment variables
+
+Output:
+    Runs the program and marks it done.
+--- */
+void run_flow(char *envp[])
+{
+    prog.ready = ZERO_VALUE;
+    interrupt_pending = ZERO_VALUE;
+    vm.num_frames = ZERO_VALUE;
+    vm.runtime_used = ZERO_VALUE;
+    vm.running = TRUE_VALUE;
+    execute(&prog, ZERO_VALUE, envp);
+    vm.running = ZERO_VALUE;
+}
+
+/* ---
+Function Name: run_command
+
+Purpose:
+    Expands and runs one parsed command line: a function or a builtin
+    inside the shell, a background job through the scheduler, anything
+    else as a foreground job. Used for lines typed at the prompt and
+    for the commands of a compiled program.
+
+Input:
+    job  - parsed job
+    envp - environment variables
+
+Output:
+    Sets $?; clears the heap.
+--- */
+void run_command(Job *job, char *envp[])
+{
+    /* A failed expansion, or a stage that expanded to nothing
+       ('$(true)'), runs nothing. <(...) and >(...) start first, so
+       the words they become are final. */
+    int expanded = expand_process_substitutions(job, envp) && expand_redirections(job, envp);
+    for (int i = ZERO_VALUE; i < (int)job->num_stages; i++) {
+        if (!expand_variables(&job->pipeline[i], envp) || job->pipeline[i].argc == ZERO_VALUE)
+            expanded = ZERO_VALUE;
+    }
+    if (!expanded) {
+        close_pass_fds(job);
+        free_all();
+        return;
+    }
+
+    /* Functions come before builtins of the same name; in a pipeline
+       or in the background a name is run as a program */
+    int function = find_function(job->pipeline[ZERO_VALUE].argv[ZERO_VALUE]);
+    if (function != NO_FUNCTION && job->num_stages == TRUE_VALUE && !job->background) {
+        close_pass_fds(job);
+        call_function(function, job->pipeline[ZERO_VALUE].argv, envp);
+        free_all();
+        return;
+    }
+
+    /* 'parallel' reads the stages before it, or its redirection,
+       instead of the shell's own input */
+    if (find_parallel_stage(job) != NO_PARALLEL_STAGE) {
+        set_exit_status(run_parallel_job(job, envp));
+        close_pass_fds(job);
+        free_all();
+        return;
+    }
+
+    /* Built-ins run inside the shell process ('ulimit -n 64 cmd' is
+       a stage prefix for a job, not the builtin) */
+    int builtin = find_builtin(job->pipeline[ZERO_VALUE].argv[ZERO_VALUE]);
+    if (builtin != NOT_BUILTIN && !is_tuning_prefix(job->pipeline[ZERO_VALUE].argv)) {
+        set_exit_status(run_builtin(builtin, job->pipeline[ZERO_VALUE].argv, envp));
+        close_pass_fds(job);
+        free_all();
+        return;
+    }
+
+    /* The last command of 'mysh -c', if a plain program, replaces the
+       shell instead of being forked and waited for */
+    if (exec_last && can_exec_in_place(job)) exec_job(job, envp);
+
+    /* Background jobs go through the bounded-concurrency scheduler */
+    if (job->background)
+        set_exit_status(sched_submit(job));
+    else
+        run_job(job, envp);
+    close_pass_fds(job);
+    free_all();
+}
+
+/* ---
+Function Name: set_exec_last
+
+Purpose:
+    Tells run_command() whether the line being run is the shell's last
+    ('mysh -c'), so that its command may be exec'd in place of the
+    shell (see exec_job()).
+
+Input:
+    enabled - non-zero for the last line
+
+Output:
+    Stores the setting.
+--- */
+void set_exec_last(int enabled)
+{
+    exec_last = enabled;
+}
+
+/* ---
+Function Name: find_function
+
+Purpose:
+    Looks a command name up among the defined functions.
+
+Input:
+    name - command name
+
+Output:
+    Index of the function, or NO_FUNCTION.
+--- */
+int find_function(const char *name)
+{
+    if (!name) return NO_FUNCTION;
+    for (int i = ZERO_VALUE; i < library.num_functions; i++) {
+        if (mystrcmp(library.functions[i].name, name) == ZERO_VALUE) return i;
+    }
+    return NO_FUNCTION;
+}
+
+/* ---
+Function Name: call_function
+
+Purpose:
+    Calls a function in the shell process: no fork, and no parsing,
+    since its body was compiled when it was defined. The arguments
+    become $1..$N for the length of the call, and 'local' variables
+    are dropped when it returns.
+
+Input:
+    index - function found by find_function()
+    argv  - the command's words; argv[0] is the function's name
+    envp  - environment variables
+
+Output:
+    Returns its exit status, also set as $?. The heap is cleared.
+--- */
+int call_function(int index, char **argv, char *envp[])
+{
+    if (!push_scope(argv)) {
+        print_error(ERR_FUNCTION_DEPTH);
+        set_exit_status(FLOW_FAILURE_STATUS);
+        return FLOW_FAILURE_STATUS;
+    }
+    free_all();
+
+    if (scope_depth() == TRUE_VALUE && !vm.running) interrupt_pending = ZERO_VALUE;
+    set_exit_status(FLOW_SUCCESS_STATUS);
+    execute(&library.program, library.functions[index].entry, envp);
+    pop_scope();
+    return last_exit_status;
+}
+
+/* ---
+Function Name: save_functions
+
+Purpose:
+    Writes the function library (bodies compiled to bytecode, and the
+    names bound to them) to a startup snapshot.
+
+Input:
+    w - snapshot writer
+
+Output:
+    None
+--- */
+void save_functions(SnapWriter *w)
+{
+    const FlowProgram *program = &library.program;
+
+    snap_write_pool(w, program->strings);
+    save_table(w, program->strings, program->strings_used, sizeof(char));
+    save_table(w, program->code, program->code_len, sizeof(FlowInstr));
+    save_table(w, program->commands, program->num_commands, sizeof(FlowCommand));
+    save_table(w, program->words, program->num_words, sizeof(char *));
+    save_table(w, program->lists, program->num_lists, sizeof(FlowList));
+    save_table(w, library.bodies, library.num_bodies, sizeof(FlowFunction));
+    save_table(w, library.functions, library.num_functions, sizeof(FlowFunction));
+}
+
+/* ---
+Function Name: load_functions
+
+Purpose:
+    Restores the function library from a startup snapshot. Nothing is
+    compiled: the bytecode is copied back and its words moved to where
+    the string pool lies now.
+
+Input:
+    r - snapshot reader
+
+Output:
+    Returns 1, or 0 if the image is damaged (the library is left
+    empty).
+--- */
+int load_functions(SnapReader *r)
+{
+    FlowProgram *program = &library.program;
+    FlowMark empty = { ZERO_VALUE };
+    restore_library(&empty);
+    library.num_functions = ZERO_VALUE;
+
+    SnapPool moved = snap_read_pool(r, program->strings);
+    int strings_used = load_table(r, program->strings, FLOW_STRINGS_LEN, sizeof(char));
+    int code_len = load_table(r, program->code, FLOW_MAX_CODE, sizeof(FlowInstr));
+    int num_commands = load_table(r, program->commands, FLOW_MAX_COMMANDS, sizeof(FlowCommand));
+    int num_words = load_table(r, program->words, FLOW_MAX_WORDS, sizeof(char *));
+    int num_lists = load_table(r, program->lists, FLOW_MAX_LISTS, sizeof(FlowList));
+    int num_bodies = load_table(r, library.bodies, FLOW_MAX_FUNCTIONS, sizeof(FlowFunction));
+    int num_functions = load_table(r, library.functions, FLOW_MAX_FUNCTIONS, sizeof(FlowFunction));
+    if (r->failed) return ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; i < num_words; i++)
+        program->words[i] = snap_relocate(program->words[i], &moved);
+    for (int i = ZERO_VALUE; i < num_commands; i++) {
+        program->commands[i].infile_path = snap_relocate(program->commands[i].infile_path, &moved);
+        program->commands[i].outfile_path = snap_relocate(program->commands[i].outfile_path, &moved);
+    }
+    for (int i = ZERO_VALUE; i < num_bodies; i++)
+        library.bodies[i].name = snap_relocate(library.bodies[i].name, &moved);
+    for (int i = ZERO_VALUE; i < num_functions; i++)
+        library.functions[i].name = snap_relocate(library.functions[i].name, &moved);
+
+    program->strings_used = strings_used;
+    program->code_len = code_len;
+    program->num_commands = num_commands;
+    program->num_words = num_words;
+    program->num_lists = num_lists;
+    library.num_bodies = num_bodies;
+    library.num_functions = num_functions;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: compile_program
+
+Purpose:
+    Compiles the whole source text from the start.
+
+Input:
+    None (comp.source)
+
+Output:
+    Fills prog and adds function bodies to the library; returns
+    FLOW_OK, FLOW_INCOMPLETE if a compound command is still open at the
+    end, or FLOW_ERROR with comp.error set.
+--- */
+static int compile_program(void)
+{
+    prog.code_len = ZERO_VALUE;
+    prog.num_commands = ZERO_VALUE;
+    prog.num_words = ZERO_VALUE;
+    prog.num_lists = ZERO_VALUE;
+    prog.strings_used = ZERO_VALUE;
+    restore_library(&comp.library_mark);
+    comp.out = &prog;
+    comp.in_function = ZERO_VALUE;
+    comp.pos = ZERO_VALUE;
+    comp.status = FLOW_OK;
+    comp.depth = ZERO_VALUE;
+    comp.num_loops = ZERO_VALUE;
+    comp.loop_base = ZERO_VALUE;
+    comp.num_patches = ZERO_VALUE;
+    comp.num_breaks = ZERO_VALUE;
+
+    compile_list(STOP_AT(WORD_END));
+    emit(OP_HALT, ZERO_VALUE, NO_TARGET);
+    return comp.status;
+}
+
+/* ---
+Function Name: compile_list
+
+Purpose:
+    Compiles commands separated by ';', '&' or newlines up to one of
+    the given words, which is left for the caller to consume.
+
+Input:
+    stops - STOP_AT() bits of the words that end the list
+
+Output:
+    Returns the word that ended the list, or WORD_NONE on failure.
+--- */
+static int compile_list(int stops)
+{
+    int name_end;
+    while (comp.status == FLOW_OK) {
+        enum FlowWord word = next_command_word();
+        if (stops & STOP_AT(word)) return word;
+
+        switch (word) {
+        case WORD_END:
+            comp.status = FLOW_INCOMPLETE;
+            break;
+        case WORD_IF:
+            compile_if();
+            break;
+        case WORD_WHILE:
+            compile_while(OP_JUMP_IF_FAILED);
+            break;
+        case WORD_UNTIL:
+            compile_while(OP_JUMP_IF_SUCCEEDED);
+            break;
+        case WORD_FOR:
+            compile_for();
+            break;
+        case WORD_CASE:
+            compile_case();
+            break;
+        case WORD_BREAK:
+        case WORD_CONTINUE:
+            compile_jump(word);
+            break;
+        case WORD_RETURN:
+            compile_return();
+            break;
+        case WORD_GROUP_OPEN:
+            compile_group();
+            break;
+        case WORD_NONE:
+            if (definition_at(comp.source, comp.pos, &name_end) != ERROR_CODE) compile_function();
+            else compile_command();
+            break;
+        default:
+            flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+            break;
+        }
+    }
+    return WORD_NONE;
+}
+
+/* ---
+Function Name: compile_if
+
+Purpose:
+    Compiles if LIST; then LIST; [elif LIST; then LIST;]... [else LIST;] fi.
+    Each condition jumps past its branch when it fails, and each branch
+    jumps to the end. Without an else, $? is 0 when no branch runs.
+
+Input:
+    None (the parser is at 'if')
+
+Output:
+    Emits the instructions.
+--- */
+static void compile_if(void)
+{
+    int first_end = comp.num_patches;
+    enum FlowWord word = WORD_ELIF;
+
+    while (word == WORD_ELIF) {
+        consume_word();
+        if (compile_list(STOP_AT(WORD_THEN)) != WORD_THEN) return;
+        consume_word();
+
+        int skip = emit(OP_JUMP_IF_FAILED, ZERO_VALUE, NO_TARGET);
+        word = compile_list(STOP_AT(WORD_ELIF) | STOP_AT(WORD_ELSE) | STOP_AT(WORD_FI));
+        if (word == WORD_NONE) return;
+
+        if (comp.num_patches == FLOW_MAX_PATCHES) {
+            flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+            return;
+        }
+        comp.patches[comp.num_patches++] = emit(OP_JUMP, ZERO_VALUE, NO_TARGET);
+        comp.out->code[skip].target = comp.out->code_len;
+    }
+
+    if (word == WORD_ELSE) {
+        consume_word();
+        if (compile_list(STOP_AT(WORD_FI)) != WORD_FI) return;
+    } else {
+        emit(OP_SET_SUCCESS, ZERO_VALUE, NO_TARGET);
+    }
+    consume_word();
+    expect_command_end();
+
+    for (int k = first_end; k < comp.num_patches; k++)
+        comp.out->code[comp.patches[k]].target = comp.out->code_len;
+    comp.num_patches = first_end;
+}
+
+/* ---
+Function Name: compile_while
+
+Purpose:
+    Compiles while/until LIST; do LIST; done. The condition is at the
+    top; the body jumps back to it. The loop leaves $? at 0.
+
+Input:
+    exit_op - OP_JUMP_IF_FAILED for while, OP_JUMP_IF_SUCCEEDED for until
+
+Output:
+    Emits the instructions.
+--- */
+static void compile_while(enum FlowOp exit_op)
+{
+    consume_word();
+    int top = comp.out->code_len;
+    if (compile_list(STOP_AT(WORD_DO)) != WORD_DO) return;
+    consume_word();
+
+    if (comp.num_loops == FLOW_MAX_LOOPS) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+    FlowLoop *loop = &comp.loops[comp.num_loops++];
+    loop->continue_target = top;
+    loop->depth = comp.depth;
+    loop->first_break = comp.num_breaks;
+
+    int exit_jump = emit(exit_op, ZERO_VALUE, NO_TARGET);
+    if (compile_list(STOP_AT(WORD_DONE)) != WORD_DONE) return;
+    consume_word();
+    expect_command_end();
+    emit(OP_JUMP, ZERO_VALUE, top);
+
+    comp.out->code[exit_jump].target = comp.out->code_len;
+    for (int k = loop->first_break; k < comp.num_breaks; k++)
+        comp.out->code[comp.breaks[k]].target = comp.out->code_len;
+    comp.num_breaks = loop->first_break;
+    comp.num_loops--;
+    emit(OP_SET_SUCCESS, ZERO_VALUE, NO_TARGET);
+}
+
+/* ---
+Function Name: compile_for
+
+Purpose:
+    Compiles for NAME in WORDS; do LIST; done. The words are stored
+    unexpanded; OP_FOR_START expands them (patterns included) once per
+    run of the loop, and OP_FOR_NEXT steps through them.
+
+Input:
+    None (the parser is at 'for')
+
+Output:
+    Emits the instructions.
+--- */
+static void compile_for(void)
+{
+    consume_word();
+    int first = comp.out->num_words;
+    if (!read_word() || !expect_in()) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+        return;
+    }
+    while (read_word())
+        ;
+    if (comp.status != FLOW_OK) return;
+    int list = add_list(first);
+
+    if (!expect_keyword(WORD_DO)) return;
+    if (comp.num_loops == FLOW_MAX_LOOPS || comp.depth == FLOW_MAX_FRAMES) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+
+    emit(OP_FOR_START, list, NO_TARGET);
+    comp.depth++;
+    int next = emit(OP_FOR_NEXT, ZERO_VALUE, NO_TARGET);
+
+    FlowLoop *loop = &comp.loops[comp.num_loops++];
+    loop->continue_target = next;
+    loop->depth = comp.depth;
+    loop->first_break = comp.num_breaks;
+
+    if (compile_list(STOP_AT(WORD_DONE)) != WORD_DONE) return;
+    consume_word();
+    expect_command_end();
+    emit(OP_JUMP, ZERO_VALUE, next);
+
+    comp.out->code[next].target = comp.out->code_len;
+    for (int k = loop->first_break; k < comp.num_breaks; k++)
+        comp.out->code[comp.breaks[k]].target = comp.out->code_len;
+    comp.num_breaks = loop->first_break;
+    comp.num_loops--;
+    emit(OP_POP_FRAME, ZERO_VALUE, NO_TARGET);
+    comp.depth--;
+}
+
+/* ---
+Function Name: compile_case
+
+Purpose:
+    Compiles case WORD in [(]PATTERN[|PATTERN]...) LIST ;; ... esac.
+    Each item tests its patterns and jumps to the next item if none
+    matches; its list jumps to the end.
+
+Input:
+    None (the parser is at 'case')
+
+Output:
+    Emits the instructions.
+--- */
+static void compile_case(void)
+{
+    consume_word();
+    int first = comp.out->num_words;
+    if (!read_word()) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+        return;
+    }
+    int subject = add_list(first);
+    if (!expect_in()) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+        return;
+    }
+    if (comp.depth == FLOW_MAX_FRAMES) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+
+    emit(OP_CASE_START, subject, NO_TARGET);
+    comp.depth++;
+    int first_end = comp.num_patches;
+
+    for (;;) {
+        enum FlowWord word = next_command_word();
+        if (word == WORD_ESAC) break;
+        if (word == WORD_END) {
+            comp.status = FLOW_INCOMPLETE;
+            return;
+        }
+        if (word == WORD_CASE_END) {
+            flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+            return;
+        }
+
+        int patterns = compile_patterns();
+        if (patterns < ZERO_VALUE) return;
+        int skip = emit(OP_CASE_MATCH, patterns, NO_TARGET);
+
+        word = compile_list(STOP_AT(WORD_CASE_END) | STOP_AT(WORD_ESAC));
+        if (word == WORD_NONE) return;
+        if (comp.num_patches == FLOW_MAX_PATCHES) {
+            flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+            return;
+        }
+        comp.patches[comp.num_patches++] = emit(OP_JUMP, ZERO_VALUE, NO_TARGET);
+        comp.out->code[skip].target = comp.out->code_len;
+        if (word == WORD_CASE_END) comp.pos += CASE_END_LEN;
+    }
+    consume_word();
+
+    for (int k = first_end; k < comp.num_patches; k++)
+        comp.out->code[comp.patches[k]].target = comp.out->code_len;
+    comp.num_patches = first_end;
+    emit(OP_POP_FRAME, ZERO_VALUE, NO_TARGET);
+    comp.depth--;
+    expect_command_end();
+}
+
+/* ---
+Function Name: compile_patterns
+
+Purpose:
+    Reads the patterns of one case item, up to and including its ')'.
+
+Input:
+    None (the parser is at the item)
+
+Output:
+    Returns the index of the pattern list, or -1 on a syntax error.
+--- */
+static int compile_patterns(void)
+{
+    int first = comp.out->num_words;
+    if (comp.source[comp.pos] == PATTERN_OPEN_CHAR) comp.pos++;
+
+    for (;;) {
+        skip_blanks();
+        int start = comp.pos;
+        char c;
+        while ((c = comp.source[comp.pos]) != NULL_CHAR && c != SPACE_CHAR && c != TAB_CHAR &&
+               c != PATTERN_OR_CHAR && c != PATTERN_CLOSE_CHAR && c != LINE_SEPARATOR_CHAR &&
+               c != COMMAND_SEPARATOR_CHAR)
+            comp.pos++;
+        if (comp.pos == start || !store_word(comp.source + start, comp.pos - start)) break;
+
+        skip_blanks();
+        c = comp.source[comp.pos++];
+        if (c == PATTERN_CLOSE_CHAR) return add_list(first);
+        if (c != PATTERN_OR_CHAR) break;
+    }
+    if (comp.status == FLOW_OK) flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+    return ERROR_CODE;
+}
+
+/* ---
+Function Name: compile_jump
+
+Purpose:
+    Compiles 'break' (to the end of the innermost loop, patched when
+    the loop is done; kept in breaks[], apart from the end jumps of an
+    enclosing if or case) or 'continue' (to its condition or next word).
+    The jump drops the frames of any for or case it leaves. A loop
+    outside the function being compiled does not count.
+
+Input:
+    word - WORD_BREAK or WORD_CONTINUE
+
+Output:
+    Emits the jump.
+--- */
+static void compile_jump(enum FlowWord word)
+{
+    consume_word();
+    expect_command_end();
+    if (comp.status != FLOW_OK) return;
+    if (comp.num_loops == comp.loop_base) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+        return;
+    }
+
+    FlowLoop *loop = &comp.loops[comp.num_loops - TRUE_VALUE];
+    if (word == WORD_BREAK) {
+        if (comp.num_breaks == FLOW_MAX_PATCHES) {
+            flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+            return;
+        }
+        int at = emit(OP_JUMP, ZERO_VALUE, NO_TARGET);
+        comp.breaks[comp.num_breaks++] = at;
+        comp.out->code[at].depth = loop->depth;
+    } else {
+        int at = emit(OP_JUMP, ZERO_VALUE, loop->continue_target);
+        comp.out->code[at].depth = loop->depth;
+    }
+}
+
+/* ---
+Function Name: compile_function
+
+Purpose:
+    Compiles name() { LIST; } into the library, with frame depths and
+    loops counted from the start of the body, and emits the OP_DEFINE
+    that binds the name when the definition runs. A definition inside
+    a function body is jumped over by the code around it.
+
+Input:
+    None (the parser is at the name)
+
+Output:
+    Emits the body and the OP_DEFINE.
+--- */
+static void compile_function(void)
+{
+    int name_start = comp.pos, name_end;
+    comp.pos = definition_at(comp.source, comp.pos, &name_end);
+    if (!expect_keyword(WORD_GROUP_OPEN)) return;
+
+    FlowProgram *outer = comp.out;
+    int depth = comp.depth, loop_base = comp.loop_base, in_function = comp.in_function;
+    int skip = (outer == &library.program) ? emit(OP_JUMP, ZERO_VALUE, NO_TARGET) : NO_TARGET;
+
+    comp.out = &library.program;
+    if (!store_word(comp.source + name_start, name_end - name_start)) return;
+    const char *name = library.program.words[--library.program.num_words];
+    int entry = library.program.code_len;
+
+    comp.depth = ZERO_VALUE;
+    comp.loop_base = comp.num_loops;
+    comp.in_function = TRUE_VALUE;
+    enum FlowWord word = compile_list(STOP_AT(WORD_GROUP_CLOSE));
+    emit(OP_RETURN, RETURN_LAST_STATUS, NO_TARGET);
+    if (skip != NO_TARGET) library.program.code[skip].target = library.program.code_len;
+
+    comp.out = outer;
+    comp.depth = depth;
+    comp.loop_base = loop_base;
+    comp.in_function = in_function;
+    if (word != WORD_GROUP_CLOSE) return;
+    consume_word();
+    expect_command_end();
+
+    if (library.num_bodies == FLOW_MAX_FUNCTIONS) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+    library.bodies[library.num_bodies].name = name;
+    library.bodies[library.num_bodies].entry = entry;
+    emit(OP_DEFINE, library.num_bodies++, NO_TARGET);
+}
+
+/* ---
+Function Name: compile_group
+
+Purpose:
+    Compiles { LIST; }, which runs its commands as one.
+
+Input:
+    None (the parser is at '{')
+
+Output:
+    Emits the list's instructions.
+--- */
+static void compile_group(void)
+{
+    consume_word();
+    if (compile_list(STOP_AT(WORD_GROUP_CLOSE)) != WORD_GROUP_CLOSE) return;
+    consume_word();
+    expect_command_end();
+}
+
+/* ---
+Function Name: compile_return
+
+Purpose:
+    Compiles 'return [N]', which leaves the function being compiled
+    with status N, or with the status of the last command.
+
+Input:
+    None (the parser is at 'return')
+
+Output:
+    Emits OP_RETURN.
+--- */
+static void compile_return(void)
+{
+    consume_word();
+    int first = comp.out->num_words;
+    int status = read_word() ? add_list(first) : RETURN_LAST_STATUS;
+    expect_command_end();
+    if (comp.status != FLOW_OK) return;
+    if (!comp.in_function) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+        return;
+    }
+    emit(OP_RETURN, status, NO_TARGET);
+}
+
+/* ---
+Function Name: definition_at
+
+Purpose:
+    Checks for "name()" or "name ()", the start of a function
+    definition.
+
+Input:
+    text     - source text
+    i        - index of the first word
+    name_end - receives the index just past the name
+
+Output:
+    Index just past the "()", or -1 if there is no definition.
+--- */
+static int definition_at(const char *text, int i, int *name_end)
+{
+    int j = i;
+    while (is_name_char(text[j])) j++;
+    if (j == i || (text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR)) return ERROR_CODE;
+    *name_end = j;
+
+    while (text[j] == SPACE_CHAR || text[j] == TAB_CHAR) j++;
+    if (text[j] != FUNCTION_OPEN_CHAR || text[j + TRUE_VALUE] != FUNCTION_CLOSE_CHAR) return ERROR_CODE;
+    return j + FUNCTION_PARENS_LEN;
+}
+
+/* ---
+Function Name: compile_command
+
+Purpose:
+    Tokenizes one command with parse_job_line(), patterns left as they
+    are, and copies its words into the program.
+
+Input:
+    None (the parser is at the command)
+
+Output:
+    Emits OP_RUN for it.
+--- */
+static void compile_command(void)
+{
+    int start = comp.pos;
+    comp.pos = command_end(start);
+
+    int len = comp.pos - start;
+    char *line = alloc(len + TRUE_VALUE);
+    if (!line) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+    for (int i = ZERO_VALUE; i < len; i++) line[i] = comp.source[start + i];
+    line[len] = NULL_CHAR;
+
+    Job *job = &comp.parsed;
+    set_pattern_expansion(ZERO_VALUE);
+    parse_job_line(job, line);
+    set_pattern_expansion(TRUE_VALUE);
+    if (job->num_stages == ZERO_VALUE) return;
+
+    if (comp.out->num_commands == FLOW_MAX_COMMANDS) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return;
+    }
+    FlowCommand *command = &comp.out->commands[comp.out->num_commands];
+    command->num_stages = job->num_stages;
+    command->background = job->background;
+    command->infile_path = NULL;
+    command->outfile_path = NULL;
+    if (job->infile_path && store_word(job->infile_path, mystrlen(job->infile_path)))
+        command->infile_path = comp.out->words[--comp.out->num_words];
+    if (job->outfile_path && store_word(job->outfile_path, mystrlen(job->outfile_path)))
+        command->outfile_path = comp.out->words[--comp.out->num_words];
+
+    for (int s = ZERO_VALUE; s < (int)job->num_stages; s++) {
+        command->stages[s].first = comp.out->num_words;
+        command->stages[s].count = job->pipeline[s].argc;
+        for (int i = ZERO_VALUE; i < (int)job->pipeline[s].argc; i++) {
+            char *word = job->pipeline[s].argv[i];
+            if (!store_word(word, mystrlen(word))) return;
+        }
+    }
+    if (comp.status == FLOW_OK) emit(OP_RUN, comp.out->num_commands++, NO_TARGET);
+}
+
+/* ---
+Function Name: next_command_word
+
+Purpose:
+    Skips blanks and command separators, and classifies what follows.
+
+Input:
+    None
+
+Output:
+    The keyword there, WORD_CASE_END for ";;", WORD_END at the end of
+    the source, or WORD_NONE for a command.
+--- */
+static enum FlowWord next_command_word(void)
+{
+    for (;;) {
+        char c = comp.source[comp.pos];
+        if (c == COMMAND_SEPARATOR_CHAR && comp.source[comp.pos + TRUE_VALUE] == COMMAND_SEPARATOR_CHAR)
+            return WORD_CASE_END;
+        if (c != SPACE_CHAR && c != TAB_CHAR && c != LINE_SEPARATOR_CHAR && c != COMMAND_SEPARATOR_CHAR)
+            break;
+        comp.pos++;
+    }
+    if (comp.source[comp.pos] == NULL_CHAR) return WORD_END;
+    return keyword_at(comp.pos);
+}
+
+/* ---
+Function Name: keyword_at
+
+Purpose:
+    Checks whether the word at an index is a keyword.
+
+Input:
+    i - index into the source
+
+Output:
+    The keyword, or WORD_NONE.
+--- */
+static enum FlowWord keyword_at(int i)
+{
+    int len = word_end(i) - i;
+    for (int k = ZERO_VALUE; k < NUM_KEYWORDS; k++) {
+        const char *text = keywords[k].text;
+        if ((int)mystrlen(text) != len) continue;
+        int j = ZERO_VALUE;
+        while (j < len && comp.source[i + j] == text[j]) j++;
+        if (j == len) return keywords[k].word;
+    }
+    return WORD_NONE;
+}
+
+/* ---
+Function Name: consume_word
+
+Purpose:
+    Moves past the word at the parser's position.
+
+Input:
+    None
+
+Output:
+    Updates comp.pos.
+--- */
+static void consume_word(void)
+{
+    skip_blanks();
+    comp.pos = word_end(comp.pos);
+}
+
+/* ---
+Function Name: expect_keyword
+
+Purpose:
+    Consumes a keyword that must come next ('do' after a for list).
+
+Input:
+    word - the keyword
+
+Output:
+    Returns 1 if it was there; otherwise records an incomplete program
+    (at the end of the source) or a syntax error and returns 0.
+--- */
+static int expect_keyword(enum FlowWord word)
+{
+    enum FlowWord found = next_command_word();
+    if (found == word) {
+        consume_word();
+        return TRUE_VALUE;
+    }
+    if (found == WORD_END) comp.status = FLOW_INCOMPLETE;
+    else flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: expect_in
+
+Purpose:
+    Consumes the 'in' after a for variable or case word.
+
+Input:
+    None
+
+Output:
+    Returns 1 if it was there.
+--- */
+static int expect_in(void)
+{
+    skip_blanks();
+    int end = word_end(comp.pos);
+    int len = mystrlen(KEYWORD_IN);
+    if (end - comp.pos != len) return ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < len; i++) {
+        if (comp.source[comp.pos + i] != KEYWORD_IN[i]) return ZERO_VALUE;
+    }
+    comp.pos = end;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: expect_command_end
+
+Purpose:
+    Checks that fi, done, esac, break and continue end their command
+    ('done > file' is not supported).
+
+Input:
+    None
+
+Output:
+    Records a syntax error if anything else follows.
+--- */
+static void expect_command_end(void)
+{
+    skip_blanks();
+    char c = comp.source[comp.pos];
+    if (c != NULL_CHAR && c != COMMAND_SEPARATOR_CHAR && c != LINE_SEPARATOR_CHAR)
+        flow_failed(FLOW_ERROR, ERR_FLOW_SYNTAX);
+}
+
+/* ---
+Function Name: read_word
+
+Purpose:
+    Stores the next word of the current command (a for variable or
+    list word, or a case word).
+
+Input:
+    None
+
+Output:
+    Returns 1 if a word was stored, 0 at the end of the command.
+--- */
+static int read_word(void)
+{
+    skip_blanks();
+    int end = word_end(comp.pos);
+    if (end == comp.pos) return ZERO_VALUE;
+
+    int start = comp.pos;
+    comp.pos = end;
+    return store_word(comp.source + start, end - start);
+}
+
+/* ---
+Function Name: word_end
+
+Purpose:
+    Finds the end of the word at an index. A $(...), <(...) or >(...)
+    is part of the word, blanks and separators included.
+
+Input:
+    i - index into the source
+
+Output:
+    Index of the blank, separator or null character after the word.
+--- */
+static int word_end(int i)
+{
+    const char *text = comp.source;
+    for (;;) {
+        char c = text[i];
+        if (c == NULL_CHAR || c == SPACE_CHAR || c == TAB_CHAR ||
+            c == COMMAND_SEPARATOR_CHAR || c == LINE_SEPARATOR_CHAR)
+            return i;
+        if ((c == SUBST_START_CHAR || c == PROC_INPUT_CHAR || c == PROC_OUTPUT_CHAR) &&
+            text[i + TRUE_VALUE] == SUBST_OPEN_CHAR)
+            i = substitution_end(text, i);
+        else
+            i++;
+    }
+}
+
+/* ---
+Function Name: command_end
+
+Purpose:
+    Finds the end of the command at an index: the next ';' or newline,
+    or just past a '&' that sends it to the background (one after '<'
+    or '>' is a descriptor redirection, '>&N').
+
+Input:
+    i - index into the source
+
+Output:
+    Index just past the command's text.
+--- */
+static int command_end(int i)
+{
+    const char *text = comp.source;
+    for (;;) {
+        char c = text[i];
+        if (c == NULL_CHAR || c == COMMAND_SEPARATOR_CHAR || c == LINE_SEPARATOR_CHAR)
+            return i;
+        if (c == BACKGROUND_CHAR && (i == ZERO_VALUE ||
+            (text[i - TRUE_VALUE] != PROC_INPUT_CHAR && text[i - TRUE_VALUE] != PROC_OUTPUT_CHAR)))
+            return i + TRUE_VALUE;
+        if ((c == SUBST_START_CHAR || c == PROC_INPUT_CHAR || c == PROC_OUTPUT_CHAR) &&
+            text[i + TRUE_VALUE] == SUBST_OPEN_CHAR)
+            i = substitution_end(text, i);
+        else
+            i++;
+    }
+}
+
+/* ---
+Function Name: skip_blanks
+
+Purpose:
+    Moves the parser past spaces and tabs.
+
+Input:
+    None
+
+Output:
+    Updates comp.pos.
+--- */
+static void skip_blanks(void)
+{
+    while (comp.source[comp.pos] == SPACE_CHAR || comp.source[comp.pos] == TAB_CHAR)
+        comp.pos++;
+}
+
+/* ---
+Function Name: store_word
+
+Purpose:
+    Copies a word into the program's strings and word table.
+
+Input:
+    text, len - the word
+
+Output:
+    Returns 1, or 0 (recording the error) if the program is full.
+--- */
+static int store_word(const char *text, int len)
+{
+    if (comp.out->num_words == FLOW_MAX_WORDS || comp.out->strings_used + len + TRUE_VALUE > FLOW_STRINGS_LEN) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return ZERO_VALUE;
+    }
+
+    char *copy = comp.out->strings + comp.out->strings_used;
+    for (int i = ZERO_VALUE; i < len; i++) copy[i] = text[i];
+    copy[len] = NULL_CHAR;
+    comp.out->strings_used += len + TRUE_VALUE;
+    comp.out->words[comp.out->num_words++] = copy;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: add_list
+
+Purpose:
+    Records the words stored since 'first' as one list.
+
+Input:
+    first - index of the list's first word
+
+Output:
+    Returns the list's index, or -1 (recording the error) if full.
+--- */
+static int add_list(int first)
+{
+    if (comp.out->num_lists == FLOW_MAX_LISTS) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return ERROR_CODE;
+    }
+    comp.out->lists[comp.out->num_lists].first = first;
+    comp.out->lists[comp.out->num_lists].count = comp.out->num_words - first;
+    return comp.out->num_lists++;
+}
+
+/* ---
+Function Name: emit
+
+Purpose:
+    Appends an instruction. Jumps keep the frames open at this point.
+
+Input:
+    op     - operation
+    arg    - command or list index
+    target - jump target, or NO_TARGET until it is patched
+
+Output:
+    Returns the instruction's index (0 once the program is full, with
+    the error recorded).
+--- */
+static int emit(enum FlowOp op, int arg, int target)
+{
+    if (comp.out->code_len == FLOW_MAX_CODE) {
+        flow_failed(FLOW_ERROR, ERR_FLOW_TOO_LARGE);
+        return ZERO_VALUE;
+    }
+
+    FlowInstr *in = &comp.out->code[comp.out->code_len];
+    in->op = (unsigned char)op;
+    in->depth = (unsigned char)comp.depth;
+    in->arg = arg;
+    in->target = target;
+    return comp.out->code_len++;
+}
+
+/* ---
+Function Name: flow_failed
+
+Purpose:
+    Records the first failure of a compile.
+
+Input:
+    status - FLOW_ERROR or FLOW_INCOMPLETE
+    error  - ErrorCode to report for FLOW_ERROR
+
+Output:
+    Updates comp.status and comp.error.
+--- */
+static void flow_failed(int status, int error)
+{
+    if (comp.status != FLOW_OK) return;
+    comp.status = status;
+    comp.error = error;
+}
+
+/* ---
+Function Name: mark_library
+
+Purpose:
+    Records how full the library is before a compile.
+
+Input:
+    mark - receives the sizes
+
+Output:
+    None
+--- */
+static void mark_library(FlowMark *mark)
+{
+    mark->code_len = library.program.code_len;
+    mark->num_commands = library.program.num_commands;
+    mark->num_words = library.program.num_words;
+    mark->num_lists = library.program.num_lists;
+    mark->strings_used = library.program.strings_used;
+    mark->num_bodies = library.num_bodies;
+}
+
+/* ---
+Function Name: restore_library
+
+Purpose:
+    Drops the function bodies compiled since a mark. None of them is
+    bound to a name yet: that happens when their OP_DEFINE runs.
+
+Input:
+    mark - sizes from mark_library()
+
+Output:
+    None
+--- */
+static void restore_library(const FlowMark *mark)
+{
+    library.program.code_len = mark->code_len;
+    library.program.num_commands = mark->num_commands;
+    library.program.num_words = mark->num_words;
+    library.program.num_lists = mark->num_lists;
+    library.program.strings_used = mark->strings_used;
+    library.num_bodies = mark->num_bodies;
+}
+
+/* ---
+Function Name: save_table
+
+Purpose:
+    Writes the used part of a library table, preceded by its count.
+
+Input:
+    w     - snapshot writer
+    table - first element
+    count - elements in use
+    size  - bytes per element
+
+Output:
+    None
+--- */
+static void save_table(SnapWriter *w, const void *table, int count, int size)
+{
+    snap_write_int(w, count);
+    snap_write(w, table, (long long)count * size);
+}
+
+/* ---
+Function Name: load_table
+
+Purpose:
+    Reads a table written by save_table().
+
+Input:
+    r     - snapshot reader
+    table - first element
+    max   - elements it holds
+    size  - bytes per element
+
+Output:
+    The count, or -1 with the reader marked failed.
+--- */
+static int load_table(SnapReader *r, void *table, int max, int size)
+{
+    int count = snap_read_count(r, max);
+    if (count < ZERO_VALUE || !snap_read(r, table, (long long)count * size)) return ERROR_CODE;
+    return count;
+}
+
+/* ---
+Function Name: execute
+
+Purpose:
+    Runs instructions from 'pc' up to OP_HALT, or OP_RETURN in a
+    function. Frame depths in the code count from the frames open when
+    it starts, so a function body runs the same from any call; the
+    frames it opened are closed when it stops.
+
+Input:
+    program - the top-level program or the library
+    pc      - first instruction
+    envp    - environment variables
+
+Output:
+    None
+--- */
+static void execute(const FlowProgram *program, int pc, char *envp[])
+{
+    int base = vm.num_frames;
+    int running = TRUE_VALUE;
+
+    while (running) {
+        const FlowInstr *in = &program->code[pc++];
+        FlowFrame *frame;
+
+        switch (in->op) {
+        case OP_RUN:
+            run_flow_command(program, &program->commands[in->arg], envp);
+            running = !interrupted();
+            break;
+        case OP_JUMP:
+            drop_frames(base + in->depth);
+            pc = in->target;
+            running = !interrupted();
+            break;
+        case OP_JUMP_IF_FAILED:
+            if (last_exit_status != FLOW_SUCCESS_STATUS) pc = in->target;
+            break;
+        case OP_JUMP_IF_SUCCEEDED:
+            if (last_exit_status == FLOW_SUCCESS_STATUS) pc = in->target;
+            break;
+        case OP_SET_SUCCESS:
+            set_exit_status(FLOW_SUCCESS_STATUS);
+            break;
+        case OP_FOR_START:
+            running = push_frame(program, &program->lists[in->arg], FOR_NAME_WORDS, TRUE_VALUE, envp);
+            if (running) set_exit_status(FLOW_SUCCESS_STATUS);
+            break;
+        case OP_FOR_NEXT:
+            frame = &vm.frames[vm.num_frames - TRUE_VALUE];
+            if (frame->next == frame->count) {
+                pc = in->target;
+            } else if (!set_shell_variable(frame->name, frame->items[frame->next++], envp)) {
+                print_error(ERR_FLOW_TOO_LARGE);
+                set_exit_status(FLOW_FAILURE_STATUS);
+                running = ZERO_VALUE;
+            }
+            break;
+        case OP_CASE_START:
+            running = push_frame(program, &program->lists[in->arg], ZERO_VALUE, ZERO_VALUE, envp);
+            if (running) set_exit_status(FLOW_SUCCESS_STATUS);
+            break;
+        case OP_CASE_MATCH:
+            if (!case_matches(program, &program->lists[in->arg])) pc = in->target;
+            break;
+        case OP_POP_FRAME:
+            drop_frames(vm.num_frames - TRUE_VALUE);
+            break;
+        case OP_DEFINE:
+            define_function(&library.bodies[in->arg]);
+            break;
+        case OP_RETURN:
+            if (in->arg != RETURN_LAST_STATUS) return_status(program, &program->lists[in->arg], envp);
+            running = ZERO_VALUE;
+            break;
+        case OP_HALT:
+        default:
+            running = ZERO_VALUE;
+            break;
+        }
+    }
+    drop_frames(base);
+}
+
+/* ---
+Function Name: define_function
+
+Purpose:
+    Binds a function name to a compiled body, replacing any earlier
+    definition of the name.
+
+Input:
+    body - body in the library
+
+Output:
+    Sets $? to 0, or reports that the function table is full.
+--- */
+static void define_function(const FlowFunction *body)
+{
+    int index = find_function(body->name);
+    if (index == NO_FUNCTION) {
+        if (library.num_functions == FLOW_MAX_FUNCTIONS) {
+            print_error(ERR_FLOW_TOO_LARGE);
+            set_exit_status(FLOW_FAILURE_STATUS);
+            return;
+        }
+        index = library.num_functions++;
+    }
+    library.functions[index] = *body;
+    set_exit_status(FLOW_SUCCESS_STATUS);
+}
+
+/* ---
+Function Name: return_status
+
+Purpose:
+    Sets $? from the word after 'return' ('return $code' is expanded
+    when it runs).
+
+Input:
+    program - program the word belongs to
+    list    - the word
+    envp    - environment variables
+
+Output:
+    Sets $? to the number, modulo 256.
+--- */
+static void return_status(const FlowProgram *program, const FlowList *list, char *envp[])
+{
+    Command *words = &vm.words;
+    words->argv[ZERO_VALUE] = program->words[list->first];
+    words->argv[TRUE_VALUE] = NULL;
+    words->argc = TRUE_VALUE;
+
+    int status = FLOW_FAILURE_STATUS;
+    if (expand_variables(words, envp) && words->argc > ZERO_VALUE)
+        status = myatoi(words->argv[ZERO_VALUE]) & RETURN_STATUS_MASK;
+    free_all();
+    release_substitutions();
+    set_exit_status(status);
+}
+
+/* ---
+Function Name: can_exec_in_place
+
+Purpose:
+    Tells whether the last command of 'mysh -c' can replace the shell:
+    a single foreground program, run outside any compound command or
+    function, with nothing the shell would still have to do after it
+    (jobs to wait for or start, process substitutions, trace records,
+    stage prefixes).
+
+Input:
+    job - expanded job
+
+Output:
+    Non-zero if it can.
+--- */
+static int can_exec_in_place(Job *job)
+{
+    JobEntry *entries[MAX_JOBS];
+
+    return !vm.running && scope_depth() == ZERO_VALUE && job->num_stages == TRUE_VALUE && !job->background &&
+           job->num_pass_fds == ZERO_VALUE && job->in_fd == NO_FD && job->out_fd == NO_FD &&
+           !is_tuning_prefix(job->pipeline[ZERO_VALUE].argv) && !trace_enabled() &&
+           sched_queued_count() == ZERO_VALUE && collect_jobs(entries) == ZERO_VALUE;
+}
+
+/* ---
+Function Name: run_flow_command
+
+Purpose:
+    Builds the Job of a compiled command from its stored words and
+    runs it. Only patterns are expanded here; the words are not
+    tokenized again.
+
+Input:
+    program - program the command belongs to
+    command - compiled command
+    envp    - environment variables
+
+Output:
+    Runs the command (see run_command()).
+--- */
+static void run_flow_command(const FlowProgram *program, const FlowCommand *command, char *envp[])
+{
+    Job *job = &vm.job;
+    set_job(job);
+    job->background = command->background;
+    job->infile_path = command->infile_path;
+    job->outfile_path = command->outfile_path;
+
+    for (int s = ZERO_VALUE; s < command->num_stages; s++) {
+        Command *cmd = &job->pipeline[s];
+        const FlowList *list = &command->stages[s];
+        cmd->argc = ZERO_VALUE;
+
+        for (int i = ZERO_VALUE; i < list->count; i++) {
+            char *word = program->words[list->first + i];
+            if (has_glob_chars(word) && !has_substitution(word) && !has_process_substitution(word)) {
+                int added = expand_glob(cmd, word);
+                if (added > GLOB_NO_MATCH) continue;
+                if (added == GLOB_TOO_MANY) {
+                    print_error(ERR_ARG_EXCD);
+                    set_exit_status(FLOW_FAILURE_STATUS);
+                    free_all();
+                    return;
+                }
+            }
+            if (cmd->argc < MAX_ARGS) cmd->argv[cmd->argc++] = word;
+        }
+        cmd->argv[cmd->argc] = NULL;
+    }
+    job->num_stages = command->num_stages;
+
+    run_command(job, envp);
+
+    /* large $(...) outputs are not referenced once the command is done */
+    release_substitutions();
+}
+
+/* ---
+Function Name: push_frame
+
+Purpose:
+    Expands the words of a for list or a case word and keeps them, for
+    the length of the loop or case, in the interpreter's memory.
+
+Input:
+    program  - program the words belong to
+    list     - stored words
+    skip     - leading words that are not expanded (the for variable)
+    patterns - non-zero to expand pathname patterns
+    envp     - environment variables
+
+Output:
+    Pushes a frame; returns 0 (after reporting it) if the words do not
+    fit.
+--- */
+static int push_frame(const FlowProgram *program, const FlowList *list, int skip, int patterns, char *envp[])
+{
+    Command *words = &vm.words;
+    words->argc = ZERO_VALUE;
+
+    for (int i = skip; i < list->count; i++) {
+        char *word = program->words[list->first + i];
+        if (patterns && has_glob_chars(word) && !has_substitution(word)) {
+            int added = expand_glob(words, word);
+            if (added > GLOB_NO_MATCH) continue;
+            if (added == GLOB_TOO_MANY) words->argc = MAX_ARGS;
+        }
+        if (words->argc == MAX_ARGS) {
+            print_error(ERR_ARG_EXCD);
+            set_exit_status(FLOW_FAILURE_STATUS);
+            return ZERO_VALUE;
+        }
+        words->argv[words->argc++] = word;
+    }
+    words->argv[words->argc] = NULL;
+
+    int ok = expand_variables(words, envp);
+    FlowFrame *frame = &vm.frames[vm.num_frames];
+    frame->mark = vm.runtime_used;
+    frame->items = (char **)runtime_alloc(words->argc * (int)sizeof(char *));
+    for (int i = ZERO_VALUE; ok && frame->items && i < (int)words->argc; i++) {
+        int len = mystrlen(words->argv[i]);
+        frame->items[i] = runtime_alloc(len + TRUE_VALUE);
+        if (!frame->items[i]) ok = ZERO_VALUE;
+        else mystrcpy(frame->items[i], words->argv[i]);
+    }
+    free_all();
+    release_substitutions();
+
+    if (!ok || !frame->items) {
+        vm.runtime_used = frame->mark;
+        if (ok) print_error(ERR_FLOW_TOO_LARGE);
+        set_exit_status(FLOW_FAILURE_STATUS);
+        return ZERO_VALUE;
+    }
+    frame->count = words->argc;
+    frame->next = ZERO_VALUE;
+    frame->name = skip ? program->words[list->first] : NULL;
+    vm.num_frames++;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: case_matches
+
+Purpose:
+    Matches the word of the innermost case against a list of patterns.
+
+Input:
+    program  - program the patterns belong to
+    patterns - pattern list of one item
+
+Output:
+    Non-zero if any pattern matches.
+--- */
+static int case_matches(const FlowProgram *program, const FlowList *patterns)
+{
+    const FlowFrame *frame = &vm.frames[vm.num_frames - TRUE_VALUE];
+    const char *subject = frame->count > ZERO_VALUE ? frame->items[ZERO_VALUE] : EMPTY_STRING;
+
+    for (int i = ZERO_VALUE; i < patterns->count; i++) {
+        if (glob_match(program->words[patterns->first + i], subject)) return TRUE_VALUE;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: drop_frames
+
+Purpose:
+    Closes the frames above a depth, releasing their words.
+
+Input:
+    depth - frames to keep
+
+Output:
+    Updates vm.num_frames and vm.runtime_used.
+--- */
+static void drop_frames(int depth)
+{
+    if (depth >= vm.num_frames) return;
+    vm.runtime_used = vm.frames[depth].mark;
+    vm.num_frames = depth;
+}
+
+/* ---
+Function Name: runtime_alloc
+
+Purpose:
+    Allocates from the interpreter's memory, pointer-aligned.
+
+Input:
+    size - bytes
+
+Output:
+    The block, or NULL if it does not fit.
+--- */
+static char *runtime_alloc(int size)
+{
+    int start = (vm.runtime_used + (int)sizeof(char *) - TRUE_VALUE) & ~((int)sizeof(char *) - TRUE_VALUE);
+    if (start + size > FLOW_RUNTIME_LEN) return NULL;
+    vm.runtime_used = start + size;
+    return vm.runtime + start;
+}
+
+/* ---
+Function Name: interrupted
+
+Purpose:
+    Tells whether Ctrl+C should stop the program: it reached the shell,
+    or it killed the last command.
+
+Input:
+    None
+
+Output:
+    Non-zero to stop.
+--- */
+static int interrupted(void)
+{
+    return interrupt_pending || last_exit_status == FLOW_INTERRUPT_STATUS;
+}
@@ -0,0 +1,303 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include "jobs.h"
+#include "snapio.h"
+
+/* KEYWORDS */
+#define KEYWORD_IF              "if"
+#define KEYWORD_THEN            "then"
+#define KEYWORD_ELIF            "elif"
+#define KEYWORD_ELSE            "else"
+#define KEYWORD_FI              "fi"
+#define KEYWORD_WHILE           "while"
+#define KEYWORD_UNTIL           "until"
+#define KEYWORD_DO              "do"
+#define KEYWORD_DONE            "done"
+#define KEYWORD_FOR             "for"
+#define KEYWORD_IN              "in"
+#define KEYWORD_CASE            "case"
+#define KEYWORD_ESAC            "esac"
+#define KEYWORD_BREAK           "break"
+#define KEYWORD_CONTINUE        "continue"
+#define KEYWORD_RETURN          "return"
+#define KEYWORD_GROUP_OPEN      "{"
+#define KEYWORD_GROUP_CLOSE     "}"
+
+/* SYNTAX */
+#define COMMAND_SEPARATOR_CHAR  ';'
+#define LINE_SEPARATOR_CHAR     '\n'
+#define BACKGROUND_CHAR         '&'
+#define PATTERN_OPEN_CHAR       '('
+#define PATTERN_CLOSE_CHAR      ')'
+#define PATTERN_OR_CHAR         '|'
+#define SPACE_CHAR              ' '
+#define TAB_CHAR                '\t'
+#define CASE_END_LEN            2       /* ";;" */
+#define FUNCTION_OPEN_CHAR      '('
+#define FUNCTION_CLOSE_CHAR     ')'
+#define FUNCTION_PARENS_LEN     2       /* "()" */
+
+/* SIZES */
+#define FLOW_SOURCE_LEN         (1 << 16)
+#define FLOW_STRINGS_LEN        (1 << 17)
+#define FLOW_RUNTIME_LEN        (1 << 17)
+#define FLOW_MAX_CODE           4096
+#define FLOW_MAX_COMMANDS       1024
+#define FLOW_MAX_WORDS          8192
+#define FLOW_MAX_LISTS          512
+#define FLOW_MAX_LOOPS          32
+#define FLOW_MAX_PATCHES        256
+#define FLOW_MAX_FRAMES         32
+#define FLOW_MAX_FUNCTIONS      256
+
+/* COMPILE RESULTS */
+#define FLOW_OK                 0
+#define FLOW_INCOMPLETE         1
+#define FLOW_ERROR              2
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define NO_TARGET               (-1)
+#define FOR_NAME_WORDS          1       /* the variable precedes the words */
+#define FLOW_SUCCESS_STATUS     0
+#define FLOW_FAILURE_STATUS     1
+#define FLOW_INTERRUPT_STATUS   130     /* a command killed by Ctrl+C */
+#define NO_FUNCTION             (-1)
+#define RETURN_LAST_STATUS      (-1)    /* 'return' without a number */
+#define RETURN_STATUS_MASK      0xFF
+#define STOP_AT(word)           (1 << (word))
+
+/* WORDS THAT END OR START PART OF A COMPOUND COMMAND */
+enum FlowWord {
+    WORD_NONE,                  /* a plain command */
+    WORD_IF,
+    WORD_THEN,
+    WORD_ELIF,
+    WORD_ELSE,
+    WORD_FI,
+    WORD_WHILE,
+    WORD_UNTIL,
+    WORD_DO,
+    WORD_DONE,
+    WORD_FOR,
+    WORD_CASE,
+    WORD_ESAC,
+    WORD_BREAK,
+    WORD_CONTINUE,
+    WORD_RETURN,
+    WORD_GROUP_OPEN,            /* { */
+    WORD_GROUP_CLOSE,           /* } */
+    WORD_CASE_END,              /* ;; */
+    WORD_END                    /* end of the source */
+};
+
+typedef struct
+{
+    const char *text;
+    enum FlowWord word;
+} FlowKeyword;
+
+/* INSTRUCTIONS */
+enum FlowOp {
+    OP_RUN,                     /* run commands[arg] */
+    OP_JUMP,                    /* to target, leaving 'depth' frames */
+    OP_JUMP_IF_FAILED,          /* to target if $? is not 0 */
+    OP_JUMP_IF_SUCCEEDED,       /* to target if $? is 0 */
+    OP_SET_SUCCESS,             /* $? = 0 */
+    OP_FOR_START,               /* expand lists[arg], push a frame */
+    OP_FOR_NEXT,                /* set the variable to the next word, or jump to target */
+    OP_CASE_START,              /* expand the word lists[arg], push a frame */
+    OP_CASE_MATCH,              /* jump to target unless a pattern of lists[arg] matches */
+    OP_POP_FRAME,
+    OP_DEFINE,                  /* bind the name of library bodies[arg] to it */
+    OP_RETURN,                  /* end a function, $? from lists[arg] unless RETURN_LAST_STATUS */
+    OP_HALT
+};
+
+typedef struct
+{
+    unsigned char op;
+    unsigned char depth;        /* frames left after a jump */
+    int arg;
+    int target;
+} FlowInstr;
+
+/* A RUN OF WORDS IN THE PROGRAM'S WORD TABLE */
+typedef struct
+{
+    int first;
+    int count;
+} FlowList;
+
+/* A COMMAND, TOKENIZED ONCE WHEN THE PROGRAM IS COMPILED */
+typedef struct
+{
+    FlowList stages[MAX_PIPELINE_LEN];
+    int num_stages;
+    int background;
+    char *infile_path;
+    char *outfile_path;
+} FlowCommand;
+
+/* A COMPILED PROGRAM
+   Lives in static memory, apart from the heap that every command
+   clears, so loop bodies are parsed once however often they run. */
+typedef struct
+{
+    FlowInstr code[FLOW_MAX_CODE];
+    int code_len;
+    FlowCommand commands[FLOW_MAX_COMMANDS];
+    int num_commands;
+    char *words[FLOW_MAX_WORDS];
+    int num_words;
+    FlowList lists[FLOW_MAX_LISTS];
+    int num_lists;
+    char strings[FLOW_STRINGS_LEN];
+    int strings_used;
+    int ready;                  /* compiled and not yet run */
+} FlowProgram;
+
+/* A FUNCTION BODY IN THE LIBRARY */
+typedef struct
+{
+    const char *name;
+    int entry;                  /* first instruction */
+} FlowFunction;
+
+/* FUNCTION BODIES
+   Compiled into a program of their own that is never reset, so a
+   function is parsed once, where it is defined, and a call just jumps
+   into it. 'functions' holds the definitions that have been run, by
+   name; a redefinition points the name at the new body. */
+typedef struct
+{
+    FlowProgram program;
+    FlowFunction bodies[FLOW_MAX_FUNCTIONS];
+    int num_bodies;
+    FlowFunction functions[FLOW_MAX_FUNCTIONS];
+    int num_functions;
+} FlowLibrary;
+
+/* HOW FULL THE LIBRARY WAS BEFORE A COMPILE, TO UNDO IT */
+typedef struct
+{
+    int code_len;
+    int num_commands;
+    int num_words;
+    int num_lists;
+    int strings_used;
+    int num_bodies;
+} FlowMark;
+
+/* AN OPEN LOOP WHILE COMPILING */
+typedef struct
+{
+    int continue_target;
+    int depth;                  /* frames inside the loop */
+    int first_break;            /* its 'break' jumps in breaks[] */
+} FlowLoop;
+
+/* STATE OF THE COMPILER */
+typedef struct
+{
+    char source[FLOW_SOURCE_LEN];
+    int source_len;
+    int pos;
+    int status;
+    int error;                  /* ErrorCode to report */
+    int depth;                  /* frames open at the current instruction */
+    FlowProgram *out;           /* prog, or the library inside a function */
+    int in_function;
+    FlowMark library_mark;
+    FlowLoop loops[FLOW_MAX_LOOPS];
+    int num_loops;
+    int loop_base;              /* loops outside the function being compiled */
+    int patches[FLOW_MAX_PATCHES];  /* end jumps of open ifs and cases */
+    int num_patches;
+    int breaks[FLOW_MAX_PATCHES];   /* 'break' jumps of open loops */
+    int num_breaks;
+    Job parsed;
+} FlowCompiler;
+
+/* A 'for' OR 'case' BEING RUN */
+typedef struct
+{
+    char **items;               /* expanded words */
+    int count;
+    int next;
+    const char *name;           /* loop variable */
+    int mark;                   /* runtime bytes in use before the frame */
+} FlowFrame;
+
+/* STATE OF THE INTERPRETER */
+typedef struct
+{
+    FlowFrame frames[FLOW_MAX_FRAMES];
+    int num_frames;
+    char runtime[FLOW_RUNTIME_LEN];
+    int runtime_used;
+    int running;                /* run_flow() is in progress */
+    Job job;
+    Command words;
+} FlowRuntime;
+
+/* FUNCTION DECLARATIONS */
+int flow_starts(const char *line);
+void compile_flow(const char *line, int (*read_more)(char *buffer));
+int flow_pending(void);
+void run_flow(char *envp[]);
+void run_command(Job *job, char *envp[]);
+void set_exec_last(int enabled);
+int find_function(const char *name);
+int call_function(int index, char **argv, char *envp[]);
+void save_functions(SnapWriter *w);
+int load_functions(SnapReader *r);
+
+/* STATIC HELPER FUNCTIONS */
+static int compile_program(void);
+static int compile_list(int stops);
+static void compile_if(void);
+static void compile_while(enum FlowOp exit_op);
+static void compile_for(void);
+static void compile_case(void);
+static void compile_jump(enum FlowWord word);
+static void compile_function(void);
+static void compile_group(void);
+static void compile_return(void);
+static int definition_at(const char *text, int i, int *name_end);
+static void compile_command(void);
+static int compile_patterns(void);
+static enum FlowWord next_command_word(void);
+static enum FlowWord keyword_at(int i);
+static void consume_word(void);
+static int expect_keyword(enum FlowWord word);
+static int expect_in(void);
+static void expect_command_end(void);
+static int read_word(void);
+static int word_end(int i);
+static int command_end(int i);
+static void skip_blanks(void);
+static int store_word(const char *text, int len);
+static int add_list(int first);
+static int emit(enum FlowOp op, int arg, int target);
+static void flow_failed(int status, int error);
+static void mark_library(FlowMark *mark);
+static void restore_library(const FlowMark *mark);
+static void save_table(SnapWriter *w, const void *table, int count, int size);
+static int load_table(SnapReader *r, void *table, int max, int size);
+static void execute(const FlowProgram *program, int pc, char *envp[]);
+static void define_function(const FlowFunction *body);
+static void return_status(const FlowProgram *program, const FlowList *list, char *envp[]);
+static int can_exec_in_place(Job *job);
+static void run_flow_command(const FlowProgram *program, const FlowCommand *command, char *envp[]);
+static int push_frame(const FlowProgram *program, const FlowList *list, int skip, int patterns, char *envp[]);
+static int case_matches(const FlowProgram *program, const FlowList *patterns);
+static void drop_frames(int depth);
+static char *runtime_alloc(int size);
+static int interrupted(void);
+
+#endif
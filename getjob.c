@@ -2,9 +2,35 @@
 #include "mystring.h"
 #include "myheap.h"
 #include "errors.h"
+#include "trace.h"
+#include "history.h"
+#include "lineedit.h"
+#include "pathglob.h"
+#include "subst.h"
+#include "procsubst.h"
+#include "alias.h"
+#include "flow.h"
 
 #include <unistd.h>    // fork, pipe, dup2, execve, read, write, _exit
 #include <sys/wait.h>  // waitpid
+#include <poll.h>      // poll
+#include <errno.h>
+
+/* Optional event source serviced while waiting for input */
+static int wakeup_fd = ERROR_CODE;
+static void (*wakeup_handler)(void) = NULL;
+
+/* Set when a stage cannot be parsed (e.g. a pattern with too many matches) */
+static int parse_failed = ZERO_VALUE;
+
+/* Cleared while if/while/for/case bodies are compiled */
+static int expand_patterns = TRUE_VALUE;
+
+/* A script being read instead of standard input: the rc file, or the
+   command string of 'mysh -c' */
+static int script_fd = NO_SCRIPT;
+static const char *script_text = NULL;
+static int script_pos = ZERO_VALUE;
 
 /* ---
 Function Name: get_job
@@ -23,25 +49,285 @@ Input:
 Output:
   Populates the Job structure with parsed command stages, background 
   execution flag, and resets file redirection paths. The number of 
-  stages is stored in job->num_stages.
+  stages is stored in job->num_stages. The line is read, and its
+  history events expanded, by read_command_line(). A line starting with
+  if, while, until, for or case is compiled by compile_flow() instead
+  and leaves job->num_stages at 0 (see flow_pending()).
+  Returns 0 once standard input is exhausted, 1 otherwise (including
+  for blank lines, which leave job->num_stages at 0).
 --- */
-void get_job(Job *job)
+int get_job(Job *job)
 {
     set_job(job);
-    write(STDOUT_FILENO, SHELL, mystrlen(SHELL));
 
-    char *command_buffer = alloc(MAX_ARGS);
-    if (!command_buffer) return;
+    /* not on the heap: a wakeup handler may reset it while we read */
+    char command_buffer[MAX_ARGS];
 
-    int bytes_read = read_line_from_stdin(command_buffer, MAX_ARGS);
-    if (bytes_read <= ZERO_VALUE) return;
+    int at_eof = ZERO_VALUE;
+    int bytes_read = read_command_line(SHELL, command_buffer, &at_eof);
+    if (bytes_read < ZERO_VALUE) return TRUE_VALUE;
+    if (bytes_read == ZERO_VALUE) return !at_eof;
+
+    /* if, while, until, for and case are compiled, with the lines that
+       complete them, into a program that main() runs */
+    if (flow_starts(command_buffer)) {
+        compile_flow(command_buffer, read_continuation_line);
+        return TRUE_VALUE;
+    }
+
+    long long parse_start = trace_now();
+    parse_job_line(job, command_buffer);
+    trace_parse_done(trace_now() - parse_start);
+    return TRUE_VALUE;
+}
+
+
+/* ---
+Function Name: read_continuation_line
+
+Purpose:
+    Reads the next line of an unfinished if, while, for or case, with
+    the continuation prompt.
+
+Input:
+    buffer - destination, MAX_ARGS bytes
+
+Output:
+    Returns 1 with the line in buffer (possibly blank), 0 once standard
+    input is exhausted, or -1 if the line was cancelled (Ctrl+C) or its
+    history events could not be expanded.
+--- */
+int read_continuation_line(char *buffer)
+{
+    int at_eof = ZERO_VALUE;
+    int bytes_read = read_command_line(CONTINUATION_PROMPT, buffer, &at_eof);
+    if (bytes_read < ZERO_VALUE) return ERROR_CODE;
+    if (bytes_read == ZERO_VALUE) {
+        buffer[ZERO_VALUE] = NULL_CHAR;
+        return !at_eof;
+    }
+    return TRUE_VALUE;
+}
+
+
+/* ---
+Function Name: set_pattern_expansion
+
+Purpose:
+    Turns pathname pattern expansion in parse_job_line() off or on. The
+    compiler of if/while/for/case parses commands once and expands
+    their patterns each time they run.
+
+Input:
+    enabled - 0 to keep pattern words as they are
+
+Output:
+    Stores the setting.
+--- */
+void set_pattern_expansion(int enabled)
+{
+    expand_patterns = enabled;
+}
+
+
+/* ---
+Function Name: set_script_input
+
+Purpose:
+    Makes get_job() read command lines from a script (the rc file)
+    instead of standard input, or switches it back.
+
+Input:
+    fd - open script, or NO_SCRIPT for standard input
+
+Output:
+    Stores the setting.
+--- */
+void set_script_input(int fd)
+{
+    script_fd = fd;
+}
+
+
+/* ---
+Function Name: set_script_text
+
+Purpose:
+    Makes get_job() read command lines from a string ('mysh -c'), or
+    switches back to standard input.
+
+Input:
+    text - the commands, one per line, or NULL
+
+Output:
+    Stores the setting; reading starts at the first line.
+--- */
+void set_script_text(const char *text)
+{
+    script_text = text;
+    script_pos = ZERO_VALUE;
+}
+
+
+/* ---
+Function Name: script_text_finished
+
+Purpose:
+    Tells whether the line just read was the last one of the string set
+    by set_script_text(), so the command on it is the shell's last.
+
+Input:
+    None
+
+Output:
+    Non-zero if nothing but blank lines is left of the string; 0 if
+    more remains or no string is being read.
+--- */
+int script_text_finished(void)
+{
+    if (!script_text) return ZERO_VALUE;
+    int i = script_pos;
+    while (script_text[i] == SPACE_CHAR || script_text[i] == TAB_CHAR || script_text[i] == NEWLINE_CHAR) i++;
+    return script_text[i] == NULL_CHAR;
+}
+
+
+/* ---
+Function Name: read_command_line
+
+Purpose:
+    Reads one line after printing prompt. On a terminal the line is
+    read with the line editor (see edit_line()), its history events are
+    expanded (and the result echoed) and it is added to history. Lines
+    piped or redirected in are neither expanded nor recorded, and lines
+    of a script set by set_script_input() or set_script_text() also get
+    no prompt.
+
+Input:
+    prompt - prompt to print
+    buffer - destination, MAX_ARGS bytes
+    at_eof - set to 1 once standard input is exhausted
+
+Output:
+    Returns the length of the line, 0 for a blank line or at the end of
+    input, or -1 if it could not be read or expanded.
+--- */
+static int read_command_line(const char *prompt, char *buffer, int *at_eof)
+{
+    if (script_fd != NO_SCRIPT || script_text) return read_line_from_input(buffer, MAX_ARGS, at_eof);
+
+    /* terminals get the line editor; scripts and pipes the plain reader */
+    int bytes_read = EDIT_UNAVAILABLE;
+    if (isatty(STDIN_FILENO))
+        bytes_read = edit_line(prompt, buffer, MAX_ARGS, at_eof, wait_for_input);
+    if (bytes_read == EDIT_UNAVAILABLE) {
+        write(STDOUT_FILENO, prompt, mystrlen(prompt));
+        bytes_read = read_line_from_input(buffer, MAX_ARGS, at_eof);
+    }
+    if (bytes_read <= ZERO_VALUE || !isatty(STDIN_FILENO)) return bytes_read;
+
+    /* !!, !n and !prefix are replaced before the line is recorded; like
+       sh, only for typed lines, so a '!' in piped input stays as it is */
+    char expanded[MAX_ARGS];
+    int expand_result = history_expand(buffer, expanded, MAX_ARGS);
+    if (expand_result == EXPAND_FAILED) {
+        print_error(ERR_HISTORY_EVENT);
+        return ERROR_CODE;
+    }
+    if (expand_result == EXPAND_DONE) {
+        mystrcpy(buffer, expanded);
+        write(STDOUT_FILENO, buffer, mystrlen(buffer));
+        write(STDOUT_FILENO, NEWLINE_TEXT, mystrlen(NEWLINE_TEXT));
+    }
+    history_add(buffer);
+    return mystrlen(buffer);
+}
+
+
+/* ---
+Function Name: parse_job_line
+
+Purpose:
+    Parses one complete command line (already read into memory) into the
+    provided Job structure. This is the parsing half of get_job() and is
+    usable on lines that did not come from standard input.
+
+Input:
+    job  - pointer to a Job structure to populate
+    line - null-terminated, writable command line; modified in place
+
+Output:
+    Resets and populates job. Blank lines, and lines with an error that
+    has been reported, leave job->num_stages at 0.
+--- */
+void parse_job_line(Job *job, char *line)
+{
+    set_job(job);
+    parse_failed = ZERO_VALUE;
+
+    normalize_newlines(line);
+    int start = skip_leading_whitespace(line);
+    if (line[start] == NULL_CHAR) return;
+
+    handle_background(job, line);
+    start = handle_queue_prefix(job, line, start);
+    parse_pipeline(job, line, start);
+    if (parse_failed) set_job(job);
+}
+
+
+/* ---
+Function Name: set_input_wakeup
+
+Purpose:
+    Registers a file descriptor to watch while the shell waits for a
+    command line. When it becomes readable the handler runs, then the
+    shell keeps waiting; the handler is expected to drain the descriptor.
+    Used by the job scheduler to start queued jobs while idle.
+
+Input:
+    fd      - descriptor to watch, or -1 to disable
+    handler - function called when fd is readable
+
+Output:
+    Stores the wakeup source.
+--- */
+void set_input_wakeup(int fd, void (*handler)(void))
+{
+    wakeup_fd = fd;
+    wakeup_handler = handler;
+}
+
+
+/* ---
+Function Name: handle_queue_prefix
+
+Purpose:
+    Detects the 'queue' keyword in front of a command, which submits the
+    whole pipeline to the job scheduler like a trailing '&'.
+
+Input:
+    job    - pointer to Job structure
+    buffer - command buffer
+    start  - index of the first non-blank character
 
-    normalize_newlines(command_buffer);
-    int start = skip_leading_whitespace(command_buffer);
-    if (command_buffer[start] == NULL_CHAR) return;
+Output:
+    Sets job->background and returns the index of the command after the
+    keyword, or start if there is no keyword.
+--- */
+static int handle_queue_prefix(Job *job, char *buffer, int start)
+{
+    for (int i = ZERO_VALUE; i < QUEUE_KEYWORD_LEN; i++) {
+        if (buffer[start + i] != QUEUE_KEYWORD[i]) return start;
+    }
+
+    int i = start + QUEUE_KEYWORD_LEN;
+    if (buffer[i] != SPACE_CHAR && buffer[i] != TAB_CHAR) return start;
+    while (buffer[i] == SPACE_CHAR || buffer[i] == TAB_CHAR) i++;
+    if (buffer[i] == NULL_CHAR) return start;
 
-    handle_background(job, command_buffer);
-    parse_pipeline(job, command_buffer, start);
+    job->background = TRUE_VALUE;
+    return i;
 }
 
 
@@ -152,6 +438,12 @@ static void parse_pipeline(Job *job, char *buffer, int start)
     for (int i = start;; i++) {
         char c = buffer[i];
 
+        /* a '|' inside $(...), <(...) or >(...) belongs to the inner command */
+        if (starts_substitution(buffer, i)) {
+            i = substitution_end(buffer, i) - TRUE_VALUE;
+            continue;
+        }
+
         if (c == PIPE_CHAR || c == NULL_CHAR) {
             buffer[i] = NULL_CHAR;
 
@@ -178,7 +470,12 @@ Function Name: parse_stage
 Purpose:
     Tokenizes a single stage of a pipeline command into arguments,
     input/output redirection. Uses helper functions to handle each
-    type of token.
+    type of token. A "$(...)", "<(...)" or ">(...)" stays in one token,
+    blanks included; it is run later by expand_variables() or
+    expand_process_substitutions(). '<&N' and '>&N' (or '< &N') name
+    an open descriptor: the path is kept as "&N" and resolved after
+    expansion by expand_redirections(). An alias in the command's
+    place is replaced by its words (see expand_alias()).
     
 Input:
     cmd - pointer to Command structure
@@ -198,7 +495,12 @@ void parse_stage(Command *cmd, char *stage_str, Job *job)
         if (stage_str[i] == NULL_CHAR) break;
 
         int start = i;
-        while (stage_str[i] != SPACE_CHAR && stage_str[i] != TAB_CHAR && stage_str[i] != NULL_CHAR) i++;
+        while (stage_str[i] != SPACE_CHAR && stage_str[i] != TAB_CHAR && stage_str[i] != NULL_CHAR) {
+            if (starts_substitution(stage_str, i))
+                i = substitution_end(stage_str, i);
+            else
+                i++;
+        }
 
         int tok_len = i - start;
         char *token = alloc(tok_len + TRUE_VALUE);
@@ -209,7 +511,11 @@ void parse_stage(Command *cmd, char *stage_str, Job *job)
             parse_input_redirection(job, stage_str, &i);
         } else if (mystrcmp(token, TOKEN_OUTPUT) == ZERO_VALUE) {
             parse_output_redirection(job, stage_str, &i);
-        } else {
+        } else if (token[ZERO_VALUE] == INPUT_REDIRECT_CHAR && token[TRUE_VALUE] == FD_REDIRECT_CHAR) {
+            job->infile_path = token + TRUE_VALUE;
+        } else if (token[ZERO_VALUE] == OUTPUT_REDIRECT_CHAR && token[TRUE_VALUE] == FD_REDIRECT_CHAR) {
+            job->outfile_path = token + TRUE_VALUE;
+        } else if (cmd->argc != ZERO_VALUE || !expand_alias(cmd, token, ZERO_VALUE)) {
             parse_argument(cmd, token);
         }
 
@@ -220,22 +526,77 @@ void parse_stage(Command *cmd, char *stage_str, Job *job)
 }
 
 
+/* ---
+Function Name: expand_alias
+
+Purpose:
+    Puts the words of an alias in place of a stage's first word. The
+    words were split when the alias was defined, so nothing is
+    tokenized here; patterns among them are still expanded. An alias
+    whose first word is another alias is expanded in turn, but an
+    alias already being expanded is not ('alias ls=ls -F').
+
+Input:
+    cmd   - stage being parsed, with no arguments yet
+    name  - the first word
+    depth - aliases already being expanded
+
+Output:
+    Returns 1 if the word was an alias and its words were added, 0 if
+    it is to be taken as it is.
+--- */
+static int expand_alias(Command *cmd, const char *name, int depth)
+{
+    static const Alias *expanding[ALIAS_MAX_DEPTH];
+
+    const Alias *alias = find_alias(name);
+    if (!alias || depth == ALIAS_MAX_DEPTH) return ZERO_VALUE;
+    for (int k = ZERO_VALUE; k < depth; k++) {
+        if (expanding[k] == alias) return ZERO_VALUE;
+    }
+    expanding[depth] = alias;
+
+    for (int w = ZERO_VALUE; w < alias->num_words; w++) {
+        char *word = alias->words[w];
+        if (w != ZERO_VALUE || !expand_alias(cmd, word, depth + TRUE_VALUE))
+            parse_argument(cmd, word);
+    }
+    return TRUE_VALUE;
+}
+
 /* ---
 Function Name: parse_argument
 
 Purpose:
-    Adds a normal argument token to the Command structure.
+    Adds a normal argument token to the Command structure. A token with
+    pattern characters is replaced by the sorted paths it matches, or
+    kept as it is if nothing matches.
     
 Input:
     cmd - pointer to Command structure
     token - argument string
     
 Output:
-    Updates cmd->argv and cmd->argc
+    Updates cmd->argv and cmd->argc; reports ERR_ARG_EXCD and fails the
+    line if the arguments do not fit.
 --- */
 static void parse_argument(Command *cmd, char *token)
 {
-    cmd->argv[cmd->argc++] = token;
+    if (parse_failed) return;
+
+    /* patterns inside $(...), <(...) and >(...) are for the inner command */
+    if (expand_patterns && has_glob_chars(token) && !has_substitution(token) &&
+        !has_process_substitution(token)) {
+        int added = expand_glob(cmd, token);
+        if (added > GLOB_NO_MATCH) return;
+        if (added == GLOB_TOO_MANY) {
+            print_error(ERR_ARG_EXCD);
+            parse_failed = TRUE_VALUE;
+            return;
+        }
+    }
+
+    if (cmd->argc < MAX_ARGS) cmd->argv[cmd->argc++] = token;
 }
 
 /* ---
@@ -256,7 +617,10 @@ static void parse_input_redirection(Job *job, char *stage_str, int *i)
 {
     while (stage_str[*i] == SPACE_CHAR || stage_str[*i] == TAB_CHAR) (*i)++;
     int start = *i;
-    while (stage_str[*i] != SPACE_CHAR && stage_str[*i] != TAB_CHAR && stage_str[*i] != NULL_CHAR) (*i)++;
+    while (stage_str[*i] != SPACE_CHAR && stage_str[*i] != TAB_CHAR && stage_str[*i] != NULL_CHAR) {
+        if (starts_substitution(stage_str, *i)) *i = substitution_end(stage_str, *i);
+        else (*i)++;
+    }
     int len = *i - start;
     char *path = alloc(len + TRUE_VALUE);
     for (int j = ZERO_VALUE; j < len; j++) path[j] = stage_str[start + j];
@@ -284,7 +648,10 @@ static void parse_output_redirection(Job *job, char *stage_str, int *i)
 {
     while (stage_str[*i] == SPACE_CHAR || stage_str[*i] == TAB_CHAR) (*i)++;
     int start = *i;
-    while (stage_str[*i] != SPACE_CHAR && stage_str[*i] != TAB_CHAR && stage_str[*i] != NULL_CHAR) (*i)++;
+    while (stage_str[*i] != SPACE_CHAR && stage_str[*i] != TAB_CHAR && stage_str[*i] != NULL_CHAR) {
+        if (starts_substitution(stage_str, *i)) *i = substitution_end(stage_str, *i);
+        else (*i)++;
+    }
     int len = *i - start;
     char *path = alloc(len + TRUE_VALUE);
     for (int j = ZERO_VALUE; j < len; j++) path[j] = stage_str[start + j];
@@ -295,6 +662,28 @@ static void parse_output_redirection(Job *job, char *stage_str, int *i)
 }
 
 
+/* ---
+Function Name: starts_substitution
+
+Purpose:
+    Checks whether a "$(", "<(" or ">(" starts at text[i], so the
+    tokenizer keeps the whole substitution in one word.
+
+Input:
+    text - command text
+    i    - index to check
+
+Output:
+    Non-zero if a substitution starts there.
+--- */
+static int starts_substitution(const char *text, int i)
+{
+    char c = text[i];
+    return (c == SUBST_START_CHAR || c == PROC_INPUT_CHAR || c == PROC_OUTPUT_CHAR) &&
+           text[i + TRUE_VALUE] == SUBST_OPEN_CHAR;
+}
+
+
 /* --- 
 Function Name: set_job
 
@@ -313,6 +702,9 @@ void set_job(Job *job)
     job->background = ZERO_VALUE;
     job->infile_path = NULL;
     job->outfile_path = NULL;
+    job->in_fd = NO_FD;
+    job->out_fd = NO_FD;
+    job->num_pass_fds = ZERO_VALUE;
 }
 
 /* --- 
@@ -343,28 +735,46 @@ int check_read_status(int bytes_read)
     return exit_status;
 }
 /* ---
-Function Name: read_line_from_stdin
+Function Name: read_line_from_input
 
 Purpose:
-    Reads one line from stdin (up to newline or EOF) using system calls only.
+    Reads one line from stdin, or from the script set by
+    set_script_input() or set_script_text(), (up to newline or EOF)
+    using system calls only.
     
 Input:
     buffer - destination buffer
     maxlen - maximum bytes to read (including null terminator)
+    at_eof - set to 1 when end of input is reached before a newline
     
 Output:
     Returns number of bytes read (excluding null terminator), 
-    0 on EOF, or -1 on error.
+    0 on EOF or blank line, or -1 on error.
 --- */
-static int read_line_from_stdin(char *buffer, int maxlen)
+static int read_line_from_input(char *buffer, int maxlen, int *at_eof)
 {
     int total = ZERO_VALUE;
+    int fd = script_fd != NO_SCRIPT ? script_fd : STDIN_FILENO;
     char c;
 
+    if (script_text) {
+        while ((c = script_text[script_pos]) != NULL_CHAR && c != NEWLINE_CHAR && total < maxlen - TRUE_VALUE) {
+            buffer[total++] = c;
+            script_pos++;
+        }
+        if (c == NEWLINE_CHAR) script_pos++;
+        if (c == NULL_CHAR) *at_eof = TRUE_VALUE;
+        buffer[total] = NULL_CHAR;
+        return total;
+    }
+
+    if (script_fd == NO_SCRIPT) wait_for_input();
+
     while (total < maxlen - TRUE_VALUE) {
-        int n = read(STDIN_FILENO, &c, READ_BYTE_COUNT);
+        int n = read(fd, &c, READ_BYTE_COUNT);
 
         if (n == ZERO_VALUE) {
+            *at_eof = TRUE_VALUE;
             break;
         } else if (n < ZERO_VALUE) {
             return ERROR_CODE;
@@ -378,3 +788,38 @@ static int read_line_from_stdin(char *buffer, int maxlen)
     buffer[total] = NULL_CHAR;
     return total;
 }
+
+
+/* ---
+Function Name: wait_for_input
+
+Purpose:
+    Blocks until standard input is readable, servicing the registered
+    wakeup descriptor in the meantime. Returns at once if none is set.
+
+Input:
+    None
+
+Output:
+    Calls the wakeup handler each time its descriptor becomes readable.
+--- */
+static void wait_for_input(void)
+{
+    if (wakeup_fd < ZERO_VALUE || !wakeup_handler) return;
+
+    struct pollfd fds[POLL_FD_COUNT] = {
+        { STDIN_FILENO, POLLIN, ZERO_VALUE },
+        { wakeup_fd, POLLIN, ZERO_VALUE }
+    };
+
+    for (;;) {
+        if (poll(fds, POLL_FD_COUNT, NO_TIMEOUT) < ZERO_VALUE) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[TRUE_VALUE].revents & POLLIN)
+            wakeup_handler();
+        if (fds[ZERO_VALUE].revents)
+            return;
+    }
+}
@@ -17,28 +17,49 @@
 /* TOKEN CONSTANTS */
 #define TOKEN_INPUT             "<"
 #define TOKEN_OUTPUT            ">"
+#define NEWLINE_TEXT            "\n"
+#define CONTINUATION_PROMPT     "> "
 
 /* NUMERIC CONSTANTS */
 #define ZERO_VALUE              0
 #define TRUE_VALUE              1
 #define ERROR_CODE              -1
 #define READ_BYTE_COUNT         1
+#define POLL_FD_COUNT           2
+#define NO_TIMEOUT              -1
+#define NO_SCRIPT               -1
+
+/* KEYWORD CONSTANTS */
+#define QUEUE_KEYWORD           "queue"
+#define QUEUE_KEYWORD_LEN       5
 
 /* FUNCTION DECLARATIONS */
-void get_job(Job *job);
+int get_job(Job *job);
+void parse_job_line(Job *job, char *line);
+void set_input_wakeup(int fd, void (*handler)(void));
 void set_job(Job *job);
 int check_read_status(int bytes_read);
 void parse_stage(Command *cmd, char *stage_str, Job *job);
+int read_continuation_line(char *buffer);
+void set_pattern_expansion(int enabled);
+void set_script_input(int fd);
+void set_script_text(const char *text);
+int script_text_finished(void);
 
 /* STATIC HELPER FUNCTIONS */
 static void parse_argument(Command *cmd, char *token);
+static int expand_alias(Command *cmd, const char *name, int depth);
 static void parse_input_redirection(Job *job, char *stage_str, int *i);
 static void parse_output_redirection(Job *job, char *stage_str, int *i);
 static void handle_background(Job *job, char *buffer);
+static int handle_queue_prefix(Job *job, char *buffer, int start);
 static void parse_pipeline(Job *job, char *buffer, int start);
 static void normalize_newlines(char *buffer);
 static void trim_newline(char *buffer, int bytes_read);
 static int skip_leading_whitespace(char *buffer);
-static int read_line_from_stdin(char *buffer, int maxlen);
+static int read_line_from_input(char *buffer, int maxlen, int *at_eof);
+static void wait_for_input(void);
+static int read_command_line(const char *prompt, char *buffer, int *at_eof);
+static int starts_substitution(const char *text, int i);
 
 #endif
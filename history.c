@@ -0,0 +1,650 @@
+#define _GNU_SOURCE    /* memmem */
+#include "history.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* write, pwrite, ftruncate, isatty */
+#include <fcntl.h>        /* open */
+#include <string.h>       /* memchr, memmem, memcpy */
+#include <sys/mman.h>     /* mmap */
+#include <sys/stat.h>     /* fstat */
+#include <sys/file.h>     /* flock */
+#include <sys/uio.h>      /* writev */
+
+static HistoryLog hist = { .data_fd = ERROR_CODE, .index_fd = ERROR_CODE };
+
+/* ---
+Function Name: history_init
+
+Purpose:
+    Opens and maps the history log. The log is $MYSH_HISTFILE, or
+    ~/.mysh_history for an interactive shell. A shell reading a pipe
+    or file maps $MYSH_HISTFILE for 'history' but adds nothing to it
+    (see read_command_line()). Startup only maps the two
+    files, so it takes the same time for ten entries or ten million.
+    The index is rebuilt from the log only if the two disagree (e.g.
+    after a crash between the two appends), and the log is compacted if
+    it has grown well past $MYSH_HISTSIZE entries (default 1000000).
+
+Input:
+    envp - environment variables
+
+Output:
+    Enables history, or leaves it disabled if the files cannot be used.
+--- */
+void history_init(char *envp[])
+{
+    char *file = mygetenv(HISTFILE_ENV_NAME, envp);
+    char *size = mygetenv(HISTSIZE_ENV_NAME, envp);
+
+    hist.histsize = DEFAULT_HISTSIZE;
+    if (size) {
+        int used;
+        long n = parse_event_number(size, &used);
+        if (used > ZERO_VALUE && size[used] == NULL_CHAR) hist.histsize = n;
+    }
+    if (hist.histsize == ZERO_VALUE) return;
+
+    if (file) {
+        if (mystrlen(file) + mystrlen(HISTORY_INDEX_SUFFIX) >= HISTORY_PATH_LEN) return;
+        mystrcpy(hist.path, file);
+    } else {
+        char *home = mygetenv(HOME_DIR_ENV_NAME, envp);
+        if (!isatty(STDIN_FILENO) || !home) return;
+        if (mystrlen(home) + mystrlen(HISTORY_FILE_NAME) + mystrlen(HISTORY_INDEX_SUFFIX) >= HISTORY_PATH_LEN)
+            return;
+        mystrcpy(hist.path, home);
+        mystrcat(hist.path, HISTORY_FILE_NAME);
+    }
+    mystrcpy(hist.index_path, hist.path);
+    mystrcat(hist.index_path, HISTORY_INDEX_SUFFIX);
+
+    if (!open_history_files()) return;
+
+    flock(hist.data_fd, LOCK_EX);
+    map_history();
+    int usable = history_is_consistent() || rebuild_index();
+    flock(hist.data_fd, LOCK_UN);
+    if (!usable) {
+        unmap_history();
+        close(hist.data_fd);
+        close(hist.index_fd);
+        return;
+    }
+
+    hist.enabled = TRUE_VALUE;
+    if (hist.count > hist.histsize + hist.histsize / COMPACT_SLACK_DIVISOR)
+        history_compact();
+}
+
+/* ---
+Function Name: history_add
+
+Purpose:
+    Appends a command line to the log and its offset to the index.
+    Both appends happen under an exclusive flock(), so several shells
+    can share one history file.
+
+Input:
+    line - command line, without a trailing newline
+
+Output:
+    Records the line unless history is disabled or the line is blank.
+--- */
+void history_add(const char *line)
+{
+    if (!hist.enabled) return;
+
+    int i = ZERO_VALUE;
+    while (line[i] == SPACE_CHAR || line[i] == TAB_CHAR) i++;
+    if (line[i] == NULL_CHAR) return;
+
+    char newline = NEWLINE_CHAR;
+    struct iovec parts[] = {
+        { (void *)line, mystrlen(line) },
+        { &newline, sizeof(newline) }
+    };
+
+    flock(hist.data_fd, LOCK_EX);
+    struct stat st;
+    if (fstat(hist.data_fd, &st) == ZERO_VALUE) {
+        uint64_t offset = (uint64_t)st.st_size;
+        if (writev(hist.data_fd, parts, sizeof(parts) / sizeof(parts[ZERO_VALUE])) > ZERO_VALUE)
+            write_all(hist.index_fd, (const char *)&offset, sizeof(offset));
+    }
+    flock(hist.data_fd, LOCK_UN);
+
+    refresh_history();
+    if (hist.count > hist.histsize + hist.histsize / COMPACT_SLACK_DIVISOR)
+        history_compact();
+}
+
+/* ---
+Function Name: history_count
+
+Purpose:
+    Returns the number of history entries; entries are numbered from 1.
+
+Input:
+    None
+
+Output:
+    Entry count (0 when history is disabled).
+--- */
+long history_count(void)
+{
+    return hist.enabled ? hist.count : ZERO_VALUE;
+}
+
+/* ---
+Function Name: history_entry
+
+Purpose:
+    Looks up one entry through the index, without copying it.
+
+Input:
+    n   - entry number, 1 to history_count()
+    len - receives the entry length
+
+Output:
+    Pointer into the mapped log (not null-terminated), or NULL if n is
+    out of range.
+--- */
+const char *history_entry(long n, int *len)
+{
+    if (!hist.enabled || n < TRUE_VALUE || n > hist.count) return NULL;
+
+    uint64_t start = hist.offsets[n - TRUE_VALUE];
+    if (start >= hist.data_len) return NULL;
+
+    const char *text = hist.data + start;
+    const char *end = memchr(text, NEWLINE_CHAR, hist.data_len - start);
+    *len = end ? (int)(end - text) : (int)(hist.data_len - start);
+    return text;
+}
+
+/* ---
+Function Name: history_find_prefix
+
+Purpose:
+    Finds the newest entry older than 'before' that starts with prefix
+    ('!prefix').
+
+Input:
+    prefix - text the entry must start with
+    before - search entries numbered below this (history_count() + 1
+             searches them all)
+
+Output:
+    Entry number, or NO_ENTRY.
+--- */
+long history_find_prefix(const char *prefix, long before)
+{
+    int plen = mystrlen(prefix);
+    if (before > history_count() + TRUE_VALUE) before = history_count() + TRUE_VALUE;
+
+    for (long n = before - TRUE_VALUE; n >= TRUE_VALUE; n--) {
+        int len;
+        const char *text = history_entry(n, &len);
+        if (text && len >= plen && memcmp(text, prefix, plen) == ZERO_VALUE) return n;
+    }
+    return NO_ENTRY;
+}
+
+/* ---
+Function Name: history_find_substring
+
+Purpose:
+    Finds the newest entry older than 'before' that contains text, for
+    incremental (Ctrl-R style) search; call again with the result to
+    step to older matches.
+
+Input:
+    text   - text to look for
+    before - search entries numbered below this (history_count() + 1
+             searches them all)
+
+Output:
+    Entry number, or NO_ENTRY.
+--- */
+long history_find_substring(const char *text, long before)
+{
+    int tlen = mystrlen(text);
+    if (before > history_count() + TRUE_VALUE) before = history_count() + TRUE_VALUE;
+
+    for (long n = before - TRUE_VALUE; n >= TRUE_VALUE; n--) {
+        int len;
+        const char *entry = history_entry(n, &len);
+        if (entry && memmem(entry, len, text, tlen)) return n;
+    }
+    return NO_ENTRY;
+}
+
+/* ---
+Function Name: history_expand
+
+Purpose:
+    Replaces history events in a command line:
+      !!        the previous command
+      !n        entry n
+      !-n       the n-th previous command
+      !prefix   the newest command starting with prefix
+    A '!' followed by a blank, '=' or the end of the line is literal.
+
+Input:
+    line   - command line
+    out    - output buffer
+    outlen - size of out
+
+Output:
+    EXPAND_NONE if line has no events or history is disabled,
+    EXPAND_DONE with the expanded line in out, or EXPAND_FAILED if an
+    event does not exist or the result does not fit.
+--- */
+int history_expand(const char *line, char *out, int outlen)
+{
+    if (!hist.enabled) return EXPAND_NONE;
+
+    int o = ZERO_VALUE;
+    int expanded = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; line[i] != NULL_CHAR;) {
+        int end;
+        long n = (line[i] == HISTORY_EXPAND_CHAR) ? find_event(line, i, &end) : ERROR_CODE;
+
+        if (n == ERROR_CODE) {
+            if (o + TRUE_VALUE >= outlen) return EXPAND_FAILED;
+            out[o++] = line[i++];
+            continue;
+        }
+
+        int len;
+        const char *text = history_entry(n, &len);
+        if (!text || o + len >= outlen) return EXPAND_FAILED;
+        memcpy(out + o, text, len);
+        o += len;
+        i = end;
+        expanded = TRUE_VALUE;
+    }
+
+    out[o] = NULL_CHAR;
+    return expanded ? EXPAND_DONE : EXPAND_NONE;
+}
+
+/* ---
+Function Name: history_clear
+
+Purpose:
+    Empties the history log and its index ('history -c').
+
+Input:
+    None
+
+Output:
+    Truncates both files.
+--- */
+void history_clear(void)
+{
+    if (!hist.enabled) return;
+
+    flock(hist.data_fd, LOCK_EX);
+    ftruncate(hist.index_fd, ZERO_VALUE);
+    ftruncate(hist.data_fd, ZERO_VALUE);
+    flock(hist.data_fd, LOCK_UN);
+    refresh_history();
+}
+
+/* ---
+Function Name: history_compact
+
+Purpose:
+    Bounds the log to the newest $MYSH_HISTSIZE entries. The kept tail
+    is copied to the front of both files in place and they are then
+    truncated, so other shells appending through their own descriptors
+    keep writing to the same files. Runs only once the log has grown a
+    quarter past the limit, so its cost is spread over many commands.
+    An interrupted compaction leaves the index inconsistent with the
+    log, and the next startup rebuilds it.
+
+Input:
+    None
+
+Output:
+    Shrinks the history files.
+--- */
+void history_compact(void)
+{
+    if (!hist.enabled) return;
+
+    flock(hist.data_fd, LOCK_EX);
+    map_history();
+
+    /* pwrite() ignores the offset on O_APPEND descriptors */
+    int data_fd = open(hist.path, O_WRONLY | O_CLOEXEC);
+    int index_fd = open(hist.index_path, O_WRONLY | O_CLOEXEC);
+
+    if (data_fd >= ZERO_VALUE && index_fd >= ZERO_VALUE &&
+        hist.count > hist.histsize && history_is_consistent()) {
+        long first = hist.count - hist.histsize;
+        uint64_t base = hist.offsets[first];
+        uint64_t data_keep = hist.data_len - base;
+        uint64_t buf[COPY_CHUNK_LEN / sizeof(uint64_t)];
+
+        /* the tail moves towards the front, so chunks never overlap
+           bytes that are still to be copied */
+        for (uint64_t done = ZERO_VALUE; done < data_keep;) {
+            size_t chunk = (data_keep - done < COPY_CHUNK_LEN) ? data_keep - done : COPY_CHUNK_LEN;
+            memcpy(buf, hist.data + base + done, chunk);
+            if (pwrite(data_fd, buf, chunk, done) != (ssize_t)chunk) break;
+            done += chunk;
+        }
+
+        int per_chunk = COPY_CHUNK_LEN / sizeof(uint64_t);
+        for (long k = ZERO_VALUE; k < hist.histsize; k += per_chunk) {
+            int n = (hist.histsize - k < per_chunk) ? hist.histsize - k : per_chunk;
+            for (int j = ZERO_VALUE; j < n; j++) buf[j] = hist.offsets[first + k + j] - base;
+            pwrite(index_fd, buf, n * sizeof(uint64_t), k * sizeof(uint64_t));
+        }
+
+        ftruncate(data_fd, data_keep);
+        ftruncate(index_fd, hist.histsize * sizeof(uint64_t));
+        map_history();
+    }
+    if (data_fd >= ZERO_VALUE) close(data_fd);
+    if (index_fd >= ZERO_VALUE) close(index_fd);
+    flock(hist.data_fd, LOCK_UN);
+}
+
+/* ---
+Function Name: open_history_files
+
+Purpose:
+    Opens (creating if needed) the log and index for appending.
+
+Input:
+    None
+
+Output:
+    Returns 1 on success, 0 if either file cannot be opened.
+--- */
+static int open_history_files(void)
+{
+    int flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC;
+    hist.data_fd = open(hist.path, flags, HISTORY_FILE_MODE);
+    if (hist.data_fd < ZERO_VALUE) return ZERO_VALUE;
+
+    hist.index_fd = open(hist.index_path, flags, HISTORY_FILE_MODE);
+    if (hist.index_fd < ZERO_VALUE) {
+        close(hist.data_fd);
+        return ZERO_VALUE;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: history_is_consistent
+
+Purpose:
+    Checks that the index describes the whole log: the last offset must
+    start a line, and that line must be the last one in the log. Only
+    the last entry is examined, so the check is O(1) in the log size.
+
+Input:
+    None (uses the current mapping)
+
+Output:
+    Returns 1 if the index can be used as is.
+--- */
+static int history_is_consistent(void)
+{
+    if (hist.count == ZERO_VALUE) return hist.data_len == ZERO_VALUE;
+
+    uint64_t last = hist.offsets[hist.count - TRUE_VALUE];
+    if (last >= hist.data_len) return ZERO_VALUE;
+    if (last > ZERO_VALUE && hist.data[last - TRUE_VALUE] != NEWLINE_CHAR) return ZERO_VALUE;
+    return memchr(hist.data + last, NEWLINE_CHAR, hist.data_len - last) ==
+           hist.data + hist.data_len - TRUE_VALUE;
+}
+
+/* ---
+Function Name: rebuild_index
+
+Purpose:
+    Recreates the index by scanning the log once. A partial last line
+    (from an interrupted write) is terminated first. Called with the
+    history lock held.
+
+Input:
+    None
+
+Output:
+    Returns 1 on success, 0 on a write error. Remaps both files.
+--- */
+static int rebuild_index(void)
+{
+    char newline = NEWLINE_CHAR;
+    if (hist.data_len > ZERO_VALUE && hist.data[hist.data_len - TRUE_VALUE] != NEWLINE_CHAR) {
+        if (!write_all(hist.data_fd, &newline, sizeof(newline))) return ZERO_VALUE;
+        map_history();
+    }
+    if (ftruncate(hist.index_fd, ZERO_VALUE) < ZERO_VALUE) return ZERO_VALUE;
+
+    uint64_t buf[COPY_CHUNK_LEN / sizeof(uint64_t)];
+    int per_chunk = COPY_CHUNK_LEN / sizeof(uint64_t);
+    int n = ZERO_VALUE;
+    size_t pos = ZERO_VALUE;
+
+    while (pos < hist.data_len) {
+        buf[n++] = pos;
+        const char *end = memchr(hist.data + pos, NEWLINE_CHAR, hist.data_len - pos);
+        pos = (size_t)(end - hist.data) + TRUE_VALUE;
+        if (n == per_chunk) {
+            if (!write_all(hist.index_fd, (const char *)buf, n * sizeof(uint64_t))) return ZERO_VALUE;
+            n = ZERO_VALUE;
+        }
+    }
+    if (n > ZERO_VALUE && !write_all(hist.index_fd, (const char *)buf, n * sizeof(uint64_t)))
+        return ZERO_VALUE;
+
+    map_history();
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: map_history
+
+Purpose:
+    (Re)maps the log and the index read-only at their current sizes.
+    mmap() only sets up page tables, so this is cheap however large the
+    files are; pages are read in when an entry is first looked at.
+
+Input:
+    None
+
+Output:
+    Updates the mapping, data_len and count (empty if a map fails).
+--- */
+static void map_history(void)
+{
+    struct stat data_st, index_st;
+
+    unmap_history();
+    if (fstat(hist.data_fd, &data_st) < ZERO_VALUE || fstat(hist.index_fd, &index_st) < ZERO_VALUE)
+        return;
+
+    if (data_st.st_size > ZERO_VALUE) {
+        void *p = mmap(NULL, data_st.st_size, PROT_READ, MAP_SHARED, hist.data_fd, ZERO_VALUE);
+        if (p == MAP_FAILED) return;
+        hist.data = p;
+        hist.data_len = data_st.st_size;
+    }
+
+    long count = index_st.st_size / sizeof(uint64_t);
+    if (count > ZERO_VALUE) {
+        void *p = mmap(NULL, count * sizeof(uint64_t), PROT_READ, MAP_SHARED, hist.index_fd, ZERO_VALUE);
+        if (p == MAP_FAILED) return;
+        hist.offsets = p;
+        hist.count = count;
+    }
+}
+
+/* ---
+Function Name: unmap_history
+
+Purpose:
+    Removes the current mappings.
+
+Input:
+    None
+
+Output:
+    Leaves history looking empty until the next map_history().
+--- */
+static void unmap_history(void)
+{
+    if (hist.data) munmap((void *)hist.data, hist.data_len);
+    if (hist.offsets) munmap((void *)hist.offsets, hist.count * sizeof(uint64_t));
+    hist.data = NULL;
+    hist.data_len = ZERO_VALUE;
+    hist.offsets = NULL;
+    hist.count = ZERO_VALUE;
+}
+
+/* ---
+Function Name: refresh_history
+
+Purpose:
+    Remaps after this shell (or another one) changed the files.
+
+Input:
+    None
+
+Output:
+    Updates the mapping under a shared lock.
+--- */
+static void refresh_history(void)
+{
+    flock(hist.data_fd, LOCK_SH);
+    map_history();
+    flock(hist.data_fd, LOCK_UN);
+}
+
+/* ---
+Function Name: write_all
+
+Purpose:
+    Writes a whole buffer, retrying short writes.
+
+Input:
+    fd  - file descriptor
+    buf - data
+    len - number of bytes
+
+Output:
+    Returns 1 on success, 0 on error.
+--- */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > ZERO_VALUE) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= ZERO_VALUE) return ZERO_VALUE;
+        buf += n;
+        len -= n;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: parse_event_number
+
+Purpose:
+    Parses the decimal digits at the start of text.
+
+Input:
+    text - text to parse
+    used - receives the number of digits consumed (0 if none)
+
+Output:
+    The number.
+--- */
+static long parse_event_number(const char *text, int *used)
+{
+    long n = ZERO_VALUE;
+    int i = ZERO_VALUE;
+    while (text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR)
+        n = n * DECIMAL_BASE + (text[i++] - ZERO_CHAR);
+    *used = i;
+    return n;
+}
+
+/* ---
+Function Name: event_word_end
+
+Purpose:
+    Finds the end of a '!prefix' word: the next blank or shell operator.
+
+Input:
+    line - command line
+    i    - index of the first character of the word
+
+Output:
+    Index just past the word.
+--- */
+static int event_word_end(const char *line, int i)
+{
+    while (line[i] != NULL_CHAR && line[i] != SPACE_CHAR && line[i] != TAB_CHAR &&
+           line[i] != PIPE_CHAR && line[i] != BACKGROUND_CHAR &&
+           line[i] != INPUT_REDIRECT_CHAR && line[i] != OUTPUT_REDIRECT_CHAR)
+        i++;
+    return i;
+}
+
+/* ---
+Function Name: find_event
+
+Purpose:
+    Resolves the history event starting at a '!'.
+
+Input:
+    line - command line
+    i    - index of the '!'
+    end  - receives the index just past the event
+
+Output:
+    Entry number (NO_ENTRY if it does not exist), or ERROR_CODE if the
+    '!' is literal.
+--- */
+static long find_event(const char *line, int i, int *end)
+{
+    const char *ev = line + i + TRUE_VALUE;
+    int used;
+
+    if (*ev == NULL_CHAR || *ev == SPACE_CHAR || *ev == TAB_CHAR || *ev == ENV_ASSIGN_CHAR)
+        return ERROR_CODE;
+
+    if (*ev == HISTORY_LAST_CHAR) {
+        *end = i + EVENT_PREFIX_LEN;
+        return history_count();
+    }
+
+    if (*ev == HISTORY_RELATIVE_CHAR) {
+        long back = parse_event_number(ev + TRUE_VALUE, &used);
+        if (used == ZERO_VALUE) return ERROR_CODE;
+        *end = i + EVENT_PREFIX_LEN + used;
+        return (back >= TRUE_VALUE && back <= history_count()) ? history_count() + TRUE_VALUE - back : NO_ENTRY;
+    }
+
+    long n = parse_event_number(ev, &used);
+    if (used > ZERO_VALUE) {
+        *end = i + TRUE_VALUE + used;
+        return n;
+    }
+
+    char word[HISTORY_WORD_LEN];
+    int word_end = event_word_end(line, i + TRUE_VALUE);
+    int len = word_end - (i + TRUE_VALUE);
+    if (len >= HISTORY_WORD_LEN) return NO_ENTRY;
+    memcpy(word, ev, len);
+    word[len] = NULL_CHAR;
+    *end = word_end;
+    return history_find_prefix(word, history_count() + TRUE_VALUE);
+}
@@ -0,0 +1,90 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>         /* size_t */
+#include <stdint.h>         /* uint64_t */
+
+/* FILES AND ENVIRONMENT */
+#define HISTFILE_ENV_NAME       "MYSH_HISTFILE"
+#define HISTSIZE_ENV_NAME       "MYSH_HISTSIZE"
+#define HOME_DIR_ENV_NAME       "HOME"
+#define HISTORY_FILE_NAME       "/.mysh_history"
+#define HISTORY_INDEX_SUFFIX    ".idx"
+#define HISTORY_FILE_MODE       0600
+
+/* SIZES */
+#define HISTORY_PATH_LEN        1024
+#define DEFAULT_HISTSIZE        1000000
+#define COMPACT_SLACK_DIVISOR   4       /* compact at histsize + histsize/4 */
+#define HISTORY_WORD_LEN        256
+#define COPY_CHUNK_LEN          65536
+
+/* EXPANSION */
+#define HISTORY_EXPAND_CHAR     '!'
+#define HISTORY_LAST_CHAR       '!'
+#define HISTORY_RELATIVE_CHAR   '-'
+#define EVENT_PREFIX_LEN        2       /* "!!" or "!-" */
+#define PIPE_CHAR               '|'
+#define BACKGROUND_CHAR         '&'
+#define INPUT_REDIRECT_CHAR     '<'
+#define OUTPUT_REDIRECT_CHAR    '>'
+#define ENV_ASSIGN_CHAR         '='
+#define EXPAND_NONE             0
+#define EXPAND_DONE             1
+#define EXPAND_FAILED           -1
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NO_ENTRY                0
+#define NULL_CHAR               '\0'
+#define NEWLINE_CHAR            '\n'
+#define SPACE_CHAR              ' '
+#define TAB_CHAR                '\t'
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define DECIMAL_BASE            10
+
+/* THE MAPPED HISTORY LOG
+   The log file holds one command per line, appended and never edited.
+   The index file beside it holds the byte offset of every line as a
+   uint64_t, so entry n is found in O(1) and startup never reads the log. */
+typedef struct
+{
+    int enabled;
+    int data_fd;
+    int index_fd;
+    const char *data;           /* mapped log, data_len bytes */
+    size_t data_len;
+    const uint64_t *offsets;    /* mapped index, count entries */
+    long count;
+    long histsize;              /* entries kept by compaction */
+    char path[HISTORY_PATH_LEN];
+    char index_path[HISTORY_PATH_LEN];
+} HistoryLog;
+
+/* FUNCTION DECLARATIONS */
+void history_init(char *envp[]);
+void history_add(const char *line);
+long history_count(void);
+const char *history_entry(long n, int *len);
+long history_find_prefix(const char *prefix, long before);
+long history_find_substring(const char *text, long before);
+int history_expand(const char *line, char *out, int outlen);
+void history_clear(void);
+void history_compact(void);
+
+/* STATIC HELPER FUNCTIONS */
+static int open_history_files(void);
+static int history_is_consistent(void);
+static int rebuild_index(void);
+static void map_history(void);
+static void unmap_history(void);
+static void refresh_history(void);
+static int write_all(int fd, const char *buf, size_t len);
+static long parse_event_number(const char *text, int *used);
+static int event_word_end(const char *line, int i);
+static long find_event(const char *line, int i, int *end);
+
+#endif
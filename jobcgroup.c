@@ -0,0 +1,596 @@
+#include "jobcgroup.h"
+#include "mystring.h"
+#include "errors.h"
+
+#include <unistd.h>    /* read, write, close, getpid */
+#include <fcntl.h>     /* open, openat, O_CLOEXEC, AT_REMOVEDIR */
+#include <sys/stat.h>  /* mkdirat */
+#include <errno.h>
+
+/* The shell's own cgroup, under which every job cgroup is created */
+static int base_state = BASE_UNKNOWN;
+static int base_fd = ERROR_CODE;
+static int next_cgroup_id = ZERO_VALUE;
+static int warned = ZERO_VALUE;
+
+/* ---
+Function Name: cgroup_setup
+
+Purpose:
+    Works out a job's resource limits and, if it has any, creates a
+    fresh cgroup v2 child group for it with memory.max, cpu.max and
+    pids.max set. Limits come from a leading
+      limit [mem=SIZE] [cpu=PERCENT] [pids=N] command ...
+    on the first stage (the words are removed) or from the
+    MYSH_MEMORY_MAX, MYSH_CPU_MAX and MYSH_PIDS_MAX environment
+    variables. If the cgroup hierarchy is not writable, a warning is
+    printed once and the job runs without limits.
+
+Input:
+    job  - job about to be spawned; job->cgroup is filled in
+    envp - environment variables
+
+Output:
+    Returns 1 if the job can be started, 0 for a malformed 'limit'
+    prefix.
+--- */
+int cgroup_setup(Job *job, char *envp[])
+{
+    JobCgroup *cgroup = &job->cgroup;
+    JobLimits limits = { ZERO_VALUE, ZERO_VALUE, ZERO_VALUE };
+
+    cgroup->id = NO_CGROUP;
+    cgroup->dir_fd = ERROR_CODE;
+    cgroup->procs_fd = ERROR_CODE;
+
+    char *value;
+    if ((value = mygetenv(MEMORY_MAX_ENV_NAME, envp))) limits.memory_max = parse_size(value);
+    if ((value = mygetenv(CPU_MAX_ENV_NAME, envp))) limits.cpu_percent = parse_size(value);
+    if ((value = mygetenv(PIDS_MAX_ENV_NAME, envp))) limits.pids_max = parse_size(value);
+
+    if (!parse_limit_prefix(&job->pipeline[ZERO_VALUE], &limits)) {
+        print_error(ERR_LIMIT_USAGE);
+        return ZERO_VALUE;
+    }
+
+    if (limits.memory_max <= ZERO_VALUE && limits.cpu_percent <= ZERO_VALUE &&
+        limits.pids_max <= ZERO_VALUE)
+        return TRUE_VALUE;
+
+    int id = ++next_cgroup_id;
+    char name[CGROUP_NAME_LEN];
+    cgroup_name(id, name);
+
+    int ok = prepare_base() &&
+             mkdirat(base_fd, name, CGROUP_DIR_MODE) == ZERO_VALUE;
+    if (ok) {
+        cgroup->id = id;
+        cgroup->dir_fd = openat(base_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ok = cgroup->dir_fd >= ZERO_VALUE;
+    }
+    if (ok && limits.memory_max > ZERO_VALUE)
+        ok = write_number_at(cgroup->dir_fd, MEMORY_MAX_FILE, limits.memory_max, EMPTY_SUFFIX);
+    if (ok && limits.cpu_percent > ZERO_VALUE)
+        ok = write_number_at(cgroup->dir_fd, CPU_MAX_FILE,
+                             limits.cpu_percent * CPU_QUOTA_PER_PERCENT, CPU_PERIOD_TEXT);
+    if (ok && limits.pids_max > ZERO_VALUE)
+        ok = write_number_at(cgroup->dir_fd, PIDS_MAX_FILE, limits.pids_max, EMPTY_SUFFIX);
+    if (ok) {
+        cgroup->procs_fd = openat(cgroup->dir_fd, CGROUP_PROCS_FILE, O_WRONLY | O_CLOEXEC);
+        ok = cgroup->procs_fd >= ZERO_VALUE;
+    }
+
+    if (!ok) {
+        /* a limit we cannot enforce: run the job unconfined instead */
+        cgroup_release(cgroup);
+        if (!warned) print_error(ERR_CGROUP_UNAVAILABLE);
+        warned = TRUE_VALUE;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: cgroup_join
+
+Purpose:
+    Moves the calling process into the job's cgroup. Called in each
+    stage's child before execve; async-signal-safe, so it is fine after
+    vfork().
+
+Input:
+    cgroup - job's cgroup
+
+Output:
+    The process and everything it later forks are limited by the cgroup.
+--- */
+void cgroup_join(JobCgroup *cgroup)
+{
+    if (cgroup->procs_fd >= ZERO_VALUE)
+        write(cgroup->procs_fd, JOIN_SELF_TEXT, mystrlen(JOIN_SELF_TEXT));
+}
+
+/* ---
+Function Name: cgroup_spawned
+
+Purpose:
+    Closes the cgroup.procs descriptor once every stage has joined.
+
+Input:
+    cgroup - job's cgroup
+
+Output:
+    Releases cgroup->procs_fd.
+--- */
+void cgroup_spawned(JobCgroup *cgroup)
+{
+    if (cgroup->procs_fd >= ZERO_VALUE) close(cgroup->procs_fd);
+    cgroup->procs_fd = ERROR_CODE;
+}
+
+/* ---
+Function Name: cgroup_read_stats
+
+Purpose:
+    Reads a job's peak memory (memory.peak) and total CPU time
+    (usage_usec in cpu.stat) back from its cgroup.
+
+Input:
+    cgroup - job's cgroup
+    stats  - output
+
+Output:
+    Fills stats; fields are -1 when unavailable.
+--- */
+void cgroup_read_stats(JobCgroup *cgroup, CgroupStats *stats)
+{
+    char buf[CGROUP_READ_LEN];
+    stats->memory_peak = ERROR_CODE;
+    stats->cpu_usec = ERROR_CODE;
+    if (cgroup->id == NO_CGROUP || cgroup->dir_fd < ZERO_VALUE) return;
+
+    if (read_file_at(cgroup->dir_fd, MEMORY_PEAK_FILE, buf, CGROUP_READ_LEN) > ZERO_VALUE)
+        stats->memory_peak = parse_size(buf);
+
+    if (read_file_at(cgroup->dir_fd, CPU_STAT_FILE, buf, CGROUP_READ_LEN) > ZERO_VALUE) {
+        for (char *line = buf; *line; ) {
+            if (starts_with(line, CPU_USAGE_KEY)) {
+                char *num = line + mystrlen(CPU_USAGE_KEY);
+                char *end = num;
+                while (*end >= ZERO_CHAR && *end <= NINE_CHAR) end++;
+                *end = NULL_CHAR;
+                stats->cpu_usec = parse_size(num);
+                break;
+            }
+            while (*line && *line != NEWLINE_CHAR) line++;
+            if (*line) line++;
+        }
+    }
+}
+
+/* ---
+Function Name: cgroup_release
+
+Purpose:
+    Closes a job's cgroup descriptors and removes the cgroup. Removal
+    only succeeds once all of its processes have exited; a cgroup
+    still in use (e.g. of a disowned job) is left behind.
+
+Input:
+    cgroup - job's cgroup
+
+Output:
+    cgroup->id becomes NO_CGROUP.
+--- */
+void cgroup_release(JobCgroup *cgroup)
+{
+    if (cgroup->id == NO_CGROUP) return;
+
+    cgroup_spawned(cgroup);
+    if (cgroup->dir_fd >= ZERO_VALUE) close(cgroup->dir_fd);
+    cgroup->dir_fd = ERROR_CODE;
+
+    char name[CGROUP_NAME_LEN];
+    cgroup_name(cgroup->id, name);
+    unlinkat(base_fd, name, AT_REMOVEDIR);
+    cgroup->id = NO_CGROUP;
+}
+
+/* ---
+Function Name: parse_limit_prefix
+
+Purpose:
+    Consumes a leading "limit key=value ..." from a command.
+
+Input:
+    cmd    - first stage of the job
+    limits - limits to update
+
+Output:
+    Returns 1 if there was no prefix or it was valid (the prefix words
+    are removed from cmd), 0 if it is malformed or has no command.
+--- */
+static int parse_limit_prefix(Command *cmd, JobLimits *limits)
+{
+    if (!cmd->argv[ZERO_VALUE] || mystrcmp(cmd->argv[ZERO_VALUE], LIMIT_KEYWORD) != ZERO_VALUE)
+        return TRUE_VALUE;
+
+    int skip = TRUE_VALUE;
+    for (; cmd->argv[skip]; skip++) {
+        int result = parse_limit_word(cmd->argv[skip], limits);
+        if (result == ERROR_CODE) return ZERO_VALUE;
+        if (result == ZERO_VALUE) break;
+    }
+    if (!cmd->argv[skip]) return ZERO_VALUE;
+
+    int n = ZERO_VALUE;
+    for (int i = skip; i <= (int)cmd->argc; i++)
+        cmd->argv[n++] = cmd->argv[i];
+    cmd->argc -= skip;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: parse_limit_word
+
+Purpose:
+    Parses one "mem=512M", "cpu=50%" or "pids=64" word.
+
+Input:
+    word   - argument
+    limits - limits to update
+
+Output:
+    Returns 1 if it was a limit, 0 if it is not a limit word (the
+    command starts here), -1 if the value is invalid.
+--- */
+static int parse_limit_word(const char *word, JobLimits *limits)
+{
+    long long *field;
+    const char *key;
+
+    if (starts_with(word, LIMIT_MEMORY_KEY)) {
+        field = &limits->memory_max;
+        key = LIMIT_MEMORY_KEY;
+    } else if (starts_with(word, LIMIT_CPU_KEY)) {
+        field = &limits->cpu_percent;
+        key = LIMIT_CPU_KEY;
+    } else if (starts_with(word, LIMIT_PIDS_KEY)) {
+        field = &limits->pids_max;
+        key = LIMIT_PIDS_KEY;
+    } else {
+        return ZERO_VALUE;
+    }
+
+    *field = parse_size(word + mystrlen(key));
+    return (*field > ZERO_VALUE) ? TRUE_VALUE : ERROR_CODE;
+}
+
+/* ---
+Function Name: starts_with
+
+Purpose:
+    Tests whether a string begins with a prefix.
+
+Input:
+    s      - string
+    prefix - prefix
+
+Output:
+    Returns 1 if s starts with prefix.
+--- */
+static int starts_with(const char *s, const char *prefix)
+{
+    while (*prefix) {
+        if (*s++ != *prefix++) return ZERO_VALUE;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: parse_size
+
+Purpose:
+    Parses a number with an optional K, M or G suffix (powers of 1024)
+    or a trailing '%' (ignored, for cpu=50%). A trailing newline, as
+    read from cgroup files, is accepted.
+
+Input:
+    text - number text
+
+Output:
+    The value, or -1 if text is not a number (e.g. "max").
+--- */
+static long long parse_size(const char *text)
+{
+    long long value = ZERO_VALUE;
+    int i = ZERO_VALUE;
+
+    if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return ERROR_CODE;
+    while (text[i] >= ZERO_CHAR && text[i] <= NINE_CHAR)
+        value = value * DECIMAL_BASE + (text[i++] - ZERO_CHAR);
+
+    switch (text[i]) {
+    case SUFFIX_GIGA: case SUFFIX_GIGA_LOWER: value *= KILO_MULTIPLIER; /* fall through */
+    case SUFFIX_MEGA: case SUFFIX_MEGA_LOWER: value *= KILO_MULTIPLIER; /* fall through */
+    case SUFFIX_KILO: case SUFFIX_KILO_LOWER: value *= KILO_MULTIPLIER; /* fall through */
+    case SUFFIX_PERCENT: i++; break;
+    default: break;
+    }
+
+    if (text[i] == NEWLINE_CHAR) i++;
+    return (text[i] == NULL_CHAR) ? value : ERROR_CODE;
+}
+
+/* ---
+Function Name: prepare_base
+
+Purpose:
+    Locates the shell's own cgroup v2 directory, once, and delegates the
+    memory, cpu and pids controllers to its children. cgroup v2 does not
+    allow that while the group itself holds processes, so if the first
+    attempt fails the shell moves itself into a "mysh-shell" leaf group
+    and retries.
+
+Input:
+    None
+
+Output:
+    Returns 1 if job cgroups can be created under base_fd.
+--- */
+static int prepare_base(void)
+{
+    if (base_state != BASE_UNKNOWN) return base_state == BASE_READY;
+    base_state = BASE_UNAVAILABLE;
+
+    char mount[CGROUP_PATH_LEN];
+    char own[CGROUP_PATH_LEN];
+    char path[CGROUP_PATH_LEN * 2];
+    if (!find_cgroup2_mount(mount, CGROUP_PATH_LEN) || !find_own_cgroup(own, CGROUP_PATH_LEN))
+        return ZERO_VALUE;
+
+    mystrcpy(path, mount);
+    mystrcat(path, own);
+    base_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base_fd < ZERO_VALUE) return ZERO_VALUE;
+
+    if (!enable_controllers() && errno == EBUSY) {
+        mkdirat(base_fd, SHELL_CGROUP_NAME, CGROUP_DIR_MODE);
+        int leaf = openat(base_fd, SHELL_CGROUP_NAME, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (leaf >= ZERO_VALUE) {
+            write_file_at(leaf, CGROUP_PROCS_FILE, JOIN_SELF_TEXT);
+            close(leaf);
+        }
+        enable_controllers();
+    }
+
+    /* job groups can still be created (and measured) without every
+       controller; writing an unsupported limit fails per job */
+    base_state = BASE_READY;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: enable_controllers
+
+Purpose:
+    Enables each controller for the base group's children separately, so
+    a missing controller does not prevent the others.
+
+Input:
+    None
+
+Output:
+    Returns 1 if at least one controller was enabled.
+--- */
+static int enable_controllers(void)
+{
+    int enabled = ZERO_VALUE;
+    enabled |= write_file_at(base_fd, CGROUP_SUBTREE_FILE, ENABLE_MEMORY);
+    enabled |= write_file_at(base_fd, CGROUP_SUBTREE_FILE, ENABLE_CPU);
+    enabled |= write_file_at(base_fd, CGROUP_SUBTREE_FILE, ENABLE_PIDS);
+    return enabled;
+}
+
+/* ---
+Function Name: find_cgroup2_mount
+
+Purpose:
+    Finds where the cgroup v2 hierarchy is mounted (usually
+    /sys/fs/cgroup, or /sys/fs/cgroup/unified on hybrid systems).
+
+Input:
+    path - output buffer
+    len  - size of path
+
+Output:
+    Returns 1 and fills path if a cgroup2 mount was found.
+--- */
+static int find_cgroup2_mount(char *path, int len)
+{
+    char buf[CGROUP_READ_LEN];
+    if (read_file_at(AT_FDCWD, PROC_MOUNTINFO_PATH, buf, CGROUP_READ_LEN) <= ZERO_VALUE)
+        return ZERO_VALUE;
+
+    for (char *line = buf; *line; ) {
+        char *eol = line;
+        while (*eol && *eol != NEWLINE_CHAR) eol++;
+        char saved = *eol;
+        *eol = NULL_CHAR;
+
+        int is_cgroup2 = ZERO_VALUE;
+        for (char *p = line; *p && !is_cgroup2; p++)
+            is_cgroup2 = starts_with(p, CGROUP2_FS_TYPE);
+
+        if (is_cgroup2) {
+            /* fields: id parent major:minor root mount-point ... */
+            char *field = line;
+            for (int f = ZERO_VALUE; f < MOUNT_POINT_FIELD && *field; f++) {
+                while (*field && *field != SPACE_CHAR) field++;
+                if (*field) field++;
+            }
+            int n = ZERO_VALUE;
+            while (field[n] && field[n] != SPACE_CHAR && n < len - TRUE_VALUE) {
+                path[n] = field[n];
+                n++;
+            }
+            path[n] = NULL_CHAR;
+            return n > ZERO_VALUE;
+        }
+
+        *eol = saved;
+        line = saved ? eol + TRUE_VALUE : eol;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: find_own_cgroup
+
+Purpose:
+    Reads the shell's cgroup v2 path from /proc/self/cgroup ("0::/path").
+
+Input:
+    path - output buffer
+    len  - size of path
+
+Output:
+    Returns 1 and fills path on success.
+--- */
+static int find_own_cgroup(char *path, int len)
+{
+    char buf[CGROUP_READ_LEN];
+    if (read_file_at(AT_FDCWD, PROC_CGROUP_PATH, buf, CGROUP_READ_LEN) <= ZERO_VALUE)
+        return ZERO_VALUE;
+
+    for (char *line = buf; *line; ) {
+        if (starts_with(line, CGROUP2_ENTRY_PREFIX)) {
+            char *src = line + mystrlen(CGROUP2_ENTRY_PREFIX);
+            int n = ZERO_VALUE;
+            while (src[n] && src[n] != NEWLINE_CHAR && n < len - TRUE_VALUE) {
+                path[n] = src[n];
+                n++;
+            }
+            /* the root group is "/", which would double the slash */
+            if (n == TRUE_VALUE) n = ZERO_VALUE;
+            path[n] = NULL_CHAR;
+            return TRUE_VALUE;
+        }
+        while (*line && *line != NEWLINE_CHAR) line++;
+        if (*line) line++;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: read_file_at
+
+Purpose:
+    Reads a small file into a NUL-terminated buffer.
+
+Input:
+    dir_fd - directory, or AT_FDCWD
+    name   - file name
+    buf    - output buffer
+    len    - size of buf
+
+Output:
+    Number of bytes read, or -1 on error.
+--- */
+static int read_file_at(int dir_fd, const char *name, char *buf, int len)
+{
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < ZERO_VALUE) return ERROR_CODE;
+
+    int total = ZERO_VALUE, n;
+    while (total < len - TRUE_VALUE &&
+           (n = read(fd, buf + total, len - TRUE_VALUE - total)) > ZERO_VALUE)
+        total += n;
+    close(fd);
+    buf[total] = NULL_CHAR;
+    return total;
+}
+
+/* ---
+Function Name: write_file_at
+
+Purpose:
+    Writes a string to a cgroup control file.
+
+Input:
+    dir_fd - cgroup directory
+    name   - control file name
+    text   - value to write
+
+Output:
+    Returns 1 on success, 0 on failure (errno is preserved).
+--- */
+static int write_file_at(int dir_fd, const char *name, const char *text)
+{
+    int fd = openat(dir_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < ZERO_VALUE) return ZERO_VALUE;
+
+    int len = mystrlen(text);
+    int ok = write(fd, text, len) == len;
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return ok;
+}
+
+/* ---
+Function Name: write_number_at
+
+Purpose:
+    Writes a number, optionally followed by more text, to a control file.
+
+Input:
+    dir_fd - cgroup directory
+    name   - control file name
+    value  - number to write
+    suffix - text after the number (e.g. the cpu.max period)
+
+Output:
+    Returns 1 on success, 0 on failure.
+--- */
+static int write_number_at(int dir_fd, const char *name, long long value, const char *suffix)
+{
+    char digits[CGROUP_NUM_LEN];
+    char text[CGROUP_NUM_LEN + CGROUP_NAME_LEN];
+    int n = ZERO_VALUE;
+
+    do {
+        digits[n++] = ZERO_CHAR + (int)(value % DECIMAL_BASE);
+        value /= DECIMAL_BASE;
+    } while (value > ZERO_VALUE);
+
+    int k = ZERO_VALUE;
+    while (n > ZERO_VALUE) text[k++] = digits[--n];
+    text[k] = NULL_CHAR;
+    mystrcat(text, suffix);
+    return write_file_at(dir_fd, name, text);
+}
+
+/* ---
+Function Name: cgroup_name
+
+Purpose:
+    Builds a job cgroup's directory name, "mysh-<shell pid>-<id>", so
+    several shells can share one parent group.
+
+Input:
+    id  - job cgroup number
+    buf - output buffer of CGROUP_NAME_LEN bytes
+
+Output:
+    Fills buf.
+--- */
+static void cgroup_name(int id, char *buf)
+{
+    char num[CGROUP_NUM_LEN];
+    mystrcpy(buf, JOB_CGROUP_PREFIX);
+    myitoa(getpid(), num);
+    mystrcat(buf, num);
+    mystrcat(buf, JOB_CGROUP_SEPARATOR);
+    myitoa(id, num);
+    mystrcat(buf, num);
+}
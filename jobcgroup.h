@@ -0,0 +1,108 @@
+#ifndef JOBCGROUP_H
+#define JOBCGROUP_H
+
+#include "jobs.h"
+
+/* LIMIT PREFIX AND ENVIRONMENT */
+#define LIMIT_KEYWORD           "limit"
+#define LIMIT_MEMORY_KEY        "mem="
+#define LIMIT_CPU_KEY           "cpu="
+#define LIMIT_PIDS_KEY          "pids="
+#define MEMORY_MAX_ENV_NAME     "MYSH_MEMORY_MAX"
+#define CPU_MAX_ENV_NAME        "MYSH_CPU_MAX"
+#define PIDS_MAX_ENV_NAME       "MYSH_PIDS_MAX"
+
+/* CGROUP V2 FILES */
+#define PROC_CGROUP_PATH        "/proc/self/cgroup"
+#define PROC_MOUNTINFO_PATH     "/proc/self/mountinfo"
+#define CGROUP2_FS_TYPE         " - cgroup2 "
+#define CGROUP2_ENTRY_PREFIX    "0::"
+#define CGROUP_PROCS_FILE       "cgroup.procs"
+#define CGROUP_SUBTREE_FILE     "cgroup.subtree_control"
+#define MEMORY_MAX_FILE         "memory.max"
+#define CPU_MAX_FILE            "cpu.max"
+#define PIDS_MAX_FILE           "pids.max"
+#define MEMORY_PEAK_FILE        "memory.peak"
+#define CPU_STAT_FILE           "cpu.stat"
+#define CPU_USAGE_KEY           "usage_usec "
+#define SHELL_CGROUP_NAME       "mysh-shell"
+#define JOB_CGROUP_PREFIX       "mysh-"
+#define JOB_CGROUP_SEPARATOR    "-"
+#define ENABLE_MEMORY           "+memory"
+#define ENABLE_CPU              "+cpu"
+#define ENABLE_PIDS             "+pids"
+#define JOIN_SELF_TEXT          "0"
+#define CPU_PERIOD_TEXT         " 100000"
+#define CPU_QUOTA_PER_PERCENT   1000
+#define EMPTY_SUFFIX            ""
+#define MOUNT_POINT_FIELD       4
+
+/* SIZES */
+#define CGROUP_PATH_LEN         1024
+#define CGROUP_NAME_LEN         64
+#define CGROUP_READ_LEN         16384
+#define CGROUP_NUM_LEN          24
+#define CGROUP_DIR_MODE         0755
+
+/* BASE STATES */
+#define BASE_UNKNOWN            0
+#define BASE_READY              1
+#define BASE_UNAVAILABLE        2
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NO_CGROUP               0
+#define NULL_CHAR               '\0'
+#define NEWLINE_CHAR            '\n'
+#define SPACE_CHAR              ' '
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define DECIMAL_BASE            10
+#define KILO_MULTIPLIER         1024LL
+#define SUFFIX_KILO             'K'
+#define SUFFIX_KILO_LOWER       'k'
+#define SUFFIX_MEGA             'M'
+#define SUFFIX_MEGA_LOWER       'm'
+#define SUFFIX_GIGA             'G'
+#define SUFFIX_GIGA_LOWER       'g'
+#define SUFFIX_PERCENT          '%'
+
+/* LIMITS REQUESTED FOR ONE JOB (0 = unlimited) */
+typedef struct
+{
+    long long memory_max;   /* bytes */
+    long long cpu_percent;  /* of one CPU */
+    long long pids_max;
+} JobLimits;
+
+/* RESOURCE USAGE READ BACK FROM A JOB'S CGROUP */
+typedef struct
+{
+    long long memory_peak;  /* bytes, -1 if unknown */
+    long long cpu_usec;     /* -1 if unknown */
+} CgroupStats;
+
+/* FUNCTION DECLARATIONS */
+int cgroup_setup(Job *job, char *envp[]);
+void cgroup_join(JobCgroup *cgroup);
+void cgroup_spawned(JobCgroup *cgroup);
+void cgroup_read_stats(JobCgroup *cgroup, CgroupStats *stats);
+void cgroup_release(JobCgroup *cgroup);
+
+/* STATIC HELPER FUNCTIONS */
+static int parse_limit_prefix(Command *cmd, JobLimits *limits);
+static int parse_limit_word(const char *word, JobLimits *limits);
+static int starts_with(const char *s, const char *prefix);
+static long long parse_size(const char *text);
+static int prepare_base(void);
+static int enable_controllers(void);
+static int find_cgroup2_mount(char *path, int len);
+static int find_own_cgroup(char *path, int len);
+static int read_file_at(int dir_fd, const char *name, char *buf, int len);
+static int write_file_at(int dir_fd, const char *name, const char *text);
+static int write_number_at(int dir_fd, const char *name, long long value, const char *suffix);
+static void cgroup_name(int id, char *buf);
+
+#endif
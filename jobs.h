@@ -3,7 +3,11 @@
 
 #define MAX_ARGS 1024
 #define MAX_PIPELINE_LEN 10
-#define MAX_JOBS 16
+#define MAX_JOBS 64
+#define NO_FD (-1)
+#define MAX_PASS_FDS 16
+#define NO_STAGE (-1)
+#define FD_REDIRECT_CHAR '&'  /* an infile/outfile path "&N" ('<&N', '>&N') names a descriptor */
 
 typedef struct
 {
@@ -11,6 +15,19 @@ typedef struct
   unsigned int argc;
 } Command;
 
+typedef struct
+{
+  int id;        /* 0 if the job runs without a cgroup */
+  int dir_fd;    /* the job's cgroup v2 directory */
+  int procs_fd;  /* its cgroup.procs, written by each stage before exec */
+} JobCgroup;
+
+typedef struct
+{
+  int fd;        /* open in the shell, close-on-exec */
+  int stage;     /* stage that keeps it across exec, NO_STAGE for none */
+} PassFd;
+
 typedef struct
 {
   Command pipeline[MAX_PIPELINE_LEN];
@@ -19,6 +36,12 @@ typedef struct
   char *infile_path;
   int background;
   int pgid;
+  int pids[MAX_PIPELINE_LEN];
+  int in_fd;     /* stdin of the first stage, NO_FD to inherit */
+  int out_fd;    /* stdout of the last stage, NO_FD to inherit */
+  JobCgroup cgroup;
+  PassFd pass_fds[MAX_PASS_FDS];  /* <(...) and >(...) pipe ends, see procsubst.c */
+  int num_pass_fds;
 } Job;
 
 #endif
@@ -0,0 +1,520 @@
+#define _GNU_SOURCE    /* pipe2 */
+#include "jobsched.h"
+#include "runjob.h"
+#include "mystring.h"
+#include "errors.h"
+
+#include <unistd.h>    /* pipe2, read, write, sysconf */
+#include <fcntl.h>     /* O_CLOEXEC, O_NONBLOCK */
+#include <poll.h>      /* poll */
+#include <signal.h>    /* sigprocmask */
+#include <errno.h>
+
+/* FIFO of jobs waiting for a free slot */
+static QueuedJob queue[SCHED_QUEUE_LEN];
+static int queue_head = ZERO_VALUE;
+static int queue_count = ZERO_VALUE;
+
+/* Started jobs; entries are released from the SIGCHLD handler */
+static RunSlot slots[SCHED_MAX_SLOTS];
+static int job_limit = SCHED_LIMIT_UNSET;
+
+/* Self-pipe: the SIGCHLD handler writes a byte when a slot frees up */
+static int wake_pipe[2] = { ERROR_CODE, ERROR_CODE };
+static char **sched_envp;
+
+/* ---
+Function Name: sched_init
+
+Purpose:
+    Sets up the background job scheduler. The worker limit defaults to
+    the number of online CPUs, read when a job first needs it (see
+    current_limit()) rather than here: every 'mysh -c' runs this.
+
+Input:
+    envp - environment used to launch scheduled jobs
+
+Output:
+    Creates the wakeup pipe and sets the default limit.
+--- */
+void sched_init(char *envp[])
+{
+    sched_envp = envp;
+
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) < ZERO_VALUE) {
+        print_error(ERR_PIPE_FAIL);
+        wake_pipe[ZERO_VALUE] = wake_pipe[TRUE_VALUE] = ERROR_CODE;
+    }
+}
+
+/* ---
+Function Name: sched_submit
+
+Purpose:
+    Submits a background job. It starts at once if fewer than the limit
+    are running and nothing is waiting ahead of it; otherwise a copy of
+    the parsed job joins the FIFO and starts when a running job finishes.
+
+Input:
+    job - parsed and expanded job
+
+Output:
+    Returns 0 if the job was started or queued, 1 otherwise.
+--- */
+int sched_submit(Job *job)
+{
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    int slot = (queue_count == ZERO_VALUE) ? find_free_slot() : NO_SLOT;
+    int status = (slot != NO_SLOT) ? launch_job(job, slot) : enqueue_job(job);
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return status;
+}
+
+/* ---
+Function Name: sched_dispatch
+
+Purpose:
+    Starts queued jobs, oldest first, while slots are free. Runs at idle
+    points only (while the shell waits for input), since launching a job
+    resets the per-command heap.
+
+Input:
+    None
+
+Output:
+    Launches queued jobs and clears pending wakeups.
+--- */
+void sched_dispatch(void)
+{
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    drain_wakeup_pipe();
+
+    while (queue_count > ZERO_VALUE) {
+        int slot = find_free_slot();
+        if (slot == NO_SLOT) break;
+
+        Job job;
+        restore_job(&queue[queue_head], &job);
+        queue_head = (queue_head + TRUE_VALUE) % SCHED_QUEUE_LEN;
+        queue_count--;
+        launch_job(&job, slot);
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+}
+
+/* ---
+Function Name: sched_child_exited
+
+Purpose:
+    Records that a child process was reaped. When the last stage of a
+    scheduled job is gone its slot is released and the shell is woken
+    to start the next queued job. Async-signal-safe.
+
+Input:
+    pid - process ID returned by waitpid
+
+Output:
+    Updates the slot table; may write to the wakeup pipe.
+--- */
+void sched_child_exited(int pid)
+{
+    int saved_errno = errno;
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    for (int i = ZERO_VALUE; i < SCHED_MAX_SLOTS; i++) {
+        if (slots[i].remaining == ZERO_VALUE) continue;
+        for (int k = ZERO_VALUE; k < MAX_PIPELINE_LEN; k++) {
+            if (slots[i].pids[k] != pid) continue;
+            slots[i].pids[k] = ZERO_VALUE;
+            if (--slots[i].remaining == ZERO_VALUE && wake_pipe[TRUE_VALUE] >= ZERO_VALUE)
+                write(wake_pipe[TRUE_VALUE], NEWLINE_STR, WAKE_BYTE_COUNT);
+            i = SCHED_MAX_SLOTS;
+            break;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    errno = saved_errno;
+}
+
+/* ---
+Function Name: sched_drain
+
+Purpose:
+    Runs every queued job before the shell exits at end of input, waiting
+    for running jobs to free their slots. Jobs already started are left
+    running, as with any background job.
+
+Input:
+    None
+
+Output:
+    Returns once the queue is empty.
+--- */
+void sched_drain(void)
+{
+    while (queue_count > ZERO_VALUE) {
+        sched_dispatch();
+        if (queue_count == ZERO_VALUE || wake_pipe[ZERO_VALUE] < ZERO_VALUE) break;
+
+        struct pollfd pfd = { wake_pipe[ZERO_VALUE], POLLIN, ZERO_VALUE };
+        poll(&pfd, TRUE_VALUE, NO_TIMEOUT);
+    }
+}
+
+/* ---
+Function Name: sched_wakeup_fd
+
+Purpose:
+    Exposes the read end of the wakeup pipe so the input loop can wait on
+    it alongside stdin.
+
+Input:
+    None
+
+Output:
+    File descriptor, or -1 if the pipe could not be created.
+--- */
+int sched_wakeup_fd(void)
+{
+    return wake_pipe[ZERO_VALUE];
+}
+
+/* ---
+Function Name: sched_queued_count
+
+Purpose:
+    Returns how many jobs are waiting in the queue.
+
+Input:
+    None
+
+Output:
+    Number of queued, not yet started jobs.
+--- */
+int sched_queued_count(void)
+{
+    return queue_count;
+}
+
+/* ---
+Function Name: sched_get_limit
+
+Purpose:
+    Returns the maximum number of scheduled jobs run at once.
+
+Input:
+    None
+
+Output:
+    Current worker limit.
+--- */
+int sched_get_limit(void)
+{
+    return current_limit();
+}
+
+/* ---
+Function Name: sched_set_limit
+
+Purpose:
+    Changes the worker limit ('jobs -j N'). Raising it wakes the shell so
+    waiting jobs start at the next idle point.
+
+Input:
+    limit - new limit, clamped to [1, SCHED_MAX_SLOTS]
+
+Output:
+    Updates job_limit.
+--- */
+void sched_set_limit(int limit)
+{
+    if (limit < SCHED_MIN_LIMIT) limit = SCHED_MIN_LIMIT;
+    if (limit > SCHED_MAX_SLOTS) limit = SCHED_MAX_SLOTS;
+    job_limit = limit;
+
+    if (queue_count > ZERO_VALUE && wake_pipe[TRUE_VALUE] >= ZERO_VALUE)
+        write(wake_pipe[TRUE_VALUE], NEWLINE_STR, WAKE_BYTE_COUNT);
+}
+
+/* ---
+Function Name: sched_print_queue
+
+Purpose:
+    Lists waiting jobs in start order as "[Qn] Queued<TAB>command".
+
+Input:
+    None
+
+Output:
+    Writes the queue to standard output.
+--- */
+void sched_print_queue(void)
+{
+    for (int n = ZERO_VALUE; n < queue_count; n++)
+        print_entry(&queue[(queue_head + n) % SCHED_QUEUE_LEN], n + TRUE_VALUE);
+}
+
+/* ---
+Function Name: print_entry
+
+Purpose:
+    Writes one queued job as "[Qn] Queued<TAB>command".
+
+Input:
+    entry    - queued job
+    position - 1-based position in the queue
+
+Output:
+    Writes the line to standard output.
+--- */
+static void print_entry(QueuedJob *entry, int position)
+{
+    char num[MAX_MSG_LEN];
+    myitoa(position, num);
+
+    write(STDOUT_FILENO, MSG_QUEUED_PREFIX, mystrlen(MSG_QUEUED_PREFIX));
+    write(STDOUT_FILENO, num, mystrlen(num));
+    write(STDOUT_FILENO, MSG_QUEUED_SUFFIX, mystrlen(MSG_QUEUED_SUFFIX));
+
+    char *arg = entry->text;
+    for (int s = ZERO_VALUE; s < entry->num_stages; s++) {
+        if (s > ZERO_VALUE)
+            write(STDOUT_FILENO, MSG_PIPE_SEPARATOR, mystrlen(MSG_PIPE_SEPARATOR));
+        for (int a = ZERO_VALUE; a < entry->argc[s]; a++) {
+            if (a > ZERO_VALUE)
+                write(STDOUT_FILENO, MSG_ARG_SEPARATOR, mystrlen(MSG_ARG_SEPARATOR));
+            write(STDOUT_FILENO, arg, mystrlen(arg));
+            arg += mystrlen(arg) + TRUE_VALUE;
+        }
+    }
+    if (entry->has_infile) {
+        write(STDOUT_FILENO, MSG_INPUT_REDIRECT, mystrlen(MSG_INPUT_REDIRECT));
+        write(STDOUT_FILENO, arg, mystrlen(arg));
+        arg += mystrlen(arg) + TRUE_VALUE;
+    }
+    if (entry->has_outfile) {
+        write(STDOUT_FILENO, MSG_OUTPUT_REDIRECT, mystrlen(MSG_OUTPUT_REDIRECT));
+        write(STDOUT_FILENO, arg, mystrlen(arg));
+    }
+    write(STDOUT_FILENO, NEWLINE_STR, mystrlen(NEWLINE_STR));
+}
+
+/* ---
+Function Name: find_free_slot
+
+Purpose:
+    Finds an unused slot if fewer than job_limit scheduled jobs are
+    running. Caller blocks SIGCHLD.
+
+Input:
+    None
+
+Output:
+    Slot index, or NO_SLOT if the limit is reached.
+--- */
+static int find_free_slot(void)
+{
+    int running = ZERO_VALUE;
+    int free_slot = NO_SLOT;
+
+    for (int i = ZERO_VALUE; i < SCHED_MAX_SLOTS; i++) {
+        if (slots[i].remaining > ZERO_VALUE)
+            running++;
+        else if (free_slot == NO_SLOT)
+            free_slot = i;
+    }
+    return (running < current_limit()) ? free_slot : NO_SLOT;
+}
+
+/* ---
+Function Name: current_limit
+
+Purpose:
+    Gives the worker limit, setting the default (the number of online
+    CPUs, which sysconf() reads from /sys) the first time it is needed.
+
+Input:
+    None
+
+Output:
+    Current worker limit.
+--- */
+static int current_limit(void)
+{
+    if (job_limit == SCHED_LIMIT_UNSET) sched_set_limit((int)sysconf(_SC_NPROCESSORS_ONLN));
+    return job_limit;
+}
+
+/* ---
+Function Name: launch_job
+
+Purpose:
+    Starts a job in the background and records its stage PIDs in a slot.
+    SIGCHLD stays blocked until the slot is filled, so no stage can be
+    reaped before the scheduler knows about it.
+
+Input:
+    job  - job to start
+    slot - free slot index
+
+Output:
+    Returns 0 on success, non-zero if the job could not be started.
+--- */
+static int launch_job(Job *job, int slot)
+{
+    job->background = TRUE_VALUE;
+    int status = run_job(job, sched_envp);
+    if (status != EXIT_SUCCESS_CODE) return status;
+
+    for (int k = ZERO_VALUE; k < MAX_PIPELINE_LEN; k++)
+        slots[slot].pids[k] = (k < (int)job->num_stages) ? job->pids[k] : ZERO_VALUE;
+    slots[slot].remaining = job->num_stages;
+    return EXIT_SUCCESS_CODE;
+}
+
+/* ---
+Function Name: enqueue_job
+
+Purpose:
+    Appends a copy of a job to the FIFO. Arguments are copied because the
+    parsed job lives on the per-command heap.
+
+Input:
+    job - parsed and expanded job
+
+Output:
+    Prints the queue position. Returns 0, or 1 if the queue or the
+    entry's text buffer is full.
+--- */
+static int enqueue_job(Job *job)
+{
+    if (queue_count == SCHED_QUEUE_LEN) {
+        print_error(ERR_QUEUE_FULL);
+        return EXIT_FAILURE_CODE;
+    }
+
+    QueuedJob *entry = &queue[(queue_head + queue_count) % SCHED_QUEUE_LEN];
+    char *p = entry->text;
+    char *end = entry->text + SCHED_TEXT_LEN;
+
+    entry->num_stages = job->num_stages;
+    for (int s = ZERO_VALUE; s < (int)job->num_stages; s++) {
+        entry->argc[s] = job->pipeline[s].argc;
+        for (int a = ZERO_VALUE; p && a < (int)job->pipeline[s].argc; a++)
+            p = copy_arg(p, end, job->pipeline[s].argv[a]);
+    }
+    entry->has_infile = (job->infile_path != NULL);
+    entry->has_outfile = (job->outfile_path != NULL);
+    entry->in_fd = job->in_fd;
+    entry->out_fd = job->out_fd;
+    if (p && entry->has_infile) p = copy_arg(p, end, job->infile_path);
+    if (p && entry->has_outfile) p = copy_arg(p, end, job->outfile_path);
+
+    if (!p) {
+        print_error(ERR_ARG_EXCD);
+        return EXIT_FAILURE_CODE;
+    }
+
+    queue_count++;
+    print_entry(entry, queue_count);
+    return EXIT_SUCCESS_CODE;
+}
+
+/* ---
+Function Name: restore_job
+
+Purpose:
+    Rebuilds a Job from a queued entry. The argument pointers refer to the
+    entry's text, which stays intact until the job has been launched.
+
+Input:
+    entry - queued job
+    job   - Job to populate
+
+Output:
+    job describes the queued command as a background job.
+--- */
+static void restore_job(QueuedJob *entry, Job *job)
+{
+    char *arg = entry->text;
+
+    job->num_stages = entry->num_stages;
+    for (int s = ZERO_VALUE; s < entry->num_stages; s++) {
+        job->pipeline[s].argc = entry->argc[s];
+        for (int a = ZERO_VALUE; a < entry->argc[s]; a++) {
+            job->pipeline[s].argv[a] = arg;
+            arg += mystrlen(arg) + TRUE_VALUE;
+        }
+        job->pipeline[s].argv[entry->argc[s]] = NULL;
+    }
+
+    job->infile_path = NULL;
+    job->outfile_path = NULL;
+    if (entry->has_infile) {
+        job->infile_path = arg;
+        arg += mystrlen(arg) + TRUE_VALUE;
+    }
+    if (entry->has_outfile)
+        job->outfile_path = arg;
+
+    job->background = TRUE_VALUE;
+    job->pgid = ZERO_VALUE;
+    job->in_fd = entry->in_fd;
+    job->out_fd = entry->out_fd;
+    job->num_pass_fds = ZERO_VALUE;
+}
+
+/* ---
+Function Name: drain_wakeup_pipe
+
+Purpose:
+    Empties the non-blocking wakeup pipe so it only signals new events.
+
+Input:
+    None
+
+Output:
+    Discards pending wakeup bytes.
+--- */
+static void drain_wakeup_pipe(void)
+{
+    char buf[WAKE_DRAIN_LEN];
+    if (wake_pipe[ZERO_VALUE] < ZERO_VALUE) return;
+    while (read(wake_pipe[ZERO_VALUE], buf, WAKE_DRAIN_LEN) > ZERO_VALUE) {}
+}
+
+/* ---
+Function Name: copy_arg
+
+Purpose:
+    Appends a NUL-terminated string to a queued entry's text buffer.
+
+Input:
+    p   - write position
+    end - end of the buffer
+    arg - string to copy
+
+Output:
+    Position after the copied terminator, or NULL if it does not fit.
+--- */
+static char *copy_arg(char *p, char *end, const char *arg)
+{
+    int len = mystrlen(arg) + TRUE_VALUE;
+    if (p + len > end) return NULL;
+    mystrcpy(p, arg);
+    return p + len;
+}
@@ -0,0 +1,72 @@
+#ifndef JOBSCHED_H
+#define JOBSCHED_H
+
+#include "jobs.h"
+
+/* SCHEDULER SIZES */
+#define SCHED_QUEUE_LEN         512
+#define SCHED_MAX_SLOTS         256
+#define SCHED_TEXT_LEN          MAX_ARGS
+#define SCHED_MIN_LIMIT         1
+#define SCHED_LIMIT_UNSET       0       /* CPU count not read yet */
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NO_SLOT                 -1
+#define NO_TIMEOUT              -1
+#define WAKE_BYTE_COUNT         1
+#define WAKE_DRAIN_LEN          64
+
+/* MESSAGE FORMATTING CONSTANTS */
+#define MSG_QUEUED_PREFIX       "[Q"
+#define MSG_QUEUED_SUFFIX       "] Queued\t"
+#define MSG_PIPE_SEPARATOR      " | "
+#define MSG_ARG_SEPARATOR       " "
+#define MSG_INPUT_REDIRECT      " < "
+#define MSG_OUTPUT_REDIRECT     " > "
+#define NEWLINE_STR             "\n"
+
+/* QUEUED JOB: a parsed and expanded job copied out of the per-command heap */
+typedef struct
+{
+    char text[SCHED_TEXT_LEN];      /* NUL-separated arguments, then paths */
+    int argc[MAX_PIPELINE_LEN];
+    int num_stages;
+    int has_infile;
+    int has_outfile;
+    int in_fd;                      /* '<&N' and '>&N' descriptors, or NO_FD */
+    int out_fd;
+} QueuedJob;
+
+/* RUNNING SLOT: one scheduled job that has been started */
+typedef struct
+{
+    int pids[MAX_PIPELINE_LEN];
+    int remaining;                  /* stages not yet reaped, 0 = free */
+} RunSlot;
+
+/* FUNCTION DECLARATIONS */
+void sched_init(char *envp[]);
+int sched_submit(Job *job);
+void sched_dispatch(void);
+void sched_child_exited(int pid);
+void sched_drain(void);
+int sched_wakeup_fd(void);
+int sched_queued_count(void);
+int sched_get_limit(void);
+void sched_set_limit(int limit);
+void sched_print_queue(void);
+
+/* STATIC HELPER FUNCTIONS */
+static int current_limit(void);
+static int find_free_slot(void);
+static int launch_job(Job *job, int slot);
+static int enqueue_job(Job *job);
+static void restore_job(QueuedJob *entry, Job *job);
+static void print_entry(QueuedJob *entry, int position);
+static void drain_wakeup_pipe(void);
+static char *copy_arg(char *p, char *end, const char *arg);
+
+#endif
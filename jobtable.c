@@ -0,0 +1,610 @@
+#include "jobtable.h"
+#include "runjob.h"
+#include "mystring.h"
+#include "jobcgroup.h"
+#include "trace.h"
+
+#include <unistd.h>    /* write */
+#include <string.h>    /* strsignal */
+#include <signal.h>    /* sigprocmask */
+#include <sys/wait.h>  /* WIFSTOPPED, WIFCONTINUED */
+
+/* Job table: slot i holds job number i + 1 */
+static JobEntry jobs[MAX_JOBS];
+static unsigned long job_clock = ZERO_VALUE;
+
+/* Process group of the shell, set once at startup */
+int shell_pgid = ZERO_VALUE;
+
+/* ---
+Function Name: add_job
+
+Purpose:
+    Records a launched job with all of its stage PIDs so that builtins
+    such as 'jobs', 'fg' and 'bg' can manage the whole pipeline. The
+    lowest free job number is used. Callers block SIGCHLD so no stage can
+    be reaped before it is recorded.
+
+Input:
+    job - launched job; job->pids and job->pgid are filled in
+
+Output:
+    The new entry with every process running, or NULL if the table is
+    full.
+--- */
+JobEntry *add_job(Job *job)
+{
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        JobEntry *entry = &jobs[i];
+        if (entry->id != NO_JOB_ID) continue;
+
+        entry->id = i + JOB_ID_OFFSET;
+        entry->pgid = job->pgid;
+        entry->num_procs = job->num_stages;
+        for (int k = ZERO_VALUE; k < (int)job->num_stages; k++) {
+            entry->pids[k] = job->pids[k];
+            entry->state[k] = PROC_RUNNING;
+            entry->status[k] = ZERO_VALUE;
+        }
+        entry->cgroup = job->cgroup;
+        build_job_text(job, entry->command);
+        touch_job(entry);
+        return entry;
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: remove_job
+
+Purpose:
+    Frees a job's slot and number, and its cgroup if it has one.
+
+Input:
+    entry - job to remove
+
+Output:
+    The slot becomes free.
+--- */
+void remove_job(JobEntry *entry)
+{
+    if (entry->cgroup.id && trace_enabled() && job_state(entry) == PROC_DONE) {
+        CgroupStats stats;
+        cgroup_read_stats(&entry->cgroup, &stats);
+        trace_job_usage(entry->pids[ZERO_VALUE], stats.memory_peak, stats.cpu_usec);
+    }
+    cgroup_release(&entry->cgroup);
+    entry->id = NO_JOB_ID;
+    entry->num_procs = ZERO_VALUE;
+}
+
+/* ---
+Function Name: find_job_by_pid
+
+Purpose:
+    Finds the job that owns a process.
+
+Input:
+    pid - process ID of any stage
+
+Output:
+    The owning job, or NULL.
+--- */
+JobEntry *find_job_by_pid(int pid)
+{
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id == NO_JOB_ID) continue;
+        for (int k = ZERO_VALUE; k < jobs[i].num_procs; k++) {
+            if (jobs[i].pids[k] == pid) return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: find_job_by_id
+
+Purpose:
+    Finds a job by its job number.
+
+Input:
+    id - job number, as shown by 'jobs'
+
+Output:
+    The job, or NULL.
+--- */
+JobEntry *find_job_by_id(int id)
+{
+    if (id < JOB_ID_OFFSET || id > MAX_JOBS) return NULL;
+    JobEntry *entry = &jobs[id - JOB_ID_OFFSET];
+    return (entry->id == NO_JOB_ID) ? NULL : entry;
+}
+
+/* ---
+Function Name: collect_jobs
+
+Purpose:
+    Lists every job in the table in job-number order.
+
+Input:
+    out - array of at least MAX_JOBS entries
+
+Output:
+    Fills out and returns the number of jobs.
+--- */
+int collect_jobs(JobEntry **out)
+{
+    int count = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id != NO_JOB_ID) out[count++] = &jobs[i];
+    }
+    return count;
+}
+
+/* ---
+Function Name: most_recent_job
+
+Purpose:
+    Returns the job that was started, stopped or resumed last.
+
+Input:
+    None
+
+Output:
+    The job, or NULL if the table is empty.
+--- */
+JobEntry *most_recent_job(void)
+{
+    JobEntry *best = NULL;
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id == NO_JOB_ID) continue;
+        if (!best || jobs[i].order > best->order) best = &jobs[i];
+    }
+    return best;
+}
+
+/* ---
+Function Name: previous_job
+
+Purpose:
+    Returns the job used before the most recent one (%-). With a single
+    job this is that job, as in Bash.
+
+Input:
+    None
+
+Output:
+    The job, or NULL if the table is empty.
+--- */
+JobEntry *previous_job(void)
+{
+    JobEntry *current = most_recent_job();
+    JobEntry *best = NULL;
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id == NO_JOB_ID || &jobs[i] == current) continue;
+        if (!best || jobs[i].order > best->order) best = &jobs[i];
+    }
+    return best ? best : current;
+}
+
+/* ---
+Function Name: resolve_job_spec
+
+Purpose:
+    Finds the job a job spec refers to:
+      %n         job number n (direct slot lookup)
+      %+ %% %    the current (most recent) job
+      %-         the previous job
+      %text      the job whose command starts with text
+      %?text     the job whose command contains text
+      pid        the job owning that process
+
+Input:
+    spec - job spec text
+    out  - receives the job when found
+
+Output:
+    JOB_SPEC_FOUND, JOB_SPEC_NOT_FOUND, or JOB_SPEC_AMBIGUOUS when a
+    text spec matches more than one job.
+--- */
+int resolve_job_spec(const char *spec, JobEntry **out)
+{
+    *out = NULL;
+
+    if (spec[ZERO_VALUE] != JOB_SPEC_CHAR) {
+        int pid = parse_job_number(spec);
+        if (pid > ZERO_VALUE) *out = find_job_by_pid(pid);
+        return *out ? JOB_SPEC_FOUND : JOB_SPEC_NOT_FOUND;
+    }
+
+    const char *text = spec + TRUE_VALUE;
+    if (text[ZERO_VALUE] == NULL_CHAR ||
+        ((text[ZERO_VALUE] == CURRENT_JOB_CHAR || text[ZERO_VALUE] == JOB_SPEC_CHAR) &&
+         text[TRUE_VALUE] == NULL_CHAR)) {
+        *out = most_recent_job();
+    } else if (text[ZERO_VALUE] == PREVIOUS_JOB_CHAR && text[TRUE_VALUE] == NULL_CHAR) {
+        *out = previous_job();
+    } else if (parse_job_number(text) > ZERO_VALUE) {
+        *out = find_job_by_id(parse_job_number(text));
+    } else {
+        int anywhere = (text[ZERO_VALUE] == CONTAINS_JOB_CHAR);
+        if (anywhere) text++;
+        for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+            if (jobs[i].id == NO_JOB_ID || !match_job_text(jobs[i].command, text, anywhere))
+                continue;
+            if (*out) {
+                *out = NULL;
+                return JOB_SPEC_AMBIGUOUS;
+            }
+            *out = &jobs[i];
+        }
+    }
+    return *out ? JOB_SPEC_FOUND : JOB_SPEC_NOT_FOUND;
+}
+
+/* ---
+Function Name: update_job_status
+
+Purpose:
+    Applies a status reported by waitpid() to the process it belongs to.
+    Async-signal-safe; called from the SIGCHLD handler.
+
+Input:
+    pid    - process ID
+    status - wait status (exit, signal, stop or continue)
+
+Output:
+    Updates the owning job's process state, if any.
+--- */
+void update_job_status(int pid, int status)
+{
+    JobEntry *entry = find_job_by_pid(pid);
+    if (!entry) return;
+
+    for (int k = ZERO_VALUE; k < entry->num_procs; k++) {
+        if (entry->pids[k] == pid) {
+            set_job_proc_status(entry, k, status);
+            return;
+        }
+    }
+}
+
+/* ---
+Function Name: set_job_proc_status
+
+Purpose:
+    Sets one process's state from a wait status.
+
+Input:
+    entry  - job
+    index  - stage index within the job
+    status - wait status
+
+Output:
+    Updates entry->state and entry->status.
+--- */
+void set_job_proc_status(JobEntry *entry, int index, int status)
+{
+    if (WIFSTOPPED(status)) {
+        entry->state[index] = PROC_STOPPED;
+        entry->status[index] = status;
+    } else if (WIFCONTINUED(status)) {
+        entry->state[index] = PROC_RUNNING;
+    } else {
+        entry->state[index] = PROC_DONE;
+        entry->status[index] = status;
+    }
+}
+
+/* ---
+Function Name: job_state
+
+Purpose:
+    Combines the states of a job's processes: running while any process
+    runs, stopped if the rest are stopped, done once all are reaped.
+
+Input:
+    entry - job
+
+Output:
+    PROC_RUNNING, PROC_STOPPED or PROC_DONE.
+--- */
+int job_state(JobEntry *entry)
+{
+    int stopped = ZERO_VALUE;
+    for (int k = ZERO_VALUE; k < entry->num_procs; k++) {
+        if (entry->state[k] == PROC_RUNNING) return PROC_RUNNING;
+        if (entry->state[k] == PROC_STOPPED) stopped = TRUE_VALUE;
+    }
+    return stopped ? PROC_STOPPED : PROC_DONE;
+}
+
+/* ---
+Function Name: job_exit_status
+
+Purpose:
+    Returns the exit code of a finished job (that of its last stage).
+
+Input:
+    entry - job
+
+Output:
+    Exit code in the range 0-255.
+--- */
+int job_exit_status(JobEntry *entry)
+{
+    if (entry->num_procs == ZERO_VALUE) return EXIT_SUCCESS_CODE;
+    return wait_status_to_exit_code(entry->status[entry->num_procs - TRUE_VALUE]);
+}
+
+/* ---
+Function Name: mark_job_running
+
+Purpose:
+    Marks every stopped process of a job as running after SIGCONT.
+
+Input:
+    entry - job
+
+Output:
+    Updates entry->state.
+--- */
+void mark_job_running(JobEntry *entry)
+{
+    for (int k = ZERO_VALUE; k < entry->num_procs; k++) {
+        if (entry->state[k] == PROC_STOPPED) entry->state[k] = PROC_RUNNING;
+    }
+}
+
+/* ---
+Function Name: touch_job
+
+Purpose:
+    Makes a job the most recent one (the default for 'fg' and 'bg').
+
+Input:
+    entry - job
+
+Output:
+    Updates entry->order.
+--- */
+void touch_job(JobEntry *entry)
+{
+    entry->order = ++job_clock;
+}
+
+/* ---
+Function Name: print_job_status
+
+Purpose:
+    Writes "[n]+ State<TAB>command" for one job; '+' marks the current
+    job, '-' the previous one. A job whose last process was killed by a
+    signal shows the signal's description ("Terminated", "Killed")
+    instead of "Done".
+
+Input:
+    entry - job
+
+Output:
+    Writes the line to standard output.
+--- */
+void print_job_status(JobEntry *entry)
+{
+    const char *state = STATUS_RUNNING_TEXT;
+    int combined = job_state(entry);
+    int last_status = entry->status[entry->num_procs - TRUE_VALUE];
+    if (combined == PROC_STOPPED) state = STATUS_STOPPED_TEXT;
+    else if (combined == PROC_DONE && WIFSIGNALED(last_status)) state = strsignal(WTERMSIG(last_status));
+    else if (combined == PROC_DONE) state = STATUS_DONE_TEXT;
+
+    const char *mark = MSG_OTHER_MARK;
+    if (entry == most_recent_job()) mark = MSG_CURRENT_MARK;
+    else if (entry == previous_job()) mark = MSG_PREVIOUS_MARK;
+
+    char id[JOB_ID_STR_LEN];
+    myitoa(entry->id, id);
+
+    write(STDOUT_FILENO, MSG_JOB_PREFIX, mystrlen(MSG_JOB_PREFIX));
+    write(STDOUT_FILENO, id, mystrlen(id));
+    write(STDOUT_FILENO, MSG_JOB_SUFFIX, mystrlen(MSG_JOB_SUFFIX));
+    write(STDOUT_FILENO, mark, mystrlen(mark));
+    write(STDOUT_FILENO, state, mystrlen(state));
+    write(STDOUT_FILENO, JOB_TAB_STR, mystrlen(JOB_TAB_STR));
+    write(STDOUT_FILENO, entry->command, mystrlen(entry->command));
+    if (combined == PROC_DONE && entry->cgroup.id) print_cgroup_usage(entry);
+    write(STDOUT_FILENO, JOB_NEWLINE_STR, mystrlen(JOB_NEWLINE_STR));
+}
+
+/* ---
+Function Name: print_cgroup_usage
+
+Purpose:
+    Appends a finished limited job's peak memory and CPU time, read
+    back from its cgroup, to its status line.
+
+Input:
+    entry - finished job with a cgroup
+
+Output:
+    Writes e.g. "<TAB>(peak 5120K, cpu 12ms)" to standard output.
+--- */
+static void print_cgroup_usage(JobEntry *entry)
+{
+    CgroupStats stats;
+    char num[JOB_ID_STR_LEN];
+    cgroup_read_stats(&entry->cgroup, &stats);
+    if (stats.memory_peak < ZERO_VALUE && stats.cpu_usec < ZERO_VALUE) return;
+
+    write(STDOUT_FILENO, MSG_USAGE_PREFIX, mystrlen(MSG_USAGE_PREFIX));
+    myitoa((int)(stats.memory_peak < ZERO_VALUE ? ZERO_VALUE : stats.memory_peak / BYTES_PER_KB), num);
+    write(STDOUT_FILENO, num, mystrlen(num));
+    write(STDOUT_FILENO, MSG_BYTES_UNIT, mystrlen(MSG_BYTES_UNIT));
+    write(STDOUT_FILENO, MSG_USAGE_CPU, mystrlen(MSG_USAGE_CPU));
+    myitoa((int)(stats.cpu_usec < ZERO_VALUE ? ZERO_VALUE : stats.cpu_usec / USEC_PER_MS), num);
+    write(STDOUT_FILENO, num, mystrlen(num));
+    write(STDOUT_FILENO, MSG_USAGE_SUFFIX, mystrlen(MSG_USAGE_SUFFIX));
+}
+
+/* ---
+Function Name: print_jobs
+
+Purpose:
+    Lists every job in job-number order ('jobs'). Finished jobs are
+    listed once as Done and then removed.
+
+Input:
+    None
+
+Output:
+    Writes one status line per job.
+--- */
+void print_jobs(void)
+{
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id == NO_JOB_ID) continue;
+        print_job_status(&jobs[i]);
+        /* a finished job has now been reported */
+        if (job_state(&jobs[i]) == PROC_DONE) remove_job(&jobs[i]);
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+}
+
+/* ---
+Function Name: report_finished_jobs
+
+Purpose:
+    Announces jobs whose processes have all been reaped and frees their
+    numbers. Called before each prompt, as Bash does.
+
+Input:
+    None
+
+Output:
+    Writes "[n]  Done<TAB>command" lines and removes those jobs.
+--- */
+void report_finished_jobs(void)
+{
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    for (int i = ZERO_VALUE; i < MAX_JOBS; i++) {
+        if (jobs[i].id == NO_JOB_ID || job_state(&jobs[i]) != PROC_DONE) continue;
+        print_job_status(&jobs[i]);
+        remove_job(&jobs[i]);
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+}
+
+/* ---
+Function Name: build_job_text
+
+Purpose:
+    Renders a job's pipeline as text for job listings, since the parsed
+    arguments live on the per-command heap.
+
+Input:
+    job - parsed job
+    buf - output buffer of JOB_TEXT_LEN bytes
+
+Output:
+    buf holds e.g. "sort < in | uniq > out", truncated if too long.
+--- */
+static void build_job_text(Job *job, char *buf)
+{
+    char *p = buf;
+    char *end = buf + JOB_TEXT_LEN - TRUE_VALUE;
+
+    for (int s = ZERO_VALUE; s < (int)job->num_stages; s++) {
+        if (s > ZERO_VALUE) p = append_text(p, end, JOB_PIPE_TEXT);
+        for (int a = ZERO_VALUE; a < (int)job->pipeline[s].argc; a++) {
+            if (a > ZERO_VALUE) p = append_text(p, end, JOB_ARG_TEXT);
+            p = append_text(p, end, job->pipeline[s].argv[a]);
+        }
+    }
+    if (job->infile_path) {
+        p = append_text(p, end, JOB_INPUT_TEXT);
+        p = append_text(p, end, job->infile_path);
+    }
+    if (job->outfile_path) {
+        p = append_text(p, end, JOB_OUTPUT_TEXT);
+        p = append_text(p, end, job->outfile_path);
+    }
+    *p = NULL_CHAR;
+}
+
+/* ---
+Function Name: append_text
+
+Purpose:
+    Copies a string into a bounded buffer.
+
+Input:
+    p   - write position
+    end - last usable position
+    s   - string to copy
+
+Output:
+    New write position.
+--- */
+static char *append_text(char *p, char *end, const char *s)
+{
+    while (*s && p < end) *p++ = *s++;
+    return p;
+}
+
+/* ---
+Function Name: parse_job_number
+
+Purpose:
+    Parses a job number or PID made only of digits.
+
+Input:
+    text - number text
+
+Output:
+    The number, or 0 if text is empty or not all digits.
+--- */
+static int parse_job_number(const char *text)
+{
+    int n = ZERO_VALUE;
+    if (text[ZERO_VALUE] == NULL_CHAR) return ZERO_VALUE;
+    for (int i = ZERO_VALUE; text[i]; i++) {
+        if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return ZERO_VALUE;
+        n = n * DECIMAL_BASE + (text[i] - ZERO_CHAR);
+    }
+    return n;
+}
+
+/* ---
+Function Name: match_job_text
+
+Purpose:
+    Matches a %text or %?text job spec against a job's command.
+
+Input:
+    command  - job command text
+    text     - text from the spec
+    anywhere - non-zero to match anywhere, zero to match a prefix
+
+Output:
+    Returns 1 on a match.
+--- */
+static int match_job_text(const char *command, const char *text, int anywhere)
+{
+    for (int start = ZERO_VALUE; command[start]; start++) {
+        int k = ZERO_VALUE;
+        while (text[k] && command[start + k] == text[k]) k++;
+        if (text[k] == NULL_CHAR) return TRUE_VALUE;
+        if (!anywhere) break;
+    }
+    return ZERO_VALUE;
+}
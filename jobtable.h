@@ -0,0 +1,99 @@
+#ifndef JOBTABLE_H
+#define JOBTABLE_H
+
+#include "jobs.h"
+
+/* JOB TABLE SIZES */
+#define JOB_TEXT_LEN            256
+#define NO_JOB_ID               0
+
+/* PROCESS AND JOB STATES */
+#define PROC_RUNNING            0
+#define PROC_STOPPED            1
+#define PROC_DONE               2
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define JOB_ID_OFFSET           1
+#define JOB_ID_STR_LEN          16
+#define NULL_CHAR               '\0'
+
+/* JOB SPECS: %n, %+, %%, %-, %prefix, %?text, or a PID */
+#define JOB_SPEC_CHAR           '%'
+#define CURRENT_JOB_CHAR        '+'
+#define PREVIOUS_JOB_CHAR       '-'
+#define CONTAINS_JOB_CHAR       '?'
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define DECIMAL_BASE            10
+#define JOB_SPEC_FOUND          0
+#define JOB_SPEC_NOT_FOUND      1
+#define JOB_SPEC_AMBIGUOUS      2
+
+/* OUTPUT FORMATTING */
+#define STATUS_RUNNING_TEXT     "Running"
+#define STATUS_DONE_TEXT        "Done"
+#define STATUS_STOPPED_TEXT     "Stopped"
+#define MSG_JOB_PREFIX          "["
+#define MSG_JOB_SUFFIX          "]"
+#define MSG_CURRENT_MARK        "+ "
+#define MSG_PREVIOUS_MARK       "- "
+#define MSG_OTHER_MARK          "  "
+#define JOB_TAB_STR             "\t"
+#define JOB_NEWLINE_STR         "\n"
+#define JOB_PIPE_TEXT           " | "
+#define JOB_ARG_TEXT            " "
+#define JOB_INPUT_TEXT          " < "
+#define JOB_OUTPUT_TEXT         " > "
+#define MSG_USAGE_PREFIX        "\t(peak "
+#define MSG_USAGE_CPU           ", cpu "
+#define MSG_USAGE_SUFFIX        "ms)"
+#define MSG_BYTES_UNIT          "K"
+#define BYTES_PER_KB            1024
+#define USEC_PER_MS             1000
+
+/* ONE BACKGROUND OR STOPPED JOB: every process of its pipeline */
+typedef struct
+{
+    int id;                             /* job number, NO_JOB_ID if free */
+    int pgid;                           /* process group of all stages */
+    int num_procs;
+    int pids[MAX_PIPELINE_LEN];
+    int state[MAX_PIPELINE_LEN];        /* PROC_RUNNING/STOPPED/DONE */
+    int status[MAX_PIPELINE_LEN];       /* wait status once stopped or done */
+    unsigned long order;                /* larger = more recently used */
+    JobCgroup cgroup;                   /* resource-limit group, if any */
+    char command[JOB_TEXT_LEN];
+} JobEntry;
+
+/* GLOBAL VARIABLES */
+extern int shell_pgid;
+
+/* FUNCTION DECLARATIONS */
+JobEntry *add_job(Job *job);
+void remove_job(JobEntry *entry);
+JobEntry *find_job_by_pid(int pid);
+JobEntry *find_job_by_id(int id);
+int collect_jobs(JobEntry **out);
+JobEntry *most_recent_job(void);
+JobEntry *previous_job(void);
+int resolve_job_spec(const char *spec, JobEntry **out);
+void update_job_status(int pid, int status);
+void set_job_proc_status(JobEntry *entry, int index, int status);
+int job_state(JobEntry *entry);
+int job_exit_status(JobEntry *entry);
+void mark_job_running(JobEntry *entry);
+void touch_job(JobEntry *entry);
+void print_job_status(JobEntry *entry);
+void print_jobs(void);
+void report_finished_jobs(void);
+
+/* STATIC HELPER FUNCTIONS */
+static char *append_text(char *p, char *end, const char *s);
+static void build_job_text(Job *job, char *buf);
+static void print_cgroup_usage(JobEntry *entry);
+static int parse_job_number(const char *text);
+static int match_job_text(const char *command, const char *text, int anywhere);
+
+#endif
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE    /* syscall */
+#include "jobwait.h"
+#include "jobsched.h"
+#include "runjob.h"
+#include "trace.h"
+
+#include <unistd.h>       /* close, syscall */
+#include <poll.h>         /* poll */
+#include <signal.h>       /* sigprocmask */
+#include <sys/wait.h>     /* wait4 */
+#include <sys/syscall.h>  /* SYS_pidfd_open */
+#include <time.h>         /* clock_gettime */
+#include <errno.h>
+
+/* Processes being watched by the current wait, and their poll set */
+static WaitFd watches[WAIT_MAX_FDS];
+static struct pollfd poll_set[WAIT_MAX_FDS];
+static int num_watches = ZERO_VALUE;
+
+/* ---
+Function Name: wait_for_jobs
+
+Purpose:
+    Blocks until background jobs finish ('wait'). Every running process
+    of the jobs is watched through a pidfd, so however many children
+    there are, the shell sleeps in a single poll() until one of them
+    exits and then reaps exactly that one. SIGCHLD stays blocked
+    meanwhile, so no process can be reaped (and its PID reused) between
+    opening its pidfd and reaping it. Queued jobs are started as
+    running ones finish.
+
+Input:
+    targets     - jobs to wait for; if count is 0, every job in the
+                  table plus every job still queued in the scheduler
+    count       - number of targets
+    wait_any    - non-zero to return as soon as one job finishes
+    timeout_ms  - maximum wait in milliseconds, or NO_TIMEOUT
+    exit_status - receives the exit status of the finished job (wait_any),
+                  of the last target, or 0 when waiting for every job
+
+Output:
+    WAIT_COMPLETED, WAIT_TIMED_OUT, WAIT_INTERRUPTED (a signal such as
+    SIGINT arrived) or WAIT_NO_JOBS (wait_any with nothing to wait for).
+    Jobs whose status is returned are removed from the table; jobs that
+    stopped instead of exiting count as finished but are kept.
+--- */
+int wait_for_jobs(JobEntry **targets, int count, int wait_any, int timeout_ms, int *exit_status)
+{
+    JobEntry *all[MAX_JOBS];
+    int wait_all_jobs = (count == ZERO_VALUE);
+    long long deadline = (timeout_ms >= ZERO_VALUE) ? monotonic_ms() + timeout_ms : NO_TIMEOUT;
+    int result = WAIT_COMPLETED;
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    *exit_status = EXIT_SUCCESS_CODE;
+    num_watches = ZERO_VALUE;
+
+    for (;;) {
+        /* start queued jobs whose slots were freed by the last reap */
+        sched_dispatch();
+
+        int queued = ZERO_VALUE;
+        if (wait_all_jobs) {
+            count = collect_jobs(all);
+            targets = all;
+            queued = sched_queued_count();
+            if (count == ZERO_VALUE && queued == ZERO_VALUE) {
+                if (wait_any) result = WAIT_NO_JOBS;
+                break;
+            }
+        }
+
+        int finished = ZERO_VALUE;
+        JobEntry *first_done = NULL;
+        for (int i = ZERO_VALUE; i < count; i++) {
+            if (!job_finished(targets[i])) continue;
+            finished++;
+            if (!first_done) first_done = targets[i];
+        }
+
+        if (wait_any && first_done) {
+            *exit_status = collect_result(first_done);
+            break;
+        }
+        if (!wait_any && finished == count && queued == ZERO_VALUE) {
+            for (int i = ZERO_VALUE; i < count; i++)
+                *exit_status = collect_result(targets[i]);
+            if (wait_all_jobs) *exit_status = EXIT_SUCCESS_CODE;
+            break;
+        }
+
+        int changed = ZERO_VALUE;
+        for (int i = ZERO_VALUE; i < count; i++) {
+            for (int k = ZERO_VALUE; k < targets[i]->num_procs; k++) {
+                if (targets[i]->state[k] == PROC_RUNNING && !watch_process(targets[i], k))
+                    changed = TRUE_VALUE;
+            }
+        }
+        if (changed) continue;
+
+        int wait_ms = NO_TIMEOUT;
+        if (deadline != NO_TIMEOUT) {
+            long long left = deadline - monotonic_ms();
+            wait_ms = (left > ZERO_VALUE) ? (int)left : ZERO_VALUE;
+        }
+
+        for (int i = ZERO_VALUE; i < num_watches; i++) {
+            poll_set[i].fd = watches[i].fd;
+            poll_set[i].events = POLLIN;
+            poll_set[i].revents = ZERO_VALUE;
+        }
+
+        int ready = poll(poll_set, num_watches, wait_ms);
+        if (ready < ZERO_VALUE) {
+            if (errno == EINTR) {
+                result = WAIT_INTERRUPTED;
+                break;
+            }
+            continue;
+        }
+        if (ready == ZERO_VALUE) {
+            result = WAIT_TIMED_OUT;
+            break;
+        }
+        reap_ready(ready);
+    }
+
+    close_watches();
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return result;
+}
+
+/* ---
+Function Name: pidfd_open_pid
+
+Purpose:
+    Opens a pidfd for a process (glibc has no wrapper on older systems).
+
+Input:
+    pid - process ID
+
+Output:
+    The pidfd (close-on-exec), or -1 with errno set.
+--- */
+static int pidfd_open_pid(int pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, ZERO_VALUE);
+}
+
+/* ---
+Function Name: watch_process
+
+Purpose:
+    Adds one running process of a job to the poll set, unless it is
+    already there. If no pidfd can be opened (e.g. a kernel without
+    pidfd_open), the process is waited for directly instead.
+
+Input:
+    entry - job
+    index - stage index within the job
+
+Output:
+    Returns 1 if the process is being watched, 0 if its state was
+    updated instead.
+--- */
+static int watch_process(JobEntry *entry, int index)
+{
+    int pid = entry->pids[index];
+    for (int i = ZERO_VALUE; i < num_watches; i++) {
+        if (watches[i].pid == pid) return TRUE_VALUE;
+    }
+
+    int fd = (num_watches < WAIT_MAX_FDS) ? pidfd_open_pid(pid) : ERROR_CODE;
+    if (fd >= ZERO_VALUE) {
+        watches[num_watches].pid = pid;
+        watches[num_watches].fd = fd;
+        num_watches++;
+        return TRUE_VALUE;
+    }
+
+    /* fallback: a blocking wait on just this process */
+    int status;
+    int reaped;
+    struct rusage usage;
+    while ((reaped = wait4(pid, &status, WUNTRACED, &usage)) < ZERO_VALUE && errno == EINTR)
+        continue;
+    if (reaped == pid) {
+        if (!WIFSTOPPED(status)) sched_child_exited(pid);
+        trace_proc_reaped(pid, status, &usage);
+        set_job_proc_status(entry, index, status);
+    } else {
+        /* not our child any more; nothing left to wait for */
+        set_job_proc_status(entry, index, ZERO_VALUE);
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: job_finished
+
+Purpose:
+    Checks whether 'wait' is done with a job.
+
+Input:
+    entry - job
+
+Output:
+    Returns 1 if no process of the job is still running.
+--- */
+static int job_finished(JobEntry *entry)
+{
+    return entry->id == NO_JOB_ID || job_state(entry) != PROC_RUNNING;
+}
+
+/* ---
+Function Name: collect_result
+
+Purpose:
+    Returns a finished job's status and removes it from the table if
+    all of its processes have exited.
+
+Input:
+    entry - finished job
+
+Output:
+    Exit status, or 128 + signal for a stopped job.
+--- */
+static int collect_result(JobEntry *entry)
+{
+    if (entry->id == NO_JOB_ID) return EXIT_SUCCESS_CODE;
+
+    if (job_state(entry) == PROC_STOPPED) {
+        for (int k = ZERO_VALUE; k < entry->num_procs; k++) {
+            if (entry->state[k] == PROC_STOPPED) return wait_status_to_exit_code(entry->status[k]);
+        }
+    }
+
+    int status = job_exit_status(entry);
+    remove_job(entry);
+    return status;
+}
+
+/* ---
+Function Name: reap_ready
+
+Purpose:
+    Reaps every watched process whose pidfd poll() reported readable and
+    stops watching it.
+
+Input:
+    ready - number of ready descriptors reported by poll()
+
+Output:
+    Updates the job table and the scheduler.
+--- */
+static void reap_ready(int ready)
+{
+    int kept = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; i < num_watches; i++) {
+        int status;
+        struct rusage usage;
+        if (ready > ZERO_VALUE && poll_set[i].revents &&
+            wait4(watches[i].pid, &status, WNOHANG, &usage) == watches[i].pid) {
+            ready--;
+            trace_proc_reaped(watches[i].pid, status, &usage);
+            update_job_status(watches[i].pid, status);
+            sched_child_exited(watches[i].pid);
+            close(watches[i].fd);
+            continue;
+        }
+        watches[kept] = watches[i];
+        poll_set[kept] = poll_set[i];
+        kept++;
+    }
+    num_watches = kept;
+}
+
+/* ---
+Function Name: close_watches
+
+Purpose:
+    Closes every pidfd opened by the current wait.
+
+Input:
+    None
+
+Output:
+    Empties the watch list.
+--- */
+static void close_watches(void)
+{
+    for (int i = ZERO_VALUE; i < num_watches; i++)
+        close(watches[i].fd);
+    num_watches = ZERO_VALUE;
+}
+
+/* ---
+Function Name: monotonic_ms
+
+Purpose:
+    Reads the monotonic clock, for timeouts.
+
+Input:
+    None
+
+Output:
+    Milliseconds since an arbitrary fixed point.
+--- */
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * MS_PER_SEC + ts.tv_nsec / NS_PER_MS;
+}
@@ -0,0 +1,42 @@
+#ifndef JOBWAIT_H
+#define JOBWAIT_H
+
+#include "jobtable.h"
+
+/* WAIT SET SIZE: one pidfd per process of every job */
+#define WAIT_MAX_FDS            (MAX_JOBS * MAX_PIPELINE_LEN)
+
+/* WAIT RESULTS */
+#define WAIT_COMPLETED          0
+#define WAIT_TIMED_OUT          1
+#define WAIT_NO_JOBS            2
+#define WAIT_INTERRUPTED        3
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NO_TIMEOUT              -1
+#define MS_PER_SEC              1000
+#define NS_PER_MS               1000000
+
+/* ONE WATCHED PROCESS */
+typedef struct
+{
+    int pid;
+    int fd;             /* pidfd, readable once the process has exited */
+} WaitFd;
+
+/* FUNCTION DECLARATIONS */
+int wait_for_jobs(JobEntry **targets, int count, int wait_any, int timeout_ms, int *exit_status);
+
+/* STATIC HELPER FUNCTIONS */
+static int pidfd_open_pid(int pid);
+static int watch_process(JobEntry *entry, int index);
+static int job_finished(JobEntry *entry);
+static int collect_result(JobEntry *entry);
+static void reap_ready(int ready);
+static void close_watches(void);
+static long long monotonic_ms(void);
+
+#endif
@@ -0,0 +1,1040 @@
+#include "lineedit.h"
+#include "history.h"
+#include "complete.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* read, write */
+#include <termios.h>      /* tcgetattr, tcsetattr */
+#include <poll.h>         /* poll */
+#include <string.h>       /* memcpy, memmove */
+#include <sys/ioctl.h>    /* TIOCGWINSZ */
+#include <errno.h>
+
+static LineEditor ed;
+
+/* Terminal modes to restore while commands run */
+static struct termios shell_tmodes;
+
+/* Text removed by the last kill command(s), for Ctrl-Y */
+static char kill_buffer[MAX_ARGS];
+static int kill_len = ZERO_VALUE;
+
+/* Candidates for the last Tab (large, so not on the stack) */
+static Completions completions;
+
+/* ---
+Function Name: edit_line
+
+Purpose:
+    Reads one command line from the terminal with emacs-style editing:
+      Ctrl-A/E, Home/End        start / end of line
+      Ctrl-B/F, Left/Right      move one character
+      Alt-B/F                   move one word
+      Backspace, Ctrl-D/Delete  delete a character (Ctrl-D on an
+                                empty line ends input)
+      Ctrl-K/U/W, Alt-D         kill to end / to start / word back /
+                                word forward; Ctrl-Y yanks it back
+      Ctrl-T                    swap two characters
+      Ctrl-P/N, Up/Down         step through history
+      Ctrl-R                    incremental history search
+      Ctrl-L                    clear the screen
+      Ctrl-C                    discard the line
+    The terminal is in raw mode only while the line is read. Each
+    keystroke redraws only the part of the line that changed, and all of
+    its output goes out in a single write().
+
+Input:
+    prompt     - prompt to print
+    buffer     - destination buffer
+    maxlen     - size of buffer (including the null terminator)
+    at_eof     - set to 1 when input ends (Ctrl-D on an empty line)
+    wait_input - called before each key is read, or NULL
+
+Output:
+    Number of bytes in the line (0 for an empty line), EDIT_DISCARDED
+    if Ctrl+C discarded it, or EDIT_UNAVAILABLE if the terminal cannot
+    be put in raw mode.
+--- */
+int edit_line(const char *prompt, char *buffer, int maxlen, int *at_eof, void (*wait_input)(void))
+{
+    if (!enable_raw_mode()) return EDIT_UNAVAILABLE;
+
+    ed.buf = buffer;
+    ed.len = ZERO_VALUE;
+    ed.pos = ZERO_VALUE;
+    ed.maxlen = (maxlen < MAX_ARGS) ? maxlen : MAX_ARGS;
+    ed.line_prompt = prompt;
+    ed.prompt = prompt;
+    ed.prompt_cols = display_cols(prompt, mystrlen(prompt));
+    ed.cols = terminal_cols();
+    ed.shown_len = ZERO_VALUE;
+    ed.shown_pos = ZERO_VALUE;
+    ed.hist_index = history_count() + TRUE_VALUE;
+    ed.last_was_kill = ZERO_VALUE;
+    ed.last_was_tab = ZERO_VALUE;
+    ed.out_len = ZERO_VALUE;
+
+    out_text(prompt, mystrlen(prompt));
+    flush_output();
+
+    int action = EDIT_CONTINUE;
+    while (action == EDIT_CONTINUE) {
+        if (wait_input) wait_input();
+        int key = read_key();
+        if (key == KEY_CTRL_R) key = search_history(wait_input);
+        action = handle_key(key);
+        flush_output();
+    }
+
+    move_cursor(display_cols(ed.shown, ed.shown_pos), display_cols(ed.shown, ed.shown_len));
+    if (action == EDIT_CANCEL) {
+        out_text(INTERRUPT_TEXT, mystrlen(INTERRUPT_TEXT));
+        ed.len = ZERO_VALUE;
+    } else {
+        out_text(LINE_END_TEXT, mystrlen(LINE_END_TEXT));
+    }
+    flush_output();
+    disable_raw_mode();
+
+    if (action == EDIT_END_OF_INPUT) *at_eof = TRUE_VALUE;
+    buffer[ed.len] = NULL_CHAR;
+    return action == EDIT_CANCEL ? EDIT_DISCARDED : ed.len;
+}
+
+/* ---
+Function Name: enable_raw_mode
+
+Purpose:
+    Saves the terminal modes and switches off line buffering, echo and
+    signal keys, so every key reaches the editor as it is typed. Output
+    processing is left on.
+
+Input:
+    None
+
+Output:
+    Returns 1 on success, 0 if stdin is not a usable terminal.
+--- */
+static int enable_raw_mode(void)
+{
+    if (tcgetattr(STDIN_FILENO, &shell_tmodes) < ZERO_VALUE) return ZERO_VALUE;
+
+    struct termios raw = shell_tmodes;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = TRUE_VALUE;
+    raw.c_cc[VTIME] = ZERO_VALUE;
+
+    /* TCSANOW, not TCSAFLUSH: pasted lines typed ahead must survive */
+    return tcsetattr(STDIN_FILENO, TCSANOW, &raw) == ZERO_VALUE;
+}
+
+/* ---
+Function Name: disable_raw_mode
+
+Purpose:
+    Restores the terminal modes saved by enable_raw_mode().
+
+Input:
+    None
+
+Output:
+    Terminal back in cooked mode for the command about to run.
+--- */
+static void disable_raw_mode(void)
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &shell_tmodes);
+}
+
+/* ---
+Function Name: read_key
+
+Purpose:
+    Reads one key, decoding escape sequences for arrows and the like.
+
+Input:
+    None
+
+Output:
+    A byte value, a KEY_* code, or KEY_EOF when input ends.
+--- */
+static int read_key(void)
+{
+    char c;
+    int n;
+    while ((n = read(STDIN_FILENO, &c, READ_ONE_BYTE)) < ZERO_VALUE && errno == EINTR)
+        continue;
+    if (n <= ZERO_VALUE) return KEY_EOF;
+    if (c == KEY_ESCAPE) return read_escape_sequence();
+    return (unsigned char)c;
+}
+
+/* ---
+Function Name: read_byte_timeout
+
+Purpose:
+    Reads the next byte of an escape sequence, giving up after a short
+    delay so a lone Escape key does not block.
+
+Input:
+    c          - receives the byte
+    timeout_ms - how long to wait
+
+Output:
+    Returns 1 if a byte was read, 0 otherwise.
+--- */
+static int read_byte_timeout(char *c, int timeout_ms)
+{
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, ZERO_VALUE };
+    if (poll(&pfd, TRUE_VALUE, timeout_ms) <= ZERO_VALUE) return ZERO_VALUE;
+    return read(STDIN_FILENO, c, READ_ONE_BYTE) == READ_ONE_BYTE;
+}
+
+/* ---
+Function Name: read_escape_sequence
+
+Purpose:
+    Decodes the bytes after an Escape: Alt+letter, CSI sequences such
+    as "[A" or "[3~" (modifier parameters like "[1;5C" are accepted and
+    ignored) and SS3 sequences such as "OH".
+
+Input:
+    None
+
+Output:
+    The KEY_* code, or KEY_NONE for anything not understood.
+--- */
+static int read_escape_sequence(void)
+{
+    char c;
+    if (!read_byte_timeout(&c, ESCAPE_TIMEOUT_MS)) return KEY_NONE;
+    if (c == META_WORD_LEFT) return KEY_WORD_LEFT;
+    if (c == META_WORD_RIGHT) return KEY_WORD_RIGHT;
+    if (c == META_KILL_WORD) return KEY_KILL_WORD;
+    if (c != CSI_CHAR && c != SS3_CHAR) return KEY_NONE;
+
+    char first;
+    if (!read_byte_timeout(&first, ESCAPE_TIMEOUT_MS)) return KEY_NONE;
+
+    char final = first;
+    if (first >= ZERO_CHAR && first <= NINE_CHAR) {
+        for (int i = ZERO_VALUE; i < MAX_SEQUENCE_LEN; i++) {
+            if (!read_byte_timeout(&final, ESCAPE_TIMEOUT_MS)) return KEY_NONE;
+            if ((final < ZERO_CHAR || final > NINE_CHAR) && final != SEQ_PARAM_SEPARATOR) break;
+        }
+        if (final == TILDE_CHAR) {
+            switch (first) {
+            case SEQ_HOME_TILDE:
+            case SEQ_HOME_TILDE_ALT: return KEY_HOME;
+            case SEQ_END_TILDE:
+            case SEQ_END_TILDE_ALT:  return KEY_END;
+            case SEQ_DELETE_TILDE:   return KEY_DELETE;
+            default:                 return KEY_NONE;
+            }
+        }
+        if (final < SEQ_FINAL_FIRST || final > SEQ_FINAL_LAST) return KEY_NONE;
+    }
+
+    switch (final) {
+    case SEQ_UP:    return KEY_UP;
+    case SEQ_DOWN:  return KEY_DOWN;
+    case SEQ_RIGHT: return KEY_RIGHT;
+    case SEQ_LEFT:  return KEY_LEFT;
+    case SEQ_HOME:  return KEY_HOME;
+    case SEQ_END:   return KEY_END;
+    default:        return KEY_NONE;
+    }
+}
+
+/* ---
+Function Name: handle_key
+
+Purpose:
+    Applies one key to the line and queues the screen update.
+
+Input:
+    key - key from read_key()
+
+Output:
+    EDIT_CONTINUE, or EDIT_ACCEPT / EDIT_CANCEL / EDIT_END_OF_INPUT
+    when the line is finished.
+--- */
+static int handle_key(int key)
+{
+    int kill = ZERO_VALUE;
+    int tab = ZERO_VALUE;
+
+    switch (key) {
+    case KEY_ENTER:
+    case KEY_LINE_FEED:
+        return EDIT_ACCEPT;
+    case KEY_CTRL_C:
+        return EDIT_CANCEL;
+    case KEY_EOF:
+        return EDIT_END_OF_INPUT;
+    case KEY_CTRL_D:
+        if (ed.len == ZERO_VALUE) return EDIT_END_OF_INPUT;
+        delete_range(ed.pos, next_char(ed.pos), ZERO_VALUE, ZERO_VALUE);
+        break;
+    case KEY_DELETE:
+        delete_range(ed.pos, next_char(ed.pos), ZERO_VALUE, ZERO_VALUE);
+        break;
+    case KEY_CTRL_H:
+    case KEY_BACKSPACE:
+        delete_range(prev_char(ed.pos), ed.pos, ZERO_VALUE, ZERO_VALUE);
+        break;
+    case KEY_CTRL_A:
+    case KEY_HOME:
+        ed.pos = ZERO_VALUE;
+        break;
+    case KEY_CTRL_E:
+    case KEY_END:
+        ed.pos = ed.len;
+        break;
+    case KEY_CTRL_B:
+    case KEY_LEFT:
+        ed.pos = prev_char(ed.pos);
+        break;
+    case KEY_CTRL_F:
+    case KEY_RIGHT:
+        ed.pos = next_char(ed.pos);
+        break;
+    case KEY_WORD_LEFT:
+        ed.pos = word_left(ed.pos);
+        break;
+    case KEY_WORD_RIGHT:
+        ed.pos = word_right(ed.pos);
+        break;
+    case KEY_CTRL_K:
+        delete_range(ed.pos, ed.len, TRUE_VALUE, ZERO_VALUE);
+        kill = TRUE_VALUE;
+        break;
+    case KEY_CTRL_U:
+        delete_range(ZERO_VALUE, ed.pos, TRUE_VALUE, TRUE_VALUE);
+        kill = TRUE_VALUE;
+        break;
+    case KEY_CTRL_W: {
+        /* Ctrl-W stops at blanks, not at punctuation */
+        int start = ed.pos;
+        while (start > ZERO_VALUE && ed.buf[start - TRUE_VALUE] == SPACE_CHAR) start--;
+        while (start > ZERO_VALUE && ed.buf[start - TRUE_VALUE] != SPACE_CHAR) start--;
+        delete_range(start, ed.pos, TRUE_VALUE, TRUE_VALUE);
+        kill = TRUE_VALUE;
+        break;
+    }
+    case KEY_KILL_WORD:
+        delete_range(ed.pos, word_right(ed.pos), TRUE_VALUE, ZERO_VALUE);
+        kill = TRUE_VALUE;
+        break;
+    case KEY_CTRL_Y:
+        insert_text(kill_buffer, kill_len);
+        break;
+    case KEY_CTRL_T:
+        if (ed.len >= TRANSPOSE_MIN_LEN && ed.pos > ZERO_VALUE) {
+            int at = (ed.pos == ed.len) ? ed.pos - TRUE_VALUE : ed.pos;
+            char a = ed.buf[at - TRUE_VALUE], b = ed.buf[at];
+            if ((unsigned char)a < UTF8_CONTINUATION_BITS && (unsigned char)b < UTF8_CONTINUATION_BITS) {
+                ed.buf[at - TRUE_VALUE] = b;
+                ed.buf[at] = a;
+                ed.pos = at + TRUE_VALUE;
+            }
+        }
+        break;
+    case KEY_CTRL_P:
+    case KEY_UP:
+        history_step(MOVE_BACK);
+        break;
+    case KEY_CTRL_N:
+    case KEY_DOWN:
+        history_step(MOVE_FORWARD);
+        break;
+    case KEY_TAB:
+        complete_at_cursor();
+        tab = TRUE_VALUE;
+        break;
+    case KEY_CTRL_L:
+        out_text(CLEAR_SCREEN_TEXT, mystrlen(CLEAR_SCREEN_TEXT));
+        out_text(ed.prompt, mystrlen(ed.prompt));
+        ed.shown_len = ZERO_VALUE;
+        ed.shown_pos = ZERO_VALUE;
+        break;
+    default:
+        if (key >= FIRST_PRINTABLE && key < BYTE_LIMIT && key != KEY_BACKSPACE) {
+            char c = (char)key;
+            insert_text(&c, TRUE_VALUE);
+        }
+        break;
+    }
+
+    ed.last_was_kill = kill;
+    ed.last_was_tab = tab;
+    refresh_line();
+    return EDIT_CONTINUE;
+}
+
+/* ---
+Function Name: complete_at_cursor
+
+Purpose:
+    Completes the word before the cursor. A single match is inserted
+    whole, followed by a space (or '/' for a directory); several
+    matches extend the word to their longest common prefix. If that
+    adds nothing, a second Tab in a row lists the matches.
+
+Input:
+    None
+
+Output:
+    Updates the line, or rings the bell if nothing matches.
+--- */
+static void complete_at_cursor(void)
+{
+    int start = ed.pos;
+    while (start > ZERO_VALUE && ed.buf[start - TRUE_VALUE] != SPACE_CHAR &&
+           !is_break_char(ed.buf[start - TRUE_VALUE], WORD_BREAK_TEXT))
+        start--;
+
+    int before = start;
+    while (before > ZERO_VALUE && ed.buf[before - TRUE_VALUE] == SPACE_CHAR) before--;
+    int command_position = (before == ZERO_VALUE) ||
+                           is_break_char(ed.buf[before - TRUE_VALUE], COMMAND_BREAK_TEXT);
+
+    find_completions(ed.buf + start, ed.pos - start, command_position, &completions);
+    if (completions.count == ZERO_VALUE) {
+        out_text(BELL_TEXT, mystrlen(BELL_TEXT));
+        return;
+    }
+
+    const char *first = completions.items[ZERO_VALUE].name + completions.typed_len;
+    if (completions.total == TRUE_VALUE) {
+        insert_text(first, mystrlen(first));
+        if (completions.suffix != NO_SUFFIX) insert_text(&completions.suffix, TRUE_VALUE);
+        return;
+    }
+
+    /* the common prefix is only known if every match was stored */
+    int common = ZERO_VALUE;
+    if (completions.total == completions.count) {
+        common = mystrlen(first);
+        for (int i = TRUE_VALUE; i < completions.count; i++) {
+            const char *name = completions.items[i].name + completions.typed_len;
+            int n = ZERO_VALUE;
+            while (n < common && name[n] == first[n]) n++;
+            common = n;
+        }
+    }
+
+    if (common > ZERO_VALUE)
+        insert_text(first, common);
+    else if (ed.last_was_tab)
+        list_completions();
+    else
+        out_text(BELL_TEXT, mystrlen(BELL_TEXT));
+}
+
+/* ---
+Function Name: list_completions
+
+Purpose:
+    Prints the current candidates below the line in columns, sorted
+    down each column, then starts the prompt and line again under them.
+
+Input:
+    None
+
+Output:
+    Queues output; the line is redrawn by the next refresh_line().
+--- */
+static void list_completions(void)
+{
+    int width = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < completions.count; i++) {
+        int n = display_cols(completions.items[i].name, mystrlen(completions.items[i].name)) +
+                completions.items[i].is_dir;
+        if (n > width) width = n;
+    }
+    width += LIST_COLUMN_GAP;
+
+    int per_row = ed.cols / width;
+    if (per_row < TRUE_VALUE) per_row = TRUE_VALUE;
+    int rows = (completions.count + per_row - TRUE_VALUE) / per_row;
+
+    move_cursor(display_cols(ed.shown, ed.shown_pos), display_cols(ed.shown, ed.shown_len));
+    out_text(LINE_END_TEXT, mystrlen(LINE_END_TEXT));
+
+    char dir_suffix = DIR_SUFFIX_CHAR;
+    for (int r = ZERO_VALUE; r < rows; r++) {
+        for (int c = ZERO_VALUE; c < per_row; c++) {
+            int i = c * rows + r;
+            if (i >= completions.count) break;
+
+            const char *name = completions.items[i].name;
+            int n = mystrlen(name);
+            out_text(name, n);
+            if (completions.items[i].is_dir) out_text(&dir_suffix, TRUE_VALUE);
+
+            int next = (c + TRUE_VALUE) * rows + r;
+            if (next >= completions.count) break;
+            for (int pad = display_cols(name, n) + completions.items[i].is_dir; pad < width; pad++)
+                out_text(SPACE_TEXT, TRUE_VALUE);
+        }
+        out_text(LINE_END_TEXT, mystrlen(LINE_END_TEXT));
+    }
+
+    if (completions.total > completions.count) {
+        char num[EDIT_NUM_LEN];
+        myitoa(completions.total - completions.count, num);
+        out_text(MORE_MATCHES_START, mystrlen(MORE_MATCHES_START));
+        out_text(num, mystrlen(num));
+        out_text(MORE_MATCHES_END, mystrlen(MORE_MATCHES_END));
+        out_text(LINE_END_TEXT, mystrlen(LINE_END_TEXT));
+    }
+
+    out_text(ed.prompt, mystrlen(ed.prompt));
+    ed.shown_len = ZERO_VALUE;
+    ed.shown_pos = ZERO_VALUE;
+}
+
+/* ---
+Function Name: is_break_char
+
+Purpose:
+    Checks whether a character is one of a set of separators.
+
+Input:
+    c   - character
+    set - separators
+
+Output:
+    Non-zero if c is in set.
+--- */
+static int is_break_char(char c, const char *set)
+{
+    for (int i = ZERO_VALUE; set[i] != NULL_CHAR; i++) {
+        if (set[i] == c) return TRUE_VALUE;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: search_history
+
+Purpose:
+    Runs a Ctrl-R incremental search. Typed characters extend the
+    search text and show the newest entry containing it; Ctrl-R again
+    steps to older matches, Backspace shortens the text and Ctrl-G
+    cancels. Any other key leaves the match on the line and is then
+    handled as usual (so Enter runs it).
+
+Input:
+    wait_input - called before each key is read, or NULL
+
+Output:
+    The key that ended the search, or KEY_NONE.
+--- */
+static int search_history(void (*wait_input)(void))
+{
+    char original[MAX_ARGS];
+    int original_len = ed.len;
+    memcpy(original, ed.buf, ed.len);
+
+    char query[SEARCH_QUERY_LEN];
+    char prompt[SEARCH_PROMPT_LEN];
+    int qlen = ZERO_VALUE;
+    long match = NO_ENTRY;
+    int failed = ZERO_VALUE;
+    int key;
+
+    for (;;) {
+        query[qlen] = NULL_CHAR;
+        mystrcpy(prompt, failed ? FAILED_SEARCH_START : SEARCH_PROMPT_START);
+        mystrcat(prompt, query);
+        mystrcat(prompt, SEARCH_PROMPT_END);
+        redraw_all(prompt);
+        flush_output();
+
+        if (wait_input) wait_input();
+        key = read_key();
+
+        long from;
+        if (key == KEY_CTRL_R) {
+            if (qlen == ZERO_VALUE) continue;
+            from = (match != NO_ENTRY) ? match : history_count() + TRUE_VALUE;
+        } else if (key == KEY_BACKSPACE || key == KEY_CTRL_H) {
+            if (qlen > ZERO_VALUE) qlen--;
+            from = history_count() + TRUE_VALUE;
+        } else if (key >= FIRST_PRINTABLE && key < BYTE_LIMIT && qlen < SEARCH_QUERY_LEN - TRUE_VALUE) {
+            /* a longer text may still match the current entry */
+            query[qlen++] = (char)key;
+            from = (match != NO_ENTRY) ? match + TRUE_VALUE : history_count() + TRUE_VALUE;
+        } else {
+            break;
+        }
+
+        query[qlen] = NULL_CHAR;
+        if (qlen == ZERO_VALUE) {
+            load_text(original, original_len);
+            match = NO_ENTRY;
+            failed = ZERO_VALUE;
+            continue;
+        }
+
+        long found = history_find_substring(query, from);
+        failed = (found == NO_ENTRY);
+        if (!failed) {
+            int len;
+            const char *text = history_entry(found, &len);
+            match = found;
+            load_text(text, len);
+        }
+    }
+
+    if (key == KEY_CTRL_G) {
+        load_text(original, original_len);
+        key = KEY_NONE;
+    } else if (match != NO_ENTRY) {
+        ed.hist_index = match;
+    }
+    redraw_all(ed.line_prompt);
+    return key;
+}
+
+/* ---
+Function Name: insert_text
+
+Purpose:
+    Inserts text at the cursor, truncating it if the line is full.
+
+Input:
+    text - bytes to insert
+    n    - number of bytes
+
+Output:
+    Updates the line and moves the cursor past the text.
+--- */
+static void insert_text(const char *text, int n)
+{
+    if (ed.len + n > ed.maxlen - TRUE_VALUE) n = ed.maxlen - TRUE_VALUE - ed.len;
+    if (n <= ZERO_VALUE) return;
+
+    memmove(ed.buf + ed.pos + n, ed.buf + ed.pos, ed.len - ed.pos);
+    memcpy(ed.buf + ed.pos, text, n);
+    ed.len += n;
+    ed.pos += n;
+}
+
+/* ---
+Function Name: delete_range
+
+Purpose:
+    Removes buf[from, to), optionally saving it for Ctrl-Y. Consecutive
+    kills are joined, as in Emacs and Bash.
+
+Input:
+    from, to  - byte range
+    save_kill - non-zero to store the text in the kill buffer
+    prepend   - non-zero if the text lies before the previous kill
+
+Output:
+    Updates the line; the cursor moves to 'from'.
+--- */
+static void delete_range(int from, int to, int save_kill, int prepend)
+{
+    if (from >= to) return;
+    int n = to - from;
+
+    if (save_kill) {
+        if (!ed.last_was_kill) kill_len = ZERO_VALUE;
+        if (kill_len + n > MAX_ARGS) n = MAX_ARGS - kill_len;
+        if (prepend) {
+            memmove(kill_buffer + n, kill_buffer, kill_len);
+            memcpy(kill_buffer, ed.buf + to - n, n);
+        } else {
+            memcpy(kill_buffer + kill_len, ed.buf + from, n);
+        }
+        kill_len += n;
+    }
+
+    memmove(ed.buf + from, ed.buf + to, ed.len - to);
+    ed.len -= to - from;
+    ed.pos = from;
+}
+
+/* ---
+Function Name: load_text
+
+Purpose:
+    Replaces the whole line (history recall), cursor at the end.
+
+Input:
+    text - new contents
+    n    - number of bytes
+
+Output:
+    Updates the line.
+--- */
+static void load_text(const char *text, int n)
+{
+    if (n > ed.maxlen - TRUE_VALUE) n = ed.maxlen - TRUE_VALUE;
+    memcpy(ed.buf, text, n);
+    ed.len = n;
+    ed.pos = n;
+}
+
+/* ---
+Function Name: history_step
+
+Purpose:
+    Moves to the previous or next history entry. The line being typed
+    is kept aside and comes back after the newest entry.
+
+Input:
+    direction - MOVE_BACK (older) or MOVE_FORWARD (newer)
+
+Output:
+    Loads the entry into the line.
+--- */
+static void history_step(int direction)
+{
+    long count = history_count();
+    long target = ed.hist_index + direction;
+    if (target < TRUE_VALUE || target > count + TRUE_VALUE) return;
+
+    if (ed.hist_index > count) {
+        memcpy(ed.saved, ed.buf, ed.len);
+        ed.saved_len = ed.len;
+    }
+    ed.hist_index = target;
+
+    if (target > count) {
+        load_text(ed.saved, ed.saved_len);
+        return;
+    }
+    int len;
+    const char *text = history_entry(target, &len);
+    if (text) load_text(text, len);
+}
+
+/* ---
+Function Name: prev_char
+
+Purpose:
+    Finds the start of the character before index i, skipping UTF-8
+    continuation bytes.
+
+Input:
+    i - byte index
+
+Output:
+    Byte index of the previous character (0 at the start).
+--- */
+static int prev_char(int i)
+{
+    if (i <= ZERO_VALUE) return ZERO_VALUE;
+    i--;
+    while (i > ZERO_VALUE && (ed.buf[i] & UTF8_CONTINUATION_MASK) == UTF8_CONTINUATION_BITS) i--;
+    return i;
+}
+
+/* ---
+Function Name: next_char
+
+Purpose:
+    Finds the start of the character after index i.
+
+Input:
+    i - byte index
+
+Output:
+    Byte index of the next character (len at the end).
+--- */
+static int next_char(int i)
+{
+    if (i >= ed.len) return ed.len;
+    i++;
+    while (i < ed.len && (ed.buf[i] & UTF8_CONTINUATION_MASK) == UTF8_CONTINUATION_BITS) i++;
+    return i;
+}
+
+/* ---
+Function Name: word_left
+
+Purpose:
+    Finds the start of the word before index i (Alt-B).
+
+Input:
+    i - byte index
+
+Output:
+    Byte index.
+--- */
+static int word_left(int i)
+{
+    while (i > ZERO_VALUE && !is_word_char(ed.buf[i - TRUE_VALUE])) i--;
+    while (i > ZERO_VALUE && is_word_char(ed.buf[i - TRUE_VALUE])) i--;
+    return i;
+}
+
+/* ---
+Function Name: word_right
+
+Purpose:
+    Finds the end of the word after index i (Alt-F, Alt-D).
+
+Input:
+    i - byte index
+
+Output:
+    Byte index.
+--- */
+static int word_right(int i)
+{
+    while (i < ed.len && !is_word_char(ed.buf[i])) i++;
+    while (i < ed.len && is_word_char(ed.buf[i])) i++;
+    return i;
+}
+
+/* ---
+Function Name: is_word_char
+
+Purpose:
+    Tells whether a byte belongs to a word: letters, digits and any
+    non-ASCII byte.
+
+Input:
+    c - byte
+
+Output:
+    Returns 1 for word characters.
+--- */
+static int is_word_char(char c)
+{
+    unsigned char u = (unsigned char)c;
+    return (u >= LOWER_FIRST_CHAR && u <= LOWER_LAST_CHAR) ||
+           (u >= UPPER_FIRST_CHAR && u <= UPPER_LAST_CHAR) ||
+           (u >= ZERO_CHAR && u <= NINE_CHAR) || u >= UTF8_CONTINUATION_BITS;
+}
+
+/* ---
+Function Name: display_cols
+
+Purpose:
+    Counts the terminal columns used by text (one per character, so
+    UTF-8 continuation bytes take none).
+
+Input:
+    text - bytes
+    n    - number of bytes
+
+Output:
+    Column count.
+--- */
+static int display_cols(const char *text, int n)
+{
+    int cols = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < n; i++) {
+        if ((text[i] & UTF8_CONTINUATION_MASK) != UTF8_CONTINUATION_BITS) cols++;
+    }
+    return cols;
+}
+
+/* ---
+Function Name: refresh_line
+
+Purpose:
+    Brings the screen up to date with the line. The text is compared
+    with what is already shown and only the tail from the first
+    difference is rewritten (typing at the end writes one character);
+    a line that got shorter is cleared with one erase sequence. Lines
+    that wrap past the terminal width are handled by moving between
+    rows.
+
+Input:
+    None
+
+Output:
+    Queues output and records what is now shown.
+--- */
+static void refresh_line(void)
+{
+    int d = ZERO_VALUE;
+    while (d < ed.len && d < ed.shown_len && ed.buf[d] == ed.shown[d]) d++;
+    while (d > ZERO_VALUE &&
+           ((d < ed.len && (ed.buf[d] & UTF8_CONTINUATION_MASK) == UTF8_CONTINUATION_BITS) ||
+            (d < ed.shown_len && (ed.shown[d] & UTF8_CONTINUATION_MASK) == UTF8_CONTINUATION_BITS)))
+        d--;
+
+    int cursor_col = display_cols(ed.shown, ed.shown_pos);
+    int target_col = display_cols(ed.buf, ed.pos);
+
+    if (d == ed.len && d == ed.shown_len) {
+        move_cursor(cursor_col, target_col);
+    } else {
+        int end_col = display_cols(ed.buf, ed.len);
+        move_cursor(cursor_col, display_cols(ed.buf, d));
+        out_text(ed.buf + d, ed.len - d);
+
+        /* leave the terminal's pending-wrap state at a row boundary */
+        if (ed.len > d && (ed.prompt_cols + end_col) % ed.cols == ZERO_VALUE)
+            out_text(LINE_END_TEXT, mystrlen(LINE_END_TEXT));
+        if (ed.shown_len > ed.len)
+            out_text(ERASE_BELOW_TEXT, mystrlen(ERASE_BELOW_TEXT));
+        move_cursor(end_col, target_col);
+    }
+
+    memcpy(ed.shown, ed.buf, ed.len);
+    ed.shown_len = ed.len;
+    ed.shown_pos = ed.pos;
+}
+
+/* ---
+Function Name: redraw_all
+
+Purpose:
+    Redraws the prompt and the line from scratch, e.g. to switch to
+    the search prompt and back.
+
+Input:
+    prompt - prompt to show
+
+Output:
+    Queues output and records what is now shown.
+--- */
+static void redraw_all(const char *prompt)
+{
+    int rows = (ed.prompt_cols + display_cols(ed.shown, ed.shown_pos)) / ed.cols;
+    out_move(rows, CURSOR_UP_CHAR);
+    out_text(CARRIAGE_RETURN_TEXT, mystrlen(CARRIAGE_RETURN_TEXT));
+    out_text(ERASE_BELOW_TEXT, mystrlen(ERASE_BELOW_TEXT));
+
+    ed.prompt = prompt;
+    ed.prompt_cols = display_cols(prompt, mystrlen(prompt));
+    out_text(prompt, mystrlen(prompt));
+    ed.shown_len = ZERO_VALUE;
+    ed.shown_pos = ZERO_VALUE;
+    refresh_line();
+}
+
+/* ---
+Function Name: move_cursor
+
+Purpose:
+    Moves the terminal cursor between two columns of the line, which
+    may be on different rows once the line wraps.
+
+Input:
+    from_col - current column, counted from the end of the prompt
+    to_col   - target column
+
+Output:
+    Queues cursor movement sequences.
+--- */
+static void move_cursor(int from_col, int to_col)
+{
+    int from = ed.prompt_cols + from_col;
+    int to = ed.prompt_cols + to_col;
+    int from_row = from / ed.cols, to_row = to / ed.cols;
+    int from_x = from % ed.cols, to_x = to % ed.cols;
+
+    if (from_row > to_row) out_move(from_row - to_row, CURSOR_UP_CHAR);
+    if (to_row > from_row) out_move(to_row - from_row, CURSOR_DOWN_CHAR);
+    if (from_x > to_x) out_move(from_x - to_x, CURSOR_LEFT_CHAR);
+    if (to_x > from_x) out_move(to_x - from_x, CURSOR_RIGHT_CHAR);
+}
+
+/* ---
+Function Name: out_text
+
+Purpose:
+    Queues bytes for the terminal.
+
+Input:
+    text - bytes
+    n    - number of bytes
+
+Output:
+    Appends to the output buffer, flushing first if it is full.
+--- */
+static void out_text(const char *text, int n)
+{
+    if (ed.out_len + n > EDIT_OUT_LEN) flush_output();
+    if (n > EDIT_OUT_LEN) {
+        write(STDOUT_FILENO, text, n);
+        return;
+    }
+    memcpy(ed.out + ed.out_len, text, n);
+    ed.out_len += n;
+}
+
+/* ---
+Function Name: out_move
+
+Purpose:
+    Queues a cursor movement ("ESC [ n X"); one step left is a plain
+    backspace, which is shorter.
+
+Input:
+    count     - number of rows or columns (nothing if 0)
+    direction - CURSOR_UP_CHAR, CURSOR_DOWN_CHAR, ...
+
+Output:
+    Appends to the output buffer.
+--- */
+static void out_move(int count, char direction)
+{
+    if (count <= ZERO_VALUE) return;
+    if (count == TRUE_VALUE && direction == CURSOR_LEFT_CHAR) {
+        out_text(BACKSPACE_TEXT, mystrlen(BACKSPACE_TEXT));
+        return;
+    }
+
+    char num[EDIT_NUM_LEN];
+    myitoa(count, num);
+    out_text(CSI_TEXT, mystrlen(CSI_TEXT));
+    out_text(num, mystrlen(num));
+    out_text(&direction, TRUE_VALUE);
+}
+
+/* ---
+Function Name: flush_output
+
+Purpose:
+    Sends everything queued for the current keystroke in one write().
+
+Input:
+    None
+
+Output:
+    Empties the output buffer.
+--- */
+static void flush_output(void)
+{
+    int done = ZERO_VALUE;
+    while (done < ed.out_len) {
+        int n = write(STDOUT_FILENO, ed.out + done, ed.out_len - done);
+        if (n < ZERO_VALUE && errno == EINTR) continue;
+        if (n <= ZERO_VALUE) break;
+        done += n;
+    }
+    ed.out_len = ZERO_VALUE;
+}
+
+/* ---
+Function Name: terminal_cols
+
+Purpose:
+    Reads the terminal width.
+
+Input:
+    None
+
+Output:
+    Number of columns (80 if unknown).
+--- */
+static int terminal_cols(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < ZERO_VALUE || ws.ws_col == ZERO_VALUE)
+        return DEFAULT_TERM_COLS;
+    return ws.ws_col;
+}
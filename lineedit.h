@@ -0,0 +1,187 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include "jobs.h"
+
+/* KEYS (control characters) */
+#define KEY_CTRL_A              1
+#define KEY_CTRL_B              2
+#define KEY_CTRL_C              3
+#define KEY_CTRL_D              4
+#define KEY_CTRL_E              5
+#define KEY_CTRL_F              6
+#define KEY_CTRL_G              7
+#define KEY_CTRL_H              8
+#define KEY_TAB                 9
+#define KEY_LINE_FEED           10
+#define KEY_CTRL_K              11
+#define KEY_CTRL_L              12
+#define KEY_ENTER               13
+#define KEY_CTRL_N              14
+#define KEY_CTRL_P              16
+#define KEY_CTRL_R              18
+#define KEY_CTRL_T              20
+#define KEY_CTRL_U              21
+#define KEY_CTRL_W              23
+#define KEY_CTRL_Y              25
+#define KEY_ESCAPE              27
+#define KEY_BACKSPACE           127
+
+/* KEYS (decoded escape sequences, outside the byte range) */
+#define KEY_UP                  1000
+#define KEY_DOWN                1001
+#define KEY_RIGHT               1002
+#define KEY_LEFT                1003
+#define KEY_HOME                1004
+#define KEY_END                 1005
+#define KEY_DELETE              1006
+#define KEY_WORD_LEFT           1007
+#define KEY_WORD_RIGHT          1008
+#define KEY_KILL_WORD           1009
+#define KEY_NONE                1010
+#define KEY_EOF                 (-1)
+
+/* ESCAPE SEQUENCE INPUT */
+#define CSI_CHAR                '['
+#define SS3_CHAR                'O'
+#define TILDE_CHAR              '~'
+#define ESCAPE_TIMEOUT_MS       50
+#define SEQ_UP                  'A'
+#define SEQ_DOWN                'B'
+#define SEQ_RIGHT               'C'
+#define SEQ_LEFT                'D'
+#define SEQ_HOME                'H'
+#define SEQ_END                 'F'
+#define SEQ_HOME_TILDE          '1'
+#define SEQ_DELETE_TILDE        '3'
+#define SEQ_END_TILDE           '4'
+#define SEQ_HOME_TILDE_ALT      '7'
+#define SEQ_END_TILDE_ALT       '8'
+#define META_WORD_LEFT          'b'
+#define META_WORD_RIGHT         'f'
+#define META_KILL_WORD          'd'
+
+/* TERMINAL OUTPUT */
+#define CSI_TEXT                "\x1b["
+#define ERASE_BELOW_TEXT        "\x1b[J"
+#define CLEAR_SCREEN_TEXT       "\x1b[H\x1b[2J"
+#define CURSOR_UP_CHAR          'A'
+#define CURSOR_DOWN_CHAR        'B'
+#define CURSOR_RIGHT_CHAR       'C'
+#define CURSOR_LEFT_CHAR        'D'
+#define CARRIAGE_RETURN_TEXT    "\r"
+#define LINE_END_TEXT           "\r\n"
+#define BACKSPACE_TEXT          "\b"
+#define INTERRUPT_TEXT          "^C\r\n"
+#define SEARCH_PROMPT_START     "(reverse-i-search)`"
+#define SEARCH_PROMPT_END       "': "
+#define FAILED_SEARCH_START     "(failing reverse-i-search)`"
+#define BELL_TEXT               "\a"
+#define SPACE_TEXT              " "
+#define MORE_MATCHES_START      "... "
+#define MORE_MATCHES_END        " more"
+
+/* COMPLETION */
+#define WORD_BREAK_TEXT         "|&;<>"
+#define COMMAND_BREAK_TEXT      "|&;"
+#define LIST_COLUMN_GAP         2
+
+/* SIZES */
+#define EDIT_OUT_LEN            (MAX_ARGS * 4)
+#define EDIT_NUM_LEN            16
+#define DEFAULT_TERM_COLS       80
+#define SEARCH_QUERY_LEN        256
+#define SEARCH_PROMPT_LEN       (SEARCH_QUERY_LEN + 64)
+#define MAX_SEQUENCE_LEN        8
+
+/* EDIT RESULTS */
+#define EDIT_CONTINUE           0
+#define EDIT_ACCEPT             1
+#define EDIT_END_OF_INPUT       2
+#define EDIT_CANCEL             3
+#define EDIT_UNAVAILABLE        (-2)
+#define EDIT_DISCARDED          (-3)
+#define MOVE_BACK               (-1)
+#define MOVE_FORWARD            1
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define FIRST_PRINTABLE         ' '
+#define UTF8_CONTINUATION_MASK  0xC0
+#define UTF8_CONTINUATION_BITS  0x80
+#define DECIMAL_BASE            10
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define SEQ_PARAM_SEPARATOR     ';'
+#define SEQ_FINAL_FIRST         'A'
+#define SEQ_FINAL_LAST          'Z'
+#define SPACE_CHAR              ' '
+#define BYTE_LIMIT              256
+#define READ_ONE_BYTE           1
+#define TRANSPOSE_MIN_LEN       2
+#define LOWER_FIRST_CHAR        'a'
+#define LOWER_LAST_CHAR         'z'
+#define UPPER_FIRST_CHAR        'A'
+#define UPPER_LAST_CHAR         'Z'
+
+/* STATE OF THE LINE BEING EDITED
+   'shown' mirrors what is on the terminal after the prompt, so each
+   keystroke only rewrites the part of the line that changed. */
+typedef struct
+{
+    char *buf;                  /* line being edited */
+    int len;
+    int pos;                    /* cursor, as a byte index into buf */
+    int maxlen;
+    const char *line_prompt;    /* the shell prompt */
+    const char *prompt;         /* prompt on screen (differs while searching) */
+    int prompt_cols;
+    int cols;                   /* terminal width */
+    char shown[MAX_ARGS];
+    int shown_len;
+    int shown_pos;
+    long hist_index;            /* history entry shown, count+1 = new line */
+    char saved[MAX_ARGS];       /* the new line while browsing history */
+    int saved_len;
+    int last_was_kill;
+    int last_was_tab;           /* a second Tab lists completions */
+    char out[EDIT_OUT_LEN];     /* escape sequences batched per keystroke */
+    int out_len;
+} LineEditor;
+
+/* FUNCTION DECLARATIONS */
+int edit_line(const char *prompt, char *buffer, int maxlen, int *at_eof, void (*wait_input)(void));
+
+/* STATIC HELPER FUNCTIONS */
+static int enable_raw_mode(void);
+static void disable_raw_mode(void);
+static int read_key(void);
+static int read_byte_timeout(char *c, int timeout_ms);
+static int read_escape_sequence(void);
+static int handle_key(int key);
+static void complete_at_cursor(void);
+static void list_completions(void);
+static int is_break_char(char c, const char *set);
+static int search_history(void (*wait_input)(void));
+static void insert_text(const char *text, int n);
+static void delete_range(int from, int to, int save_kill, int prepend);
+static void load_text(const char *text, int n);
+static void history_step(int direction);
+static int prev_char(int i);
+static int next_char(int i);
+static int word_left(int i);
+static int word_right(int i);
+static int is_word_char(char c);
+static int display_cols(const char *text, int n);
+static void refresh_line(void);
+static void redraw_all(const char *prompt);
+static void move_cursor(int from_col, int to_col);
+static void out_text(const char *text, int n);
+static void out_move(int count, char direction);
+static void flush_output(void);
+static int terminal_cols(void);
+
+#endif
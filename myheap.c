@@ -45,3 +45,60 @@ void free_all()
   freep = heap;
 }
 
+
+/* ---
+Function Name: heap_mark
+
+Purpose: 
+  Records the current top of the heap so that later allocations can be
+  released without discarding earlier ones.
+
+Input:
+  none
+  
+Output:
+  Mark to pass to heap_release().
+--- */
+char *heap_mark(void)
+{
+  return freep;
+}
+
+
+/* ---
+Function Name: heap_release
+
+Purpose: 
+  Frees every block allocated since heap_mark() returned mark.
+
+Input:
+  mark - value returned by heap_mark()
+  
+Output:
+  Blocks allocated after the mark are invalidated.
+--- */
+void heap_release(char *mark)
+{
+  if (mark >= heap && mark <= freep)
+    freep = mark;
+}
+
+
+/* ---
+Function Name: heap_available
+
+Purpose: 
+  Reports how many bytes can still be allocated. A caller may write up
+  to this many bytes at heap_mark() and then alloc() what it used, which
+  grows a buffer in place without copying.
+
+Input:
+  none
+  
+Output:
+  Number of free bytes.
+--- */
+unsigned int heap_available(void)
+{
+  return (unsigned int)(heap + HEAP_SIZE - freep);
+}
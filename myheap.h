@@ -3,9 +3,12 @@
 
 #include <unistd.h>
 
-#define HEAP_SIZE 10000     /* adjust as necessary */
+#define HEAP_SIZE (1 << 20) /* room for pattern matches; adjust as necessary */
 
 char *alloc(unsigned int size);
 void free_all();
+char *heap_mark(void);
+void heap_release(char *mark);
+unsigned int heap_available(void);
 
 #endif
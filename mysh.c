@@ -1,97 +1,95 @@
+#define _GNU_SOURCE    /* cpu_set_t in stagetune.h */
 #include "mystring.h"
 #include "jobs.h"
 #include "myheap.h"
+#include "stagetune.h"
 #include "getjob.h"
 #include "runjob.h"  
 #include "signal.h"
 #include "mysh.h"
 #include "builtin.h"
+#include "trace.h"
+#include "jobsched.h"
+#include "jobtable.h"
+#include "history.h"
+#include "complete.h"
+#include "subst.h"
+#include "flow.h"
+#include "snapshot.h"
+#include "coproc.h"
+#include "errors.h"
 
 #include <stdlib.h>
 #include <unistd.h>
-
-int fg_job_status = FALSE_VALUE;
+#include <fcntl.h>
+#include <sys/wait.h>  /* wait4 */
 
 /* ---
 Function Name: main
 
 Purpose: 
-  Runs the personal MYSH shell program.
+  Runs the personal MYSH shell program. 'mysh -c string' runs the
+  lines of string instead of standard input, without job control (so
+  it can serve as make's SHELL), and execs its last command in place
+  of the shell when that is a plain program.
 
 Input:
 arc  - number of command-line arguments
 argv - array of command-line argument strings
 envp - array of environment variable strings
 
-Returns EXIT_SUCCESS upon normal shell termination.
+Returns the exit status of the last command at end of input.
 --- */
 int main(int argc, char *argv[], char *envp[])
 {
     Job job;
-    int exitShell = FALSE_VALUE;
 
-    int shell_pgid = getpid();
-    setpgid(shell_pgid, shell_pgid);
-    tcsetpgrp(STDIN_FILENO, shell_pgid);
-    
+    /* new variables are appended to the environment, which needs room */
+    envp = copy_environment(envp);
+
+    int command_mode = argc > COMMAND_OPTION_INDEX && mystrcmp(argv[COMMAND_OPTION_INDEX], COMMAND_OPTION) == FALSE_VALUE;
+    if (command_mode && argc <= COMMAND_STRING_INDEX) {
+        print_error(ERR_COMMAND_STRING);
+        return USAGE_EXIT_STATUS;
+    }
+
+    /* 'mysh -c' stays in its caller's process group and leaves the
+       terminal to it */
+    if (command_mode) {
+        shell_pgid = getpgrp();
+    } else {
+        shell_pgid = getpid();
+        setpgid(shell_pgid, shell_pgid);
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+
     initialize_signal_handler();
-    get_job(&job);
-
-    while (!exitShell) {
-        remove_zombies();
-
-        /* Ignore empty input lines*/
-        if (job.num_stages == FALSE_VALUE) {
-            get_job(&job);
-            continue;
-        }
-
-        expand_variables(job.pipeline[INITIAL_INDEX].argv, envp);
-        /* Built-in Exit */
-        if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_EXIT) == FALSE_VALUE) {
-            int status = FALSE_VALUE;
-            if (job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX + 1])
-                status = myatoi(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX + 1]);
-            free_all();
-            _exit(status);
-        }
-        /* Built-in cd */
-        if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_CD) == FALSE_VALUE) {
-            handle_cd(job.pipeline[INITIAL_INDEX].argv, envp);
-            get_job(&job);
-            continue;
-        }
-        /* Built-in export */
-        if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_EXPORT) == FALSE_VALUE) {
-            handle_export(job.pipeline[INITIAL_INDEX].argv, envp);
-            get_job(&job);
-            continue;
-        }
-	/* Built-in jobs*/
-	if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_JOBS) == FALSE_VALUE) {
-	  handle_jobs(job.pipeline[INITIAL_INDEX].argv);
-	  get_job(&job);
-	  continue;
-	}
-        /* Built-in fg */
-        if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_FG) == FALSE_VALUE) {
-            builtin_fg(NULL_PTR);
-            get_job(&job);
-            continue;
-        }
-        /* Built-in bg */
-        if (mystrcmp(job.pipeline[INITIAL_INDEX].argv[INITIAL_INDEX], CMD_BG) == FALSE_VALUE) {
-            builtin_bg(NULL_PTR);
-            get_job(&job);
-            continue;
-        }
-
-        run_job(&job, envp);
-        free_all();
-        get_job(&job);
+    trace_init(envp);
+    sched_init(envp);
+
+    /* history and the line editor serve typed input only; 'mysh -c'
+       (one per recipe line under make) should not map the history
+       files just because its standard input is a terminal */
+    if (!command_mode) {
+        history_init(envp);
+        set_completion_env(envp);
+        set_input_wakeup(sched_wakeup_fd(), sched_dispatch);
+    }
+
+    /* ~/.myshrc: its snapshot is mapped unless the rc has changed */
+    if (load_snapshot(envp) == RC_STALE) {
+        source_rc(&job, envp);
+        save_snapshot(envp);
     }
 
-    return EXIT_SUCCESS;
+    if (command_mode) set_script_text(argv[COMMAND_STRING_INDEX]);
+    while (run_next_line(&job, envp))
+        ;
+
+    /* End of input: queued jobs still get their turn */
+    sched_drain();
+    trace_close();
+    return last_exit_status;
 }
 
 
@@ -112,5 +110,76 @@ Output:
 static void remove_zombies(void)
 {
     int status;
-    while (waitpid(WAIT_ANY_CHILD, &status, WNOHANG) > FALSE_VALUE) {}
+    int pid;
+    struct rusage usage;
+    while ((pid = wait4(WAIT_ANY_CHILD, &status, WNOHANG, &usage)) > FALSE_VALUE) {
+        sched_child_exited(pid);
+        coproc_exited(pid);
+        trace_proc_reaped(pid, status, &usage);
+        update_job_status(pid, status);
+    }
+}
+
+
+/* ---
+Function Name: run_next_line
+
+Purpose:
+  Reads the next command line (see get_job()) and runs it.
+
+Input:
+  job  - Job structure to parse the line into
+  envp - environment variables
+
+Output:
+  Returns 0 at the end of input, 1 otherwise.
+--- */
+static int run_next_line(Job *job, char *envp[])
+{
+    /* Large $(...) outputs of the last line are no longer referenced */
+    release_substitutions();
+
+    /* Announce background jobs that finished since the last prompt */
+    report_finished_jobs();
+    if (!get_job(job)) return FALSE_VALUE;
+    remove_zombies();
+    set_exec_last(script_text_finished());
+
+    /* if, while, for and case lines were compiled by get_job(); empty
+       input lines are ignored */
+    if (flow_pending())
+        run_flow(envp);
+    else if (job->num_stages != FALSE_VALUE)
+        run_command(job, envp);
+
+    /* Shell is idle until the next line: drain queued trace records */
+    trace_flush();
+    return TRUE_VALUE;
+}
+
+
+/* ---
+Function Name: source_rc
+
+Purpose:
+  Runs the rc file found by load_snapshot(), line by line like
+  standard input but without prompts or history.
+
+Input:
+  job  - Job structure to parse its lines into
+  envp - environment variables
+
+Output:
+  The rc's commands have run; an unreadable rc is skipped.
+--- */
+static void source_rc(Job *job, char *envp[])
+{
+    int fd = open(rc_file(), O_RDONLY | O_CLOEXEC);
+    if (fd < FALSE_VALUE) return;
+
+    set_script_input(fd);
+    while (run_next_line(job, envp))
+        ;
+    set_script_input(NO_SCRIPT);
+    close(fd);
 }
@@ -13,6 +13,24 @@
 #define CMD_JOBS                "jobs"
 #define CMD_FG                  "fg"
 #define CMD_BG                  "bg"
+#define CMD_HASH                "hash"
+#define CMD_SET                 "set"
+#define CMD_PARALLEL            "parallel"
+#define CMD_WAIT                "wait"
+#define CMD_KILL                "kill"
+#define CMD_DISOWN              "disown"
+#define CMD_ULIMIT              "ulimit"
+#define CMD_HISTORY             "history"
+#define CMD_LOCAL               "local"
+#define CMD_ALIAS               "alias"
+#define CMD_UNALIAS             "unalias"
+#define CMD_COPROC              "coproc"
+
+/* COMMAND LINE ('mysh -c string') */
+#define COMMAND_OPTION          "-c"
+#define COMMAND_OPTION_INDEX    1
+#define COMMAND_STRING_INDEX    2
+#define USAGE_EXIT_STATUS       2
 
 /* STANDARD FILE DESCRIPTORS */
 #define STD_IN                  0
@@ -26,9 +44,8 @@
 #define WAIT_ANY_CHILD          (-1)
 #define NULL_PTR                ((char **)0)
 
-/* GLOBAL VARIABLES */
-extern int fg_job_status;
-
 static void remove_zombies(void);
+static int run_next_line(Job *job, char *envp[]);
+static void source_rc(Job *job, char *envp[]);
 
 #endif
@@ -150,3 +150,29 @@ void myitoa(int n, char *buf)
         buf[i - j - 1] = temp;
     }
 }
+
+/* ---
+Function Name: mygetenv
+
+Purpose:
+  Looks up an environment variable in the given environment array.
+
+Input:
+  name - variable name (without '=')
+  envp - NULL-terminated array of "NAME=value" strings
+
+Output:
+  Pointer to the value part of the matching entry, or NULL if not found.
+--- */
+char *mygetenv(const char *name, char *envp[])
+{
+    if (!envp) return 0;
+
+    for (int i = INITIAL_INDEX; envp[i]; i++) {
+        int j = INITIAL_INDEX;
+        while (name[j] && envp[i][j] == name[j]) j++;
+        if (name[j] == NULL_CHAR && envp[i][j] == ENV_ASSIGN_CHAR)
+            return envp[i] + j + 1;
+    }
+    return 0;
+}
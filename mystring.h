@@ -9,6 +9,7 @@
 #define NULL_CHAR           '\0'
 #define NEGATIVE_SIGN       '-'
 #define ZERO_CHAR           '0'
+#define ENV_ASSIGN_CHAR     '='
 
 /* NUMERIC CONSTANTS */
 #define ZERO_VALUE          0
@@ -22,5 +23,6 @@ int mystrcmp(const char *s1, const char *s2);
 char *mystrcpy(char *dest, const char *src);
 char *mystrcat(char *dest, const char *src);
 void myitoa(int n, char *buf);
+char *mygetenv(const char *name, char *envp[]);
 
 #endif
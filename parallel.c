@@ -0,0 +1,340 @@
+#define _GNU_SOURCE    /* memfd_create */
+#include "parallel.h"
+#include "runjob.h"
+#include "jobsched.h"
+#include "getjob.h"
+#include "mystring.h"
+#include "myheap.h"
+#include "trace.h"
+#include "jobtable.h"
+#include "jobcgroup.h"
+#include "coproc.h"
+
+#include <unistd.h>    /* read, write, lseek, close */
+#include <sys/mman.h>  /* memfd_create */
+#include <sys/wait.h>  /* waitpid */
+#include <signal.h>    /* sigprocmask */
+#include <errno.h>
+
+/* ---
+Function Name: run_parallel
+
+Purpose:
+    Runs a command template once per input line on up to 'workers'
+    concurrent jobs (a built-in 'xargs -P' / GNU parallel). Each job's
+    stdout is buffered in its own memfd and written out when the job
+    finishes, either as jobs complete or, with keep_order, in input
+    order. Jobs are started with spawn_job(), so they get the same PATH
+    cache, redirection and trace records as any other job.
+
+Input:
+    template   - command words; "{}" is replaced by the line, or the line
+                 is appended as the last argument if no word contains "{}"
+    workers    - maximum number of jobs running at once
+    keep_order - non-zero to print outputs in input order
+    input_fd   - descriptor the lines are read from
+    envp       - environment variables
+
+Output:
+    Returns the number of failed jobs, capped at 101 (0 if all succeeded).
+--- */
+int run_parallel(char **template, int workers, int keep_order, int input_fd, char *envp[])
+{
+    static ParallelTask tasks[PARALLEL_MAX_PENDING];
+    static LineReader reader;
+    char line[MAX_ARGS];
+
+    if (workers < TRUE_VALUE) workers = TRUE_VALUE;
+    if (workers > PARALLEL_MAX_PENDING) workers = PARALLEL_MAX_PENDING;
+
+    reader.fd = input_fd;
+    reader.pos = reader.len = reader.eof = ZERO_VALUE;
+
+    /* Reap our own jobs below; the SIGCHLD handler must not take them */
+    sigset_t chld_mask, prev_mask, child_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+    child_mask = prev_mask;
+    sigdelset(&child_mask, SIGCHLD);
+
+    char *mark = heap_mark();
+    int next_seq = ZERO_VALUE, next_print = ZERO_VALUE;
+    int running = ZERO_VALUE, failed = ZERO_VALUE;
+    int input_done = ZERO_VALUE;
+
+    for (;;) {
+        while (!input_done && running < workers && next_seq - next_print < PARALLEL_MAX_PENDING) {
+            int len = read_input_line(&reader, line, MAX_ARGS);
+            if (len < ZERO_VALUE) {
+                input_done = TRUE_VALUE;
+                break;
+            }
+            if (len == ZERO_VALUE) continue;
+
+            ParallelTask *task = &tasks[next_seq % PARALLEL_MAX_PENDING];
+            if (start_task(task, template, line, envp, &child_mask))
+                running++;
+            else
+                failed++;
+            heap_release(mark);
+            next_seq++;
+        }
+
+        if (running == ZERO_VALUE && input_done) break;
+
+        if (running > ZERO_VALUE) {
+            int status;
+            struct rusage usage;
+            int pid = wait4(-1, &status, ZERO_VALUE, &usage);
+            if (pid < ZERO_VALUE) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            trace_proc_reaped(pid, status, &usage);
+
+            ParallelTask *task = find_task(tasks, next_print, next_seq, pid);
+            if (!task) {
+                /* a background job ended while we waited */
+                update_job_status(pid, status);
+                sched_child_exited(pid);
+                coproc_exited(pid);
+                continue;
+            }
+
+            if (pid == task->pids[task->num_pids - TRUE_VALUE])
+                task->status = wait_status_to_exit_code(status);
+            if (--task->remaining == ZERO_VALUE) {
+                task->done = TRUE_VALUE;
+                cgroup_release(&task->cgroup);
+                running--;
+                if (task->status != EXIT_SUCCESS_CODE) failed++;
+                if (!keep_order) print_task(task);
+            }
+        }
+
+        /* Release finished tasks at the head of the window, in order */
+        while (next_print < next_seq && tasks[next_print % PARALLEL_MAX_PENDING].done) {
+            print_task(&tasks[next_print % PARALLEL_MAX_PENDING]);
+            next_print++;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    return (failed > FAILED_STATUS_CAP) ? FAILED_STATUS_CAP : failed;
+}
+
+/* ---
+Function Name: read_input_line
+
+Purpose:
+    Reads the next line from a LineReader, buffering reads.
+
+Input:
+    reader - line reader
+    line   - output buffer
+    maxlen - size of line; longer lines are truncated
+
+Output:
+    Returns the line length without the newline, or -1 at end of input.
+--- */
+static int read_input_line(LineReader *reader, char *line, int maxlen)
+{
+    int n = ZERO_VALUE;
+    int got_any = ZERO_VALUE;
+
+    for (;;) {
+        if (reader->pos == reader->len) {
+            if (reader->eof) break;
+            int r = read(reader->fd, reader->buf, PARALLEL_READ_LEN);
+            if (r < ZERO_VALUE && errno == EINTR) continue;
+            if (r <= ZERO_VALUE) {
+                reader->eof = TRUE_VALUE;
+                break;
+            }
+            reader->pos = ZERO_VALUE;
+            reader->len = r;
+        }
+
+        char c = reader->buf[reader->pos++];
+        got_any = TRUE_VALUE;
+        if (c == NEWLINE_CHAR) break;
+        if (n < maxlen - TRUE_VALUE) line[n++] = c;
+    }
+
+    line[n] = NULL_CHAR;
+    return got_any ? n : ERROR_CODE;
+}
+
+/* ---
+Function Name: start_task
+
+Purpose:
+    Builds the job for one input line and starts it with its stdout
+    redirected into a fresh memfd.
+
+Input:
+    task       - task slot to fill
+    template   - command template
+    line       - input line
+    envp       - environment variables
+    child_mask - signal mask the job should exec with
+
+Output:
+    Returns 1 if the job was started, 0 otherwise (the task is then
+    marked done with status 1).
+--- */
+static int start_task(ParallelTask *task, char **template, const char *line,
+                      char *envp[], sigset_t *child_mask)
+{
+    Job job;
+    set_job(&job);
+    build_command(&job.pipeline[ZERO_VALUE], template, line);
+    job.num_stages = TRUE_VALUE;
+    job.background = TRUE_VALUE;    /* never hand it the terminal */
+
+    task->out_fd = memfd_create(OUTPUT_MEMFD_NAME, MFD_CLOEXEC);
+    task->status = EXIT_FAILURE_CODE;
+    task->done = task->printed = ZERO_VALUE;
+    job.out_fd = task->out_fd;
+
+    if (task->out_fd < ZERO_VALUE || !spawn_job(&job, envp, child_mask)) {
+        task->done = TRUE_VALUE;
+        return ZERO_VALUE;
+    }
+    trace_job_end(&job);
+
+    task->cgroup = job.cgroup;
+    task->num_pids = task->remaining = job.num_stages;
+    for (int i = ZERO_VALUE; i < (int)job.num_stages; i++)
+        task->pids[i] = job.pids[i];
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: build_command
+
+Purpose:
+    Instantiates the template for one line. Every "{}" in a word is
+    replaced by the line; if no word has one, the line becomes an extra
+    final argument. The line always stays a single argument.
+
+Input:
+    cmd      - command to fill
+    template - NULL-terminated template words
+    line     - input line
+
+Output:
+    Populates cmd->argv (heap strings) and cmd->argc.
+--- */
+static void build_command(Command *cmd, char **template, const char *line)
+{
+    int used_placeholder = ZERO_VALUE;
+    cmd->argc = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; template[i] && cmd->argc < MAX_ARGS - TRUE_VALUE; i++) {
+        char *word = substitute(template[i], line);
+        if (word != template[i]) used_placeholder = TRUE_VALUE;
+        cmd->argv[cmd->argc++] = word;
+    }
+
+    if (!used_placeholder)
+        cmd->argv[cmd->argc++] = (char *)line;
+    cmd->argv[cmd->argc] = NULL;
+}
+
+/* ---
+Function Name: substitute
+
+Purpose:
+    Replaces every "{}" in a template word with the input line.
+
+Input:
+    arg  - template word
+    line - input line
+
+Output:
+    Heap copy with substitutions, or arg itself if it has no "{}" (or
+    the heap is exhausted).
+--- */
+static char *substitute(const char *arg, const char *line)
+{
+    int count = ZERO_VALUE;
+    for (int i = ZERO_VALUE; arg[i]; i++) {
+        if (arg[i] == TEMPLATE_PLACEHOLDER[ZERO_VALUE] && arg[i + TRUE_VALUE] == TEMPLATE_PLACEHOLDER[TRUE_VALUE])
+            count++;
+    }
+    if (count == ZERO_VALUE) return (char *)arg;
+
+    int line_len = mystrlen(line);
+    char *word = alloc(mystrlen(arg) + count * (line_len - PLACEHOLDER_LEN) + TRUE_VALUE);
+    if (!word) return (char *)arg;
+
+    int n = ZERO_VALUE;
+    for (int i = ZERO_VALUE; arg[i]; i++) {
+        if (arg[i] == TEMPLATE_PLACEHOLDER[ZERO_VALUE] && arg[i + TRUE_VALUE] == TEMPLATE_PLACEHOLDER[TRUE_VALUE]) {
+            for (int k = ZERO_VALUE; k < line_len; k++) word[n++] = line[k];
+            i++;
+        } else {
+            word[n++] = arg[i];
+        }
+    }
+    word[n] = NULL_CHAR;
+    return word;
+}
+
+/* ---
+Function Name: find_task
+
+Purpose:
+    Finds the running task that owns a reaped PID.
+
+Input:
+    tasks - task ring
+    first - sequence number of the oldest unprinted task
+    last  - sequence number one past the newest task
+    pid   - reaped process ID
+
+Output:
+    The owning task, or NULL if pid belongs to another job.
+--- */
+static ParallelTask *find_task(ParallelTask *tasks, int first, int last, int pid)
+{
+    for (int seq = first; seq < last; seq++) {
+        ParallelTask *task = &tasks[seq % PARALLEL_MAX_PENDING];
+        if (task->done) continue;
+        for (int i = ZERO_VALUE; i < task->num_pids; i++) {
+            if (task->pids[i] == pid) return task;
+        }
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: print_task
+
+Purpose:
+    Copies a finished task's buffered output to stdout, once, and
+    releases its memfd.
+
+Input:
+    task - finished task
+
+Output:
+    Writes the output and closes task->out_fd.
+--- */
+static void print_task(ParallelTask *task)
+{
+    if (task->printed) return;
+    task->printed = TRUE_VALUE;
+    if (task->out_fd < ZERO_VALUE) return;
+
+    char buf[PARALLEL_COPY_LEN];
+    int n;
+    lseek(task->out_fd, ZERO_VALUE, SEEK_SET);
+    while ((n = read(task->out_fd, buf, PARALLEL_COPY_LEN)) > ZERO_VALUE)
+        write(STDOUT_FILENO, buf, n);
+
+    close(task->out_fd);
+    task->out_fd = ERROR_CODE;
+}
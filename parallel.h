@@ -0,0 +1,60 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "jobs.h"
+#include <signal.h>     /* sigset_t */
+
+/* PARALLEL LIMITS */
+#define PARALLEL_MAX_PENDING    256     /* started but not yet printed */
+#define PARALLEL_READ_LEN       4096
+#define PARALLEL_COPY_LEN       65536
+#define FAILED_STATUS_CAP       101
+
+/* TEMPLATE CONSTANTS */
+#define TEMPLATE_PLACEHOLDER    "{}"
+#define PLACEHOLDER_LEN         2
+#define OUTPUT_MEMFD_NAME       "mysh-parallel"
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NEWLINE_CHAR            '\n'
+#define NULL_CHAR               '\0'
+
+/* ONE INPUT LINE'S JOB */
+typedef struct
+{
+    int pids[MAX_PIPELINE_LEN];
+    int num_pids;
+    int remaining;      /* stages not yet reaped */
+    int out_fd;         /* memfd buffering the job's stdout */
+    int status;         /* exit code of the last stage */
+    JobCgroup cgroup;   /* released once the job has been reaped */
+    int done;
+    int printed;
+} ParallelTask;
+
+/* BUFFERED LINE INPUT */
+typedef struct
+{
+    int fd;
+    char buf[PARALLEL_READ_LEN];
+    int pos;
+    int len;
+    int eof;
+} LineReader;
+
+/* FUNCTION DECLARATIONS */
+int run_parallel(char **template, int workers, int keep_order, int input_fd, char *envp[]);
+
+/* STATIC HELPER FUNCTIONS */
+static int read_input_line(LineReader *reader, char *line, int maxlen);
+static int start_task(ParallelTask *task, char **template, const char *line,
+                      char *envp[], sigset_t *child_mask);
+static void build_command(Command *cmd, char **template, const char *line);
+static char *substitute(const char *arg, const char *line);
+static ParallelTask *find_task(ParallelTask *tasks, int first, int last, int pid);
+static void print_task(ParallelTask *task);
+
+#endif
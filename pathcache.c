@@ -0,0 +1,559 @@
+#define _GNU_SOURCE    /* syscall */
+#include "pathcache.h"
+#include "runjob.h"
+#include "mystring.h"
+#include "myheap.h"
+
+#include <unistd.h>       /* write, access, syscall */
+#include <stdlib.h>       /* qsort */
+#include <fcntl.h>        /* open */
+#include <dirent.h>       /* DT_DIR */
+#include <sys/stat.h>     /* stat */
+#include <sys/syscall.h>  /* SYS_getdents64 */
+
+static CacheEntry cache[CACHE_SLOTS];
+static char cached_path_env[CACHE_ENV_LEN];
+
+/* Every executable name on PATH, sorted, for completion and lookups */
+static IndexDir index_dirs[INDEX_MAX_DIRS];
+static int num_index_dirs = ZERO_VALUE;
+static char index_pool[INDEX_POOL_LEN];
+static int index_pool_used = ZERO_VALUE;
+static IndexEntry index_entries[INDEX_MAX_NAMES];
+static int num_index_entries = ZERO_VALUE;
+static int index_built = ZERO_VALUE;
+static char index_path_env[CACHE_ENV_LEN];
+static char dirent_buf[DIRENT_BUF_LEN];
+
+/* ---
+Function Name: lookup_command_path
+
+Purpose:
+    Resolves a command name to its executable path, remembering the result
+    so repeated commands skip the PATH scan (like Bash's hash table). Names
+    containing '/' are never cached. The cache is dropped automatically
+    whenever PATH changes. Once tab completion has built the PATH index
+    (or the rc snapshot has restored it), cache misses are answered from
+    it with a single access() check instead of probing every PATH
+    directory.
+
+Input:
+    cmd  - command name
+    envp - environment variables
+
+Output:
+    Returns a heap-allocated full path, or NULL if the command is not found.
+--- */
+char *lookup_command_path(const char *cmd, char *envp[])
+{
+    if (!cmd || cmd[INITIAL_INDEX] == NULL_CHAR) return NULL;
+
+    for (int k = INITIAL_INDEX; cmd[k]; k++) {
+        if (cmd[k] == PATH_SEPARATOR)
+            return resolve_command_path(cmd, envp);
+    }
+
+    char *path_env = mygetenv(PATH_ENV_NAME, envp);
+    sync_path_env(path_env ? path_env : DEFAULT_PATH);
+
+    CacheEntry *entry = &cache[hash_name(cmd)];
+    if (mystrcmp(entry->name, cmd) == ZERO_VALUE)
+        return copy_to_heap(entry->path);
+
+    char *fullpath = index_lookup(cmd, envp);
+    if (!fullpath) fullpath = resolve_command_path(cmd, envp);
+    if (fullpath && mystrlen(cmd) < CACHE_NAME_LEN && mystrlen(fullpath) < CACHE_PATH_LEN) {
+        mystrcpy(entry->name, cmd);
+        mystrcpy(entry->path, fullpath);
+    }
+    return fullpath;
+}
+
+/* ---
+Function Name: clear_command_cache
+
+Purpose:
+    Forgets every remembered command location ('hash -r').
+
+Input:
+    none
+
+Output:
+    Empties the cache.
+--- */
+void clear_command_cache(void)
+{
+    for (int i = INITIAL_INDEX; i < CACHE_SLOTS; i++)
+        cache[i].name[INITIAL_INDEX] = NULL_CHAR;
+}
+
+/* ---
+Function Name: print_command_cache
+
+Purpose:
+    Lists remembered commands as "name<TAB>path" lines ('hash').
+
+Input:
+    none
+
+Output:
+    Writes the cache contents to standard output.
+--- */
+void print_command_cache(void)
+{
+    for (int i = INITIAL_INDEX; i < CACHE_SLOTS; i++) {
+        if (cache[i].name[INITIAL_INDEX] == NULL_CHAR) continue;
+        write(STDOUT_FILENO, cache[i].name, mystrlen(cache[i].name));
+        write(STDOUT_FILENO, "\t", 1);
+        write(STDOUT_FILENO, cache[i].path, mystrlen(cache[i].path));
+        write(STDOUT_FILENO, NEWLINE_STR, mystrlen(NEWLINE_STR));
+    }
+}
+
+/* ---
+Function Name: hash_name
+
+Purpose:
+    Computes the cache slot of a command name (FNV-1a).
+
+Input:
+    name - command name
+
+Output:
+    Slot index in [0, CACHE_SLOTS).
+--- */
+static unsigned int hash_name(const char *name)
+{
+    unsigned int h = FNV_OFFSET_BASIS;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= FNV_PRIME;
+    }
+    return h % CACHE_SLOTS;
+}
+
+/* ---
+Function Name: sync_path_env
+
+Purpose:
+    Drops the cache if PATH differs from the value the cache was built for.
+
+Input:
+    path_env - current PATH value
+
+Output:
+    Updates cached_path_env and clears stale entries.
+--- */
+static void sync_path_env(const char *path_env)
+{
+    if (mystrcmp(cached_path_env, path_env) == ZERO_VALUE) return;
+
+    clear_command_cache();
+    if (mystrlen(path_env) < CACHE_ENV_LEN)
+        mystrcpy(cached_path_env, path_env);
+    else
+        cached_path_env[INITIAL_INDEX] = NULL_CHAR;
+}
+
+/* ---
+Function Name: copy_to_heap
+
+Purpose:
+    Copies a cached path into the per-command heap so callers own a copy
+    that later cache updates cannot change.
+
+Input:
+    src - string to copy
+
+Output:
+    Heap copy, or NULL if the heap is exhausted.
+--- */
+static char *copy_to_heap(const char *src)
+{
+    char *copy = alloc(mystrlen(src) + TRUE_VALUE);
+    if (!copy) return NULL;
+    return mystrcpy(copy, src);
+}
+
+/* ---
+Function Name: refresh_path_index
+
+Purpose:
+    Brings the index of PATH executables up to date. Each directory is
+    read with getdents64 in one pass, and only again once its mtime
+    changes (adding or removing a file updates it), so an up-to-date
+    index costs one stat() per PATH directory and no per-file calls.
+    The names of all directories are merged into one sorted array,
+    keeping the first directory in PATH order for each name.
+
+Input:
+    envp - environment variables
+
+Output:
+    Number of distinct command names in the index.
+--- */
+int refresh_path_index(char *envp[])
+{
+    char *path_env = mygetenv(PATH_ENV_NAME, envp);
+    if (!path_env) path_env = DEFAULT_PATH;
+    if (!index_built || mystrcmp(index_path_env, path_env) != ZERO_VALUE)
+        reset_path_index(path_env);
+
+    int changed = !index_built;
+    int restarted = ZERO_VALUE;
+    for (int i = INITIAL_INDEX; i < num_index_dirs; i++) {
+        IndexDir *dir = &index_dirs[i];
+        struct stat st;
+
+        if (stat(dir->path, &st) < ZERO_VALUE) {
+            if (dir->scanned) {
+                dir->scanned = ZERO_VALUE;
+                dir->pool_end = dir->pool_start;
+                changed = TRUE_VALUE;
+            }
+            continue;
+        }
+        if (dir->scanned && st.st_mtim.tv_sec == dir->mtime.tv_sec &&
+            st.st_mtim.tv_nsec == dir->mtime.tv_nsec)
+            continue;
+
+        changed = TRUE_VALUE;
+        if (!scan_index_dir(dir) && !restarted) {
+            /* the pool is full of names from earlier scans: start over */
+            restarted = TRUE_VALUE;
+            index_pool_used = ZERO_VALUE;
+            for (int k = INITIAL_INDEX; k < num_index_dirs; k++) index_dirs[k].scanned = ZERO_VALUE;
+            i = INITIAL_INDEX - TRUE_VALUE;
+        }
+    }
+
+    if (changed) rebuild_sorted_index();
+    index_built = TRUE_VALUE;
+    return num_index_entries;
+}
+
+/* ---
+Function Name: find_path_index_prefix
+
+Purpose:
+    Finds the commands starting with a prefix by binary search.
+
+Input:
+    prefix - text to match (need not be null-terminated)
+    len    - length of prefix
+    first  - receives the index of the first match
+
+Output:
+    Number of matches; they are path_index_name(first) onwards, sorted.
+--- */
+int find_path_index_prefix(const char *prefix, int len, int *first)
+{
+    int lo = ZERO_VALUE, hi = num_index_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / HALF;
+        if (compare_prefix(path_index_name(mid), prefix, len) < ZERO_VALUE) lo = mid + TRUE_VALUE;
+        else hi = mid;
+    }
+    *first = lo;
+
+    hi = num_index_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / HALF;
+        if (compare_prefix(path_index_name(mid), prefix, len) <= ZERO_VALUE) lo = mid + TRUE_VALUE;
+        else hi = mid;
+    }
+    return lo - *first;
+}
+
+/* ---
+Function Name: path_index_name
+
+Purpose:
+    Returns one command name from the sorted index.
+
+Input:
+    i - index, below the count from refresh_path_index()
+
+Output:
+    The name (valid until the index is next refreshed).
+--- */
+const char *path_index_name(int i)
+{
+    return index_pool + index_entries[i].name;
+}
+
+/* ---
+Function Name: save_path_index
+
+Purpose:
+    Writes the PATH index to a startup snapshot. It holds offsets, not
+    pointers, so it is saved as it is.
+
+Input:
+    w - snapshot writer
+
+Output:
+    None
+--- */
+void save_path_index(SnapWriter *w)
+{
+    snap_write_int(w, index_built);
+    if (!index_built) return;
+
+    snap_write(w, index_path_env, CACHE_ENV_LEN);
+    snap_write_int(w, num_index_dirs);
+    snap_write(w, index_dirs, num_index_dirs * (long long)sizeof(IndexDir));
+    snap_write_int(w, index_pool_used);
+    snap_write(w, index_pool, index_pool_used);
+    snap_write_int(w, num_index_entries);
+    snap_write(w, index_entries, num_index_entries * (long long)sizeof(IndexEntry));
+}
+
+/* ---
+Function Name: load_path_index
+
+Purpose:
+    Restores the PATH index from a startup snapshot. The directory
+    mtimes come with it, so a directory changed since the snapshot was
+    written is rescanned on the next lookup as usual.
+
+Input:
+    r - snapshot reader
+
+Output:
+    Returns 1, or 0 if the image is damaged (the index is left unbuilt).
+--- */
+int load_path_index(SnapReader *r)
+{
+    index_built = ZERO_VALUE;
+    int built = snap_read_count(r, TRUE_VALUE);
+    if (built <= ZERO_VALUE) return built == ZERO_VALUE;
+
+    snap_read(r, index_path_env, CACHE_ENV_LEN);
+    index_path_env[CACHE_ENV_LEN - TRUE_VALUE] = NULL_CHAR;
+    int dirs = snap_read_count(r, INDEX_MAX_DIRS);
+    if (dirs < ZERO_VALUE || !snap_read(r, index_dirs, dirs * (long long)sizeof(IndexDir))) return ZERO_VALUE;
+    int pool_used = snap_read_count(r, INDEX_POOL_LEN);
+    if (pool_used < ZERO_VALUE || !snap_read(r, index_pool, pool_used)) return ZERO_VALUE;
+    int entries = snap_read_count(r, INDEX_MAX_NAMES);
+    if (entries < ZERO_VALUE || !snap_read(r, index_entries, entries * (long long)sizeof(IndexEntry)))
+        return ZERO_VALUE;
+
+    num_index_dirs = dirs;
+    index_pool_used = pool_used;
+    num_index_entries = entries;
+    index_built = TRUE_VALUE;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: index_lookup
+
+Purpose:
+    Resolves a command through the PATH index, if it has been built.
+
+Input:
+    cmd  - command name
+    envp - environment variables
+
+Output:
+    Heap copy of the full path, or NULL if the index is not built, does
+    not have the command, or the file is not executable.
+--- */
+static char *index_lookup(const char *cmd, char *envp[])
+{
+    if (!index_built) return NULL;
+    refresh_path_index(envp);
+
+    int first;
+    int len = mystrlen(cmd);
+    if (find_path_index_prefix(cmd, len, &first) == ZERO_VALUE) return NULL;
+    if (mystrcmp(path_index_name(first), cmd) != ZERO_VALUE) return NULL;
+
+    const char *dir = index_dirs[index_entries[first].dir].path;
+    char fullpath[CACHE_PATH_LEN];
+    if (mystrlen(dir) + len + TRUE_VALUE >= CACHE_PATH_LEN) return NULL;
+    mystrcpy(fullpath, dir);
+    mystrcat(fullpath, PATH_SEPARATOR_TEXT);
+    mystrcat(fullpath, cmd);
+
+    if (access(fullpath, X_OK) < ZERO_VALUE) return NULL;
+    return copy_to_heap(fullpath);
+}
+
+/* ---
+Function Name: reset_path_index
+
+Purpose:
+    Empties the index and splits a new PATH into its directories
+    (empty and repeated entries are skipped).
+
+Input:
+    path_env - PATH value
+
+Output:
+    Resets the directory list; every directory will be scanned.
+--- */
+static void reset_path_index(const char *path_env)
+{
+    if (mystrlen(path_env) < CACHE_ENV_LEN) mystrcpy(index_path_env, path_env);
+    else index_path_env[INITIAL_INDEX] = NULL_CHAR;
+
+    num_index_dirs = ZERO_VALUE;
+    index_pool_used = ZERO_VALUE;
+    num_index_entries = ZERO_VALUE;
+
+    int start = ZERO_VALUE;
+    for (int i = ZERO_VALUE;; i++) {
+        if (path_env[i] != PATH_LIST_SEPARATOR && path_env[i] != NULL_CHAR) continue;
+
+        int len = i - start;
+        if (len > ZERO_VALUE && len < CACHE_PATH_LEN && num_index_dirs < INDEX_MAX_DIRS) {
+            IndexDir *dir = &index_dirs[num_index_dirs];
+            for (int k = ZERO_VALUE; k < len; k++) dir->path[k] = path_env[start + k];
+            dir->path[len] = NULL_CHAR;
+            dir->scanned = ZERO_VALUE;
+            dir->pool_start = dir->pool_end = ZERO_VALUE;
+
+            int duplicate = ZERO_VALUE;
+            for (int k = INITIAL_INDEX; k < num_index_dirs; k++) {
+                if (mystrcmp(index_dirs[k].path, dir->path) == ZERO_VALUE) duplicate = TRUE_VALUE;
+            }
+            if (!duplicate) num_index_dirs++;
+        }
+
+        if (path_env[i] == NULL_CHAR) break;
+        start = i + TRUE_VALUE;
+    }
+}
+
+/* ---
+Function Name: scan_index_dir
+
+Purpose:
+    Reads one PATH directory with getdents64, appending the names of
+    everything except subdirectories and hidden files to the name pool.
+    The mtime is taken from the open directory before reading, so a
+    file added during the scan causes another scan later. Files are not
+    stat()ed; index_lookup() checks the one file it returns.
+
+Input:
+    dir - directory to scan
+
+Output:
+    Returns 1 on success (an unreadable directory counts as empty), 0
+    if the name pool is full.
+--- */
+static int scan_index_dir(IndexDir *dir)
+{
+    dir->pool_start = dir->pool_end = index_pool_used;
+    dir->scanned = TRUE_VALUE;
+
+    int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < ZERO_VALUE) return TRUE_VALUE;
+
+    struct stat st;
+    if (fstat(fd, &st) == ZERO_VALUE) dir->mtime = st.st_mtim;
+
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, dirent_buf, DIRENT_BUF_LEN)) > ZERO_VALUE) {
+        for (long off = ZERO_VALUE; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(dirent_buf + off);
+            off += d->d_reclen;
+            if (d->d_name[INITIAL_INDEX] == HIDDEN_FILE_CHAR || d->d_type == DT_DIR) continue;
+
+            int len = mystrlen(d->d_name) + TRUE_VALUE;
+            if (index_pool_used + len > INDEX_POOL_LEN) {
+                close(fd);
+                dir->scanned = ZERO_VALUE;
+                return ZERO_VALUE;
+            }
+            mystrcpy(index_pool + index_pool_used, d->d_name);
+            index_pool_used += len;
+        }
+    }
+
+    close(fd);
+    dir->pool_end = index_pool_used;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: rebuild_sorted_index
+
+Purpose:
+    Merges the names of every scanned directory into the sorted index,
+    keeping only the first directory (in PATH order) for each name.
+
+Input:
+    None
+
+Output:
+    Replaces index_entries.
+--- */
+static void rebuild_sorted_index(void)
+{
+    int n = ZERO_VALUE;
+    for (int d = INITIAL_INDEX; d < num_index_dirs; d++) {
+        IndexDir *dir = &index_dirs[d];
+        if (!dir->scanned) continue;
+        for (int off = dir->pool_start; off < dir->pool_end && n < INDEX_MAX_NAMES;
+             off += mystrlen(index_pool + off) + TRUE_VALUE) {
+            index_entries[n].name = off;
+            index_entries[n].dir = d;
+            n++;
+        }
+    }
+
+    qsort(index_entries, n, sizeof(IndexEntry), compare_index_entries);
+
+    int kept = ZERO_VALUE;
+    for (int i = INITIAL_INDEX; i < n; i++) {
+        if (kept > ZERO_VALUE &&
+            mystrcmp(index_pool + index_entries[kept - TRUE_VALUE].name, index_pool + index_entries[i].name) == ZERO_VALUE)
+            continue;
+        index_entries[kept++] = index_entries[i];
+    }
+    num_index_entries = kept;
+}
+
+/* ---
+Function Name: compare_index_entries
+
+Purpose:
+    qsort() order for the index: by name, then by PATH position.
+
+Input:
+    a, b - IndexEntry pointers
+
+Output:
+    Negative, zero or positive.
+--- */
+static int compare_index_entries(const void *a, const void *b)
+{
+    const IndexEntry *x = a, *y = b;
+    int c = mystrcmp(index_pool + x->name, index_pool + y->name);
+    return c ? c : x->dir - y->dir;
+}
+
+/* ---
+Function Name: compare_prefix
+
+Purpose:
+    Compares the start of a name with a prefix, like strncmp().
+
+Input:
+    name   - null-terminated name
+    prefix - prefix text
+    len    - length of prefix
+
+Output:
+    Negative, zero (name starts with prefix) or positive.
+--- */
+static int compare_prefix(const char *name, const char *prefix, int len)
+{
+    for (int i = ZERO_VALUE; i < len; i++) {
+        if (name[i] != prefix[i]) return (unsigned char)name[i] - (unsigned char)prefix[i];
+    }
+    return ZERO_VALUE;
+}
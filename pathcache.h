@@ -0,0 +1,95 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stdint.h>         /* uint64_t */
+#include <time.h>           /* struct timespec */
+#include "snapio.h"
+
+/* CACHE SIZES */
+#define CACHE_SLOTS             64
+#define CACHE_NAME_LEN          64
+#define CACHE_PATH_LEN          512
+#define CACHE_ENV_LEN           1024
+
+/* PATH EXECUTABLE INDEX SIZES */
+#define INDEX_MAX_DIRS          64
+#define INDEX_MAX_NAMES         65536
+#define INDEX_POOL_LEN          (1 << 20)
+#define DIRENT_BUF_LEN          65536
+
+/* PATH CONSTANTS */
+#define PATH_ENV_NAME           "PATH"
+#define DEFAULT_PATH            "/usr/local/bin:/usr/bin:/bin"
+#define PATH_SEPARATOR          '/'
+#define PATH_LIST_SEPARATOR     ':'
+#define HIDDEN_FILE_CHAR        '.'
+#define CACHE_FIELD_SEPARATOR   "\t"
+#define PATH_SEPARATOR_TEXT     "/"
+
+/* HASHING CONSTANTS */
+#define FNV_OFFSET_BASIS        2166136261u
+#define FNV_PRIME               16777619u
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define NOT_FOUND               -1
+
+/* PATH HASH CACHE ENTRY */
+typedef struct
+{
+    char name[CACHE_NAME_LEN];
+    char path[CACHE_PATH_LEN];
+} CacheEntry;
+
+/* ONE PATH DIRECTORY IN THE EXECUTABLE INDEX */
+typedef struct
+{
+    char path[CACHE_PATH_LEN];
+    struct timespec mtime;      /* when it was last scanned */
+    int scanned;
+    int pool_start;             /* its names: NUL-terminated, in the pool */
+    int pool_end;
+} IndexDir;
+
+/* ONE COMMAND NAME IN THE SORTED INDEX */
+typedef struct
+{
+    int name;                   /* offset into the name pool */
+    int dir;                    /* first PATH directory that has it */
+} IndexEntry;
+
+/* DIRECTORY RECORD RETURNED BY getdents64 */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* FUNCTION DECLARATIONS */
+char *lookup_command_path(const char *cmd, char *envp[]);
+void clear_command_cache(void);
+void print_command_cache(void);
+int refresh_path_index(char *envp[]);
+int find_path_index_prefix(const char *prefix, int len, int *first);
+const char *path_index_name(int i);
+void save_path_index(SnapWriter *w);
+int load_path_index(SnapReader *r);
+
+/* STATIC HELPER FUNCTIONS */
+static unsigned int hash_name(const char *name);
+static void sync_path_env(const char *path_env);
+static char *copy_to_heap(const char *src);
+static char *index_lookup(const char *cmd, char *envp[]);
+static void reset_path_index(const char *path_env);
+static int scan_index_dir(IndexDir *dir);
+static void rebuild_sorted_index(void);
+static int compare_index_entries(const void *a, const void *b);
+static int compare_prefix(const char *name, const char *prefix, int len);
+
+#endif
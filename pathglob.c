@@ -0,0 +1,526 @@
+#define _GNU_SOURCE
+#include "pathglob.h"
+#include "pathcache.h"    /* struct linux_dirent64 */
+#include "mystring.h"
+#include "myheap.h"
+
+#include <unistd.h>       /* close, syscall */
+#include <stdlib.h>       /* qsort */
+#include <fcntl.h>        /* open, AT_* */
+#include <dirent.h>       /* DT_* */
+#include <sys/stat.h>     /* fstatat */
+#include <sys/syscall.h>  /* SYS_getdents64 */
+
+/* The word being expanded, compiled */
+static GlobState gl;
+
+/* Directory records, read in bulk */
+static char glob_dirent_buf[GLOB_DIRENT_BUF_LEN];
+
+/* ---
+Function Name: has_glob_chars
+
+Purpose:
+    Checks whether a word contains pattern characters (*, ? or [).
+
+Input:
+    word - null-terminated word
+
+Output:
+    Non-zero if the word should go through expand_glob().
+--- */
+int has_glob_chars(const char *word)
+{
+    for (int i = ZERO_VALUE; word[i] != NULL_CHAR; i++) {
+        if (word[i] == GLOB_STAR_CHAR || word[i] == GLOB_ANY_CHAR || word[i] == GLOB_CLASS_OPEN)
+            return TRUE_VALUE;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: expand_glob
+
+Purpose:
+    Expands a pathname pattern into the matching paths, which are
+    allocated on the heap, sorted and appended to the command's argv.
+    The pattern is compiled once; each directory it has to search is
+    read with getdents64 in large batches, and an entry is stat()ed
+    only when the pattern needs to know it is a directory and the
+    directory record does not say. Names starting with '.' match only
+    a pattern component starting with '.'; "." and ".." never match.
+
+Input:
+    cmd  - command whose argv receives the matches
+    word - pattern, e.g. "logs/app-?.log"
+
+Output:
+    Returns the number of words added, GLOB_NO_MATCH (the caller keeps
+    the word as it is), or GLOB_TOO_MANY if the matches do not fit in
+    argv or on the heap.
+--- */
+int expand_glob(Command *cmd, const char *word)
+{
+    if (!compile_pattern(word)) return GLOB_NO_MATCH;
+
+    int path_len = ZERO_VALUE;
+    if (word[ZERO_VALUE] == GLOB_SEPARATOR_CHAR) gl.path[path_len++] = GLOB_SEPARATOR_CHAR;
+
+    gl.results = cmd->argv + cmd->argc;
+    gl.count = ZERO_VALUE;
+    gl.limit = MAX_ARGS - cmd->argc;
+    gl.overflow = ZERO_VALUE;
+
+    walk_segment(path_len, ZERO_VALUE, ZERO_VALUE);
+
+    if (gl.overflow) return GLOB_TOO_MANY;
+    if (gl.count == ZERO_VALUE) return GLOB_NO_MATCH;
+
+    qsort(gl.results, gl.count, sizeof(char *), compare_results);
+    cmd->argc += gl.count;
+    return gl.count;
+}
+
+/* ---
+Function Name: glob_match
+
+Purpose:
+    Matches a whole string against a pattern, as 'case' does. '/' and a
+    leading '.' are ordinary characters here.
+
+Input:
+    pattern - pattern with *, ? and [...]
+    text    - string to match
+
+Output:
+    Non-zero if text matches.
+--- */
+int glob_match(const char *pattern, const char *text)
+{
+    GlobSegment *seg = &gl.segments[ZERO_VALUE];
+    gl.num_ops = ZERO_VALUE;
+    seg->text = pattern;
+    seg->len = mystrlen(pattern);
+    if (!compile_segment(seg)) return ZERO_VALUE;
+    if (!seg->is_glob) return mystrcmp(pattern, text) == ZERO_VALUE;
+    return match_segment(seg, text, mystrlen(text));
+}
+
+/* ---
+Function Name: compile_pattern
+
+Purpose:
+    Splits a word into its '/'-separated components and compiles the
+    ones containing pattern characters.
+
+Input:
+    word - pattern
+
+Output:
+    Fills gl; returns 1 if at least one component is a pattern, 0 if
+    the word is literal (e.g. an unclosed '[') or too long.
+--- */
+static int compile_pattern(const char *word)
+{
+    int any_glob = ZERO_VALUE;
+    gl.num_segments = ZERO_VALUE;
+    gl.num_ops = ZERO_VALUE;
+
+    int i = ZERO_VALUE;
+    while (word[i] != NULL_CHAR) {
+        while (word[i] == GLOB_SEPARATOR_CHAR) i++;
+        int start = i;
+        while (word[i] != GLOB_SEPARATOR_CHAR && word[i] != NULL_CHAR) i++;
+        if (i == start) break;
+
+        if (gl.num_segments == GLOB_MAX_SEGMENTS) return ZERO_VALUE;
+        GlobSegment *seg = &gl.segments[gl.num_segments++];
+        seg->text = word + start;
+        seg->len = i - start;
+        if (!compile_segment(seg)) return ZERO_VALUE;
+        if (seg->is_glob) any_glob = TRUE_VALUE;
+    }
+
+    gl.dirs_only = (i > TRUE_VALUE && word[i - TRUE_VALUE] == GLOB_SEPARATOR_CHAR);
+    return any_glob;
+}
+
+/* ---
+Function Name: compile_segment
+
+Purpose:
+    Compiles one pattern component into ops, merging runs of '*', and
+    records what a quick rejection needs: the minimum name length and
+    the literal bytes the pattern ends with (".log" in "*.log").
+
+Input:
+    seg - component; text and len are set
+
+Output:
+    Fills seg; returns 0 if the op table is full.
+--- */
+static int compile_segment(GlobSegment *seg)
+{
+    seg->first_op = gl.num_ops;
+    seg->is_glob = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; i < seg->len;) {
+        if (gl.num_ops == GLOB_MAX_OPS) return ZERO_VALUE;
+        GlobOp *op = &gl.ops[gl.num_ops];
+        char c = seg->text[i];
+        int next;
+
+        if (c == GLOB_STAR_CHAR) {
+            i++;
+            seg->is_glob = TRUE_VALUE;
+            if (gl.num_ops > seg->first_op && gl.ops[gl.num_ops - TRUE_VALUE].type == GLOB_OP_STAR)
+                continue;
+            op->type = GLOB_OP_STAR;
+        } else if (c == GLOB_ANY_CHAR) {
+            i++;
+            seg->is_glob = TRUE_VALUE;
+            op->type = GLOB_OP_ANY;
+        } else if (c == GLOB_CLASS_OPEN && (next = compile_class(seg->text, seg->len, i, op)) > ZERO_VALUE) {
+            i = next;
+            seg->is_glob = TRUE_VALUE;
+        } else {
+            op->type = GLOB_OP_CHAR;
+            op->ch = (unsigned char)c;
+            i++;
+        }
+        gl.num_ops++;
+    }
+
+    seg->op_count = gl.num_ops - seg->first_op;
+    if (!seg->is_glob) {
+        gl.num_ops = seg->first_op;
+        seg->op_count = ZERO_VALUE;
+        return TRUE_VALUE;
+    }
+
+    GlobOp *ops = gl.ops + seg->first_op;
+    seg->min_len = ZERO_VALUE;
+    for (int k = ZERO_VALUE; k < seg->op_count; k++) {
+        if (ops[k].type != GLOB_OP_STAR) seg->min_len++;
+    }
+    seg->tail_len = ZERO_VALUE;
+    while (seg->tail_len < seg->op_count &&
+           ops[seg->op_count - seg->tail_len - TRUE_VALUE].type == GLOB_OP_CHAR)
+        seg->tail_len++;
+    seg->allow_hidden = (ops[ZERO_VALUE].type == GLOB_OP_CHAR && ops[ZERO_VALUE].ch == GLOB_HIDDEN_CHAR);
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: compile_class
+
+Purpose:
+    Compiles a bracket expression such as [a-z_] or [!0-9] into a
+    bitmap. A ']' right after the '[' (or '[!') is a literal member.
+
+Input:
+    text - component text
+    len  - length of text
+    i    - index of the '['
+    op   - op to fill
+
+Output:
+    Returns the index just past the closing ']', or 0 if there is
+    none (the '[' is then an ordinary character).
+--- */
+static int compile_class(const char *text, int len, int i, GlobOp *op)
+{
+    int j = i + TRUE_VALUE;
+    op->type = GLOB_OP_CLASS;
+    op->negate = ZERO_VALUE;
+    for (int b = ZERO_VALUE; b < GLOB_CLASS_BYTES; b++) op->bits[b] = ZERO_VALUE;
+
+    if (j < len && (text[j] == GLOB_CLASS_NEGATE || text[j] == GLOB_CLASS_NEGATE_ALT)) {
+        op->negate = TRUE_VALUE;
+        j++;
+    }
+
+    int first = j;
+    while (j < len && (text[j] != GLOB_CLASS_CLOSE || j == first)) {
+        unsigned char lo = (unsigned char)text[j], hi = lo;
+        if (j + TRUE_VALUE + TRUE_VALUE < len && text[j + TRUE_VALUE] == GLOB_RANGE_CHAR &&
+            text[j + TRUE_VALUE + TRUE_VALUE] != GLOB_CLASS_CLOSE) {
+            hi = (unsigned char)text[j + TRUE_VALUE + TRUE_VALUE];
+            j += TRUE_VALUE + TRUE_VALUE;
+        }
+        for (int c = lo; c <= hi; c++)
+            op->bits[c / BITS_PER_BYTE] |= (unsigned char)(TRUE_VALUE << (c % BITS_PER_BYTE));
+        j++;
+    }
+
+    if (j >= len) return ZERO_VALUE;
+    return j + TRUE_VALUE;
+}
+
+/* ---
+Function Name: walk_segment
+
+Purpose:
+    Expands the pattern from one component onwards below the path built
+    so far. Literal components are appended without touching the disk;
+    pattern components read the directory once and recurse into each
+    matching subdirectory.
+
+Input:
+    path_len   - length of gl.path
+    seg_index  - component to expand next
+    must_check - non-zero if literal components were appended since the
+                 last directory read, so the path may not exist
+
+Output:
+    Adds matches to gl.results.
+--- */
+static void walk_segment(int path_len, int seg_index, int must_check)
+{
+    if (gl.overflow) return;
+
+    if (seg_index == gl.num_segments) {
+        if (must_check) {
+            struct stat st;
+            gl.path[path_len] = NULL_CHAR;
+            if (gl.dirs_only) {
+                if (stat(gl.path, &st) < ZERO_VALUE || !S_ISDIR(st.st_mode)) return;
+            } else if (lstat(gl.path, &st) < ZERO_VALUE) {
+                return;
+            }
+        }
+        add_result(path_len);
+        return;
+    }
+
+    GlobSegment *seg = &gl.segments[seg_index];
+    if (!seg->is_glob) {
+        int n = append_component(path_len, seg->text, seg->len);
+        if (n > ZERO_VALUE) walk_segment(n, seg_index + TRUE_VALUE, TRUE_VALUE);
+        return;
+    }
+
+    char *subdirs[GLOB_MAX_SUBDIRS];
+    int num_subdirs = ZERO_VALUE;
+    int last = (seg_index == gl.num_segments - TRUE_VALUE);
+    if (!read_matches(path_len, seg, last, subdirs, &num_subdirs)) return;
+
+    for (int k = ZERO_VALUE; k < num_subdirs && !gl.overflow; k++) {
+        int n = append_component(path_len, subdirs[k], mystrlen(subdirs[k]));
+        if (n > ZERO_VALUE) walk_segment(n, seg_index + TRUE_VALUE, ZERO_VALUE);
+    }
+}
+
+/* ---
+Function Name: read_matches
+
+Purpose:
+    Reads one directory with getdents64 and matches every name against
+    a pattern component. For the last component the matches become
+    results straight away; otherwise matching subdirectories are saved
+    for walk_segment() to descend into after the read, since deeper
+    reads reuse the record buffer.
+
+Input:
+    path_len    - length of gl.path, the directory to read ("." if 0)
+    seg         - compiled component
+    last        - non-zero if seg is the last component
+    subdirs     - receives matching subdirectory names (on the heap)
+    num_subdirs - receives their number
+
+Output:
+    Returns 0 if the directory cannot be read.
+--- */
+static int read_matches(int path_len, GlobSegment *seg, int last, char **subdirs, int *num_subdirs)
+{
+    gl.path[path_len] = NULL_CHAR;
+    int fd = open(path_len ? gl.path : GLOB_CURRENT_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < ZERO_VALUE) return ZERO_VALUE;
+
+    int need_dir = !last || gl.dirs_only;
+    long n;
+    while (!gl.overflow && (n = syscall(SYS_getdents64, fd, glob_dirent_buf, GLOB_DIRENT_BUF_LEN)) > ZERO_VALUE) {
+        for (long off = ZERO_VALUE; off < n && !gl.overflow;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(glob_dirent_buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+
+            if (name[ZERO_VALUE] == GLOB_HIDDEN_CHAR &&
+                (!seg->allow_hidden || mystrcmp(name, GLOB_CURRENT_DIR) == ZERO_VALUE ||
+                 mystrcmp(name, GLOB_PARENT_DIR) == ZERO_VALUE))
+                continue;
+
+            int name_len = mystrlen(name);
+            if (!match_segment(seg, name, name_len)) continue;
+
+            if (need_dir) {
+                int is_dir = (d->d_type == DT_DIR);
+                if (d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+                    struct stat st;
+                    is_dir = fstatat(fd, name, &st, ZERO_VALUE) == ZERO_VALUE && S_ISDIR(st.st_mode);
+                }
+                if (!is_dir) continue;
+            }
+
+            if (last) {
+                int m = append_component(path_len, name, name_len);
+                if (m > ZERO_VALUE) add_result(m);
+                continue;
+            }
+
+            char *copy = (*num_subdirs < GLOB_MAX_SUBDIRS) ? alloc(name_len + TRUE_VALUE) : NULL;
+            if (!copy) {
+                gl.overflow = TRUE_VALUE;
+                break;
+            }
+            mystrcpy(copy, name);
+            subdirs[(*num_subdirs)++] = copy;
+        }
+    }
+
+    close(fd);
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: match_segment
+
+Purpose:
+    Matches a name against a compiled component. Names that are too
+    short or do not end in the pattern's literal tail are rejected
+    first; the rest are matched left to right, going back only to the
+    most recent '*' on a mismatch, so matching is never exponential.
+
+Input:
+    seg      - compiled component
+    name     - directory entry name
+    name_len - its length
+
+Output:
+    Non-zero if the name matches.
+--- */
+static int match_segment(const GlobSegment *seg, const char *name, int name_len)
+{
+    const GlobOp *ops = gl.ops + seg->first_op;
+    int count = seg->op_count;
+
+    if (name_len < seg->min_len) return ZERO_VALUE;
+    for (int k = ZERO_VALUE; k < seg->tail_len; k++) {
+        if ((unsigned char)name[name_len - seg->tail_len + k] != ops[count - seg->tail_len + k].ch)
+            return ZERO_VALUE;
+    }
+
+    int p = ZERO_VALUE, s = ZERO_VALUE;
+    int star_p = ERROR_CODE, star_s = ZERO_VALUE;
+    while (s < name_len) {
+        if (p < count && ops[p].type == GLOB_OP_STAR) {
+            star_p = ++p;
+            star_s = s;
+        } else if (p < count && op_matches(&ops[p], (unsigned char)name[s])) {
+            p++;
+            s++;
+        } else if (star_p != ERROR_CODE) {
+            p = star_p;
+            s = ++star_s;
+        } else {
+            return ZERO_VALUE;
+        }
+    }
+    while (p < count && ops[p].type == GLOB_OP_STAR) p++;
+    return p == count;
+}
+
+/* ---
+Function Name: op_matches
+
+Purpose:
+    Matches one byte against a single-character op.
+
+Input:
+    op - GLOB_OP_CHAR, GLOB_OP_ANY or GLOB_OP_CLASS
+    c  - byte
+
+Output:
+    Non-zero if it matches.
+--- */
+static int op_matches(const GlobOp *op, unsigned char c)
+{
+    switch (op->type) {
+    case GLOB_OP_CHAR:
+        return c == op->ch;
+    case GLOB_OP_ANY:
+        return TRUE_VALUE;
+    case GLOB_OP_CLASS:
+        return ((op->bits[c / BITS_PER_BYTE] >> (c % BITS_PER_BYTE)) & TRUE_VALUE) != op->negate;
+    default:
+        return ZERO_VALUE;
+    }
+}
+
+/* ---
+Function Name: append_component
+
+Purpose:
+    Appends a name to gl.path, with a '/' first unless the path is
+    empty or already ends in one.
+
+Input:
+    path_len - current length of gl.path
+    name     - component
+    len      - length of name
+
+Output:
+    Returns the new length, or -1 if the path would be too long.
+--- */
+static int append_component(int path_len, const char *name, int len)
+{
+    int sep = (path_len > ZERO_VALUE && gl.path[path_len - TRUE_VALUE] != GLOB_SEPARATOR_CHAR);
+    if (path_len + sep + len + TRUE_VALUE + TRUE_VALUE > GLOB_PATH_LEN) return ERROR_CODE;
+
+    if (sep) gl.path[path_len++] = GLOB_SEPARATOR_CHAR;
+    for (int i = ZERO_VALUE; i < len; i++) gl.path[path_len++] = name[i];
+    return path_len;
+}
+
+/* ---
+Function Name: add_result
+
+Purpose:
+    Copies gl.path to the heap as the next match ('/' added if the
+    pattern ended with one).
+
+Input:
+    path_len - length of gl.path
+
+Output:
+    Stores the copy in the next argv slot, or sets gl.overflow.
+--- */
+static void add_result(int path_len)
+{
+    char *copy = (gl.count < gl.limit) ? alloc(path_len + gl.dirs_only + TRUE_VALUE) : NULL;
+    if (!copy) {
+        gl.overflow = TRUE_VALUE;
+        return;
+    }
+    for (int i = ZERO_VALUE; i < path_len; i++) copy[i] = gl.path[i];
+    if (gl.dirs_only) copy[path_len++] = GLOB_SEPARATOR_CHAR;
+    copy[path_len] = NULL_CHAR;
+    gl.results[gl.count++] = copy;
+}
+
+/* ---
+Function Name: compare_results
+
+Purpose:
+    qsort() order for matches: byte order, as in the C locale.
+
+Input:
+    a, b - pointers to result strings
+
+Output:
+    Negative, zero or positive.
+--- */
+static int compare_results(const void *a, const void *b)
+{
+    return mystrcmp(*(char * const *)a, *(char * const *)b);
+}
@@ -0,0 +1,102 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include "jobs.h"
+
+/* PATTERN CHARACTERS */
+#define GLOB_STAR_CHAR          '*'
+#define GLOB_ANY_CHAR           '?'
+#define GLOB_CLASS_OPEN         '['
+#define GLOB_CLASS_CLOSE        ']'
+#define GLOB_CLASS_NEGATE       '!'
+#define GLOB_CLASS_NEGATE_ALT   '^'
+#define GLOB_RANGE_CHAR         '-'
+#define GLOB_SEPARATOR_CHAR     '/'
+#define GLOB_HIDDEN_CHAR        '.'
+#define GLOB_SEPARATOR_TEXT     "/"
+#define GLOB_CURRENT_DIR        "."
+#define GLOB_PARENT_DIR         ".."
+
+/* SIZES */
+#define GLOB_MAX_SEGMENTS       32
+#define GLOB_MAX_OPS            MAX_ARGS
+#define GLOB_MAX_SUBDIRS        MAX_ARGS
+#define GLOB_PATH_LEN           4096
+#define GLOB_DIRENT_BUF_LEN     (1 << 18)
+#define GLOB_CLASS_BYTES        32      /* one bit per byte value */
+#define BITS_PER_BYTE           8
+
+/* RESULTS OF expand_glob */
+#define GLOB_NO_MATCH           0
+#define GLOB_TOO_MANY           -1
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+
+/* ONE STEP OF A COMPILED PATTERN */
+enum GlobOpType {
+    GLOB_OP_CHAR,               /* one literal byte */
+    GLOB_OP_ANY,                /* ? */
+    GLOB_OP_STAR,               /* * */
+    GLOB_OP_CLASS               /* [...] */
+};
+
+typedef struct
+{
+    enum GlobOpType type;
+    unsigned char ch;
+    int negate;
+    unsigned char bits[GLOB_CLASS_BYTES];
+} GlobOp;
+
+/* ONE '/'-SEPARATED COMPONENT OF THE PATTERN
+   Components without pattern characters are used as they are and never
+   read from disk; the others are compiled to ops once per word. */
+typedef struct
+{
+    const char *text;
+    int len;
+    int is_glob;
+    int first_op;
+    int op_count;
+    int min_len;                /* bytes a match needs at least */
+    int tail_len;               /* literal bytes the pattern ends with */
+    int allow_hidden;           /* starts with a literal '.' */
+} GlobSegment;
+
+/* STATE OF ONE EXPANSION */
+typedef struct
+{
+    GlobSegment segments[GLOB_MAX_SEGMENTS];
+    int num_segments;
+    GlobOp ops[GLOB_MAX_OPS];
+    int num_ops;
+    int dirs_only;              /* the word ends with '/' */
+    char path[GLOB_PATH_LEN];   /* path built so far */
+    char **results;             /* next free argv slot */
+    int count;
+    int limit;
+    int overflow;
+} GlobState;
+
+/* FUNCTION DECLARATIONS */
+int has_glob_chars(const char *word);
+int expand_glob(Command *cmd, const char *word);
+int glob_match(const char *pattern, const char *text);
+
+/* STATIC HELPER FUNCTIONS */
+static int compile_pattern(const char *word);
+static int compile_segment(GlobSegment *seg);
+static int compile_class(const char *text, int len, int i, GlobOp *op);
+static void walk_segment(int path_len, int seg_index, int must_check);
+static int read_matches(int path_len, GlobSegment *seg, int last, char **subdirs, int *num_subdirs);
+static int match_segment(const GlobSegment *seg, const char *name, int name_len);
+static int op_matches(const GlobOp *op, unsigned char c);
+static int append_component(int path_len, const char *name, int len);
+static void add_result(int path_len);
+static int compare_results(const void *a, const void *b);
+
+#endif
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE    /* pipe2; cpu_set_t in stagetune.h */
+#include "procsubst.h"
+#include "subst.h"
+#include "getjob.h"
+#include "runjob.h"
+#include "builtin.h"
+#include "stagetune.h"
+#include "errors.h"
+#include "myheap.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* fork, pipe2, dup2, close */
+#include <fcntl.h>        /* O_CLOEXEC */
+#include <signal.h>       /* sigprocmask */
+
+/* ---
+Function Name: has_process_substitution
+
+Purpose:
+    Checks whether a word contains <(...) or >(...).
+
+Input:
+    word - null-terminated word
+
+Output:
+    Non-zero if it does.
+--- */
+int has_process_substitution(const char *word)
+{
+    for (int i = ZERO_VALUE; word[i] != NULL_CHAR; i++) {
+        if ((word[i] == PROC_INPUT_CHAR || word[i] == PROC_OUTPUT_CHAR) &&
+            word[i + TRUE_VALUE] == PROC_OPEN_CHAR)
+            return TRUE_VALUE;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: expand_process_substitutions
+
+Purpose:
+    Starts the commands of every <(...) and >(...) in a job's arguments
+    and '<' / '>' files, each in the background with a pipe in place of
+    its stdout (<) or stdin (>), and replaces the text with /dev/fd/N
+    for the other end of the pipe. No temporary files are written.
+    The pipe ends stay in the shell, close-on-exec, in job->pass_fds:
+    the stage that names one keeps it across its exec, and spawn_job()
+    closes the shell's copies. A '<' / '>' file is opened before exec,
+    so those ends are never passed on.
+
+Input:
+    job  - parsed job
+    envp - environment variables
+
+Output:
+    Updates the job; returns 0 (after reporting it) if a command could
+    not be started.
+--- */
+int expand_process_substitutions(Job *job, char *envp[])
+{
+    for (int s = ZERO_VALUE; s < (int)job->num_stages; s++) {
+        Command *cmd = &job->pipeline[s];
+        for (int i = ZERO_VALUE; i < (int)cmd->argc; i++) {
+            if (!has_process_substitution(cmd->argv[i])) continue;
+            cmd->argv[i] = substitute_processes(job, s, cmd->argv[i], envp);
+            if (!cmd->argv[i]) return ZERO_VALUE;
+        }
+    }
+
+    if (job->infile_path && has_process_substitution(job->infile_path)) {
+        job->infile_path = substitute_processes(job, NO_STAGE, job->infile_path, envp);
+        if (!job->infile_path) return ZERO_VALUE;
+    }
+    if (job->outfile_path && has_process_substitution(job->outfile_path)) {
+        job->outfile_path = substitute_processes(job, NO_STAGE, job->outfile_path, envp);
+        if (!job->outfile_path) return ZERO_VALUE;
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: substitute_processes
+
+Purpose:
+    Replaces each <(...) / >(...) of one word with /dev/fd/N.
+
+Input:
+    job   - job the word belongs to
+    stage - stage whose exec must keep the pipe end, or NO_STAGE
+    word  - word to expand
+    envp  - environment variables
+
+Output:
+    Returns the new word on the heap, or NULL on failure.
+--- */
+static char *substitute_processes(Job *job, int stage, char *word, char *envp[])
+{
+    char result[PROC_WORD_LEN];
+    int len = ZERO_VALUE;
+
+    for (int i = ZERO_VALUE; word[i] != NULL_CHAR;) {
+        if ((word[i] != PROC_INPUT_CHAR && word[i] != PROC_OUTPUT_CHAR) ||
+            word[i + TRUE_VALUE] != PROC_OPEN_CHAR) {
+            if (len == PROC_WORD_LEN - TRUE_VALUE) return NULL;
+            result[len++] = word[i++];
+            continue;
+        }
+
+        int end = substitution_end(word, i);
+        int closed = (word[end - TRUE_VALUE] == PROC_CLOSE_CHAR && end > i + PROC_PREFIX_LEN);
+        int fd = start_process(job, stage, word + i + PROC_PREFIX_LEN, end - i - PROC_PREFIX_LEN - closed,
+                               word[i] == PROC_OUTPUT_CHAR, envp);
+        if (fd < ZERO_VALUE) return NULL;
+
+        char fd_text[PROC_FD_TEXT_LEN];
+        myitoa(fd, fd_text);
+        if (len + mystrlen(DEV_FD_PREFIX) + mystrlen(fd_text) >= PROC_WORD_LEN) return NULL;
+        mystrcpy(result + len, DEV_FD_PREFIX);
+        len += mystrlen(DEV_FD_PREFIX);
+        mystrcpy(result + len, fd_text);
+        len += mystrlen(fd_text);
+        i = end;
+    }
+    result[len] = NULL_CHAR;
+
+    char *copy = alloc(len + TRUE_VALUE);
+    return copy ? mystrcpy(copy, result) : NULL;
+}
+
+/* ---
+Function Name: start_process
+
+Purpose:
+    Parses the command of one substitution and starts it in the
+    background, in its own process group, connected to a new pipe. Its
+    exit is collected by the SIGCHLD handler like any other child.
+
+Input:
+    job          - job that receives the shell's end of the pipe
+    stage        - stage that keeps the end across exec, or NO_STAGE
+    text, len    - command text
+    writes_to_it - non-zero for >(...): the job writes, the command reads
+    envp         - environment variables
+
+Output:
+    Returns the shell's end of the pipe, or -1 after reporting an error.
+--- */
+static int start_process(Job *job, int stage, const char *text, int len, int writes_to_it, char *envp[])
+{
+    if (job->num_pass_fds == MAX_PASS_FDS) {
+        print_error(ERR_ARG_EXCD);
+        return ERROR_CODE;
+    }
+
+    char *line = alloc(len + TRUE_VALUE);
+    if (!line) return ERROR_CODE;
+    for (int i = ZERO_VALUE; i < len; i++) line[i] = text[i];
+    line[len] = NULL_CHAR;
+
+    Job inner;
+    parse_job_line(&inner, line);
+    if (inner.num_stages == ZERO_VALUE || !expand_process_substitutions(&inner, envp)) {
+        print_error(ERR_INVALID_INPUT);
+        return ERROR_CODE;
+    }
+    for (int s = ZERO_VALUE; s < (int)inner.num_stages; s++) {
+        if (!expand_variables(&inner.pipeline[s], envp) || inner.pipeline[s].argc == ZERO_VALUE) {
+            close_pass_fds(&inner);
+            return ERROR_CODE;
+        }
+    }
+
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < ZERO_VALUE) {
+        print_error(ERR_PIPE_FAIL);
+        close_pass_fds(&inner);
+        return ERROR_CODE;
+    }
+    int keep = writes_to_it ? p[TRUE_VALUE] : p[ZERO_VALUE];
+    int give = writes_to_it ? p[ZERO_VALUE] : p[TRUE_VALUE];
+
+    inner.background = TRUE_VALUE;
+    if (writes_to_it) inner.in_fd = give;
+    else inner.out_fd = give;
+
+    int started;
+    char **argv = inner.pipeline[ZERO_VALUE].argv;
+    int builtin = find_builtin(argv[ZERO_VALUE]);
+    if (builtin != NOT_BUILTIN && inner.num_stages == TRUE_VALUE && !is_tuning_prefix(argv)) {
+        started = start_builtin_process(&inner, builtin, envp);
+    } else {
+        sigset_t child_mask;
+        sigprocmask(SIG_SETMASK, NULL, &child_mask);
+        sigdelset(&child_mask, SIGCHLD);
+        started = spawn_job(&inner, envp, &child_mask);
+    }
+    close(give);
+    close_pass_fds(&inner);
+
+    if (!started) {
+        close(keep);
+        return ERROR_CODE;
+    }
+
+    job->pass_fds[job->num_pass_fds].fd = keep;
+    job->pass_fds[job->num_pass_fds].stage = stage;
+    job->num_pass_fds++;
+    return keep;
+}
+
+/* ---
+Function Name: start_builtin_process
+
+Purpose:
+    Runs a builtin named in a substitution in a forked copy of the
+    shell, since it has to run alongside the job.
+
+Input:
+    inner   - parsed single-stage job with in_fd or out_fd set
+    builtin - builtin table index
+    envp    - environment variables
+
+Output:
+    Returns 1 if the child was started.
+--- */
+static int start_builtin_process(Job *inner, int builtin, char *envp[])
+{
+    int pid = fork();
+    if (pid < ZERO_VALUE) {
+        print_error(ERR_FORK_FAIL);
+        return ZERO_VALUE;
+    }
+    if (pid == ZERO_VALUE) {
+        setpgid(ZERO_VALUE, ZERO_VALUE);
+        if (inner->in_fd != NO_FD) dup2(inner->in_fd, STDIN_FILENO);
+        if (inner->out_fd != NO_FD) dup2(inner->out_fd, STDOUT_FILENO);
+        _exit(run_builtin(builtin, inner->pipeline[ZERO_VALUE].argv, envp));
+    }
+    return TRUE_VALUE;
+}
@@ -0,0 +1,33 @@
+#ifndef PROCSUBST_H
+#define PROCSUBST_H
+
+#include "jobs.h"
+
+/* SYNTAX */
+#define PROC_INPUT_CHAR         '<'     /* <(cmd): read its output */
+#define PROC_OUTPUT_CHAR        '>'     /* >(cmd): write its input */
+#define PROC_OPEN_CHAR          '('
+#define PROC_CLOSE_CHAR         ')'
+#define PROC_PREFIX_LEN         2
+#define DEV_FD_PREFIX           "/dev/fd/"
+
+/* SIZES */
+#define PROC_WORD_LEN           (MAX_ARGS * 2)
+#define PROC_FD_TEXT_LEN        16
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+
+/* FUNCTION DECLARATIONS */
+int has_process_substitution(const char *word);
+int expand_process_substitutions(Job *job, char *envp[]);
+
+/* STATIC HELPER FUNCTIONS */
+static char *substitute_processes(Job *job, int stage, char *word, char *envp[]);
+static int start_process(Job *job, int stage, const char *text, int len, int writes_to_it, char *envp[]);
+static int start_builtin_process(Job *inner, int builtin, char *envp[]);
+
+#endif
@@ -1,15 +1,29 @@
+#define _GNU_SOURCE    /* pipe2, F_SETPIPE_SZ, cpu_set_t */
 #include "runjob.h"
 #include "mystring.h"
 #include "myheap.h"
 #include "errors.h"
 #include "signal.h"
-
-#include <unistd.h>    /* fork, pipe, dup2, execve, read, write, _exit */
-#include <sys/wait.h>  /* waitpid */
+#include "trace.h"
+#include "pathcache.h"
+#include "jobtable.h"
+#include "jobcgroup.h"
+#include "stagetune.h"
+#include "fanout.h"
+
+#include <unistd.h>    /* vfork, pipe2, dup2, execve, read, write, _exit */
+#include <sys/wait.h>  /* waitpid, wait4 */
+#include <sys/resource.h> /* struct rusage */
 #include <sys/stat.h>  /* stat */
-#include <fcntl.h>     /* open, creat */
+#include <fcntl.h>     /* open, creat, fcntl, O_CLOEXEC */
 #include <errno.h>
 
+/* Exit status bookkeeping: PIPESTATUS, $? and 'set -o pipefail' */
+int pipe_status[MAX_PIPELINE_LEN];
+int num_pipe_status = ZERO_VALUE;
+int pipefail_enabled = ZERO_VALUE;
+int last_exit_status = ZERO_VALUE;
+
 /* ---
 Function Name: run_job
 
@@ -22,56 +36,167 @@ Input:
     
 Output:
     Executes all stages of the job. Waits for foreground jobs; prints info for background jobs.
+    Returns the job's exit status (0 for a job sent to the background),
+    which is also stored in last_exit_status.
 --- */
-void run_job(Job *job, char *envp[])
+int run_job(Job *job, char *envp[])
 {
-    if (!job || job->num_stages == ZERO_VALUE) return;
+    if (!job || job->num_stages == ZERO_VALUE) return last_exit_status;
 
-    int pipefd[MAX_PIPELINE_LEN - 1][2];
-    int pids[MAX_PIPELINE_LEN];
+    int *pids = job->pids;
 
-    create_pipes(pipefd, job->num_stages);
+    /* Keep the SIGCHLD handler from reaping this job's stages before
+       handle_foreground_job() collects their statuses */
+    sigset_t chld_mask, prev_mask, child_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
 
-    if (!execute_all_stages(job, envp, pipefd, pids)) {
+    /* the caller may already block SIGCHLD (the scheduler does);
+       stages must never inherit that */
+    child_mask = prev_mask;
+    sigdelset(&child_mask, SIGCHLD);
+
+    if (!spawn_job(job, envp, &child_mask)) {
+        sigprocmask(SIG_SETMASK, &prev_mask, NULL);
         free_all();
-        return;
+        set_exit_status(EXIT_FAILURE_CODE);
+        return last_exit_status;
     }
 
-    close_all_pipes(pipefd, job->num_stages);
-
     if (job->background) {
         handle_background_job(job, pids[ZERO_VALUE]);
+        set_exit_status(EXIT_SUCCESS_CODE);
     } else {
-        handle_foreground_job(job, pids);
+        last_exit_status = handle_foreground_job(job, pids);
     }
 
+    /* a background job's record is parked before its stages can be reaped */
+    trace_job_end(job);
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
     free_all();
+    return last_exit_status;
 }
 
 
 
 /* ---
-Function Name: add_job
+Function Name: spawn_job
+
+Purpose:
+    Starts every stage of a job without waiting for it: creates the
+    pipes, places the job in its own cgroup if it has resource limits
+    (see cgroup_setup), spawns the stages and closes the shell's copies
+    of the pipe ends (and of the job's process substitution pipes).
+    Stage PIDs are stored in job->pids. Used by run_job() and by
+    builtins that manage their own children (parallel). The caller
+    should block SIGCHLD until it has recorded the PIDs.
+
+Input:
+    job - pointer to Job structure
+    envp - environment variables
+    child_mask - signal mask the stages should exec with
+
+Output:
+    Returns 1 if all stages were started, 0 otherwise.
+--- */
+int spawn_job(Job *job, char *envp[], sigset_t *child_mask)
+{
+    int pipefd[MAX_PIPELINE_LEN - 1][2];
+
+    if (!cgroup_setup(job, envp)) return ZERO_VALUE;
+
+    trace_job_begin(job);
+    if (!create_pipes(pipefd, job->num_stages, pipe_size_from_env(envp))) {
+        cgroup_release(&job->cgroup);
+        close_pass_fds(job);
+        return ZERO_VALUE;
+    }
+
+    long long launch_start = trace_now();
+    int ok = execute_all_stages(job, envp, pipefd, job->pids, child_mask);
+    if (ok) trace_job_launched(trace_now() - launch_start);
+
+    cgroup_spawned(&job->cgroup);
+    close_all_pipes(pipefd, job->num_stages);
+    close_pass_fds(job);
+    if (!ok) cgroup_release(&job->cgroup);
+    return ok;
+}
+
+/* ---
+Function Name: exec_job
 
 Purpose:
-  Adds a background job to the global jobs table for later reference by builtins
-  such as 'jobs', 'fg', and 'bg'.
+    Runs a one-stage foreground job in place of the shell: its
+    redirections are made and its program exec'd in this process, with
+    no fork and no wait. Used for the last command of 'mysh -c', after
+    which the shell would only wait and pass the status on, so the
+    program's own exit status becomes the shell's.
 
 Input:
-  job  - pointer to Job structure representing the launched job
-  pid  - process ID of the first process in the job pipeline
+    job  - pointer to Job structure: one stage, no prefixes, no
+           process substitutions, in_fd and out_fd NO_FD
+    envp - environment variables
 
 Output:
-  None. Updates global jobs[] and num_jobs.
+    Does not return once the program is found and the redirection files
+    are open. Otherwise returns 0 having changed nothing, so that
+    run_job() can run (and report) it as usual.
 --- */
-void add_job(Job *job, int pid)
+int exec_job(Job *job, char *envp[])
 {
-    if (num_jobs >= MAX_JOBS)
-        return;
+    char **argv = job->pipeline[ZERO_VALUE].argv;
+    char *path = lookup_command_path(argv[ZERO_VALUE], envp);
+    if (!path) return ZERO_VALUE;
+
+    int in_fd = NO_FD;
+    int out_fd = NO_FD;
+    if (job->infile_path && (in_fd = open(job->infile_path, O_RDONLY)) < ZERO_VALUE) return ZERO_VALUE;
+    if (job->outfile_path && (out_fd = creat(job->outfile_path, FILE_PERMISSIONS)) < ZERO_VALUE) {
+        if (in_fd != NO_FD) close(in_fd);
+        return ZERO_VALUE;
+    }
+
+    if (in_fd != NO_FD && in_fd != STDIN_FILENO) {
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
+    }
+    if (out_fd != NO_FD && out_fd != STDOUT_FILENO) {
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+    }
+
+    /* the program gets the signal setup a spawned stage would */
+    sigset_t child_mask;
+    sigprocmask(SIG_SETMASK, NULL, &child_mask);
+    sigdelset(&child_mask, SIGCHLD);
+    reset_child_signals(&child_mask);
+
+    execve(path, argv, envp);
+    write(STDERR_FILENO, error_messages[ERR_EXEC_FAIL], mystrlen(error_messages[ERR_EXEC_FAIL]));
+    _exit(EXIT_CANNOT_EXEC_CODE);
+}
+
+/* ---
+Function Name: close_pass_fds
 
-    jobs[num_jobs] = *job;         /* copy job info */
-    jobs[num_jobs].pgid = pid;     /* store process group ID */
-    num_jobs++;
+Purpose:
+    Closes the shell's copies of a job's process substitution pipes
+    (see procsubst.c) once its stages have them, or when the job does
+    not run as a process at all (a builtin, a queued job).
+
+Input:
+    job - pointer to Job structure
+
+Output:
+    Closes the descriptors and empties job->pass_fds.
+--- */
+void close_pass_fds(Job *job)
+{
+    for (int i = ZERO_VALUE; i < job->num_pass_fds; i++)
+        close(job->pass_fds[i].fd);
+    job->num_pass_fds = ZERO_VALUE;
 }
 
 /* ---
@@ -206,20 +331,124 @@ Function Name: create_pipes
 
 Purpose:
     Creates pipes for inter-process communication between pipeline stages.
+    Pipes are created close-on-exec, so every stage drops the pipe ends it
+    does not use at execve() without closing them one by one; dup2() onto
+    stdin/stdout clears the flag for the ends a stage keeps.
     
 Input:
     pipefd - 2D array to hold file descriptors
     num_stages - number of stages in pipeline
+    pipe_size - requested pipe buffer size in bytes, 0 for the kernel default
     
 Output:
-    Initializes pipefd. Prints error if pipe creation fails.
+    Returns 1 with pipefd initialized, or 0 (with an error printed and
+    no pipe left open) if a pipe cannot be created.
 --- */
-static void create_pipes(int pipefd[MAX_PIPELINE_LEN - 1][2], int num_stages)
+static int create_pipes(int pipefd[MAX_PIPELINE_LEN - 1][2], int num_stages, int pipe_size)
 {
     for (int i = ZERO_VALUE; i < num_stages - TRUE_VALUE; i++) {
-        if (pipe(pipefd[i]) < ZERO_VALUE)
+        if (pipe2(pipefd[i], O_CLOEXEC) < ZERO_VALUE) {
             print_error(ERR_PIPE_FAIL);
+            close_all_pipes(pipefd, i + TRUE_VALUE);
+            return ZERO_VALUE;
+        }
+        /* best effort: the kernel caps unprivileged sizes at pipe-max-size */
+        if (pipe_size > ZERO_VALUE)
+            fcntl(pipefd[i][TRUE_VALUE], F_SETPIPE_SZ, pipe_size);
+    }
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: pipe_size_from_env
+
+Purpose:
+    Reads the MYSH_PIPE_SIZE tunable. Accepts a byte count with an
+    optional K or M suffix (e.g. 1M). Larger sizes than 256M are
+    clamped to it.
+    
+Input:
+    envp - environment variables
+    
+Output:
+    Requested pipe buffer size in bytes, or 0 if unset or invalid.
+--- */
+static int pipe_size_from_env(char *envp[])
+{
+    char *value = mygetenv(PIPE_SIZE_ENV_NAME, envp);
+    if (!value) return ZERO_VALUE;
+
+    /* digits past MAX_PIPE_SIZE are read but no longer accumulated, so
+       neither this nor the suffix below can overflow a long long */
+    long long size = ZERO_VALUE;
+    int i = ZERO_VALUE;
+    for (; value[i] >= ZERO_CHAR && value[i] <= NINE_CHAR; i++) {
+        if (size <= MAX_PIPE_SIZE) size = size * DECIMAL_BASE + (value[i] - ZERO_CHAR);
+    }
+
+    if (value[i] == KILO_SUFFIX || value[i] == KILO_SUFFIX_LOWER) {
+        size *= KILOBYTE;
+        i++;
+    } else if (value[i] == MEGA_SUFFIX || value[i] == MEGA_SUFFIX_LOWER) {
+        size *= MEGABYTE;
+        i++;
+    }
+
+    if (value[i] != NULL_CHAR) return ZERO_VALUE;
+    return size > MAX_PIPE_SIZE ? MAX_PIPE_SIZE : (int)size;
+}
+
+/* ---
+Function Name: prepare_stages
+
+Purpose:
+    Builds the launch plan for every stage before any process is created:
+    parses nice/affinity/ulimit prefixes, resolves each command through
+    the PATH cache and records which pipe ends become the stage's stdin
+    and stdout. Doing this up front keeps the spawn loop free of lookups
+    so all stages start back to back.
+    
+Input:
+    job - pointer to Job structure
+    envp - environment variables
+    pipefd - 2D array of pipe file descriptors
+    plan - output array of StagePlan, one per stage
+    tuning - output array of per-stage settings, one per stage
+    
+Output:
+    Returns 1 on success, 0 if a stage has no command or a malformed
+    prefix.
+--- */
+static int prepare_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN - 1][2],
+                          StagePlan *plan, StageTuning *tuning)
+{
+    /* a foreground job takes the terminal if the shell currently owns it */
+    int owns_terminal = !job->background && isatty(STDIN_FILENO) &&
+                        tcgetpgrp(STDIN_FILENO) == getpgrp();
+
+    for (int i = ZERO_VALUE; i < job->num_stages; i++) {
+        if (!job->pipeline[i].argv[ZERO_VALUE]) return ZERO_VALUE;
+
+        /* strip nice/affinity/ulimit prefixes before resolving the command */
+        plan[i].tuning = &tuning[i];
+        if (!parse_stage_tuning(&job->pipeline[i], &tuning[i])) {
+            print_error(ERR_PREFIX_USAGE);
+            return ZERO_VALUE;
+        }
+
+        long long resolve_start = trace_now();
+        plan[i].path = lookup_command_path(job->pipeline[i].argv[ZERO_VALUE], envp);
+        trace_stage_resolved(i, trace_now() - resolve_start);
+
+        /* explicit '<' / '>' files take precedence over job->in_fd/out_fd */
+        plan[i].in_fd = (i > ZERO_VALUE) ? pipefd[i - TRUE_VALUE][ZERO_VALUE]
+                      : (job->infile_path ? NO_FD : job->in_fd);
+        plan[i].out_fd = (i < job->num_stages - TRUE_VALUE) ? pipefd[i][TRUE_VALUE]
+                       : (job->outfile_path ? NO_FD : job->out_fd);
+        plan[i].take_terminal = (i == ZERO_VALUE) && owns_terminal;
+        plan[i].fanout = is_fanout_stage(job->pipeline[i].argv);
     }
+    return TRUE_VALUE;
 }
 
 /* ---
@@ -232,13 +461,12 @@ Input:
     stage_index - index of the current stage
     num_stages - total number of stages
     job - pointer to Job structure
-    pipefd - 2D array of pipe file descriptors
+    plan - launch plan of the current stage, with its pipe ends
     
 Output:
     Sets up file descriptors appropriately for input/output.
 --- */
-static void setup_redirection(int stage_index, int num_stages, Job *job,
-                              int pipefd[MAX_PIPELINE_LEN - 1][2])
+static void setup_redirection(int stage_index, int num_stages, Job *job, StagePlan *plan)
 {
     if (stage_index == ZERO_VALUE && job->infile_path) {
         int fd = open(job->infile_path, O_RDONLY);
@@ -254,65 +482,111 @@ static void setup_redirection(int stage_index, int num_stages, Job *job,
         close(fd);
     }
 
-    if (stage_index > ZERO_VALUE)
-        dup2(pipefd[stage_index - TRUE_VALUE][ZERO_VALUE], STDIN_FILENO);
-    if (stage_index < num_stages - TRUE_VALUE)
-        dup2(pipefd[stage_index][TRUE_VALUE], STDOUT_FILENO);
+    /* every pipe end is close-on-exec, so unused ends need no closing */
+    if (plan->in_fd != NO_FD)
+        dup2(plan->in_fd, STDIN_FILENO);
+    if (plan->out_fd != NO_FD)
+        dup2(plan->out_fd, STDOUT_FILENO);
+}
 
-    for (int i = ZERO_VALUE; i < num_stages - TRUE_VALUE; i++) {
-        if (i != stage_index - TRUE_VALUE) close(pipefd[i][ZERO_VALUE]);
-        if (i != stage_index) close(pipefd[i][TRUE_VALUE]);
-    }
+/* ---
+Function Name: reset_child_signals
+
+Purpose:
+    Restores default signal behaviour in a freshly spawned stage before it
+    execs. Runs while every signal is still blocked (see execute_all_stages)
+    so none of the shell's handlers can run inside the child.
+    
+Input:
+    child_mask - signal mask to install before exec
+    
+Output:
+    Resets SIGINT, SIGTSTP and SIGCHLD to their defaults and unblocks signals.
+--- */
+static void reset_child_signals(sigset_t *child_mask)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_SETMASK, child_mask, NULL);
 }
 
 /* ---
 Function Name: fork_and_execute_stage
 
 Purpose:
-    Forks and executes a command stage in the pipeline.
+    Spawns one prepared pipeline stage. vfork() is used so the child
+    borrows the shell's address space instead of copying its page tables;
+    the parent resumes as soon as the child has exec'd, which makes the
+    return of this function the moment the stage has started. The child
+    therefore only makes system calls and never touches shell memory.
+    A 'tee' stage may run in the child without exec'ing anything (see
+    run_fanout_stage()), so it is forked instead.
     
 Input:
     stage_index - index of current stage
     job - pointer to Job structure
     envp - environment variables
-    pipefd - 2D array of pipe file descriptors
+    plan - launch plan of this stage, with its pipe ends
+    child_mask - signal mask the child should exec with
     
 Output:
     Executes the command in a child and returns its PID.
 --- */
 static int fork_and_execute_stage(int stage_index, Job *job, char *envp[],
-                                  int pipefd[MAX_PIPELINE_LEN - 1][2])
+                                  StagePlan *plan, sigset_t *child_mask)
 {
-    if (!job->pipeline[stage_index].argv[ZERO_VALUE]) return ERROR_CODE;
+    char **argv = job->pipeline[stage_index].argv;
 
-    int pid = fork();
+    long long spawn_start = trace_now();
+    int pid = plan->fanout ? fork() : vfork();
     if (pid < ZERO_VALUE) {
         print_error(ERR_FORK_FAIL);
         return ERROR_CODE;
     }
 
     if (pid == ZERO_VALUE) {
-        setpgid(ZERO_VALUE, ZERO_VALUE);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
+        /* every stage joins the first stage's group (pgid 0 = own pid);
+           signals are still blocked, so tcsetpgrp raises no SIGTTOU */
+        setpgid(ZERO_VALUE, job->pgid);
+        cgroup_join(&job->cgroup);
+        if (plan->take_terminal)
+            tcsetpgrp(STDIN_FILENO, getpid());
+        reset_child_signals(child_mask);
+
+        setup_redirection(stage_index, job->num_stages, job, plan);
+
+        /* /dev/fd/N arguments of this stage must survive the exec */
+        for (int i = ZERO_VALUE; i < job->num_pass_fds; i++) {
+            if (job->pass_fds[i].stage == stage_index)
+                fcntl(job->pass_fds[i].fd, F_SETFD, ZERO_VALUE);
+        }
 
-        setup_redirection(stage_index, job->num_stages, job, pipefd);
+        if (!apply_stage_tuning(plan->tuning)) {
+            write(STDERR_FILENO, error_messages[ERR_TUNING_FAIL],
+                  mystrlen(error_messages[ERR_TUNING_FAIL]));
+            _exit(EXIT_FAILURE_CODE);
+        }
+
+        /* returns only if stdin is not a pipe: then tee is exec'd */
+        if (plan->fanout) run_fanout_stage(argv);
 
-        char *fullpath = resolve_command_path(job->pipeline[stage_index].argv[ZERO_VALUE], envp);
-        if (!fullpath) {
-            write(STDERR_FILENO, job->pipeline[stage_index].argv[ZERO_VALUE],
-                  mystrlen(job->pipeline[stage_index].argv[ZERO_VALUE]));
+        if (!plan->path) {
+            write(STDERR_FILENO, argv[ZERO_VALUE], mystrlen(argv[ZERO_VALUE]));
             write(STDERR_FILENO, error_messages[ERR_CMD_NOT_FOUND],
                   mystrlen(error_messages[ERR_CMD_NOT_FOUND]));
-            _exit(EXIT_FAILURE_CODE);
+            _exit(EXIT_NOT_FOUND_CODE);
         }
 
-        execve(fullpath, job->pipeline[stage_index].argv, envp);
+        execve(plan->path, argv, envp);
         write(STDERR_FILENO, error_messages[ERR_EXEC_FAIL],
               mystrlen(error_messages[ERR_EXEC_FAIL]));
-        _exit(EXIT_FAILURE_CODE);
+        _exit(EXIT_CANNOT_EXEC_CODE);
     }
 
+    /* set the group from the parent as well, whichever runs first */
+    setpgid(pid, job->pgid ? job->pgid : pid);
+    trace_stage_spawned(stage_index, pid, trace_now() - spawn_start);
     return pid;
 }
 
@@ -394,14 +668,14 @@ Purpose:
 Input:
     job - pointer to Job structure
     pid - process ID of first command in pipeline
+    job_no - job number
     
 Output:
     Prints message like "[1] 1234 sleep" to STDOUT.
 --- */
-static void print_background_pid(Job *job, int pid)
+static void print_background_pid(Job *job, int pid, int job_no)
 {
     char msg[MAX_MSG_LEN];
-    int job_no = num_jobs + INDEX_OFFSET;
     construct_background_msg(msg, job, pid, job_no);
     write(STDOUT_FILENO, msg, mystrlen(msg));
 }
@@ -410,24 +684,83 @@ static void print_background_pid(Job *job, int pid)
 Function Name: execute_all_stages
 
 Purpose:
-    Forks and executes all stages of the job pipeline.
+    Prepares every stage, then spawns them back to back. Signals are
+    blocked for the whole spawn loop so vfork children cannot run the
+    shell's handlers. The time from the first spawn until the last stage
+    has started is reported to the trace. If a stage cannot be spawned,
+    the stages already started are killed and reaped, so a failed job
+    leaves no process behind.
 
 Input:
     job - pointer to Job structure
     envp - environment variables
     pipefd - array of pipe file descriptors
+    pids - output array of stage process IDs
+    child_mask - signal mask the stages should exec with
 
 Output:
     Returns 1 on success, 0 on failure. Populates pids array.
 --- */
-static int execute_all_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN - 1][2], int *pids)
+static int execute_all_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN - 1][2], int *pids,
+                              sigset_t *child_mask)
 {
+    StagePlan plan[MAX_PIPELINE_LEN];
+    StageTuning tuning[MAX_PIPELINE_LEN];
+
+    long long prepare_start = trace_now();
+    if (!prepare_stages(job, envp, pipefd, plan, tuning))
+        return ZERO_VALUE;
+    trace_job_prepared(trace_now() - prepare_start);
+
+    sigset_t all_signals, old_mask;
+    sigfillset(&all_signals);
+    sigprocmask(SIG_BLOCK, &all_signals, &old_mask);
+
+    long long spawn_start = trace_now();
+    int ok = TRUE_VALUE;
+    job->pgid = ZERO_VALUE;
     for (int i = ZERO_VALUE; i < job->num_stages; i++) {
-        pids[i] = fork_and_execute_stage(i, job, envp, pipefd);
-        if (pids[i] < ZERO_VALUE)
-            return ZERO_VALUE;
+        pids[i] = fork_and_execute_stage(i, job, envp, &plan[i], child_mask);
+        if (pids[i] < ZERO_VALUE) {
+            ok = ZERO_VALUE;
+            kill_started_stages(job, i, plan[ZERO_VALUE].take_terminal);
+            break;
+        }
+        if (i == ZERO_VALUE) job->pgid = pids[i];
     }
-    return TRUE_VALUE;
+    trace_job_started(trace_now() - spawn_start);
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return ok;
+}
+
+/* ---
+Function Name: kill_started_stages
+
+Purpose:
+    Undoes a partly spawned job: the stages already started (all in the
+    job's process group) are killed and reaped before the shell gets
+    the terminal back. Called with every signal blocked, so the SIGCHLD
+    handler cannot reap them first.
+
+Input:
+    job           - pointer to Job structure
+    num_started   - stages started, whose PIDs are in job->pids
+    took_terminal - non-zero if the first stage was given the terminal
+
+Output:
+    None
+--- */
+static void kill_started_stages(Job *job, int num_started, int took_terminal)
+{
+    if (num_started == ZERO_VALUE) return;
+
+    kill(-job->pgid, SIGKILL);
+    for (int i = ZERO_VALUE; i < num_started; i++) {
+        while (waitpid(job->pids[i], NULL, ZERO_VALUE) < ZERO_VALUE && errno == EINTR)
+            continue;
+    }
+    if (took_terminal) tcsetpgrp(STDIN_FILENO, getpgrp());
 }
 
 /* ---
@@ -455,7 +788,8 @@ static void close_all_pipes(int pipefd[MAX_PIPELINE_LEN - 1][2], int num_stages)
 Function Name: handle_background_job
 
 Purpose:
-    Handles background job behavior by printing PID and adding it to the job list.
+    Handles background job behavior by adding it to the job list and
+    printing its number and PID.
 
 Input:
     job - pointer to Job structure
@@ -466,8 +800,8 @@ Output:
 --- */
 static void handle_background_job(Job *job, int pid)
 {
-    print_background_pid(job, pid);
-    add_job(job, pid);
+    JobEntry *entry = add_job(job);
+    print_background_pid(job, pid, entry ? entry->id : NO_JOB_ID);
 }
 
 /* ---
@@ -475,6 +809,7 @@ Function Name: handle_foreground_job
 
 Purpose:
     Handles foreground job execution, signal management, and waiting.
+    Every stage's exit code is recorded in pipe_status (PIPESTATUS).
 
 Input:
     job - pointer to Job structure
@@ -482,11 +817,15 @@ Input:
 
 Output:
     Waits for job completion or suspension. Restores shell control.
+    Returns the job's exit status.
 --- */
-static void handle_foreground_job(Job *job, int *pids)
+static int handle_foreground_job(Job *job, int *pids)
 {
     int status;
-    int fg_job_status;
+    int stopped_status = ZERO_VALUE;
+    int pipe_status_raw[MAX_PIPELINE_LEN];
+    struct rusage usage;
+    long long wait_start = trace_now();
 
     /* Allow the foreground job to receive Ctrl+Z and Ctrl+C */
     signal(SIGTSTP, SIG_DFL);
@@ -494,36 +833,50 @@ static void handle_foreground_job(Job *job, int *pids)
 
     /* Give the terminal to the job's process group */
     signal(SIGTTOU, SIG_IGN);
-    tcsetpgrp(STDIN_FILENO, pids[ZERO_VALUE]);
+    tcsetpgrp(STDIN_FILENO, job->pgid);
 
+    num_pipe_status = job->num_stages;
+    for (int i = ZERO_VALUE; i < job->num_stages; i++)
+        pipe_status[i] = EXIT_SUCCESS_CODE;
+
+    /* Every stage is in the job's group, so Ctrl+C and Ctrl+Z reach
+       all of them; wait until each one has exited or stopped */
     for (int i = ZERO_VALUE; i < job->num_stages; i++) {
-        while (waitpid(pids[i], &status, WUNTRACED) == -1 && errno == EINTR)
+        int reaped;
+        while ((reaped = wait4(pids[i], &status, WUNTRACED, &usage)) == -1 && errno == EINTR)
+            continue;
+        if (reaped != pids[i]) {
+            pipe_status_raw[i] = ZERO_VALUE;
             continue;
+        }
 
-        if (WIFEXITED(status)) {
-            fg_job_status = WEXITSTATUS(status);
-        } else if (WIFSIGNALED(status)) {
-            fg_job_status = EXIT_FAILURE_CODE;
-            if (WTERMSIG(status) == SIGINT)
-                break;
-        } else if (WIFSTOPPED(status)) {
-            /* Handle Ctrl+Z stopping the foreground job */
-            add_job(job, pids[i]);
-            jobs[num_jobs - 1].background = 0;
-
-            write(STDOUT_FILENO, MSG_FG_PREFIX, 1);
-            char buf[MSG_BUFFER];
-            myitoa(num_jobs, buf);
-            write(STDOUT_FILENO, buf, mystrlen(buf));
-            write(STDOUT_FILENO, MSG_FG_SUFFIX, 10);
-            write(STDOUT_FILENO, job->pipeline[0].argv[0],
-                  mystrlen(job->pipeline[0].argv[0]));
-            write(STDOUT_FILENO, NEWLINE_STR, 1);
-            fsync(STDOUT_FILENO);
-            break;
+        pipe_status_raw[i] = status;
+        if (WIFSTOPPED(status)) {
+            stopped_status = wait_status_to_exit_code(status);
+            continue;
+        }
+        trace_stage_reaped(i, status, &usage);
+        pipe_status[i] = wait_status_to_exit_code(status);
+    }
+
+    if (stopped_status) {
+        /* Ctrl+Z: keep the whole pipeline as a stopped job */
+        JobEntry *entry = add_job(job);
+        if (entry) {
+            for (int i = ZERO_VALUE; i < job->num_stages; i++)
+                set_job_proc_status(entry, i, pipe_status_raw[i]);
+            print_job_status(entry);
         }
+    } else if (job->cgroup.id) {
+        /* every process has exited: record the cgroup's usage, then drop it */
+        CgroupStats stats;
+        cgroup_read_stats(&job->cgroup, &stats);
+        trace_job_cgroup(stats.memory_peak, stats.cpu_usec);
+        cgroup_release(&job->cgroup);
     }
 
+    trace_job_waited(trace_now() - wait_start);
+
     /* Return terminal control to the shell */
     tcsetpgrp(STDIN_FILENO, getpgrp());
     signal(SIGTTOU, SIG_DFL);
@@ -531,4 +884,73 @@ static void handle_foreground_job(Job *job, int *pids)
     /* Shell should ignore Ctrl+Z again */
     signal(SIGTSTP, SIG_IGN);
     signal(SIGINT, handle_signal);
+
+    return stopped_status ? stopped_status : pipeline_exit_status();
+}
+
+/* ---
+Function Name: wait_status_to_exit_code
+
+Purpose:
+    Converts a raw wait status into a shell exit code: the exit value for
+    normal termination, 128 + signal number for killed or stopped
+    processes (as Bash reports them in $?).
+
+Input:
+    status - status returned by waitpid/wait4
+
+Output:
+    Exit code in the range 0-255.
+--- */
+int wait_status_to_exit_code(int status)
+{
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return SIGNAL_EXIT_BASE + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return SIGNAL_EXIT_BASE + WSTOPSIG(status);
+    return EXIT_FAILURE_CODE;
+}
+
+/* ---
+Function Name: pipeline_exit_status
+
+Purpose:
+    Computes the status of the whole pipeline from pipe_status: the last
+    stage's code, or with pipefail the rightmost non-zero code.
+
+Input:
+    None
+
+Output:
+    Exit status of the most recent pipeline.
+--- */
+static int pipeline_exit_status(void)
+{
+    if (num_pipe_status == ZERO_VALUE) return EXIT_SUCCESS_CODE;
+    if (!pipefail_enabled) return pipe_status[num_pipe_status - TRUE_VALUE];
+
+    for (int i = num_pipe_status - TRUE_VALUE; i >= ZERO_VALUE; i--) {
+        if (pipe_status[i] != EXIT_SUCCESS_CODE)
+            return pipe_status[i];
+    }
+    return EXIT_SUCCESS_CODE;
+}
+
+/* ---
+Function Name: set_exit_status
+
+Purpose:
+    Records the status of a command that did not go through run_job (a
+    builtin) so that $? and PIPESTATUS describe it.
+
+Input:
+    status - exit status of the command
+
+Output:
+    Updates last_exit_status and pipe_status.
+--- */
+void set_exit_status(int status)
+{
+    pipe_status[ZERO_VALUE] = status;
+    num_pipe_status = TRUE_VALUE;
+    last_exit_status = status;
 }
@@ -3,6 +3,7 @@
 
 #include "jobs.h"
 #include "mysh.h"
+#include <signal.h>     /* sigset_t */
 
 /* NUMERIC / BOOLEAN CONSTANTS */
 #define INDEX_OFFSET            1
@@ -11,6 +12,9 @@
 #define ERROR_CODE              -1
 #define EXIT_FAILURE_CODE       1
 #define EXIT_SUCCESS_CODE       0
+#define EXIT_CANNOT_EXEC_CODE   126
+#define EXIT_NOT_FOUND_CODE     127
+#define SIGNAL_EXIT_BASE        128
 
 /* CHARACTER / STRING CONSTANTS */
 #define PATH_SEPARATOR          '/'
@@ -25,40 +29,70 @@
 #define FULLPATH_LEN            512
 #define MAX_MSG_LEN             128
 #define PID_STR_LEN             16
-#define MSG_BUFFER              8
 
 /* FILE / I/O CONSTANTS */
 #define FILE_PERMISSIONS        0644
 
+/* PIPE BUFFER TUNING */
+#define PIPE_SIZE_ENV_NAME      "MYSH_PIPE_SIZE"
+#define MAX_PIPE_SIZE           (256 * MEGABYTE)
+#define KILOBYTE                1024
+#define MEGABYTE                (1024 * 1024)
+#define KILO_SUFFIX             'K'
+#define KILO_SUFFIX_LOWER       'k'
+#define MEGA_SUFFIX             'M'
+#define MEGA_SUFFIX_LOWER       'm'
+#define NINE_CHAR               '9'
+
 /* MESSAGE FORMATTING CONSTANTS */
 #define MSG_SPACE               " "
 #define MSG_BG_PREFIX            "["
 #define MSG_BG_SUFFIX            "] "
-#define MSG_FG_PREFIX           "["
-#define MSG_FG_SUFFIX           "] stopped \t"
 #define NEWLINE_STR             "\n"
 
+/* PER-STAGE LAUNCH PLAN */
+typedef struct
+{
+    char *path;     /* resolved executable, NULL if not found */
+    int in_fd;      /* fd to install as stdin, NO_FD to inherit */
+    int out_fd;     /* fd to install as stdout, NO_FD to inherit */
+    int take_terminal;  /* make this stage's group the terminal's foreground */
+    int fanout;     /* a 'tee' the stage runs itself, see fanout.c */
+    struct StageTuning *tuning;     /* nice/affinity/ulimit settings */
+} StagePlan;
+
 /* GLOBAL VARIABLES */
-extern Job jobs[MAX_JOBS];
-extern int num_jobs;
+extern int pipe_status[MAX_PIPELINE_LEN];
+extern int num_pipe_status;
+extern int pipefail_enabled;
+extern int last_exit_status;
 
 char* resolve_command_path(const char *cmd, char *envp[]);
-void run_job (Job *job, char* envp[]);
-void add_job(Job *job, int pid);
+int run_job (Job *job, char* envp[]);
+int spawn_job(Job *job, char *envp[], sigset_t *child_mask);
+int exec_job(Job *job, char *envp[]);
+void close_pass_fds(Job *job);
+int wait_status_to_exit_code(int status);
+void set_exit_status(int status);
 
 static int check_executable(const char *path);
 static char* copy_string_heap(const char *src);
 static void itoa_custom(int value, char *buf, int buflen);
 static void construct_background_msg(char *msg, Job *job, int pid, int job_no);
 static void build_fullpath(char *buf, const char *dir, const char *cmd);
-static void print_background_pid(Job *job, int pid);
-static void create_pipes(int pipefd[MAX_PIPELINE_LEN-1][2], int num_stages);
-static void setup_redirection(int stage_index, int num_stages, Job *job, int pipefd[MAX_PIPELINE_LEN-1][2]);
-static int fork_and_execute_stage(int stage_index, Job *job, char* envp[], int pipefd[MAX_PIPELINE_LEN-1][2]);
+static void print_background_pid(Job *job, int pid, int job_no);
+static int create_pipes(int pipefd[MAX_PIPELINE_LEN-1][2], int num_stages, int pipe_size);
+static int pipe_size_from_env(char *envp[]);
+static int prepare_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN-1][2], StagePlan *plan,
+                          struct StageTuning *tuning);
+static void setup_redirection(int stage_index, int num_stages, Job *job, StagePlan *plan);
+static void reset_child_signals(sigset_t *child_mask);
+static int fork_and_execute_stage(int stage_index, Job *job, char* envp[], StagePlan *plan, sigset_t *child_mask);
 static void handle_background_job(Job *job, int pid);
-static int execute_all_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN - 1][2], int *pids);
+static int execute_all_stages(Job *job, char *envp[], int pipefd[MAX_PIPELINE_LEN - 1][2], int *pids, sigset_t *child_mask);
 static void close_all_pipes(int pipefd[MAX_PIPELINE_LEN - 1][2], int num_stages);
-static void handle_background_job(Job *job, int pid);
-static void handle_foreground_job(Job *job, int *pids);
+static void kill_started_stages(Job *job, int num_started, int took_terminal);
+static int handle_foreground_job(Job *job, int *pids);
+static int pipeline_exit_status(void);
 
 #endif
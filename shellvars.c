@@ -0,0 +1,360 @@
+#define _GNU_SOURCE    /* cpu_set_t in stagetune.h */
+#include "shellvars.h"
+#include "builtin.h"
+#include "mystring.h"
+
+/* Calls in progress, innermost last. Their parameters and locals live
+   in the pool, which a returning call cuts back to where it started,
+   so nothing here touches the heap that every command clears. */
+static Scope scopes[MAX_SCOPES];
+static int num_scopes = ZERO_VALUE;
+static ScopeVar vars[MAX_SCOPE_VARS];
+static int num_vars = ZERO_VALUE;
+static char pool[SCOPE_POOL_LEN];
+static int pool_used = ZERO_VALUE;
+
+/* ---
+Function Name: push_scope
+
+Purpose:
+    Starts the scope of a function call: copies its arguments, which
+    become $1..$N, out of the heap.
+
+Input:
+    argv - null-terminated arguments, argv[0] being the function name
+
+Output:
+    Returns 1, or 0 if calls are nested too deeply or the arguments do
+    not fit.
+--- */
+int push_scope(char **argv)
+{
+    if (num_scopes == MAX_SCOPES) return ZERO_VALUE;
+
+    Scope *scope = &scopes[num_scopes];
+    scope->pool_mark = pool_used;
+    scope->first_var = num_vars;
+
+    int count = ZERO_VALUE, joined_len = ZERO_VALUE;
+    while (argv[count + TRUE_VALUE]) joined_len += mystrlen(argv[++count]) + TRUE_VALUE;
+
+    scope->num_params = count;
+    scope->params = (char **)pool_alloc((count + TRUE_VALUE) * (int)sizeof(char *));
+    char *joined = pool_alloc(joined_len + TRUE_VALUE);
+    if (!scope->params || !joined) {
+        pool_used = scope->pool_mark;
+        return ZERO_VALUE;
+    }
+
+    int len = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < count; i++) {
+        const char *arg = argv[i + TRUE_VALUE];
+        int arg_len = mystrlen(arg);
+        scope->params[i] = pool_copy(arg, arg_len);
+        if (!scope->params[i]) {
+            pool_used = scope->pool_mark;
+            return ZERO_VALUE;
+        }
+        if (i > ZERO_VALUE) joined[len++] = PARAM_SEPARATOR_CHAR;
+        mystrcpy(joined + len, arg);
+        len += arg_len;
+    }
+    joined[len] = NULL_CHAR;
+    scope->params[count] = NULL;
+    scope->joined = joined;
+    num_scopes++;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: pop_scope
+
+Purpose:
+    Ends the innermost function call, dropping its parameters and
+    locals.
+
+Input:
+    None
+
+Output:
+    None
+--- */
+void pop_scope(void)
+{
+    if (num_scopes == ZERO_VALUE) return;
+    num_scopes--;
+    num_vars = scopes[num_scopes].first_var;
+    pool_used = scopes[num_scopes].pool_mark;
+}
+
+/* ---
+Function Name: scope_depth
+
+Purpose:
+    Tells how many function calls are in progress.
+
+Input:
+    None
+
+Output:
+    0 at the top level.
+--- */
+int scope_depth(void)
+{
+    return num_scopes;
+}
+
+/* ---
+Function Name: define_local
+
+Purpose:
+    Creates a variable local to the innermost function call ('local'),
+    or sets it again if that call already has one.
+
+Input:
+    name  - variable name
+    value - initial value
+
+Output:
+    Returns 1, or 0 outside a function or if the table is full.
+--- */
+int define_local(const char *name, const char *value)
+{
+    if (num_scopes == ZERO_VALUE) return ZERO_VALUE;
+
+    ScopeVar *var = find_local(name, scopes[num_scopes - TRUE_VALUE].first_var);
+    if (var) return store_value(var, value);
+    if (num_vars == MAX_SCOPE_VARS) return ZERO_VALUE;
+
+    var = &vars[num_vars];
+    var->name = pool_copy(name, mystrlen(name));
+    var->size = ZERO_VALUE;
+    if (!var->name || !store_value(var, value)) return ZERO_VALUE;
+    num_vars++;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: set_scoped_variable
+
+Purpose:
+    Assigns to a local variable, if one of that name is visible: the
+    innermost call's own, or failing that a caller's.
+
+Input:
+    name  - variable name
+    value - new value
+
+Output:
+    SCOPE_SET, SCOPE_NOT_LOCAL if the name is not local (it belongs to
+    the environment), or SCOPE_FULL if the value does not fit.
+--- */
+int set_scoped_variable(const char *name, const char *value)
+{
+    ScopeVar *var = find_local(name, ZERO_VALUE);
+    if (!var) return SCOPE_NOT_LOCAL;
+    return store_value(var, value) ? SCOPE_SET : SCOPE_FULL;
+}
+
+/* ---
+Function Name: scope_value
+
+Purpose:
+    Looks a name up among the positional parameters ($0, $1..$N, $#,
+    $@, $*) and the visible locals, which hide environment variables
+    of the same name.
+
+Input:
+    name - variable name without '$' or braces
+    buf  - INT_BUFFER_LEN bytes for $#
+
+Output:
+    The value, or NULL if the name is none of these. A parameter past
+    the last one is an empty string.
+--- */
+const char *scope_value(const char *name, char *buf)
+{
+    const Scope *scope = num_scopes ? &scopes[num_scopes - TRUE_VALUE] : NULL;
+
+    if (is_number(name)) {
+        int n = ZERO_VALUE;
+        for (int i = ZERO_VALUE; name[i]; i++) n = n * NUMBER_BASE + (name[i] - DIGIT_FIRST_CHAR);
+        if (n == ZERO_VALUE) return PARAM_SHELL_NAME;
+        return positional_param(n);
+    }
+    if (name[ZERO_VALUE] != NULL_CHAR && name[TRUE_VALUE] == NULL_CHAR) {
+        if (name[ZERO_VALUE] == PARAM_COUNT_CHAR) {
+            int_to_str(positional_count(), buf);
+            return buf;
+        }
+        if (name[ZERO_VALUE] == PARAM_ALL_CHAR || name[ZERO_VALUE] == PARAM_STAR_CHAR)
+            return scope ? scope->joined : EMPTY_STRING;
+    }
+
+    ScopeVar *var = find_local(name, ZERO_VALUE);
+    return var ? var->value : NULL;
+}
+
+/* ---
+Function Name: positional_count
+
+Purpose:
+    Gives $#.
+
+Input:
+    None
+
+Output:
+    Number of arguments of the innermost call, 0 at the top level.
+--- */
+int positional_count(void)
+{
+    return num_scopes ? scopes[num_scopes - TRUE_VALUE].num_params : ZERO_VALUE;
+}
+
+/* ---
+Function Name: positional_param
+
+Purpose:
+    Gives $n of the innermost call.
+
+Input:
+    n - parameter number, from 1
+
+Output:
+    The argument, or an empty string if there is none.
+--- */
+char *positional_param(int n)
+{
+    if (n < TRUE_VALUE || n > positional_count()) return EMPTY_STRING;
+    return scopes[num_scopes - TRUE_VALUE].params[n - TRUE_VALUE];
+}
+
+/* ---
+Function Name: is_special_param
+
+Purpose:
+    Tells whether a character after '$' names a special parameter.
+
+Input:
+    c - character
+
+Output:
+    Non-zero for '#', '@' and '*'.
+--- */
+int is_special_param(char c)
+{
+    return c == PARAM_COUNT_CHAR || c == PARAM_ALL_CHAR || c == PARAM_STAR_CHAR;
+}
+
+/* ---
+Function Name: find_local
+
+Purpose:
+    Finds the innermost visible local of a name.
+
+Input:
+    name  - variable name
+    first - index in vars[] where the search stops
+
+Output:
+    The variable, or NULL.
+--- */
+static ScopeVar *find_local(const char *name, int first)
+{
+    for (int i = num_vars - TRUE_VALUE; i >= first; i--) {
+        if (mystrcmp(vars[i].name, name) == ZERO_VALUE) return &vars[i];
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: store_value
+
+Purpose:
+    Sets a local's value, in place when it fits, so that a loop
+    assigning to a local does not keep taking pool space.
+
+Input:
+    var   - variable
+    value - new value
+
+Output:
+    Returns 1, or 0 if the pool is full.
+--- */
+static int store_value(ScopeVar *var, const char *value)
+{
+    int len = mystrlen(value);
+    if (len < var->size) {
+        mystrcpy(var->value, value);
+        return TRUE_VALUE;
+    }
+
+    char *copy = pool_copy(value, len);
+    if (!copy) return ZERO_VALUE;
+    var->value = copy;
+    var->size = len + TRUE_VALUE;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: pool_copy
+
+Purpose:
+    Copies a string into the pool.
+
+Input:
+    text, len - the string
+
+Output:
+    The copy, or NULL if the pool is full.
+--- */
+static char *pool_copy(const char *text, int len)
+{
+    char *copy = pool_alloc(len + TRUE_VALUE);
+    if (!copy) return NULL;
+    for (int i = ZERO_VALUE; i < len; i++) copy[i] = text[i];
+    copy[len] = NULL_CHAR;
+    return copy;
+}
+
+/* ---
+Function Name: pool_alloc
+
+Purpose:
+    Allocates from the pool, pointer-aligned.
+
+Input:
+    size - bytes
+
+Output:
+    The block, or NULL if it does not fit.
+--- */
+static char *pool_alloc(int size)
+{
+    int start = (pool_used + (int)sizeof(char *) - TRUE_VALUE) & ~((int)sizeof(char *) - TRUE_VALUE);
+    if (start + size > SCOPE_POOL_LEN) return NULL;
+    pool_used = start + size;
+    return pool + start;
+}
+
+/* ---
+Function Name: is_number
+
+Purpose:
+    Tells whether a name is all digits, i.e. a positional parameter.
+
+Input:
+    text - name
+
+Output:
+    Non-zero if it is.
+--- */
+static int is_number(const char *text)
+{
+    if (text[ZERO_VALUE] == NULL_CHAR) return ZERO_VALUE;
+    for (int i = ZERO_VALUE; text[i]; i++) {
+        if (text[i] < DIGIT_FIRST_CHAR || text[i] > DIGIT_LAST_CHAR) return ZERO_VALUE;
+    }
+    return TRUE_VALUE;
+}
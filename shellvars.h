@@ -0,0 +1,65 @@
+#ifndef SHELLVARS_H
+#define SHELLVARS_H
+
+/* SIZES */
+#define MAX_SCOPES              64      /* function calls in progress */
+#define MAX_SCOPE_VARS          512     /* 'local' variables, all scopes */
+#define SCOPE_POOL_LEN          (1 << 16)
+
+/* SPECIAL PARAMETERS */
+#define PARAM_COUNT_CHAR        '#'
+#define PARAM_ALL_CHAR          '@'
+#define PARAM_STAR_CHAR         '*'
+#define PARAM_SHELL_NAME        "mysh"  /* $0 */
+#define PARAM_SEPARATOR_CHAR    ' '
+
+/* set_scoped_variable() RESULTS */
+#define SCOPE_NOT_LOCAL         0
+#define SCOPE_SET               1
+#define SCOPE_FULL              (-1)
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define NULL_CHAR               '\0'
+#define DIGIT_FIRST_CHAR        '0'
+#define DIGIT_LAST_CHAR         '9'
+#define NUMBER_BASE             10
+
+/* A 'local' VARIABLE */
+typedef struct
+{
+    const char *name;
+    char *value;
+    int size;                   /* bytes available at value */
+} ScopeVar;
+
+/* ONE FUNCTION CALL */
+typedef struct
+{
+    char **params;              /* $1..$N */
+    int num_params;
+    const char *joined;         /* $@ and $* inside a word */
+    int first_var;              /* its locals start here in vars[] */
+    int pool_mark;              /* pool bytes in use before the call */
+} Scope;
+
+/* FUNCTION DECLARATIONS */
+int push_scope(char **argv);
+void pop_scope(void);
+int scope_depth(void);
+int define_local(const char *name, const char *value);
+int set_scoped_variable(const char *name, const char *value);
+const char *scope_value(const char *name, char *buf);
+int positional_count(void);
+char *positional_param(int n);
+int is_special_param(char c);
+
+/* STATIC HELPER FUNCTIONS */
+static ScopeVar *find_local(const char *name, int first);
+static int store_value(ScopeVar *var, const char *value);
+static char *pool_copy(const char *text, int len);
+static char *pool_alloc(int size);
+static int is_number(const char *text);
+
+#endif
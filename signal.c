@@ -1,16 +1,19 @@
 #include "signal.h"
 #include "jobs.h"
 #include "mystring.h"
+#include "jobsched.h"
+#include "jobtable.h"
+#include "coproc.h"
+#include "trace.h"
 
 #include <signal.h>
 #include <unistd.h>   // write()
-#include <sys/wait.h> // waitpid()
+#include <sys/wait.h> // wait4()
 
 volatile sig_atomic_t fg_job_running = NO_FLAGS;
 
-/* extern globals for background jobs */
-extern Job jobs[MAX_JOBS];
-extern int num_jobs;
+/* Set by Ctrl+C at the shell itself; stops a running if/while/for/case */
+volatile sig_atomic_t interrupt_pending = NO_FLAGS;
 
 /* forward declaration */
 void sigchld_handler(int sig);
@@ -22,11 +25,13 @@ Purpose:
   Handles shell signal events such as SIGINT (Ctrl+C).
   If a foreground job is running, sends SIGINT to terminate it;
   otherwise just prints a newline to maintain clean prompt output.
+  Also sets interrupt_pending, which stops a running loop.
 --- */
 void handle_signal(int sig)
 {
     if (sig == SIGINT)
     {
+      interrupt_pending = TRUE_VALUE;
       write(STDOUT_FILENO, NEWLINE_STR, mystrlen(NEWLINE_STR));
     }
 }
@@ -36,8 +41,9 @@ Function Name: sigchld_handler
 
 Purpose:
   Handles the SIGCHLD signal when background processes change state.
-  This function reaps all finished child processes to prevent zombies
-  and updates the job list accordingly.
+  Reaps finished children to prevent zombies and records every exit,
+  stop and continue in the job table; finished jobs are announced
+  before the next prompt by report_finished_jobs().
 --- */
 void sigchld_handler(int sig)
 {
@@ -45,23 +51,19 @@ void sigchld_handler(int sig)
 
     int status;
     pid_t pid;
+    struct rusage usage;
 
-    while ((pid = waitpid(-1, &status, WNOHANG)) > VALID_PID)
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > VALID_PID)
     {
-        for (int i = INITIAL_INDEX; i < num_jobs; i++)
+        /* frees the job's scheduler slot once all its stages are gone */
+        if (!WIFSTOPPED(status) && !WIFCONTINUED(status))
         {
-            if (jobs[i].pgid == pid)
-            {
-                // mark as completed
-                jobs[i].background = ZERO_VALUE;
-
-                write(STDOUT_FILENO, MSG_JOB_DONE, mystrlen(MSG_JOB_DONE));
-                write(STDOUT_FILENO, jobs[i].pipeline[INITIAL_INDEX].argv[INITIAL_INDEX],
-                      mystrlen(jobs[i].pipeline[INITIAL_INDEX].argv[INITIAL_INDEX]));
-                write(STDOUT_FILENO, NEWLINE_STR, mystrlen(NEWLINE_STR));
-                break;
-            }
+            sched_child_exited(pid);
+            coproc_exited(pid);
+            trace_proc_reaped(pid, status, &usage);
         }
+
+        update_job_status(pid, status);
     }
 }
 
@@ -85,7 +87,7 @@ void initialize_signal_handler()
     struct sigaction sa_chld;
     sa_chld.sa_handler = sigchld_handler;
     sigemptyset(&sa_chld.sa_mask);
-    sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sa_chld.sa_flags = SA_RESTART;
     sigaction(SIGCHLD, &sa_chld, NULL);
 
     struct sigaction sa_tstp;
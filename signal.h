@@ -10,7 +10,6 @@
 
 /* GENERAL STRING CONSTANTS */
 #define NEWLINE_STR             "\n"
-#define MSG_JOB_DONE            "[Job Done] "
 
 /* NUMERIC / CONTROL CONSTANTS */
 #define NO_FLAGS                0
@@ -20,6 +19,7 @@
 
 /* GLOBAL VARIABLES */
 extern volatile sig_atomic_t fg_job_running;
+extern volatile sig_atomic_t interrupt_pending;
 
 void handle_signal(int sig);
 void initialize_signal_handler(void);
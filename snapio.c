@@ -0,0 +1,204 @@
+#include "snapio.h"
+
+#include <unistd.h>       /* write */
+#include <string.h>       /* memcpy */
+
+/* Output is gathered here so a module saving many small fields does
+   not make a system call for each. */
+static char out_buf[SNAP_BUF_LEN];
+static int out_used = ZERO_VALUE;
+
+/* ---
+Function Name: snap_write
+
+Purpose:
+    Appends bytes to the image being written.
+
+Input:
+    w    - writer
+    data - bytes
+    len  - how many
+
+Output:
+    Buffers or writes them; a failed write marks the writer failed.
+--- */
+void snap_write(SnapWriter *w, const void *data, long long len)
+{
+    if (w->failed) return;
+    if (out_used + len > SNAP_BUF_LEN) snap_flush(w);
+
+    w->length += len;
+    if (len < SNAP_BUF_LEN) {
+        memcpy(out_buf + out_used, data, len);
+        out_used += (int)len;
+        return;
+    }
+
+    const char *p = data;
+    while (len > ZERO_VALUE) {
+        ssize_t n = write(w->fd, p, len);
+        if (n <= ZERO_VALUE) {
+            w->failed = TRUE_VALUE;
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* ---
+Function Name: snap_write_int
+
+Purpose:
+    Appends an int (a count or a flag) to the image.
+
+Input:
+    w     - writer
+    value - the int
+
+Output:
+    None
+--- */
+void snap_write_int(SnapWriter *w, int value)
+{
+    snap_write(w, &value, sizeof(value));
+}
+
+/* ---
+Function Name: snap_write_pool
+
+Purpose:
+    Records where a pool lies, so that pointers into it saved after
+    this can be moved by snap_relocate() when the image is loaded.
+
+Input:
+    w    - writer
+    pool - first byte of the pool
+
+Output:
+    None
+--- */
+void snap_write_pool(SnapWriter *w, const void *pool)
+{
+    uintptr_t base = (uintptr_t)pool;
+    snap_write(w, &base, sizeof(base));
+}
+
+/* ---
+Function Name: snap_flush
+
+Purpose:
+    Writes out what snap_write() has buffered.
+
+Input:
+    w - writer
+
+Output:
+    Empties the buffer; a failed write marks the writer failed.
+--- */
+void snap_flush(SnapWriter *w)
+{
+    const char *p = out_buf;
+    while (out_used > ZERO_VALUE && !w->failed) {
+        ssize_t n = write(w->fd, p, out_used);
+        if (n <= ZERO_VALUE) w->failed = TRUE_VALUE;
+        else {
+            p += n;
+            out_used -= (int)n;
+        }
+    }
+    out_used = ZERO_VALUE;
+}
+
+/* ---
+Function Name: snap_read
+
+Purpose:
+    Copies the next bytes out of the mapped image.
+
+Input:
+    r    - reader
+    dest - destination
+    len  - how many
+
+Output:
+    Returns 1, or 0 (and marks the reader failed) if the image is too
+    short or an earlier read failed.
+--- */
+int snap_read(SnapReader *r, void *dest, long long len)
+{
+    if (r->failed || len < ZERO_VALUE || len > r->length - r->pos) {
+        r->failed = TRUE_VALUE;
+        return ZERO_VALUE;
+    }
+    memcpy(dest, r->data + r->pos, len);
+    r->pos += len;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: snap_read_count
+
+Purpose:
+    Reads a count written by snap_write_int() and checks it against the
+    table it sizes.
+
+Input:
+    r   - reader
+    max - largest valid count
+
+Output:
+    The count, or -1 (and the reader marked failed) if it is out of
+    range or could not be read.
+--- */
+int snap_read_count(SnapReader *r, int max)
+{
+    int value = ERROR_CODE;
+    if (!snap_read(r, &value, sizeof(value))) return ERROR_CODE;
+    if (value < ZERO_VALUE || value > max) {
+        r->failed = TRUE_VALUE;
+        return ERROR_CODE;
+    }
+    return value;
+}
+
+/* ---
+Function Name: snap_read_pool
+
+Purpose:
+    Reads where a pool lay when the image was written (see
+    snap_write_pool()).
+
+Input:
+    r    - reader
+    pool - first byte of the same pool in this process
+
+Output:
+    The pair of addresses snap_relocate() needs.
+--- */
+SnapPool snap_read_pool(SnapReader *r, const void *pool)
+{
+    SnapPool moved = { ZERO_VALUE, (uintptr_t)pool };
+    snap_read(r, &moved.saved, sizeof(moved.saved));
+    return moved;
+}
+
+/* ---
+Function Name: snap_relocate
+
+Purpose:
+    Turns a pointer saved in the image into one to the same byte of
+    the pool in this process (which may lie elsewhere, e.g. with ASLR).
+
+Input:
+    p    - saved pointer, or NULL
+    pool - from snap_read_pool()
+
+Output:
+    The moved pointer, or NULL.
+--- */
+void *snap_relocate(const void *p, const SnapPool *pool)
+{
+    if (!p) return NULL;
+    return (void *)((uintptr_t)p - pool->saved + pool->now);
+}
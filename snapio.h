@@ -0,0 +1,50 @@
+#ifndef SNAPIO_H
+#define SNAPIO_H
+
+#include <stdint.h>         /* uintptr_t */
+
+/* SIZES */
+#define SNAP_BUF_LEN            65536
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+
+/* BUFFERED OUTPUT TO THE IMAGE BEING WRITTEN */
+typedef struct
+{
+    int fd;
+    long long length;
+    int failed;
+} SnapWriter;
+
+/* THE MAPPED IMAGE BEING READ */
+typedef struct
+{
+    const char *data;
+    long long length;
+    long long pos;
+    int failed;
+} SnapReader;
+
+/* WHERE A MODULE'S POOL LAY WHEN THE IMAGE WAS WRITTEN, AND LIES NOW
+   Pointers into a pool are saved as they are and moved by the
+   difference on load. */
+typedef struct
+{
+    uintptr_t saved;
+    uintptr_t now;
+} SnapPool;
+
+/* FUNCTION DECLARATIONS */
+void snap_write(SnapWriter *w, const void *data, long long len);
+void snap_write_int(SnapWriter *w, int value);
+void snap_write_pool(SnapWriter *w, const void *pool);
+void snap_flush(SnapWriter *w);
+int snap_read(SnapReader *r, void *dest, long long len);
+int snap_read_count(SnapReader *r, int max);
+SnapPool snap_read_pool(SnapReader *r, const void *pool);
+void *snap_relocate(const void *p, const SnapPool *pool);
+
+#endif
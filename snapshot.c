@@ -0,0 +1,225 @@
+#include "snapshot.h"
+#include "snapio.h"
+#include "flow.h"
+#include "alias.h"
+#include "builtin.h"
+#include "pathcache.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* getpid, unlink, close, pwrite */
+#include <fcntl.h>        /* open */
+#include <string.h>       /* memset, memcmp */
+#include <stdio.h>        /* rename */
+#include <sys/mman.h>     /* mmap */
+
+/* The rc file found by load_snapshot(), its snapshot beside it, and
+   the header an up-to-date snapshot has: taken before the rc runs,
+   since the rc may change PATH. */
+static char rc_path[RC_PATH_LEN];
+static char snap_path[RC_PATH_LEN];
+static SnapHeader expected;
+
+/* ---
+Function Name: load_snapshot
+
+Purpose:
+    Startup configuration. The rc file is $MYSH_RC (empty for none), or
+    ~/.myshrc. Running it every time would cost every short-lived shell
+    the rc's parsing and commands, so its result (aliases, functions,
+    variables and the PATH index) is kept in an image beside it, named
+    after it with ".snap" added. If that image is up to date it is
+    mapped and copied back here instead.
+
+Input:
+    envp - environment variables
+
+Output:
+    RC_LOADED if the snapshot was used, RC_STALE if the caller should
+    source rc_file() and then call save_snapshot(), or RC_NONE if there
+    is no rc file.
+--- */
+int load_snapshot(char *envp[])
+{
+    struct stat rc_st, snap_st;
+    if (!find_rc_file(envp) || stat(rc_path, &rc_st) < ZERO_VALUE || !S_ISREG(rc_st.st_mode))
+        return RC_NONE;
+    fill_header(&expected, &rc_st, envp);
+
+    int fd = open(snap_path, O_RDONLY | O_CLOEXEC);
+    if (fd < ZERO_VALUE) return RC_STALE;
+    if (fstat(fd, &snap_st) < ZERO_VALUE || snap_st.st_size < (off_t)sizeof(SnapHeader)) {
+        close(fd);
+        return RC_STALE;
+    }
+    void *data = mmap(NULL, snap_st.st_size, PROT_READ, MAP_PRIVATE, fd, ZERO_VALUE);
+    close(fd);
+    if (data == MAP_FAILED) return RC_STALE;
+
+    SnapReader r = { data, snap_st.st_size, ZERO_VALUE, ZERO_VALUE };
+    SnapHeader found;
+    expected.length = snap_st.st_size;
+    int loaded = snap_read(&r, &found, sizeof(found)) && memcmp(&found, &expected, sizeof(found)) == ZERO_VALUE &&
+                 load_functions(&r) && load_aliases(&r) && load_shell_variables(&r, envp) && load_path_index(&r);
+    munmap(data, snap_st.st_size);
+    return loaded ? RC_LOADED : RC_STALE;
+}
+
+/* ---
+Function Name: rc_file
+
+Purpose:
+    Gives the rc file found by load_snapshot().
+
+Input:
+    None
+
+Output:
+    Its path.
+--- */
+const char *rc_file(void)
+{
+    return rc_path;
+}
+
+/* ---
+Function Name: save_snapshot
+
+Purpose:
+    Writes the snapshot after the rc has been sourced. The PATH index
+    is built first so that later shells find commands without probing
+    PATH. The image is written to a file of this process's own and
+    renamed into place, so a shell starting meanwhile sees the old
+    image or the new one, never part of one. Failing to write it (e.g.
+    a read-only home) only means the rc is sourced again next time.
+
+Input:
+    envp - environment variables
+
+Output:
+    None
+--- */
+void save_snapshot(char *envp[])
+{
+    char temp_path[RC_PATH_LEN + SNAP_INT_TEXT_LEN];
+    char pid_text[SNAP_INT_TEXT_LEN];
+    myitoa(getpid(), pid_text);
+    mystrcpy(temp_path, snap_path);
+    mystrcat(temp_path, SNAPSHOT_TEMP_SEPARATOR);
+    mystrcat(temp_path, pid_text);
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, SNAPSHOT_FILE_MODE);
+    if (fd < ZERO_VALUE) return;
+
+    refresh_path_index(envp);
+    SnapWriter w = { fd, ZERO_VALUE, ZERO_VALUE };
+    expected.length = ZERO_VALUE;
+    snap_write(&w, &expected, sizeof(expected));
+    save_functions(&w);
+    save_aliases(&w);
+    save_shell_variables(&w);
+    save_path_index(&w);
+    snap_flush(&w);
+
+    expected.length = w.length;
+    if (!w.failed && pwrite(fd, &expected, sizeof(expected), ZERO_VALUE) != (ssize_t)sizeof(expected))
+        w.failed = TRUE_VALUE;
+    if (close(fd) < ZERO_VALUE) w.failed = TRUE_VALUE;
+    if (w.failed || rename(temp_path, snap_path) < ZERO_VALUE) unlink(temp_path);
+}
+
+/* ---
+Function Name: find_rc_file
+
+Purpose:
+    Works out the paths of the rc file and its snapshot.
+
+Input:
+    envp - environment variables
+
+Output:
+    Returns 1 with rc_path and snap_path set, or 0 if there is no rc to
+    look for (MYSH_RC empty, no HOME, or a path too long).
+--- */
+static int find_rc_file(char *envp[])
+{
+    char *file = mygetenv(RC_ENV_NAME, envp);
+    char *home = mygetenv(RC_HOME_ENV_NAME, envp);
+    int suffix_len = mystrlen(SNAPSHOT_SUFFIX);
+
+    if (file) {
+        if (file[ZERO_VALUE] == NULL_CHAR || mystrlen(file) + suffix_len >= RC_PATH_LEN) return ZERO_VALUE;
+        mystrcpy(rc_path, file);
+    } else {
+        if (!home || mystrlen(home) + mystrlen(RC_FILE_NAME) + suffix_len >= RC_PATH_LEN) return ZERO_VALUE;
+        mystrcpy(rc_path, home);
+        mystrcat(rc_path, RC_FILE_NAME);
+    }
+    mystrcpy(snap_path, rc_path);
+    mystrcat(snap_path, SNAPSHOT_SUFFIX);
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: fill_header
+
+Purpose:
+    Builds the header of a snapshot for the rc file as it is now.
+
+Input:
+    header - destination
+    rc_st  - stat() of the rc file
+    envp   - environment variables
+
+Output:
+    Fills header; padding is zeroed so headers compare with memcmp().
+--- */
+static void fill_header(SnapHeader *header, const struct stat *rc_st, char *envp[])
+{
+    struct stat exe_st;
+
+    memset(header, ZERO_VALUE, sizeof(*header));
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->rc_mtime_sec = rc_st->st_mtim.tv_sec;
+    header->rc_mtime_nsec = rc_st->st_mtim.tv_nsec;
+    header->rc_size = rc_st->st_size;
+    header->rc_inode = rc_st->st_ino;
+    if (stat(SELF_EXE_PATH, &exe_st) == ZERO_VALUE) {
+        header->exe_mtime_sec = exe_st.st_mtim.tv_sec;
+        header->exe_mtime_nsec = exe_st.st_mtim.tv_nsec;
+        header->exe_size = exe_st.st_size;
+    }
+    header->env_hash = env_hash(envp);
+}
+
+/* ---
+Function Name: env_hash
+
+Purpose:
+    Hashes the whole environment, so a shell started with any variable
+    added, removed or changed sources the rc afresh. The rc may branch
+    on any of them ($TERM, $USER, $MYSH_*), and so may the programs it
+    runs, so no smaller set is safe. Each "NAME=value" string is hashed
+    on its own and the results are added, which makes the hash
+    independent of the order the variables come in.
+
+Input:
+    envp - environment variables
+
+Output:
+    The hash (sum of FNV-1a hashes).
+--- */
+static unsigned int env_hash(char *envp[])
+{
+    unsigned int sum = ZERO_VALUE;
+
+    for (int e = ZERO_VALUE; envp[e]; e++) {
+        unsigned int h = ENV_HASH_OFFSET_BASIS;
+        for (const char *c = envp[e]; *c; c++) {
+            h ^= (unsigned char)*c;
+            h *= ENV_HASH_PRIME;
+        }
+        sum += h;
+    }
+    return sum;
+}
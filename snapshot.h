@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <sys/stat.h>       /* struct stat */
+
+/* FILES AND ENVIRONMENT */
+#define RC_ENV_NAME             "MYSH_RC"     /* like every variable, part of env_hash() */
+#define RC_HOME_ENV_NAME        "HOME"
+#define RC_FILE_NAME            "/.myshrc"
+#define SNAPSHOT_SUFFIX         ".snap"
+#define SNAPSHOT_TEMP_SEPARATOR "."
+#define SNAPSHOT_FILE_MODE      0600
+#define SELF_EXE_PATH           "/proc/self/exe"
+
+/* SIZES */
+#define RC_PATH_LEN             1024
+#define SNAP_INT_TEXT_LEN       16
+
+/* IMAGE IDENTITY */
+#define SNAPSHOT_MAGIC          0x4e534d4du     /* "MMSN" */
+#define SNAPSHOT_VERSION        2
+#define ENV_HASH_OFFSET_BASIS   2166136261u
+#define ENV_HASH_PRIME          16777619u
+
+/* load_snapshot() RESULTS */
+#define RC_NONE                 0       /* no rc file: nothing to do */
+#define RC_LOADED               1       /* the snapshot was mapped */
+#define RC_STALE                2       /* source the rc, then save_snapshot() */
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+
+/* FRONT OF THE IMAGE
+   The image is only used if the rc file, the mysh binary (whose
+   bytecode and struct layouts it holds) and the whole environment are
+   all what they were when it was written. */
+typedef struct
+{
+    unsigned int magic;
+    unsigned int version;
+    long long rc_mtime_sec;
+    long long rc_mtime_nsec;
+    long long rc_size;
+    long long rc_inode;
+    long long exe_mtime_sec;
+    long long exe_mtime_nsec;
+    long long exe_size;
+    unsigned int env_hash;
+    long long length;           /* whole image, to catch a short file */
+} SnapHeader;
+
+/* FUNCTION DECLARATIONS */
+int load_snapshot(char *envp[]);
+const char *rc_file(void);
+void save_snapshot(char *envp[]);
+
+/* STATIC HELPER FUNCTIONS */
+static int find_rc_file(char *envp[]);
+static void fill_header(SnapHeader *header, const struct stat *rc_st, char *envp[]);
+static unsigned int env_hash(char *envp[]);
+
+#endif
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE    /* cpu_set_t, sched_setaffinity */
+#include "stagetune.h"
+#include "mystring.h"
+
+#include <errno.h>
+
+/* RESOURCES ACCEPTED BY 'ulimit' (sizes in KB, as in Bash) */
+static const UlimitResource ulimit_resources[] = {
+    { 'c', RLIMIT_CORE,    UNIT_KILOBYTES, "core file size (KB)" },
+    { 'd', RLIMIT_DATA,    UNIT_KILOBYTES, "data seg size (KB)" },
+    { 'f', RLIMIT_FSIZE,   UNIT_KILOBYTES, "file size (KB)" },
+    { 'l', RLIMIT_MEMLOCK, UNIT_KILOBYTES, "max locked memory (KB)" },
+    { 'n', RLIMIT_NOFILE,  UNIT_BYTES,     "open files" },
+    { 's', RLIMIT_STACK,   UNIT_KILOBYTES, "stack size (KB)" },
+    { 't', RLIMIT_CPU,     UNIT_BYTES,     "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC,   UNIT_BYTES,     "max user processes" },
+    { 'v', RLIMIT_AS,      UNIT_KILOBYTES, "virtual memory (KB)" }
+};
+#define NUM_ULIMIT_RESOURCES ((int)(sizeof(ulimit_resources) / sizeof(ulimit_resources[0])))
+
+/* ---
+Function Name: parse_stage_tuning
+
+Purpose:
+    Consumes leading process-setting prefixes from one pipeline stage:
+      nice [-n N | -N] command      lower (or raise) the priority
+      affinity CPULIST command      pin to CPUs, e.g. 0 or 1-3 or 0,2
+      ulimit -X VALUE ... command   set resource limits (see 'ulimit')
+    Prefixes can be combined ("affinity 1-3 nice xz"). A keyword with
+    no command after it is run as the command itself. They are parsed
+    in the shell so the child only has to make the system calls.
+
+Input:
+    cmd    - stage command; prefix words are removed from it
+    tuning - output settings
+
+Output:
+    Returns 1 on success (including no prefix), 0 if a prefix is
+    malformed.
+--- */
+int parse_stage_tuning(Command *cmd, StageTuning *tuning)
+{
+    tuning->set_priority = ZERO_VALUE;
+    tuning->set_affinity = ZERO_VALUE;
+    tuning->num_rlimits = ZERO_VALUE;
+
+    int start = ZERO_VALUE;
+    for (;;) {
+        StageTuning before = *tuning;
+        int next = parse_prefix(cmd->argv, start, tuning);
+        if (next == ERROR_CODE) return ZERO_VALUE;
+        if (next == start) break;
+        if (!cmd->argv[next]) {
+            /* nothing after it, so the word is the command ("nice nice") */
+            *tuning = before;
+            break;
+        }
+        start = next;
+    }
+    if (start == ZERO_VALUE) return TRUE_VALUE;
+
+    int n = ZERO_VALUE;
+    for (int i = start; i <= (int)cmd->argc; i++)
+        cmd->argv[n++] = cmd->argv[i];
+    cmd->argc -= start;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: apply_stage_tuning
+
+Purpose:
+    Applies a stage's settings with setrlimit(), setpriority() and
+    sched_setaffinity(). Runs in the child between redirection setup
+    and execve, so no wrapper process is needed.
+
+Input:
+    tuning - settings parsed by parse_stage_tuning()
+
+Output:
+    Returns 1 on success, 0 if a limit or the affinity could not be
+    set. A refused priority change is ignored, as nice(1) does.
+--- */
+int apply_stage_tuning(StageTuning *tuning)
+{
+    for (int i = ZERO_VALUE; i < tuning->num_rlimits; i++) {
+        struct rlimit rl;
+        if (getrlimit(tuning->rlimits[i].resource, &rl) < ZERO_VALUE) return ZERO_VALUE;
+        rl.rlim_cur = tuning->rlimits[i].value;
+        if (rl.rlim_max != RLIM_INFINITY &&
+            (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > rl.rlim_max))
+            rl.rlim_max = rl.rlim_cur;      /* raising needs privilege */
+        if (setrlimit(tuning->rlimits[i].resource, &rl) < ZERO_VALUE) return ZERO_VALUE;
+    }
+
+    if (tuning->set_priority)
+        setpriority(PRIO_PROCESS, ZERO_VALUE, tuning->priority);
+
+    if (tuning->set_affinity &&
+        sched_setaffinity(ZERO_VALUE, sizeof(cpu_set_t), &tuning->cpus) < ZERO_VALUE)
+        return ZERO_VALUE;
+
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: is_tuning_prefix
+
+Purpose:
+    Tells whether a command that starts with the 'ulimit' builtin is
+    really a stage prefix ("ulimit -n 64 cmd") to be run as a job.
+
+Input:
+    argv - command words
+
+Output:
+    Returns 1 if argv is a valid prefix followed by a command.
+--- */
+int is_tuning_prefix(char **argv)
+{
+    StageTuning tuning = { ZERO_VALUE };
+    int next = parse_prefix(argv, ZERO_VALUE, &tuning);
+    return next > ZERO_VALUE && argv[next] != NULL;
+}
+
+/* ---
+Function Name: find_ulimit_resource
+
+Purpose:
+    Looks up a 'ulimit' option letter.
+
+Input:
+    flag - option letter
+
+Output:
+    The resource, or NULL if unknown.
+--- */
+const UlimitResource *find_ulimit_resource(char flag)
+{
+    for (int i = ZERO_VALUE; i < NUM_ULIMIT_RESOURCES; i++) {
+        if (ulimit_resources[i].flag == flag) return &ulimit_resources[i];
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: ulimit_resource_at
+
+Purpose:
+    Iterates over the known resources ('ulimit -a').
+
+Input:
+    index - position, starting at 0
+
+Output:
+    The resource, or NULL past the end.
+--- */
+const UlimitResource *ulimit_resource_at(int index)
+{
+    return (index >= ZERO_VALUE && index < NUM_ULIMIT_RESOURCES) ? &ulimit_resources[index] : NULL;
+}
+
+/* ---
+Function Name: parse_rlimit_value
+
+Purpose:
+    Converts a 'ulimit' value ("unlimited" or a number in the resource's
+    unit) to an rlim_t.
+
+Input:
+    text  - value text
+    res   - resource
+    value - output
+
+Output:
+    Returns 1 on success, 0 if text is not a valid value.
+--- */
+int parse_rlimit_value(const char *text, const UlimitResource *res, rlim_t *value)
+{
+    if (mystrcmp(text, UNLIMITED_TEXT) == ZERO_VALUE) {
+        *value = RLIM_INFINITY;
+        return TRUE_VALUE;
+    }
+    if (text[ZERO_VALUE] < ZERO_CHAR || text[ZERO_VALUE] > NINE_CHAR) return ZERO_VALUE;
+
+    rlim_t n = ZERO_VALUE;
+    for (int i = ZERO_VALUE; text[i]; i++) {
+        if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return ZERO_VALUE;
+        n = n * DECIMAL_BASE + (text[i] - ZERO_CHAR);
+    }
+    *value = n * res->unit;
+    return TRUE_VALUE;
+}
+
+/* ---
+Function Name: parse_prefix
+
+Purpose:
+    Parses one nice/affinity/ulimit prefix starting at argv[start].
+
+Input:
+    argv   - command words
+    start  - index of the possible prefix keyword
+    tuning - settings to update
+
+Output:
+    Index just past the prefix, start if argv[start] is not a prefix,
+    or -1 if it is malformed.
+--- */
+static int parse_prefix(char **argv, int start, StageTuning *tuning)
+{
+    char *word = argv[start];
+    if (!word) return start;
+    if (mystrcmp(word, NICE_KEYWORD) == ZERO_VALUE) return parse_nice(argv, start + TRUE_VALUE, tuning);
+    if (mystrcmp(word, AFFINITY_KEYWORD) == ZERO_VALUE) return parse_affinity(argv, start + TRUE_VALUE, tuning);
+    if (mystrcmp(word, ULIMIT_KEYWORD) == ZERO_VALUE) return parse_ulimit(argv, start + TRUE_VALUE, tuning);
+    return start;
+}
+
+/* ---
+Function Name: parse_nice
+
+Purpose:
+    Parses "nice [-n N | -N]"; the default adjustment is 10.
+
+Input:
+    argv   - command words
+    i      - index after the keyword
+    tuning - settings to update
+
+Output:
+    Index of the next word, or -1 if the adjustment is invalid.
+--- */
+static int parse_nice(char **argv, int i, StageTuning *tuning)
+{
+    int adjust = DEFAULT_NICE_ADJUST;
+
+    if (argv[i] && mystrcmp(argv[i], NICE_VALUE_OPTION) == ZERO_VALUE) {
+        if (!argv[i + TRUE_VALUE] || !parse_int(argv[i + TRUE_VALUE], &adjust)) return ERROR_CODE;
+        i += OPTION_WITH_VALUE_ARGS;
+    } else if (argv[i] && argv[i][ZERO_VALUE] == OPTION_CHAR) {
+        if (!parse_int(argv[i] + TRUE_VALUE, &adjust)) return ERROR_CODE;
+        i++;
+    }
+
+    /* relative to the shell's own priority, clamped like nice(2) */
+    errno = ZERO_VALUE;
+    int base = getpriority(PRIO_PROCESS, ZERO_VALUE);
+    if (errno) base = ZERO_VALUE;
+    int priority = (tuning->set_priority ? tuning->priority : base) + adjust;
+    if (priority < MIN_PRIORITY) priority = MIN_PRIORITY;
+    if (priority > MAX_PRIORITY) priority = MAX_PRIORITY;
+
+    tuning->set_priority = TRUE_VALUE;
+    tuning->priority = priority;
+    return i;
+}
+
+/* ---
+Function Name: parse_affinity
+
+Purpose:
+    Parses "affinity CPULIST", where CPULIST is comma-separated CPU
+    numbers and ranges (as in taskset -c), e.g. "0", "1-3", "0,2,4-5".
+
+Input:
+    argv   - command words
+    i      - index after the keyword
+    tuning - settings to update
+
+Output:
+    Index of the next word, or -1 if the list is invalid.
+--- */
+static int parse_affinity(char **argv, int i, StageTuning *tuning)
+{
+    const char *list = argv[i];
+    if (!list) return ERROR_CODE;
+
+    CPU_ZERO(&tuning->cpus);
+    int pos = ZERO_VALUE;
+    while (list[pos]) {
+        int first = ZERO_VALUE, last;
+        if (list[pos] < ZERO_CHAR || list[pos] > NINE_CHAR) return ERROR_CODE;
+        while (list[pos] >= ZERO_CHAR && list[pos] <= NINE_CHAR)
+            first = first * DECIMAL_BASE + (list[pos++] - ZERO_CHAR);
+        last = first;
+
+        if (list[pos] == RANGE_CHAR) {
+            pos++;
+            last = ZERO_VALUE;
+            if (list[pos] < ZERO_CHAR || list[pos] > NINE_CHAR) return ERROR_CODE;
+            while (list[pos] >= ZERO_CHAR && list[pos] <= NINE_CHAR)
+                last = last * DECIMAL_BASE + (list[pos++] - ZERO_CHAR);
+        }
+        if (last < first || last >= CPU_SETSIZE) return ERROR_CODE;
+        for (int cpu = first; cpu <= last; cpu++) CPU_SET(cpu, &tuning->cpus);
+
+        if (list[pos] == LIST_SEPARATOR_CHAR) pos++;
+        else if (list[pos]) return ERROR_CODE;
+    }
+
+    tuning->set_affinity = TRUE_VALUE;
+    return i + TRUE_VALUE;
+}
+
+/* ---
+Function Name: parse_ulimit
+
+Purpose:
+    Parses "ulimit -X VALUE [-Y VALUE ...]" in prefix form.
+
+Input:
+    argv   - command words
+    i      - index after the keyword
+    tuning - settings to update
+
+Output:
+    Index of the next word, or -1 if an option or value is invalid.
+--- */
+static int parse_ulimit(char **argv, int i, StageTuning *tuning)
+{
+    int first = i;
+    while (argv[i] && argv[i][ZERO_VALUE] == OPTION_CHAR) {
+        const UlimitResource *res = NULL;
+        if (argv[i][TRUE_VALUE] != NULL_CHAR && argv[i][OPTION_WITH_VALUE_ARGS] == NULL_CHAR)
+            res = find_ulimit_resource(argv[i][TRUE_VALUE]);
+        if (!res || !argv[i + TRUE_VALUE] || tuning->num_rlimits == MAX_STAGE_RLIMITS)
+            return ERROR_CODE;
+
+        StageRlimit *limit = &tuning->rlimits[tuning->num_rlimits];
+        if (!parse_rlimit_value(argv[i + TRUE_VALUE], res, &limit->value)) return ERROR_CODE;
+        limit->resource = res->resource;
+        tuning->num_rlimits++;
+        i += OPTION_WITH_VALUE_ARGS;
+    }
+    return (i == first) ? ERROR_CODE : i;
+}
+
+/* ---
+Function Name: parse_int
+
+Purpose:
+    Parses an optionally negative decimal integer.
+
+Input:
+    text  - number text
+    value - output
+
+Output:
+    Returns 1 on success, 0 if text is not a number.
+--- */
+static int parse_int(const char *text, int *value)
+{
+    int sign = TRUE_VALUE, i = ZERO_VALUE, n = ZERO_VALUE;
+    if (text[i] == OPTION_CHAR) {
+        sign = ERROR_CODE;
+        i++;
+    }
+    if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return ZERO_VALUE;
+    for (; text[i]; i++) {
+        if (text[i] < ZERO_CHAR || text[i] > NINE_CHAR) return ZERO_VALUE;
+        n = n * DECIMAL_BASE + (text[i] - ZERO_CHAR);
+    }
+    *value = sign * n;
+    return TRUE_VALUE;
+}
@@ -0,0 +1,78 @@
+#ifndef STAGETUNE_H
+#define STAGETUNE_H
+
+#include "jobs.h"
+#include <sched.h>          /* cpu_set_t */
+#include <sys/resource.h>   /* rlim_t */
+
+/* STAGE PREFIX KEYWORDS */
+#define NICE_KEYWORD            "nice"
+#define AFFINITY_KEYWORD        "affinity"
+#define ULIMIT_KEYWORD          "ulimit"
+#define NICE_VALUE_OPTION       "-n"
+#define UNLIMITED_TEXT          "unlimited"
+
+/* LIMITS */
+#define MAX_STAGE_RLIMITS       8
+#define OPTION_WITH_VALUE_ARGS  2
+#define DEFAULT_NICE_ADJUST     10
+#define MIN_PRIORITY            -20
+#define MAX_PRIORITY            19
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define OPTION_CHAR             '-'
+#define RANGE_CHAR              '-'
+#define LIST_SEPARATOR_CHAR     ','
+#define ZERO_CHAR               '0'
+#define NINE_CHAR               '9'
+#define DECIMAL_BASE            10
+#define UNIT_BYTES              1
+#define UNIT_KILOBYTES          1024
+
+/* ONE RESOURCE 'ulimit' KNOWS ABOUT */
+typedef struct
+{
+    char flag;              /* option letter, e.g. 'n' for -n */
+    int resource;           /* RLIMIT_* */
+    int unit;               /* bytes per unit of the user's value */
+    const char *name;
+} UlimitResource;
+
+/* ONE RLIMIT TO SET IN A STAGE */
+typedef struct
+{
+    int resource;
+    rlim_t value;
+} StageRlimit;
+
+/* PER-STAGE PROCESS SETTINGS FROM nice/affinity/ulimit PREFIXES */
+typedef struct StageTuning
+{
+    int set_priority;
+    int priority;           /* absolute nice value for setpriority() */
+    int set_affinity;
+    cpu_set_t cpus;
+    int num_rlimits;
+    StageRlimit rlimits[MAX_STAGE_RLIMITS];
+} StageTuning;
+
+/* FUNCTION DECLARATIONS */
+int parse_stage_tuning(Command *cmd, StageTuning *tuning);
+int apply_stage_tuning(StageTuning *tuning);
+int is_tuning_prefix(char **argv);
+const UlimitResource *find_ulimit_resource(char flag);
+const UlimitResource *ulimit_resource_at(int index);
+int parse_rlimit_value(const char *text, const UlimitResource *res, rlim_t *value);
+
+/* STATIC HELPER FUNCTIONS */
+static int parse_prefix(char **argv, int start, StageTuning *tuning);
+static int parse_nice(char **argv, int i, StageTuning *tuning);
+static int parse_affinity(char **argv, int i, StageTuning *tuning);
+static int parse_ulimit(char **argv, int i, StageTuning *tuning);
+static int parse_int(const char *text, int *value);
+
+#endif
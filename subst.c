@@ -0,0 +1,569 @@
+#define _GNU_SOURCE    /* memfd_create, splice; cpu_set_t in stagetune.h */
+#include "subst.h"
+#include "getjob.h"
+#include "runjob.h"
+#include "builtin.h"
+#include "flow.h"
+#include "stagetune.h"
+#include "jobtable.h"
+#include "trace.h"
+#include "errors.h"
+#include "myheap.h"
+#include "mystring.h"
+
+#include <unistd.h>       /* fork, pipe2, dup, dup2, read, write */
+#include <fcntl.h>        /* O_CLOEXEC, splice */
+#include <signal.h>       /* sigprocmask */
+#include <errno.h>
+#include <sys/mman.h>     /* memfd_create, mmap */
+#include <sys/wait.h>     /* waitpid */
+
+/* Large outputs of the current command line, unmapped before the next */
+static SubstSpill spills[SUBST_MAX_SPILLS];
+static int num_spills = ZERO_VALUE;
+
+/* ---
+Function Name: has_substitution
+
+Purpose:
+    Checks whether a word contains a command substitution.
+
+Input:
+    word - null-terminated word
+
+Output:
+    Non-zero if the word contains "$(".
+--- */
+int has_substitution(const char *word)
+{
+    for (int i = ZERO_VALUE; word[i] != NULL_CHAR; i++) {
+        if (word[i] == SUBST_START_CHAR && word[i + TRUE_VALUE] == SUBST_OPEN_CHAR)
+            return TRUE_VALUE;
+    }
+    return ZERO_VALUE;
+}
+
+/* ---
+Function Name: substitution_end
+
+Purpose:
+    Finds the end of the "$(...)" starting at text[i], counting nested
+    parentheses, so the parser keeps blanks and '|' inside it.
+
+Input:
+    text - command text
+    i    - index of the '$'
+
+Output:
+    Index just past the matching ')', or of the terminating null
+    character if it is missing.
+--- */
+int substitution_end(const char *text, int i)
+{
+    int depth = TRUE_VALUE;
+    int j = i + SUBST_PREFIX_LEN;
+    while (text[j] != NULL_CHAR && depth > ZERO_VALUE) {
+        if (text[j] == SUBST_OPEN_CHAR) depth++;
+        else if (text[j] == SUBST_CLOSE_CHAR) depth--;
+        j++;
+    }
+    return j;
+}
+
+/* ---
+Function Name: substitute_command
+
+Purpose:
+    Replaces argument 'pos' with the words produced by its "$(...)"
+    parts. The output of each command is split at blanks and newlines
+    in place: the fields become arguments without being copied, unless
+    they are joined to text around the substitution ("v$(cat VERSION)").
+    An argument that expands to nothing is removed.
+
+Input:
+    cmd  - command being expanded
+    pos  - index of the argument containing "$("
+    envp - environment variables
+
+Output:
+    Updates cmd->argv and cmd->argc; returns the index just past the
+    inserted arguments, or -1 (after reporting it) if they do not fit.
+--- */
+int substitute_command(Command *cmd, int pos, char *envp[])
+{
+    char *word = cmd->argv[pos];
+    char *words[MAX_ARGS];
+    int count = ZERO_VALUE;
+
+    char *cur = NULL;             /* word being built, cur_len bytes */
+    int cur_len = ZERO_VALUE;
+    int lit_start = ZERO_VALUE;
+    int i = ZERO_VALUE;
+    int overflow = ZERO_VALUE;
+
+    for (;;) {
+        int at_subst = (word[i] == SUBST_START_CHAR && word[i + TRUE_VALUE] == SUBST_OPEN_CHAR);
+        if (!at_subst && word[i] != NULL_CHAR) {
+            i++;
+            continue;
+        }
+
+        /* literal text before this point joins the current word */
+        if (i > lit_start) {
+            if (!cur) {
+                cur = word + lit_start;
+                cur_len = i - lit_start;
+            } else {
+                char *joined = join_words(cur, cur_len, word + lit_start, i - lit_start);
+                if (joined) cur = joined;
+                cur_len = joined ? cur_len + i - lit_start : cur_len;
+            }
+        }
+        if (!at_subst) break;
+
+        int end = substitution_end(word, i);
+        int closed = (word[end - TRUE_VALUE] == SUBST_CLOSE_CHAR && end > i + SUBST_PREFIX_LEN);
+        int out_len = ZERO_VALUE;
+        char *out = capture_output(word + i + SUBST_PREFIX_LEN, end - i - SUBST_PREFIX_LEN - closed,
+                                   envp, &out_len);
+
+        /* trailing newlines are dropped, so "v$(cat f).txt" is one word */
+        while (out && out_len > ZERO_VALUE && out[out_len - TRUE_VALUE] == NEWLINE_CHAR) out_len--;
+
+        for (int k = ZERO_VALUE; out && k < out_len;) {
+            if (is_field_separator(out[k])) {
+                /* a blank ends the word being built */
+                if (cur && count < MAX_ARGS) {
+                    words[count++] = (cur[cur_len] == NULL_CHAR) ? cur : join_words(cur, cur_len, NULL, ZERO_VALUE);
+                    if (!words[count - TRUE_VALUE]) count--;
+                } else if (cur) {
+                    overflow = TRUE_VALUE;
+                }
+                cur = NULL;
+                while (k < out_len && is_field_separator(out[k])) k++;
+                continue;
+            }
+
+            int start = k;
+            while (k < out_len && !is_field_separator(out[k])) k++;
+            out[k] = NULL_CHAR;   /* the separator, or the byte past the output */
+            if (!cur) {
+                cur = out + start;
+                cur_len = k - start;
+            } else {
+                char *joined = join_words(cur, cur_len, out + start, k - start);
+                if (joined) cur = joined;
+                cur_len = joined ? cur_len + k - start : cur_len;
+            }
+            if (k < out_len) {
+                /* out[k] was a separator: the field is complete */
+                if (count < MAX_ARGS) words[count++] = cur;
+                else overflow = TRUE_VALUE;
+                cur = NULL;
+                k++;
+            }
+        }
+
+        i = end;
+        lit_start = end;
+    }
+
+    if (cur && count < MAX_ARGS) {
+        words[count++] = (cur[cur_len] == NULL_CHAR) ? cur : join_words(cur, cur_len, NULL, ZERO_VALUE);
+        if (!words[count - TRUE_VALUE]) count--;
+    } else if (cur) {
+        overflow = TRUE_VALUE;
+    }
+
+    /* splice the words in place of the argument */
+    if (overflow || (int)cmd->argc - TRUE_VALUE + count > MAX_ARGS) {
+        print_error(ERR_ARG_EXCD);
+        set_exit_status(SUBST_FAILURE_STATUS);
+        return ERROR_CODE;
+    }
+    int shift = count - TRUE_VALUE;
+    if (shift > ZERO_VALUE) {
+        for (int k = cmd->argc; k > pos; k--)
+            cmd->argv[k + shift] = cmd->argv[k];
+    } else if (shift < ZERO_VALUE) {
+        for (int k = pos + TRUE_VALUE; k <= (int)cmd->argc; k++)
+            cmd->argv[k + shift] = cmd->argv[k];
+    }
+    cmd->argc += shift;
+    for (int k = ZERO_VALUE; k < count; k++)
+        cmd->argv[pos + k] = words[k];
+    return pos + count;
+}
+
+/* ---
+Function Name: release_substitutions
+
+Purpose:
+    Unmaps the outputs that were too large for the heap. Called once the
+    command line that used them is finished, like free_all().
+
+Input:
+    None
+
+Output:
+    Frees the mappings.
+--- */
+void release_substitutions(void)
+{
+    for (int i = ZERO_VALUE; i < num_spills; i++)
+        munmap(spills[i].data, spills[i].len);
+    num_spills = ZERO_VALUE;
+}
+
+/* ---
+Function Name: capture_output
+
+Purpose:
+    Parses and runs the command inside "$(...)" and collects its
+    standard output. A single builtin runs without a fork where that
+    is safe, and a function in a forked copy of the shell; anything
+    else is started with spawn_job() and read through a pipe. The
+    command's status becomes $?.
+
+Input:
+    text    - command text (not null-terminated)
+    len     - length of text
+    envp    - environment variables
+    out_len - receives the length of the output
+
+Output:
+    Returns the output, null-terminated and writable, or NULL if there
+    is none.
+--- */
+static char *capture_output(const char *text, int len, char *envp[], int *out_len)
+{
+    *out_len = ZERO_VALUE;
+    char *line = alloc(len + TRUE_VALUE);
+    if (!line) return NULL;
+    for (int i = ZERO_VALUE; i < len; i++) line[i] = text[i];
+    line[len] = NULL_CHAR;
+
+    Job inner;
+    parse_job_line(&inner, line);
+    if (inner.num_stages == ZERO_VALUE) return NULL;
+
+    for (int s = ZERO_VALUE; s < (int)inner.num_stages; s++) {
+        if (!expand_variables(&inner.pipeline[s], envp) || inner.pipeline[s].argc == ZERO_VALUE)
+            return NULL;
+    }
+    if (!expand_redirections(&inner, envp)) return NULL;
+    inner.background = ZERO_VALUE;
+
+    char **argv = inner.pipeline[ZERO_VALUE].argv;
+    int function = find_function(argv[ZERO_VALUE]);
+    if (function != NO_FUNCTION && inner.num_stages == TRUE_VALUE)
+        return run_subshell_captured(argv, NOT_BUILTIN, function, envp, out_len);
+    int builtin = find_builtin(argv[ZERO_VALUE]);
+    if (builtin != NOT_BUILTIN && inner.num_stages == TRUE_VALUE && !is_tuning_prefix(argv))
+        return run_builtin_captured(&inner, builtin, envp, out_len);
+    return run_job_captured(&inner, envp, out_len);
+}
+
+/* ---
+Function Name: run_builtin_captured
+
+Purpose:
+    Runs a builtin with its standard output captured. Builtins that only
+    report (jobs, history, ...) run in the shell with stdout pointed at
+    a memfd, so no process is created; the others run in a forked copy
+    of the shell, as in a subshell (see run_subshell_captured()).
+
+Input:
+    job     - parsed single-stage job
+    builtin - builtin table index
+    envp    - environment variables
+    out_len - receives the length of the output
+
+Output:
+    Returns the output (see read_output()); sets $?.
+--- */
+static char *run_builtin_captured(Job *job, int builtin, char *envp[], int *out_len)
+{
+    char **argv = job->pipeline[ZERO_VALUE].argv;
+    int mfd = builtin_runs_in_process(builtin) ? memfd_create(SUBST_MEMFD_NAME, MFD_CLOEXEC) : ERROR_CODE;
+    if (mfd < ZERO_VALUE) return run_subshell_captured(argv, builtin, NO_FUNCTION, envp, out_len);
+
+    int saved = dup(STDOUT_FILENO);
+    dup2(mfd, STDOUT_FILENO);
+    int status = run_builtin(builtin, argv, envp);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    lseek(mfd, ZERO_VALUE, SEEK_SET);
+    char *out = read_output(mfd, out_len);
+    close(mfd);
+    set_exit_status(status);
+    return out;
+}
+
+/* ---
+Function Name: run_subshell_captured
+
+Purpose:
+    Runs a builtin or a function in a forked copy of the shell with its
+    standard output on a pipe, so that what it changes (the directory,
+    variables) is left behind with the copy.
+
+Input:
+    argv     - the command's words
+    builtin  - builtin table index, or NOT_BUILTIN for a function
+    function - function index (see find_function())
+    envp     - environment variables
+    out_len  - receives the length of the output
+
+Output:
+    Returns the output (see read_output()); sets $?.
+--- */
+static char *run_subshell_captured(char **argv, int builtin, int function, char *envp[], int *out_len)
+{
+    char *out = NULL;
+    int status;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < ZERO_VALUE) {
+        print_error(ERR_PIPE_FAIL);
+        set_exit_status(SUBST_FAILURE_STATUS);
+        return NULL;
+    }
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+
+    int pid = fork();
+    if (pid == ZERO_VALUE) {
+        sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+        dup2(p[TRUE_VALUE], STDOUT_FILENO);
+        _exit(builtin != NOT_BUILTIN ? run_builtin(builtin, argv, envp) : call_function(function, argv, envp));
+    }
+    close(p[TRUE_VALUE]);
+
+    if (pid < ZERO_VALUE) {
+        print_error(ERR_FORK_FAIL);
+        status = SUBST_FAILURE_STATUS;
+    } else {
+        out = read_output(p[ZERO_VALUE], out_len);
+        while (waitpid(pid, &status, ZERO_VALUE) < ZERO_VALUE && errno == EINTR)
+            continue;
+        status = wait_status_to_exit_code(status);
+    }
+    close(p[ZERO_VALUE]);
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    set_exit_status(status);
+    return out;
+}
+
+/* ---
+Function Name: run_job_captured
+
+Purpose:
+    Starts a job with spawn_job(), its last stage writing to a pipe,
+    reads the pipe until every writer has exited, then reaps the
+    stages. The job has the terminal meanwhile, so Ctrl+C stops it.
+
+Input:
+    job     - parsed job
+    envp    - environment variables
+    out_len - receives the length of the output
+
+Output:
+    Returns the output (see read_output()); sets $? to the status of
+    the last stage.
+--- */
+static char *run_job_captured(Job *job, char *envp[], int *out_len)
+{
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < ZERO_VALUE) {
+        print_error(ERR_PIPE_FAIL);
+        set_exit_status(SUBST_FAILURE_STATUS);
+        return NULL;
+    }
+    if (job->out_fd == NO_FD) job->out_fd = p[TRUE_VALUE];   /* not for '>&N' */
+
+    /* as in run_job(): reap the stages here, not in the SIGCHLD handler */
+    sigset_t chld_mask, prev_mask, child_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+    child_mask = prev_mask;
+    sigdelset(&child_mask, SIGCHLD);
+
+    int started = spawn_job(job, envp, &child_mask);
+    close(p[TRUE_VALUE]);
+    if (!started) {
+        close(p[ZERO_VALUE]);
+        sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+        set_exit_status(SUBST_FAILURE_STATUS);
+        return NULL;
+    }
+
+    int interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+
+    char *out = read_output(p[ZERO_VALUE], out_len);
+    close(p[ZERO_VALUE]);
+
+    int status = ZERO_VALUE;
+    for (int i = ZERO_VALUE; i < (int)job->num_stages; i++) {
+        struct rusage usage;
+        int reaped;
+        while ((reaped = wait4(job->pids[i], &status, ZERO_VALUE, &usage)) < ZERO_VALUE && errno == EINTR)
+            continue;
+        if (reaped == job->pids[i]) trace_stage_reaped(i, status, &usage);
+    }
+
+    if (interactive) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+    trace_job_end(job);
+    set_exit_status(wait_status_to_exit_code(status));
+    return out;
+}
+
+/* ---
+Function Name: read_output
+
+Purpose:
+    Reads a descriptor to the end straight into the free part of the
+    heap, which is then allocated to fit, so the output is never
+    copied. Output that would leave less than SUBST_HEAP_RESERVE bytes
+    of heap is moved to a memfd instead (see spill_output()).
+
+Input:
+    fd      - pipe or memfd to read
+    out_len - receives the number of bytes read
+
+Output:
+    Returns the output with a null character after it, or NULL.
+--- */
+static char *read_output(int fd, int *out_len)
+{
+    unsigned int avail = heap_available();
+    int room = (avail > SUBST_HEAP_RESERVE) ? (int)(avail - SUBST_HEAP_RESERVE) : ZERO_VALUE;
+    char *buf = heap_mark();
+    int len = ZERO_VALUE;
+
+    for (;;) {
+        if (len == room) return spill_output(fd, buf, len, out_len);
+        int n = read(fd, buf + len, room - len);
+        if (n < ZERO_VALUE && errno == EINTR) continue;
+        if (n <= ZERO_VALUE) break;
+        len += n;
+    }
+
+    alloc(len + TRUE_VALUE);
+    buf[len] = NULL_CHAR;
+    *out_len = len;
+    return buf;
+}
+
+/* ---
+Function Name: spill_output
+
+Purpose:
+    Moves output that does not fit in the heap to a memfd: what was
+    read so far is written to it, and the rest of a pipe is moved with
+    splice() without passing through the shell. The memfd is then
+    mapped privately, so fields can still be split in place; the
+    mapping is kept until release_substitutions().
+
+Input:
+    fd      - descriptor being read
+    start   - bytes already read (in the free part of the heap)
+    len     - number of those bytes
+    out_len - receives the total length
+
+Output:
+    Returns the mapped output with a null character after it, or NULL.
+--- */
+static char *spill_output(int fd, char *start, int len, int *out_len)
+{
+    if (num_spills == SUBST_MAX_SPILLS) return NULL;
+    int mfd = memfd_create(SUBST_MEMFD_NAME, MFD_CLOEXEC);
+    if (mfd < ZERO_VALUE) return NULL;
+
+    size_t total = ZERO_VALUE;
+    for (int done = ZERO_VALUE; done < len;) {
+        int n = write(mfd, start + done, len - done);
+        if (n <= ZERO_VALUE) break;
+        done += n;
+        total += n;
+    }
+
+    char chunk[SUBST_READ_LEN];
+    for (;;) {
+        ssize_t n = splice(fd, NULL, mfd, NULL, SUBST_READ_LEN, ZERO_VALUE);
+        if (n < ZERO_VALUE && errno == EINVAL) {
+            /* not a pipe (a builtin's memfd): copy it */
+            n = read(fd, chunk, SUBST_READ_LEN);
+            if (n > ZERO_VALUE) n = write(mfd, chunk, n);
+        }
+        if (n < ZERO_VALUE && errno == EINTR) continue;
+        if (n <= ZERO_VALUE) break;
+        total += n;
+    }
+
+    /* one more byte for the terminating null character */
+    char *data = MAP_FAILED;
+    if (ftruncate(mfd, total + TRUE_VALUE) == ZERO_VALUE)
+        data = mmap(NULL, total + TRUE_VALUE, PROT_READ | PROT_WRITE, MAP_PRIVATE, mfd, ZERO_VALUE);
+    close(mfd);
+    if (data == MAP_FAILED) return NULL;
+
+    spills[num_spills].data = data;
+    spills[num_spills].len = total + TRUE_VALUE;
+    num_spills++;
+    data[total] = NULL_CHAR;
+    *out_len = (int)total;
+    return data;
+}
+
+/* ---
+Function Name: join_words
+
+Purpose:
+    Concatenates two pieces of a word on the heap.
+
+Input:
+    a, a_len - first piece
+    b, b_len - second piece (b may be NULL if b_len is 0)
+
+Output:
+    Returns the null-terminated copy, or NULL if the heap is full.
+--- */
+static char *join_words(const char *a, int a_len, const char *b, int b_len)
+{
+    char *copy = alloc(a_len + b_len + TRUE_VALUE);
+    if (!copy) return NULL;
+    for (int i = ZERO_VALUE; i < a_len; i++) copy[i] = a[i];
+    for (int i = ZERO_VALUE; i < b_len; i++) copy[a_len + i] = b[i];
+    copy[a_len + b_len] = NULL_CHAR;
+    return copy;
+}
+
+/* ---
+Function Name: is_field_separator
+
+Purpose:
+    Checks whether a byte of command output separates words.
+
+Input:
+    c - byte
+
+Output:
+    Non-zero for blanks and newlines.
+--- */
+static int is_field_separator(char c)
+{
+    return c == SPACE_CHAR || c == TAB_CHAR || c == NEWLINE_CHAR;
+}
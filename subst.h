@@ -0,0 +1,54 @@
+#ifndef SUBST_H
+#define SUBST_H
+
+#include "jobs.h"
+
+#include <stddef.h>         /* size_t */
+
+/* SYNTAX */
+#define SUBST_START_CHAR        '$'
+#define SUBST_OPEN_CHAR         '('
+#define SUBST_CLOSE_CHAR        ')'
+#define SUBST_PREFIX_LEN        2       /* "$(" */
+#define SPACE_CHAR              ' '
+#define TAB_CHAR                '\t'
+#define NEWLINE_CHAR            '\n'
+
+/* OUTPUT CAPTURE */
+#define SUBST_MEMFD_NAME        "mysh-subst"
+#define SUBST_HEAP_RESERVE      65536   /* heap left for the command itself */
+#define SUBST_READ_LEN          65536
+#define SUBST_MAX_SPILLS        16
+
+/* NUMERIC CONSTANTS */
+#define ZERO_VALUE              0
+#define TRUE_VALUE              1
+#define ERROR_CODE              -1
+#define NULL_CHAR               '\0'
+#define SUBST_FAILURE_STATUS    1
+
+/* OUTPUT THAT DID NOT FIT IN THE HEAP
+   It is kept in a mapped memfd until the next command line. */
+typedef struct
+{
+    char *data;
+    size_t len;
+} SubstSpill;
+
+/* FUNCTION DECLARATIONS */
+int has_substitution(const char *word);
+int substitution_end(const char *text, int i);
+int substitute_command(Command *cmd, int pos, char *envp[]);
+void release_substitutions(void);
+
+/* STATIC HELPER FUNCTIONS */
+static char *capture_output(const char *text, int len, char *envp[], int *out_len);
+static char *run_builtin_captured(Job *job, int builtin, char *envp[], int *out_len);
+static char *run_subshell_captured(char **argv, int builtin, int function, char *envp[], int *out_len);
+static char *run_job_captured(Job *job, char *envp[], int *out_len);
+static char *read_output(int fd, int *out_len);
+static char *spill_output(int fd, char *start, int len, int *out_len);
+static char *join_words(const char *a, int a_len, const char *b, int b_len);
+static int is_field_separator(char c);
+
+#endif
@@ -0,0 +1,579 @@
+#include "getjob.h"
+#include "runjob.h"
+#include "jobtable.h"
+#include "pathcache.h"
+#include "mystring.h"
+#include "myheap.h"
+#include "errors.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/* BENCHMARK CONSTANTS */
+#define NS_PER_SEC          1000000000.0
+#define BYTES_PER_MB        (1024.0 * 1024.0)
+#define LINE_LEN            1024
+#define ENV_PATH_LEN        8192
+#define PARSE_ITERS         200000
+#define ALLOC_ITERS         200000
+#define ALLOC_BLOCK         16
+#define ALLOC_PER_RESET     64
+#define RESOLVE_ITERS       2000
+#define SPAWN_ITERS         100
+#define PIPE_ITERS          3
+#define PIPE_FILE_MB        64
+#define PIPE_CHUNK          65536
+#define JOBTABLE_ITERS      200000
+#define MAX_CAT_CHAIN       4
+#define BENCH_FILE          "/tmp/mysh_bench_input.bin"
+#define SORT_FILE           "/tmp/mysh_bench_lines.txt"
+#define SORT_LINES          400000
+#define SORT_DISTINCT       5000
+#define SORT_ITERS          3
+#define MAX_ENV             256
+#define ENV_VAR_LEN         64
+#define MAKE_TARGETS        5000
+#define MAKE_FILE           "/tmp/mysh_bench_targets.mk"
+#define MAKE_SHELLS         2
+#define TEE_COPY_FILE       "/tmp/mysh_bench_tee_copy.bin"
+#define TEE_KINDS           2
+
+/* FUNCTION DECLARATIONS */
+static double now_sec(void);
+static void report(const char *name, const char *param_name, int param,
+                   long iters, double seconds, double bytes);
+static void clear_job(Job *job);
+static void build_line(char *line, int stages, int args);
+
+static void bench_parse_pipeline(void);
+static void bench_parse_stage(void);
+static void bench_alloc(void);
+static void bench_resolve(char *envp[]);
+static void bench_spawn(char *envp[]);
+static void bench_pipe_throughput(char *envp[]);
+static void bench_pipe_sizes(char *envp[]);
+static void bench_tee_fanout(char *envp[]);
+static char **env_with(char *envp[], char **copy, char *extra);
+static void bench_job_table(void);
+static void bench_make_shell(char *envp[]);
+
+/* MAIN BENCHMARK DRIVER */
+int main(int argc, char *argv[], char *envp[])
+{
+    bench_parse_pipeline();
+    bench_parse_stage();
+    bench_alloc();
+    bench_resolve(envp);
+    bench_spawn(envp);
+    bench_pipe_throughput(envp);
+    bench_pipe_sizes(envp);
+    bench_tee_fanout(envp);
+    bench_job_table();
+    bench_make_shell(envp);
+    return 0;
+}
+
+/* FUNCTION DEFINITIONS */
+/* ---
+Function Name: now_sec
+Purpose:
+    Reads the monotonic clock.
+Output:
+    Current time in seconds as a double.
+--- */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / NS_PER_SEC;
+}
+
+/* ---
+Function Name: report
+Purpose:
+    Prints one benchmark result as a JSON line so runs can be diffed and
+    checked for regressions by scripts.
+Input:
+    name       - benchmark name
+    param_name - name of the varied parameter (NULL if none)
+    param      - parameter value
+    iters      - number of operations timed
+    seconds    - elapsed time
+    bytes      - bytes moved (0 if not a throughput benchmark)
+Output:
+    Writes a record to stdout.
+--- */
+static void report(const char *name, const char *param_name, int param,
+                   long iters, double seconds, double bytes)
+{
+    printf("{\"bench\":\"%s\"", name);
+    if (param_name) printf(",\"%s\":%d", param_name, param);
+    printf(",\"iters\":%ld,\"seconds\":%.6f,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f",
+           iters, seconds, seconds * NS_PER_SEC / iters, iters / seconds);
+    if (bytes > 0) printf(",\"mb_per_sec\":%.1f", bytes / BYTES_PER_MB / seconds);
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* ---
+Function Name: clear_job
+Purpose:
+    Resets a Job structure before it is filled in by hand.
+--- */
+static void clear_job(Job *job)
+{
+    memset(job, 0, sizeof(*job));
+    job->in_fd = NO_FD;
+    job->out_fd = NO_FD;
+}
+
+/* ---
+Function Name: build_line
+Purpose:
+    Generates a synthetic command line with the given shape, e.g.
+    "cmd0 arg0 arg1 | cmd1 arg0 arg1 < in.txt > out.txt".
+Input:
+    line   - output buffer (LINE_LEN bytes)
+    stages - number of pipeline stages
+    args   - arguments per stage
+--- */
+static void build_line(char *line, int stages, int args)
+{
+    line[0] = '\0';
+    for (int s = 0; s < stages; s++) {
+        char word[32];
+        snprintf(word, sizeof(word), "%scommand%d", s ? " | " : "", s);
+        strcat(line, word);
+        for (int a = 0; a < args; a++) {
+            snprintf(word, sizeof(word), " --option%d", a);
+            strcat(line, word);
+        }
+    }
+    strcat(line, " < input.txt > output.txt");
+}
+
+/* ---
+Function Name: bench_parse_pipeline
+Purpose:
+    Measures parse_job_line (pipeline splitting + stage tokenizing)
+    throughput for several line shapes.
+--- */
+static void bench_parse_pipeline(void)
+{
+    static const int shapes[][2] = { {1, 1}, {1, 8}, {3, 4}, {MAX_PIPELINE_LEN, 4} };
+    char line[LINE_LEN];
+    char work[LINE_LEN];
+    Job job;
+
+    for (int k = 0; k < (int)(sizeof(shapes) / sizeof(shapes[0])); k++) {
+        build_line(line, shapes[k][0], shapes[k][1]);
+        size_t len = strlen(line) + 1;
+
+        double start = now_sec();
+        for (long i = 0; i < PARSE_ITERS; i++) {
+            memcpy(work, line, len);
+            parse_job_line(&job, work);
+            free_all();
+        }
+        double elapsed = now_sec() - start;
+
+        char name[64];
+        snprintf(name, sizeof(name), "parse_pipeline_args%d", shapes[k][1]);
+        report(name, "stages", shapes[k][0], PARSE_ITERS, elapsed, (double)len * PARSE_ITERS);
+    }
+}
+
+/* ---
+Function Name: bench_parse_stage
+Purpose:
+    Measures parse_stage on a single stage string with many arguments.
+--- */
+static void bench_parse_stage(void)
+{
+    char line[LINE_LEN];
+    char work[LINE_LEN];
+    Job job;
+
+    build_line(line, 1, 16);
+    size_t len = strlen(line) + 1;
+
+    double start = now_sec();
+    for (long i = 0; i < PARSE_ITERS; i++) {
+        memcpy(work, line, len);
+        set_job(&job);
+        parse_stage(&job.pipeline[0], work, &job);
+        free_all();
+    }
+    double elapsed = now_sec() - start;
+    report("parse_stage", "args", 16, PARSE_ITERS, elapsed, (double)len * PARSE_ITERS);
+}
+
+/* ---
+Function Name: bench_alloc
+Purpose:
+    Measures the cost of alloc() and of free_all() on the arena heap.
+--- */
+static void bench_alloc(void)
+{
+    double start = now_sec();
+    for (long i = 0; i < ALLOC_ITERS; i++) {
+        for (int j = 0; j < ALLOC_PER_RESET; j++)
+            alloc(ALLOC_BLOCK);
+        free_all();
+    }
+    double elapsed = now_sec() - start;
+    report("alloc", "block_bytes", ALLOC_BLOCK, (long)ALLOC_ITERS * ALLOC_PER_RESET, elapsed, 0);
+
+    start = now_sec();
+    for (long i = 0; i < ALLOC_ITERS; i++)
+        free_all();
+    elapsed = now_sec() - start;
+    report("free_all", NULL, 0, ALLOC_ITERS, elapsed, 0);
+}
+
+/* ---
+Function Name: bench_resolve
+Purpose:
+    Measures resolve_command_path latency as the number of PATH entries
+    ahead of the directory that holds the command grows.
+--- */
+static void bench_resolve(char *envp[])
+{
+    static const int path_lengths[] = { 1, 4, 16, 64 };
+    char path_env[ENV_PATH_LEN];
+
+    for (int k = 0; k < (int)(sizeof(path_lengths) / sizeof(path_lengths[0])); k++) {
+        strcpy(path_env, "PATH=");
+        for (int d = 1; d < path_lengths[k]; d++) {
+            char dir[32];
+            snprintf(dir, sizeof(dir), "/nx/d%d:", d);
+            strcat(path_env, dir);
+        }
+        strcat(path_env, "/bin");
+
+        char *bench_envp[] = { path_env, NULL };
+
+        double start = now_sec();
+        for (long i = 0; i < RESOLVE_ITERS; i++) {
+            resolve_command_path("ls", bench_envp);
+            free_all();
+        }
+        double elapsed = now_sec() - start;
+        report("resolve_command_path", "path_dirs", path_lengths[k], RESOLVE_ITERS, elapsed, 0);
+
+        start = now_sec();
+        for (long i = 0; i < RESOLVE_ITERS; i++) {
+            lookup_command_path("ls", bench_envp);
+            free_all();
+        }
+        elapsed = now_sec() - start;
+        report("lookup_command_path_cached", "path_dirs", path_lengths[k], RESOLVE_ITERS, elapsed, 0);
+    }
+    (void)envp;
+}
+
+/* ---
+Function Name: bench_spawn
+Purpose:
+    Measures end-to-end run_job latency for pipelines of 1..10 "true"
+    stages. ns_per_op is per job; the per-stage cost is reported as a
+    separate record.
+--- */
+static void bench_spawn(char *envp[])
+{
+    Job job;
+
+    for (int stages = 1; stages <= MAX_PIPELINE_LEN; stages++) {
+        double start = now_sec();
+        for (long i = 0; i < SPAWN_ITERS; i++) {
+            clear_job(&job);
+            job.num_stages = stages;
+            for (int s = 0; s < stages; s++) {
+                job.pipeline[s].argc = 1;
+                job.pipeline[s].argv[0] = "true";
+                job.pipeline[s].argv[1] = NULL;
+            }
+            run_job(&job, envp);
+        }
+        double elapsed = now_sec() - start;
+        report("spawn_pipeline", "stages", stages, SPAWN_ITERS, elapsed, 0);
+        report("spawn_per_stage", "stages", stages, (long)SPAWN_ITERS * stages, elapsed, 0);
+    }
+}
+
+/* ---
+Function Name: bench_pipe_throughput
+Purpose:
+    Measures bytes per second pushed through "cat < file | cat | ... > /dev/null"
+    chains of increasing length.
+--- */
+static void bench_pipe_throughput(char *envp[])
+{
+    static char chunk[PIPE_CHUNK];
+    int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    memset(chunk, 'x', sizeof(chunk));
+    for (int i = 0; i < PIPE_FILE_MB * (int)(BYTES_PER_MB / PIPE_CHUNK); i++)
+        write(fd, chunk, sizeof(chunk));
+    close(fd);
+
+    Job job;
+    double bytes = PIPE_FILE_MB * BYTES_PER_MB;
+
+    for (int stages = 1; stages <= MAX_CAT_CHAIN; stages++) {
+        double start = now_sec();
+        for (long i = 0; i < PIPE_ITERS; i++) {
+            clear_job(&job);
+            job.num_stages = stages;
+            job.infile_path = BENCH_FILE;
+            job.outfile_path = "/dev/null";
+            for (int s = 0; s < stages; s++) {
+                job.pipeline[s].argc = 1;
+                job.pipeline[s].argv[0] = "cat";
+                job.pipeline[s].argv[1] = NULL;
+            }
+            run_job(&job, envp);
+        }
+        double elapsed = now_sec() - start;
+        report("pipe_cat_chain", "stages", stages, PIPE_ITERS, elapsed, bytes * PIPE_ITERS);
+    }
+
+    unlink(BENCH_FILE);
+}
+
+/* ---
+Function Name: bench_tee_fanout
+Purpose:
+    Measures "cat < file | tee copy | cat > /dev/null" with the shell's
+    own tee stage (tee(2)/splice(2), see fanout.c) and with /usr/bin/tee,
+    which copies every byte through user space.
+--- */
+static void bench_tee_fanout(char *envp[])
+{
+    static const char *tees[TEE_KINDS] = { "tee", "/usr/bin/tee" };
+    static const char *names[TEE_KINDS] = { "tee_stage_splice", "tee_stage_program" };
+    static char chunk[PIPE_CHUNK];
+
+    int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    memset(chunk, 'x', sizeof(chunk));
+    for (int i = 0; i < PIPE_FILE_MB * (int)(BYTES_PER_MB / PIPE_CHUNK); i++)
+        write(fd, chunk, sizeof(chunk));
+    close(fd);
+
+    Job job;
+    double bytes = PIPE_FILE_MB * BYTES_PER_MB;
+
+    for (int k = 0; k < TEE_KINDS; k++) {
+        double start = now_sec();
+        for (long i = 0; i < PIPE_ITERS; i++) {
+            clear_job(&job);
+            job.num_stages = 3;
+            job.infile_path = BENCH_FILE;
+            job.outfile_path = "/dev/null";
+            for (int s = 0; s < 3; s++) {
+                job.pipeline[s].argc = 1;
+                job.pipeline[s].argv[0] = "cat";
+                job.pipeline[s].argv[1] = NULL;
+            }
+            job.pipeline[1].argc = 2;
+            job.pipeline[1].argv[0] = (char *)tees[k];
+            job.pipeline[1].argv[1] = TEE_COPY_FILE;
+            job.pipeline[1].argv[2] = NULL;
+            run_job(&job, envp);
+        }
+        double elapsed = now_sec() - start;
+        report(names[k], "stages", 3, PIPE_ITERS, elapsed, bytes * PIPE_ITERS);
+    }
+
+    unlink(TEE_COPY_FILE);
+    unlink(BENCH_FILE);
+}
+
+/* ---
+Function Name: env_with
+Purpose:
+    Copies an environment array and appends one extra "NAME=value" entry.
+Input:
+    envp  - source environment
+    copy  - destination array (MAX_ENV entries)
+    extra - entry to append, or NULL
+Output:
+    Returns copy.
+--- */
+static char **env_with(char *envp[], char **copy, char *extra)
+{
+    int n = 0;
+    for (int i = 0; envp[i] && n < MAX_ENV - 2; i++)
+        copy[n++] = envp[i];
+    if (extra) copy[n++] = extra;
+    copy[n] = NULL;
+    return copy;
+}
+
+/* ---
+Function Name: bench_pipe_sizes
+Purpose:
+    Measures "cat < file | sort | uniq > /dev/null" and a four-stage cat
+    chain at several MYSH_PIPE_SIZE settings (0 = kernel default).
+--- */
+static void bench_pipe_sizes(char *envp[])
+{
+    static const int sizes_kb[] = { 0, 256, 1024 };
+    static const char *sort_cmds[] = { "cat", "sort", "uniq" };
+
+    FILE *f = fopen(SORT_FILE, "w");
+    if (!f) return;
+    for (int i = 0; i < SORT_LINES; i++)
+        fprintf(f, "log entry %07d from worker\n", (i * 7919) % SORT_DISTINCT);
+    fclose(f);
+    struct stat st;
+    double sort_bytes = stat(SORT_FILE, &st) == 0 ? (double)st.st_size : 0;
+
+    int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    static char chunk[PIPE_CHUNK];
+    memset(chunk, 'x', sizeof(chunk));
+    for (int i = 0; i < PIPE_FILE_MB * (int)(BYTES_PER_MB / PIPE_CHUNK); i++)
+        write(fd, chunk, sizeof(chunk));
+    close(fd);
+
+    Job job;
+    char *env_copy[MAX_ENV];
+    char size_var[ENV_VAR_LEN];
+
+    for (int k = 0; k < (int)(sizeof(sizes_kb) / sizeof(sizes_kb[0])); k++) {
+        snprintf(size_var, sizeof(size_var), "MYSH_PIPE_SIZE=%dK", sizes_kb[k]);
+        char **run_envp = env_with(envp, env_copy, sizes_kb[k] ? size_var : NULL);
+
+        double start = now_sec();
+        for (long i = 0; i < SORT_ITERS; i++) {
+            clear_job(&job);
+            job.num_stages = 3;
+            job.infile_path = SORT_FILE;
+            job.outfile_path = "/dev/null";
+            for (int s = 0; s < 3; s++) {
+                job.pipeline[s].argc = 1;
+                job.pipeline[s].argv[0] = (char *)sort_cmds[s];
+                job.pipeline[s].argv[1] = NULL;
+            }
+            run_job(&job, run_envp);
+        }
+        double elapsed = now_sec() - start;
+        report("pipe_cat_sort_uniq", "pipe_size_kb", sizes_kb[k], SORT_ITERS, elapsed,
+               sort_bytes * SORT_ITERS);
+
+        start = now_sec();
+        for (long i = 0; i < PIPE_ITERS; i++) {
+            clear_job(&job);
+            job.num_stages = MAX_CAT_CHAIN;
+            job.infile_path = BENCH_FILE;
+            job.outfile_path = "/dev/null";
+            for (int s = 0; s < MAX_CAT_CHAIN; s++) {
+                job.pipeline[s].argc = 1;
+                job.pipeline[s].argv[0] = "cat";
+                job.pipeline[s].argv[1] = NULL;
+            }
+            run_job(&job, run_envp);
+        }
+        elapsed = now_sec() - start;
+        report("pipe_cat_chain4", "pipe_size_kb", sizes_kb[k], PIPE_ITERS, elapsed,
+               PIPE_FILE_MB * BYTES_PER_MB * PIPE_ITERS);
+    }
+
+    unlink(SORT_FILE);
+    unlink(BENCH_FILE);
+}
+
+/* ---
+Function Name: bench_job_table
+Purpose:
+    Measures add_job/remove_job on a full job table and the pid lookup the
+    SIGCHLD handler performs for every reaped child.
+--- */
+static void bench_job_table(void)
+{
+    Job job;
+    clear_job(&job);
+    job.num_stages = 1;
+    job.pipeline[0].argc = 1;
+    job.pipeline[0].argv[0] = "sleep";
+
+    /* fill all but one slot so every add scans the whole table */
+    JobEntry *filled[MAX_JOBS];
+    for (int i = 0; i < MAX_JOBS - 1; i++) {
+        job.pids[0] = job.pgid = i + 1;
+        filled[i] = add_job(&job);
+    }
+
+    double start = now_sec();
+    for (long i = 0; i < JOBTABLE_ITERS; i++) {
+        job.pids[0] = job.pgid = MAX_JOBS;
+        JobEntry *entry = add_job(&job);
+        if (entry) remove_job(entry);
+    }
+    double elapsed = now_sec() - start;
+    report("job_table_add", "capacity", MAX_JOBS, JOBTABLE_ITERS, elapsed, 0);
+
+    volatile int found = 0;
+    start = now_sec();
+    for (long i = 0; i < JOBTABLE_ITERS; i++) {
+        int pid = (int)(i % (MAX_JOBS - 1)) + 1;
+        if (find_job_by_pid(pid)) found++;
+    }
+    elapsed = now_sec() - start;
+    report("job_table_lookup", "jobs", MAX_JOBS - 1, JOBTABLE_ITERS, elapsed, 0);
+
+    for (int i = 0; i < MAX_JOBS - 1; i++)
+        if (filled[i]) remove_job(filled[i]);
+}
+
+/* ---
+Function Name: bench_make_shell
+Purpose:
+    Builds a synthetic Makefile of MAKE_TARGETS independent targets, one
+    recipe line each, with SHELL=/bin/sh and with SHELL=./mysh (run
+    from the repository root, as 'make bench' does). Each recipe line
+    is one 'SHELL -c' invocation, so this measures shell startup plus
+    the exec of the last command.
+--- */
+static void bench_make_shell(char *envp[])
+{
+    static const char *shells[MAKE_SHELLS] = { "SHELL=/bin/sh", "SHELL=./mysh" };
+    static const char *names[MAKE_SHELLS] = { "make_targets_sh", "make_targets_mysh" };
+
+    FILE *mk = fopen(MAKE_FILE, "w");
+    if (!mk) return;
+    fprintf(mk, "all:");
+    for (int i = 0; i < MAKE_TARGETS; i++) fprintf(mk, " t%d", i);
+    fprintf(mk, "\n.PHONY: all\n");
+    for (int i = 0; i < MAKE_TARGETS; i++) fprintf(mk, "t%d:\n\t@cat /dev/null > /dev/null\n", i);
+    fclose(mk);
+
+    if (access("./mysh", X_OK) < 0) return;
+
+    Job job;
+    for (int k = 0; k < MAKE_SHELLS; k++) {
+        clear_job(&job);
+        job.num_stages = 1;
+        job.pipeline[0].argv[0] = "make";
+        job.pipeline[0].argv[1] = "-s";
+        job.pipeline[0].argv[2] = "-f";
+        job.pipeline[0].argv[3] = MAKE_FILE;
+        job.pipeline[0].argv[4] = (char *)shells[k];
+        job.pipeline[0].argv[5] = NULL;
+        job.pipeline[0].argc = 5;
+
+        double start = now_sec();
+        run_job(&job, envp);
+        double elapsed = now_sec() - start;
+        report(names[k], "targets", MAKE_TARGETS, MAKE_TARGETS, elapsed, 0);
+    }
+    unlink(MAKE_FILE);
+}
@@ -3,23 +3,62 @@
 #include "myheap.h"
 #include "errors.h"
 #include "jobs.h"
+#include "alias.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 /* STRING FORMAT CONSTANTS*/
 #define TEST_SEPERATOR "-------------------------------------------------\n"
 
+/* SCRIPT TESTS: run the built shell, from the repository root */
+#define MYSH_PATH "./mysh"
+#define SCRIPT_OUTPUT_LEN 4096
+#define SCRIPT_INPUT_FILE "script_input.txt"
+#define SCRIPT_RC_FILE "script_rc.txt"
+#define SCRIPT_SNAP_FILE SCRIPT_RC_FILE ".snap"
+#define SCRIPT_GLOB_DIR "script_glob_dir"
+#define SCRIPT_TEE_FILE "script_tee.txt"
+#define SCRIPT_TEE_FILE2 "script_tee2.txt"
+#define SCRIPT_HIST_FILE "script_hist.txt"
+#define SCRIPT_HIST_INDEX SCRIPT_HIST_FILE ".idx"
+
+/* Number of script tests whose output differed from the expected */
+static int script_failures = 0;
+
 /* FUNCTION DECLARATIONS */
 static void print_job(Job *job);
 static void test_normal_command();
 static void test_pipeline_command();
 static void test_background_command();
 static void test_redirection_command();
+static void test_alias_command();
 static void test_bytes_read_negative();
 static void test_bytes_read_zero();
 static void test_bytes_read_overflow();
 static void test_get_job_from_stdin();
+static void run_script(const char *script, char *output);
+static void check_script(const char *name, const char *script, const char *expected);
+static void check_script_contains(const char *name, const char *script, const char *expected);
+static void test_break_continue_in_if();
+static void test_break_continue_in_case();
+static void test_parallel_input();
+static void test_signalled_job_status();
+static void test_snapshot_invalidation();
+static void test_glob_patterns();
+static void test_shell_functions();
+static void test_command_substitution();
+static void test_coprocesses();
+static void test_tee_stages();
+static void test_wait_builtin();
+static void test_job_scheduler();
+static void test_exec_last_command();
+static void test_piped_input_history();
+static void test_pipeline_status();
+static void test_process_substitution();
 
 /* MAIN TEST DRIVER */
 int main(void)
@@ -28,15 +67,35 @@ int main(void)
     test_pipeline_command();
     test_background_command();
     test_redirection_command();
+    test_alias_command();
     test_bytes_read_negative();
     test_bytes_read_zero();
     test_bytes_read_overflow();
 
+    printf("\n=== Shell Script Tests ===\n");
+    setenv("MYSH_RC", "", 1);
+    test_break_continue_in_if();
+    test_break_continue_in_case();
+    test_parallel_input();
+    test_signalled_job_status();
+    test_snapshot_invalidation();
+    test_glob_patterns();
+    test_shell_functions();
+    test_command_substitution();
+    test_coprocesses();
+    test_tee_stages();
+    test_wait_builtin();
+    test_job_scheduler();
+    test_exec_last_command();
+    test_piped_input_history();
+    test_pipeline_status();
+    test_process_substitution();
+
     printf("Integration test: get_job() reading from stdin\n");
     printf("Feed input via stdin (Ctrl+D to end if typing manually)\n");
     test_get_job_from_stdin();
 
-    return 0;
+    return script_failures != 0;
 }
 
 /* FUNCTION DEFINITIONS */
@@ -149,6 +208,28 @@ static void test_redirection_command()
     print_job(&job);
 }
 
+/* ---
+Function Name: test_alias_command
+Purpose:
+    Tests alias expansion of a stage's first word, through an alias of
+    an alias, with the recursion stopped at 'ls'
+--- */
+static void test_alias_command()
+{
+    Job job;
+    char command[] = "ll /tmp";
+
+    define_alias("ls", "ls -F");
+    define_alias("ll", "ls -l");
+    set_job(&job);
+    parse_stage(&job.pipeline[job.num_stages], command, &job);
+    job.num_stages++;
+    clear_aliases();
+
+    printf("Test: ll /tmp (alias ll='ls -l', alias ls='ls -F')\n");
+    print_job(&job);
+}
+
 /* ---
 Function Name: test_bytes_read_negative
 Purpose:
@@ -202,3 +283,572 @@ static void test_get_job_from_stdin()
 
     print_job(&job);
 }
+
+/* ---
+Function Name: run_script
+Purpose:
+    Runs a script with 'mysh -c' (no rc file) and collects its standard
+    output
+Input:
+    script - script text, lines separated by newlines
+    output - SCRIPT_OUTPUT_LEN bytes
+Output:
+    output holds what the script wrote, null-terminated
+--- */
+static void run_script(const char *script, char *output)
+{
+    size_t len = 0;
+    int out[2];
+
+    output[0] = '\0';
+    fflush(stdout);
+    if (pipe(out) < 0) return;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(out[1]);
+        execl(MYSH_PATH, MYSH_PATH, "-c", script, (char *)NULL);
+        _exit(127);
+    }
+    close(out[1]);
+    ssize_t got;
+    while (len < SCRIPT_OUTPUT_LEN - 1 && (got = read(out[0], output + len, SCRIPT_OUTPUT_LEN - 1 - len)) > 0)
+        len += got;
+    output[len] = '\0';
+    close(out[0]);
+    waitpid(pid, NULL, 0);
+}
+
+/* ---
+Function Name: check_script
+Purpose:
+    Runs a script and compares its standard output with the expected text
+Input:
+    name     - test name
+    script   - script text, lines separated by newlines
+    expected - exact standard output
+Output:
+    Prints the output and PASS or FAIL; counts failures
+--- */
+static void check_script(const char *name, const char *script, const char *expected)
+{
+    char output[SCRIPT_OUTPUT_LEN];
+
+    printf("Test: %s\n", name);
+    run_script(script, output);
+    printf("%s", output);
+    if (strcmp(output, expected) == 0) {
+        printf("PASS\n");
+    } else {
+        printf("FAIL, expected:\n%s", expected);
+        script_failures++;
+    }
+    printf(TEST_SEPERATOR);
+}
+
+/* ---
+Function Name: check_script_contains
+Purpose:
+    Runs a script and looks for a line in its standard output, for
+    output that also holds PIDs
+Input:
+    name     - test name
+    script   - script text, lines separated by newlines
+    expected - text the output must contain
+Output:
+    Prints the output and PASS or FAIL; counts failures
+--- */
+static void check_script_contains(const char *name, const char *script, const char *expected)
+{
+    char output[SCRIPT_OUTPUT_LEN];
+
+    printf("Test: %s\n", name);
+    run_script(script, output);
+    printf("%s", output);
+    if (strstr(output, expected)) {
+        printf("PASS\n");
+    } else {
+        printf("FAIL, expected to contain:\n%s", expected);
+        script_failures++;
+    }
+    printf(TEST_SEPERATOR);
+}
+
+/* ---
+Function Name: test_break_continue_in_if
+Purpose:
+    Tests that break and continue inside an if body leave or restart the
+    enclosing loop, not just the if
+--- */
+static void test_break_continue_in_if()
+{
+    check_script("break inside if, in for",
+                 "for i in 1 2 3 4; do if [ $i -eq 3 ]; then break; fi; echo $i; done\n"
+                 "echo end\n",
+                 "1\n2\nend\n");
+    check_script("continue inside if, in for",
+                 "for i in 1 2 3 4; do if [ $i -eq 2 ]; then continue; fi; echo $i; done\n",
+                 "1\n3\n4\n");
+    check_script("break inside else, in while",
+                 "while true; do if false; then echo no; else echo yes; break; fi; done\n"
+                 "echo end\n",
+                 "yes\nend\n");
+    check_script("break inside if, in inner for",
+                 "for i in a b; do for j in 1 2 3; do if [ $j -eq 2 ]; then break; fi; echo $i$j; done; done\n",
+                 "a1\nb1\n");
+}
+
+/* ---
+Function Name: test_break_continue_in_case
+Purpose:
+    Tests that break and continue inside a case branch leave or restart
+    the enclosing loop, not just the case
+--- */
+static void test_break_continue_in_case()
+{
+    check_script("break inside case, in for",
+                 "for i in 1 2 3 4; do case $i in 3) break;; esac; echo $i; done\n"
+                 "echo end\n",
+                 "1\n2\nend\n");
+    check_script("continue inside case, in for",
+                 "for i in 1 2 3 4; do case $i in 2) continue;; *) echo $i;; esac; done\n",
+                 "1\n3\n4\n");
+    check_script("break inside case inside if, in for",
+                 "for i in 1 2 3; do if true; then case $i in 2) break;; esac; fi; echo $i; done\n",
+                 "1\n");
+    check_script("break inside case, in until",
+                 "until false; do case x in x) echo x; break;; esac; echo no; done\n"
+                 "echo end\n",
+                 "x\nend\n");
+}
+
+/* ---
+Function Name: test_parallel_input
+Purpose:
+    Tests that parallel reads its lines from a preceding pipeline stage
+    or a '<' redirection, writes to a '>' redirection, and is refused
+    before another stage
+--- */
+static void test_parallel_input()
+{
+    FILE *f = fopen(SCRIPT_INPUT_FILE, "w");
+    if (!f) return;
+    fputs("a\nb\nc\n", f);
+    fclose(f);
+
+    check_script("seq 3 | parallel -k echo n",
+                 "seq 3 | parallel -k echo n\n",
+                 "n 1\nn 2\nn 3\n");
+    check_script("pipeline of two stages into parallel",
+                 "seq 3 | sort -r | parallel -k echo n\n",
+                 "n 3\nn 2\nn 1\n");
+    check_script("parallel -k echo f < " SCRIPT_INPUT_FILE,
+                 "parallel -k echo f < " SCRIPT_INPUT_FILE "\n"
+                 "echo end\n",
+                 "f a\nf b\nf c\nend\n");
+    check_script("parallel output redirection",
+                 "seq 2 | parallel -k echo o > " SCRIPT_INPUT_FILE "\n"
+                 "cat " SCRIPT_INPUT_FILE "\n",
+                 "o 1\no 2\n");
+    check_script("parallel before another stage is refused",
+                 "parallel echo | cat\n"
+                 "echo end\n",
+                 "end\n");
+    remove(SCRIPT_INPUT_FILE);
+}
+
+/* ---
+Function Name: test_signalled_job_status
+Purpose:
+    Tests that a background job killed by a signal is reported by the
+    signal, not as Done, and that its status is 128 + the signal
+--- */
+static void test_signalled_job_status()
+{
+    check_script_contains("kill %1 reports Terminated",
+                          "sleep 5 &\n"
+                          "kill %1\n"
+                          "sleep 0.2\n"
+                          "echo end\n",
+                          "[1]+ Terminated\tsleep 5\nend\n");
+    check_script_contains("kill -KILL %1 reports Killed",
+                          "sleep 5 | cat &\n"
+                          "kill -KILL %1\n"
+                          "sleep 0.2\n"
+                          "echo end\n",
+                          "[1]+ Killed\tsleep 5 | cat\nend\n");
+    check_script_contains("a finished job is Done",
+                          "true &\n"
+                          "sleep 0.2\n"
+                          "echo end\n",
+                          "[1]+ Done\ttrue\nend\n");
+    check_script_contains("wait returns 143 for a terminated job",
+                          "sleep 5 &\n"
+                          "kill %1\n"
+                          "wait %1\n"
+                          "echo status $?\n",
+                          "\nstatus 143\n");
+}
+
+/* ---
+Function Name: test_snapshot_invalidation
+Purpose:
+    Tests that the rc snapshot is written, reused while nothing changes,
+    and rebuilt when a variable the rc branches on, or the rc itself,
+    changes
+--- */
+static void test_snapshot_invalidation()
+{
+    FILE *f = fopen(SCRIPT_RC_FILE, "w");
+    if (!f) return;
+    fputs("if [ x$MYSH_TEST_MODE = xon ]; then alias greet='echo on'; else alias greet='echo off'; fi\n", f);
+    fclose(f);
+    remove(SCRIPT_SNAP_FILE);
+    setenv("MYSH_RC", SCRIPT_RC_FILE, 1);
+
+    setenv("MYSH_TEST_MODE", "on", 1);
+    check_script("rc sourced with MYSH_TEST_MODE=on", "greet\n", "on\n");
+    printf("Test: snapshot written\n%s\n", access(SCRIPT_SNAP_FILE, F_OK) == 0 ? "PASS" : "FAIL");
+    if (access(SCRIPT_SNAP_FILE, F_OK) != 0) script_failures++;
+    printf(TEST_SEPERATOR);
+    check_script("snapshot reused", "greet\n", "on\n");
+
+    unsetenv("MYSH_TEST_MODE");
+    check_script("MYSH_TEST_MODE unset rebuilds the snapshot", "greet\n", "off\n");
+    setenv("MYSH_TEST_MODE", "on", 1);
+    check_script("MYSH_TEST_MODE set again rebuilds it", "greet\n", "on\n");
+
+    f = fopen(SCRIPT_RC_FILE, "w");
+    if (f) {
+        fputs("alias greet='echo changed'\n", f);
+        fclose(f);
+    }
+    check_script("a changed rc rebuilds the snapshot", "greet\n", "changed\n");
+
+    unsetenv("MYSH_TEST_MODE");
+    setenv("MYSH_RC", "", 1);
+    remove(SCRIPT_RC_FILE);
+    remove(SCRIPT_SNAP_FILE);
+}
+
+/* ---
+Function Name: test_glob_patterns
+Purpose:
+    Tests pathname patterns: byte-order sorting, hidden names, ?, classes
+    and negated classes, patterns in directory components, trailing '/',
+    and a pattern that matches nothing
+--- */
+static void test_glob_patterns()
+{
+    char output[SCRIPT_OUTPUT_LEN];
+    run_script("mkdir -p " SCRIPT_GLOB_DIR "/sub " SCRIPT_GLOB_DIR "/sub2\n"
+               "cd " SCRIPT_GLOB_DIR "\n"
+               "touch a.log b.log B.log .hidden.log c.txt core.1 core.x sub/Makefile\n",
+               output);
+
+    check_script("* sorted in byte order",
+                 "cd " SCRIPT_GLOB_DIR "\necho *.log\n",
+                 "B.log a.log b.log\n");
+    check_script(".* matches hidden names but not . or ..",
+                 "cd " SCRIPT_GLOB_DIR "\necho .*\n",
+                 ".hidden.log\n");
+    check_script("? matches one character",
+                 "cd " SCRIPT_GLOB_DIR "\necho ?.txt\n",
+                 "c.txt\n");
+    check_script("character class and negated class",
+                 "cd " SCRIPT_GLOB_DIR "\necho core.[0-9]* [ab].log\necho core.[!0-9]\n",
+                 "core.1 a.log b.log\ncore.x\n");
+    check_script("patterns in directory components",
+                 "cd " SCRIPT_GLOB_DIR "\necho */Makefile sub*/Make*\n",
+                 "sub/Makefile sub/Makefile\n");
+    check_script("trailing / matches only directories",
+                 "cd " SCRIPT_GLOB_DIR "\necho */\n",
+                 "sub/ sub2/\n");
+    check_script("a pattern matching nothing is kept",
+                 "cd " SCRIPT_GLOB_DIR "\necho *.none\n",
+                 "*.none\n");
+    check_script("pattern in a for list",
+                 "cd " SCRIPT_GLOB_DIR "\nfor f in *.txt core.*; do echo got $f; done\n",
+                 "got c.txt\ngot core.1\ngot core.x\n");
+
+    run_script("rm -r " SCRIPT_GLOB_DIR "\n", output);
+}
+
+/* ---
+Function Name: test_shell_functions
+Purpose:
+    Tests functions: parameters, locals hiding an outer variable until
+    return, return status, ${10}, return from inside a loop, and a
+    function run by $(...)
+--- */
+static void test_shell_functions()
+{
+    check_script("parameters, locals and return status",
+                 "export v=outer\n"
+                 "g() { echo in g $v; }\n"
+                 "f() {\n"
+                 "  local v=inner\n"
+                 "  echo in f $v $# $1 $2\n"
+                 "  g\n"
+                 "  return 3\n"
+                 "}\n"
+                 "f a b\n"
+                 "echo status $? v $v\n",
+                 "in f inner 2 a b\nin g inner\nstatus 3 v outer\n");
+    check_script("${10} and $#",
+                 "h() { echo ${10} $#; }\n"
+                 "h 1 2 3 4 5 6 7 8 9 ten\n",
+                 "ten 10\n");
+    check_script("return inside a loop inside if",
+                 "r() { for i in $@; do if [ $i -eq 2 ]; then return 7; fi; echo $i; done; echo no; }\n"
+                 "r 1 2 3\n"
+                 "echo status $?\n",
+                 "1\nstatus 7\n");
+    check_script("function in $(...)",
+                 "g() { echo from g $1; }\n"
+                 "echo got $(g x)\n",
+                 "got from g x\n");
+}
+
+/* ---
+Function Name: test_command_substitution
+Purpose:
+    Tests $(...): text around it stays attached, output is split into
+    words, nesting, a subshell's cd does not leak out, and a single
+    100000-byte word
+--- */
+static void test_command_substitution()
+{
+    check_script("attached text and word splitting",
+                 "echo x$(echo a)y v$(seq 3)x\n"
+                 "echo $(seq 1000) | wc -w\n",
+                 "xay v1 2 3x\n1000\n");
+    check_script("nested substitution",
+                 "echo $(echo $(echo nested))\n",
+                 "nested\n");
+    check_script("cd inside $(...) stays in the subshell",
+                 "export d=$(pwd)\n"
+                 "echo $(cd /)\n"
+                 "if [ $(pwd) = $d ]; then echo same; fi\n",
+                 "\nsame\n");
+    check_script("100000-byte output",
+                 "echo $(head -c 100000 /dev/zero | tr -c x y) | wc -c\n",
+                 "100001\n");
+}
+
+/* ---
+Function Name: test_coprocesses
+Purpose:
+    Tests coproc: two requests to one helper through >&N and <&N, and
+    reading what a helper wrote before it exited, after its PID variable
+    is gone
+--- */
+static void test_coprocesses()
+{
+    check_script("two requests to one coprocess",
+                 "coproc TAG sed -u s/^/got:/\n"
+                 "echo hello >&${TAG[1]}\n"
+                 "head -n 1 <&${TAG[0]}\n"
+                 "echo world >&${TAG[1]}\n"
+                 "echo reply $(head -n 1 <&${TAG[0]})\n",
+                 "got:hello\nreply got:world\n");
+    check_script("output of an exited coprocess",
+                 "coproc E seq 2\n"
+                 "sleep 0.2\n"
+                 "echo pid x${E_PID}x\n"
+                 "cat <&$E\n",
+                 "pid xx\n1\n2\n");
+}
+
+/* ---
+Function Name: test_tee_stages
+Purpose:
+    Tests tee stages run by the shell: several files, -a, an input larger
+    than a pipe, and a file that cannot be opened
+--- */
+static void test_tee_stages()
+{
+    check_script("tee to two files and a pipe",
+                 "seq 3 | tee " SCRIPT_TEE_FILE " " SCRIPT_TEE_FILE2 " | wc -l\n"
+                 "cat " SCRIPT_TEE_FILE " " SCRIPT_TEE_FILE2 "\n",
+                 "3\n1\n2\n3\n1\n2\n3\n");
+    check_script("tee -a appends",
+                 "seq 2 | tee " SCRIPT_TEE_FILE " > /dev/null\n"
+                 "seq 3 4 | tee -a " SCRIPT_TEE_FILE " > /dev/null\n"
+                 "cat " SCRIPT_TEE_FILE "\n",
+                 "1\n2\n3\n4\n");
+    check_script("input larger than a pipe",
+                 "seq 200000 | tee " SCRIPT_TEE_FILE " | wc -c\n"
+                 "wc -c < " SCRIPT_TEE_FILE "\n",
+                 "1288895\n1288895\n");
+    check_script("a file that cannot be opened",
+                 "seq 2 | tee /nonexistent/" SCRIPT_TEE_FILE "\n"
+                 "echo status $?\n",
+                 "1\n2\nstatus 1\n");
+    remove(SCRIPT_TEE_FILE);
+    remove(SCRIPT_TEE_FILE2);
+}
+
+/* ---
+Function Name: test_wait_builtin
+Purpose:
+    Tests wait -t timing out with 124, wait -n returning the status of
+    the job that finished, and 127 for an unknown job
+--- */
+static void test_wait_builtin()
+{
+    check_script_contains("wait -t times out with 124",
+                          "sleep 2 &\n"
+                          "wait -t 0.2 %1\n"
+                          "echo status $?\n"
+                          "kill %1\n",
+                          "\nstatus 124\n");
+    check_script_contains("wait -n returns the finished job's status",
+                          "jobs -j 4\n"
+                          "sleep 0.2 | false &\n"
+                          "wait -n\n"
+                          "echo status $?\n",
+                          "\nstatus 1\n");
+    check_script("wait for an unknown job gives 127",
+                 "wait %9\n"
+                 "echo status $?\n",
+                 "status 127\n");
+}
+
+/* ---
+Function Name: test_job_scheduler
+Purpose:
+    Tests the background job limit: jobs -j sets and prints it, a job
+    past the limit is listed as queued, and wait runs queued jobs
+--- */
+static void test_job_scheduler()
+{
+    check_script("jobs -j sets and prints the limit",
+                 "jobs -j 3\n"
+                 "jobs -j\n",
+                 "3\n");
+    check_script_contains("a job past the limit is queued",
+                          "jobs -j 1\n"
+                          "sleep 0.3 &\n"
+                          "echo second &\n"
+                          "jobs\n"
+                          "wait\n",
+                          "[Q1] Queued\techo second\n");
+    check_script_contains("wait runs queued jobs",
+                          "jobs -j 1\n"
+                          "sleep 0.2 &\n"
+                          "seq 2 > " SCRIPT_INPUT_FILE " &\n"
+                          "wait\n"
+                          "cat " SCRIPT_INPUT_FILE "\n",
+                          "\n1\n2\n");
+    remove(SCRIPT_INPUT_FILE);
+}
+
+/* ---
+Function Name: test_exec_last_command
+Purpose:
+    Tests that 'mysh -c' replaces itself with its last command only at
+    the top level: a last line calling a function, or a loop, still runs
+    every command in it
+--- */
+static void test_exec_last_command()
+{
+    check_script("last line is a plain command",
+                 "echo one\n"
+                 "echo two > " SCRIPT_INPUT_FILE "\n",
+                 "one\n");
+    check_script("last line calls a multi-command function",
+                 "g() {\n"
+                 "echo one\n"
+                 "echo two\n"
+                 "}\n"
+                 "g\n",
+                 "one\ntwo\n");
+    check_script("last line is a loop",
+                 "for i in 1 2; do echo $i; done\n",
+                 "1\n2\n");
+    remove(SCRIPT_INPUT_FILE);
+}
+
+/* ---
+Function Name: test_piped_input_history
+Purpose:
+    Tests that lines piped into the shell are neither history-expanded
+    nor recorded, even with MYSH_HISTFILE set
+--- */
+static void test_piped_input_history()
+{
+    FILE *f = fopen(SCRIPT_INPUT_FILE, "w");
+    if (!f) return;
+    fputs("echo hi\necho wow!e\necho a!zz\n", f);
+    fclose(f);
+    setenv("MYSH_HISTFILE", SCRIPT_HIST_FILE, 1);
+
+    check_script("! in piped input is not expanded or recorded",
+                 MYSH_PATH " < " SCRIPT_INPUT_FILE "\n"
+                 "cat " SCRIPT_HIST_FILE "\n",
+                 "mysh$ hi\nmysh$ wow!e\nmysh$ a!zz\nmysh$ ");
+
+    unsetenv("MYSH_HISTFILE");
+    remove(SCRIPT_INPUT_FILE);
+    remove(SCRIPT_HIST_FILE);
+    remove(SCRIPT_HIST_INDEX);
+}
+
+/* ---
+Function Name: test_pipeline_status
+Purpose:
+    Tests $? and PIPESTATUS with and without set -o pipefail, and 127
+    for a stage that is not found
+--- */
+static void test_pipeline_status()
+{
+    check_script("$? and PIPESTATUS without pipefail",
+                 "false | true\n"
+                 "echo $? ${PIPESTATUS[@]} ${PIPESTATUS[0]} $PIPESTATUS\n",
+                 "0 1 0 1 1\n");
+    check_script("set -o pipefail returns the failing stage",
+                 "set -o pipefail\n"
+                 "false | true\n"
+                 "echo $? ${PIPESTATUS[0]} ${PIPESTATUS[1]}\n"
+                 "true | true\n"
+                 "echo $?\n",
+                 "1 1 0\n0\n");
+    check_script("set +o pipefail restores the last stage's status",
+                 "set -o pipefail\n"
+                 "set +o pipefail\n"
+                 "false | true\n"
+                 "echo $?\n",
+                 "0\n");
+    check_script("a stage that is not found gives 127",
+                 "true | nonexistentcmd\n"
+                 "echo $? ${PIPESTATUS[@]}\n"
+                 "nonexistentcmd\n"
+                 "echo $?\n",
+                 "127 0 127\n127\n");
+}
+
+/* ---
+Function Name: test_process_substitution
+Purpose:
+    Tests <(...) as input files, >(...) as an output file, and both in
+    one pipeline. The output of a >(...) command arrives after the
+    shell's own, so each of those scripts prints nothing else.
+--- */
+static void test_process_substitution()
+{
+    check_script("cat <(echo a) <(echo b)",
+                 "cat <(echo a) <(echo b)\n",
+                 "a\nb\n");
+    check_script("diff of two <(...)",
+                 "diff <(seq 2) <(seq 2)\n"
+                 "echo status $?\n",
+                 "status 0\n");
+    check_script("echo x > >(cat)",
+                 "echo x > >(cat)\n",
+                 "x\n");
+    check_script("tee into >(wc -l)",
+                 "seq 3 | tee >(wc -l) > /dev/null\n",
+                 "3\n");
+}
@@ -13,10 +13,6 @@
 /* STRING FORMAT CONSTANTS */
 #define TEST_SEPERATOR "-------------------------------------------------\n"
 
-/* Dummy globals for unit testing */
-Job jobs[MAX_JOBS];
-int num_jobs = 0;
-
 /* FUNCTION DECLARATIONS */
 static void print_job(Job *job);
 static void set_test_job(Job *job);
@@ -117,6 +113,9 @@ static void set_test_job(Job *job)
     job->background = 0;
     job->infile_path = NULL;
     job->outfile_path = NULL;
+    job->in_fd = NO_FD;
+    job->out_fd = NO_FD;
+    job->num_pass_fds = 0;
     for (int i = 0; i < MAX_PIPELINE_LEN; i++) {
         job->pipeline[i].argc = 0;
         for (int j = 0; j < MAX_ARGS; j++) job->pipeline[i].argv[j] = NULL;
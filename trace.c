@@ -0,0 +1,789 @@
+#include "trace.h"
+#include "mystring.h"
+#include "errors.h"
+#include "jobtable.h"
+
+#include <unistd.h>    /* write, close */
+#include <fcntl.h>     /* open */
+#include <time.h>      /* clock_gettime */
+#include <signal.h>    /* sigprocmask */
+#include <sys/wait.h>  /* WIFEXITED, WEXITSTATUS */
+
+static int trace_fd = TRACE_DISABLED_FD;
+static TraceRecord current;
+
+/* records of background jobs, kept until every stage has been reaped so
+   they carry exit statuses and rusage; filled in by the SIGCHLD handler */
+static TraceJob parked[TRACE_MAX_PARKED];
+
+/* asynchronous output ring: records are queued here while jobs run and
+   written to the trace file only from trace_flush() at idle points */
+static char trace_ring[TRACE_RING_SIZE];
+static unsigned int ring_head = ZERO_VALUE;   /* next byte to fill  */
+static unsigned int ring_tail = ZERO_VALUE;   /* next byte to write */
+
+/* ---
+Function Name: trace_init
+
+Purpose:
+    Enables tracing when MYSH_TRACE names a file. Every job run afterwards
+    produces one JSON record appended to that file.
+
+Input:
+    envp - environment variables
+
+Output:
+    Opens the trace file. Prints an error and leaves tracing disabled if
+    the file cannot be opened.
+--- */
+void trace_init(char *envp[])
+{
+    char *path = mygetenv(TRACE_ENV_NAME, envp);
+    if (!path || path[INITIAL_INDEX] == NULL_CHAR) return;
+
+    trace_fd = open(path, TRACE_FILE_FLAGS, TRACE_FILE_PERMISSIONS);
+    if (trace_fd < ZERO_VALUE) {
+        trace_fd = TRACE_DISABLED_FD;
+        print_error(ERR_TRACE_OPEN);
+    }
+}
+
+/* ---
+Function Name: trace_enabled
+
+Purpose:
+    Reports whether trace records are being collected.
+
+Input:
+    none
+
+Output:
+    Returns 1 if tracing is on, 0 otherwise.
+--- */
+int trace_enabled(void)
+{
+    return trace_fd != TRACE_DISABLED_FD;
+}
+
+/* ---
+Function Name: trace_now
+
+Purpose:
+    Reads the monotonic clock for interval measurements. Returns 0 without
+    touching the clock when tracing is off so untraced runs pay nothing.
+
+Input:
+    none
+
+Output:
+    Current monotonic time in nanoseconds, or 0 if tracing is disabled.
+--- */
+long long trace_now(void)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return ZERO_VALUE;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/* ---
+Function Name: trace_parse_done
+
+Purpose:
+    Records how long get_job spent parsing the most recent command line.
+
+Input:
+    parse_ns - parse duration in nanoseconds
+
+Output:
+    Stores the value for the next job record.
+--- */
+void trace_parse_done(long long parse_ns)
+{
+    current.parse_ns = parse_ns;
+}
+
+/* ---
+Function Name: trace_job_begin
+
+Purpose:
+    Starts a new trace record for a job about to be launched. The parse
+    time measured by get_job is kept.
+
+Input:
+    job - job being launched
+
+Output:
+    Resets per-stage fields of the current record.
+--- */
+void trace_job_begin(Job *job)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return;
+
+    current.start_ns = trace_now();
+    current.prepare_ns = ZERO_VALUE;
+    current.start_span_ns = ZERO_VALUE;
+    current.launch_ns = ZERO_VALUE;
+    current.wait_ns = ZERO_VALUE;
+    current.has_cgroup = FALSE;
+    for (int i = INITIAL_INDEX; i < MAX_PIPELINE_LEN; i++) {
+        TraceStage *stage = &current.stages[i];
+        stage->pid = ZERO_VALUE;
+        stage->status = ZERO_VALUE;
+        stage->reaped = FALSE;
+        stage->resolve_ns = ZERO_VALUE;
+        stage->spawn_ns = ZERO_VALUE;
+    }
+    (void)job;
+}
+
+/* ---
+Function Name: trace_stage_resolved
+
+Purpose:
+    Records the PATH resolution time of one pipeline stage.
+
+Input:
+    stage_index - stage number
+    resolve_ns  - duration of resolve_command_path
+
+Output:
+    Updates the current record.
+--- */
+void trace_stage_resolved(int stage_index, long long resolve_ns)
+{
+    current.stages[stage_index].resolve_ns = resolve_ns;
+}
+
+/* ---
+Function Name: trace_stage_spawned
+
+Purpose:
+    Records the pid and process creation latency of one pipeline stage.
+
+Input:
+    stage_index - stage number
+    pid         - child process id
+    spawn_ns    - time taken to create the child
+
+Output:
+    Updates the current record.
+--- */
+void trace_stage_spawned(int stage_index, int pid, long long spawn_ns)
+{
+    current.stages[stage_index].pid = pid;
+    current.stages[stage_index].spawn_ns = spawn_ns;
+}
+
+/* ---
+Function Name: trace_stage_reaped
+
+Purpose:
+    Records the wait status and resource usage of a finished stage.
+
+Input:
+    stage_index - stage number
+    status      - raw wait status
+    usage       - rusage returned by wait4
+
+Output:
+    Updates the current record.
+--- */
+void trace_stage_reaped(int stage_index, int status, struct rusage *usage)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return;
+
+    current.stages[stage_index].status = status;
+    current.stages[stage_index].reaped = TRUE;
+    current.stages[stage_index].usage = *usage;
+}
+
+/* ---
+Function Name: trace_job_prepared
+
+Purpose:
+    Records the time spent building the launch plan (PATH lookups and
+    pipe assignment) before the first stage was spawned.
+
+Input:
+    prepare_ns - duration of the preparation phase
+
+Output:
+    Updates the current record.
+--- */
+void trace_job_prepared(long long prepare_ns)
+{
+    current.prepare_ns = prepare_ns;
+}
+
+/* ---
+Function Name: trace_job_started
+
+Purpose:
+    Records the time from the first spawn until the last stage had started
+    (time-to-last-stage-started).
+
+Input:
+    start_span_ns - duration of the spawn loop
+
+Output:
+    Updates the current record.
+--- */
+void trace_job_started(long long start_span_ns)
+{
+    current.start_span_ns = start_span_ns;
+}
+
+/* ---
+Function Name: trace_job_launched
+
+Purpose:
+    Records the time taken to start every stage of the job.
+
+Input:
+    launch_ns - duration of the launch phase
+
+Output:
+    Updates the current record.
+--- */
+void trace_job_launched(long long launch_ns)
+{
+    current.launch_ns = launch_ns;
+}
+
+/* ---
+Function Name: trace_job_waited
+
+Purpose:
+    Records the time the shell spent waiting for a foreground job.
+
+Input:
+    wait_ns - duration of the wait phase
+
+Output:
+    Updates the current record.
+--- */
+void trace_job_waited(long long wait_ns)
+{
+    current.wait_ns = wait_ns;
+}
+
+/* ---
+Function Name: trace_job_cgroup
+
+Purpose:
+    Records the usage read back from a limited job's cgroup.
+
+Input:
+    memory_peak - peak memory in bytes, -1 if unknown
+    cpu_usec    - total CPU time in microseconds, -1 if unknown
+
+Output:
+    Adds cgroup fields to the current trace record.
+--- */
+void trace_job_cgroup(long long memory_peak, long long cpu_usec)
+{
+    current.has_cgroup = TRUE;
+    current.cgroup_memory_peak = memory_peak;
+    current.cgroup_cpu_usec = cpu_usec;
+}
+
+/* ---
+Function Name: trace_job_end
+
+Purpose:
+    Ends the current record. A foreground job's is formatted as a single
+    JSON line and queued on the output ring; nothing is written to the
+    trace file here. A background job's is parked until its stages are
+    reaped (see trace_proc_reaped()), or written at once if too many
+    are parked. Callers still block SIGCHLD, so no stage can have been
+    reaped unseen.
+
+Input:
+    job - job that just completed or was sent to the background
+
+Output:
+    Queues or parks one record.
+--- */
+void trace_job_end(Job *job)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return;
+
+    /* a finished job is formatted now, unless its record might not fit
+       the ring: then it waits for trace_flush() too, rather than the
+       ring being written out in the middle of a loop's jobs */
+    TraceJob done;
+    TraceJob *entry = &done;
+    int deferred = !job->background && ring_free() < TRACE_LINE_LEN;
+    if (job->background || deferred) {
+        for (int i = INITIAL_INDEX; i < TRACE_MAX_PARKED && entry == &done; i++) {
+            if (!parked[i].in_use) entry = &parked[i];
+        }
+    }
+
+    entry->deferred = deferred;
+    entry->background = job->background;
+    entry->num_stages = job->num_stages;
+    for (int i = INITIAL_INDEX; i < job->num_stages; i++)
+        copy_command(entry->commands[i], job->pipeline[i].argv[INITIAL_INDEX]);
+    entry->record = current;
+    entry->record.end_ns = trace_now();
+
+    if (entry == &done)
+        format_record(entry);
+    else
+        entry->in_use = TRUE;
+}
+
+/* ---
+Function Name: trace_proc_reaped
+
+Purpose:
+    Records the wait status and resource usage of a reaped process that
+    belongs to a parked background job. Called wherever children are
+    reaped, including the SIGCHLD handler, so it only stores them.
+
+Input:
+    pid    - reaped process
+    status - raw wait status
+    usage  - rusage returned by wait4
+
+Output:
+    Updates the parked record, if any.
+--- */
+void trace_proc_reaped(int pid, int status, struct rusage *usage)
+{
+    if (trace_fd == TRACE_DISABLED_FD || WIFSTOPPED(status) || WIFCONTINUED(status)) return;
+
+    TraceJob *entry = find_parked(pid);
+    if (!entry) return;
+    for (int i = INITIAL_INDEX; i < entry->num_stages; i++) {
+        TraceStage *stage = &entry->record.stages[i];
+        if (stage->pid != pid || stage->reaped) continue;
+        stage->status = status;
+        stage->usage = *usage;
+        stage->reaped = TRUE;
+    }
+    if (all_reaped(entry)) entry->record.end_ns = trace_now();
+}
+
+/* ---
+Function Name: trace_job_usage
+
+Purpose:
+    Records the usage read back from a finished background job's
+    cgroup, before the job table releases it.
+
+Input:
+    pid         - any process of the job
+    memory_peak - peak memory in bytes, -1 if unknown
+    cpu_usec    - total CPU time in microseconds, -1 if unknown
+
+Output:
+    Adds cgroup fields to the parked record, if any.
+--- */
+void trace_job_usage(int pid, long long memory_peak, long long cpu_usec)
+{
+    TraceJob *entry = find_parked(pid);
+    if (!entry) return;
+    entry->record.has_cgroup = TRUE;
+    entry->record.cgroup_memory_peak = memory_peak;
+    entry->record.cgroup_cpu_usec = cpu_usec;
+}
+
+/* ---
+Function Name: trace_flush
+
+Purpose:
+    Queues the records of background jobs that have finished and left
+    the job table (whose cgroup usage has then been read), then writes
+    every queued record to the trace file. Called from the shell's idle
+    points (before prompting, on exit) so the writes never overlap a
+    job being measured.
+
+Input:
+    none
+
+Output:
+    Drains the ring buffer to the trace file.
+--- */
+void trace_flush(void)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return;
+
+    sigset_t chld_mask, prev_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &prev_mask);
+    for (int i = INITIAL_INDEX; i < TRACE_MAX_PARKED; i++) {
+        TraceJob *entry = &parked[i];
+        if (!entry->in_use) continue;
+        if (!entry->deferred && (!all_reaped(entry) || find_job_by_pid(entry->record.stages[INITIAL_INDEX].pid)))
+            continue;
+        format_record(entry);
+        entry->in_use = FALSE;
+    }
+    sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+
+    ring_drain();
+}
+
+/* ---
+Function Name: trace_close
+
+Purpose:
+    Writes every record before the shell exits, including those of
+    background jobs still running, which then have no exit status.
+
+Input:
+    none
+
+Output:
+    Drains the ring buffer to the trace file.
+--- */
+void trace_close(void)
+{
+    if (trace_fd == TRACE_DISABLED_FD) return;
+
+    trace_flush();
+    for (int i = INITIAL_INDEX; i < TRACE_MAX_PARKED; i++) {
+        if (!parked[i].in_use) continue;
+        format_record(&parked[i]);
+        parked[i].in_use = FALSE;
+    }
+    ring_drain();
+}
+
+/* ---
+Function Name: find_parked
+
+Purpose:
+    Finds the parked record of the job a process belongs to.
+
+Input:
+    pid - process ID of any stage
+
+Output:
+    The record, or NULL.
+--- */
+static TraceJob *find_parked(int pid)
+{
+    for (int i = INITIAL_INDEX; i < TRACE_MAX_PARKED; i++) {
+        if (!parked[i].in_use || parked[i].deferred) continue;
+        for (int k = INITIAL_INDEX; k < parked[i].num_stages; k++) {
+            if (parked[i].record.stages[k].pid == pid) return &parked[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---
+Function Name: all_reaped
+
+Purpose:
+    Tells whether every stage of a parked job has been reaped.
+
+Input:
+    entry - parked record
+
+Output:
+    Non-zero if so.
+--- */
+static int all_reaped(TraceJob *entry)
+{
+    for (int i = INITIAL_INDEX; i < entry->num_stages; i++) {
+        if (!entry->record.stages[i].reaped) return FALSE;
+    }
+    return TRUE;
+}
+
+/* ---
+Function Name: format_record
+
+Purpose:
+    Formats a job's record as a single JSON line and queues it on the
+    output ring. TRACE_LINE_LEN holds the longest record (command names
+    are cut to TRACE_CMD_LEN), so the line is always complete JSON.
+
+Input:
+    entry - job record
+
+Output:
+    Appends one record to the ring buffer.
+--- */
+static void format_record(TraceJob *entry)
+{
+    TraceRecord *rec = &entry->record;
+    char line[TRACE_LINE_LEN];
+    char *end = line + TRACE_LINE_LEN - TRUE;
+    char *p = line;
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    p = append_field(p, end, "{\"ts_us\":",
+                     (long long)wall.tv_sec * USEC_PER_SEC + wall.tv_nsec / NS_PER_USEC);
+    p = append_field(p, end, ",\"background\":", entry->background);
+    p = append_field(p, end, ",\"num_stages\":", entry->num_stages);
+    p = append_field(p, end, ",\"parse_ns\":", rec->parse_ns);
+    p = append_field(p, end, ",\"prepare_ns\":", rec->prepare_ns);
+    p = append_field(p, end, ",\"start_span_ns\":", rec->start_span_ns);
+    p = append_field(p, end, ",\"launch_ns\":", rec->launch_ns);
+    p = append_field(p, end, ",\"wait_ns\":", rec->wait_ns);
+    p = append_field(p, end, ",\"total_ns\":", rec->end_ns - rec->start_ns);
+    if (rec->has_cgroup) {
+        p = append_field(p, end, ",\"cgroup_memory_peak\":", rec->cgroup_memory_peak);
+        p = append_field(p, end, ",\"cgroup_cpu_us\":", rec->cgroup_cpu_usec);
+    }
+    p = append_str(p, end, ",\"stages\":[");
+
+    for (int i = INITIAL_INDEX; i < entry->num_stages; i++) {
+        TraceStage *stage = &rec->stages[i];
+        p = append_str(p, end, i ? ",{\"cmd\":" : "{\"cmd\":");
+        p = append_json_str(p, end, entry->commands[i]);
+        p = append_field(p, end, ",\"pid\":", stage->pid);
+        p = append_field(p, end, ",\"resolve_ns\":", stage->resolve_ns);
+        p = append_field(p, end, ",\"spawn_ns\":", stage->spawn_ns);
+        if (stage->reaped) {
+            int exited = WIFEXITED(stage->status);
+            p = append_field(p, end, ",\"exit\":",
+                             exited ? WEXITSTATUS(stage->status) : ERROR_VALUE);
+            p = append_field(p, end, ",\"signal\":",
+                             WIFSIGNALED(stage->status) ? WTERMSIG(stage->status) : ZERO_VALUE);
+            p = append_field(p, end, ",\"utime_us\":", timeval_to_us(&stage->usage.ru_utime));
+            p = append_field(p, end, ",\"stime_us\":", timeval_to_us(&stage->usage.ru_stime));
+            p = append_field(p, end, ",\"maxrss_kb\":", stage->usage.ru_maxrss);
+            p = append_field(p, end, ",\"minflt\":", stage->usage.ru_minflt);
+            p = append_field(p, end, ",\"majflt\":", stage->usage.ru_majflt);
+            p = append_field(p, end, ",\"nvcsw\":", stage->usage.ru_nvcsw);
+            p = append_field(p, end, ",\"nivcsw\":", stage->usage.ru_nivcsw);
+        }
+        p = append_str(p, end, "}");
+    }
+    p = append_str(p, end, "]}\n");
+
+    ring_put(line, p - line);
+}
+
+/* ---
+Function Name: ring_put
+
+Purpose:
+    Copies one formatted record into the ring. Drains the ring first if the
+    record would not fit, which trace_job_end() avoids while jobs run by
+    deferring records; it still happens from a job when the ring and the
+    parked slots are both full (a loop running hundreds of jobs in one
+    line), so records are written late rather than dropped.
+
+Input:
+    data - record bytes
+    len  - record length
+
+Output:
+    Advances ring_head.
+--- */
+static void ring_put(const char *data, unsigned int len)
+{
+    if (len > ring_free())
+        ring_drain();
+
+    for (unsigned int i = INITIAL_INDEX; i < len; i++)
+        trace_ring[(ring_head + i) % TRACE_RING_SIZE] = data[i];
+    ring_head += len;
+}
+
+/* ---
+Function Name: ring_free
+
+Purpose:
+    Tells how many bytes can be queued before the ring must be drained.
+
+Input:
+    none
+
+Output:
+    Free bytes in the ring.
+--- */
+static unsigned int ring_free(void)
+{
+    return TRACE_RING_SIZE - (ring_head - ring_tail);
+}
+
+/* ---
+Function Name: ring_drain
+
+Purpose:
+    Writes every record queued on the ring to the trace file.
+
+Input:
+    none
+
+Output:
+    Empties the ring; records that cannot be written are dropped.
+--- */
+static void ring_drain(void)
+{
+    while (trace_fd != TRACE_DISABLED_FD && ring_tail != ring_head) {
+        unsigned int offset = ring_tail % TRACE_RING_SIZE;
+        unsigned int chunk = ring_head - ring_tail;
+        if (chunk > TRACE_RING_SIZE - offset)
+            chunk = TRACE_RING_SIZE - offset;
+
+        int written = write(trace_fd, trace_ring + offset, chunk);
+        if (written <= ZERO_VALUE) {
+            ring_tail = ring_head;   /* drop records we cannot deliver */
+            return;
+        }
+        ring_tail += written;
+    }
+}
+
+/* ---
+Function Name: copy_command
+
+Purpose:
+    Copies a command name into a record, cut to TRACE_CMD_LEN - 1 bytes
+    at the start of a UTF-8 character so the JSON stays valid.
+
+Input:
+    dst - TRACE_CMD_LEN bytes
+    src - command name (NULL is copied as an empty string)
+
+Output:
+    Fills dst.
+--- */
+static void copy_command(char *dst, const char *src)
+{
+    int n = INITIAL_INDEX;
+    while (src && src[n] && n < TRACE_CMD_LEN - TRUE) {
+        dst[n] = src[n];
+        n++;
+    }
+    if (src && src[n]) {
+        while (n > INITIAL_INDEX && ((unsigned char)src[n] & UTF8_CONTINUATION_MASK) == UTF8_CONTINUATION_BITS)
+            n--;
+    }
+    dst[n] = NULL_CHAR;
+}
+
+/* ---
+Function Name: append_str
+
+Purpose:
+    Appends a plain string to a bounded output buffer.
+
+Input:
+    p   - current write position
+    end - last usable position
+    s   - string to append
+
+Output:
+    Returns the new write position.
+--- */
+static char *append_str(char *p, char *end, const char *s)
+{
+    while (*s && p < end) *p++ = *s++;
+    return p;
+}
+
+/* ---
+Function Name: append_json_str
+
+Purpose:
+    Appends a string as a quoted JSON value, escaping quotes, backslashes
+    and control characters.
+
+Input:
+    p   - current write position
+    end - last usable position
+    s   - string to append (NULL is written as an empty string)
+
+Output:
+    Returns the new write position.
+--- */
+static char *append_json_str(char *p, char *end, const char *s)
+{
+    if (p < end) *p++ = JSON_QUOTE;
+    for (; s && *s && p < end; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == JSON_QUOTE || c == JSON_BACKSLASH) {
+            *p++ = JSON_BACKSLASH;
+            if (p < end) *p++ = c;
+        } else if (c < CONTROL_CHAR_LIMIT) {
+            p = append_str(p, end, JSON_UNICODE_ESCAPE);
+            if (p < end) *p++ = HEX_DIGITS[c >> 4];
+            if (p < end) *p++ = HEX_DIGITS[c & 0xf];
+        } else {
+            *p++ = c;
+        }
+    }
+    if (p < end) *p++ = JSON_QUOTE;
+    return p;
+}
+
+/* ---
+Function Name: append_num
+
+Purpose:
+    Appends a signed decimal number to a bounded output buffer.
+
+Input:
+    p     - current write position
+    end   - last usable position
+    value - number to append
+
+Output:
+    Returns the new write position.
+--- */
+static char *append_num(char *p, char *end, long long value)
+{
+    char digits[NUM_BUFFER_LEN];
+    int n = INITIAL_INDEX;
+    unsigned long long v = value < ZERO_VALUE ? -(unsigned long long)value : value;
+
+    do {
+        digits[n++] = (v % DECIMAL_BASE) + ZERO_CHAR;
+        v /= DECIMAL_BASE;
+    } while (v > ZERO_VALUE);
+
+    if (value < ZERO_VALUE && p < end) *p++ = NEGATIVE_SIGN;
+    while (n > INITIAL_INDEX && p < end) *p++ = digits[--n];
+    return p;
+}
+
+/* ---
+Function Name: append_field
+
+Purpose:
+    Appends a key fragment followed by its numeric value.
+
+Input:
+    p     - current write position
+    end   - last usable position
+    key   - literal JSON text preceding the value
+    value - number to append
+
+Output:
+    Returns the new write position.
+--- */
+static char *append_field(char *p, char *end, const char *key, long long value)
+{
+    return append_num(append_str(p, end, key), end, value);
+}
+
+/* ---
+Function Name: timeval_to_us
+
+Purpose:
+    Converts a struct timeval to microseconds.
+
+Input:
+    tv - time value
+
+Output:
+    Microseconds represented by tv.
+--- */
+static long long timeval_to_us(struct timeval *tv)
+{
+    return (long long)tv->tv_sec * USEC_PER_SEC + tv->tv_usec;
+}
@@ -0,0 +1,113 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "jobs.h"
+#include <sys/resource.h>   /* struct rusage */
+
+/* TRACE CONFIGURATION */
+#define TRACE_ENV_NAME          "MYSH_TRACE"
+#define TRACE_RING_SIZE         65536
+#define TRACE_MAX_PARKED        64      /* background jobs not yet reaped, and
+                                           records deferred while the ring is full */
+#define TRACE_FILE_FLAGS        (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
+#define TRACE_FILE_PERMISSIONS  0644
+
+/* NUMERIC CONSTANTS */
+#define TRACE_DISABLED_FD       (-1)
+#define ERROR_VALUE             (-1)
+#define NS_PER_SEC              1000000000LL
+#define NS_PER_USEC             1000LL
+#define USEC_PER_SEC            1000000LL
+#define NUM_BUFFER_LEN          24
+#define CONTROL_CHAR_LIMIT      0x20
+#define HEX_DIGITS              "0123456789abcdef"
+
+/* JSON FORMATTING CONSTANTS */
+#define JSON_QUOTE              '"'
+#define JSON_BACKSLASH          '\\'
+#define JSON_UNICODE_ESCAPE     "\\u00"
+#define JSON_ESCAPED_CHAR_MAX   6       /* a control character as \u00XX */
+#define UTF8_CONTINUATION_MASK  0xC0
+#define UTF8_CONTINUATION_BITS  0x80
+
+/* RECORD SIZE: a line always holds a whole record, so none is cut off */
+#define TRACE_CMD_LEN           128     /* command names are cut to this */
+#define TRACE_FIELD_LEN         48      /* ",\"key\":" and a 64-bit number */
+#define TRACE_JOB_FIELDS        16
+#define TRACE_STAGE_FIELDS      16
+#define TRACE_STAGE_LEN         (TRACE_STAGE_FIELDS * TRACE_FIELD_LEN + JSON_ESCAPED_CHAR_MAX * TRACE_CMD_LEN)
+#define TRACE_LINE_LEN          (TRACE_JOB_FIELDS * TRACE_FIELD_LEN + MAX_PIPELINE_LEN * TRACE_STAGE_LEN)
+
+/* PER-STAGE TRACE DATA */
+typedef struct
+{
+    int pid;
+    int status;
+    int reaped;
+    long long resolve_ns;
+    long long spawn_ns;
+    struct rusage usage;
+} TraceStage;
+
+/* PER-JOB TRACE RECORD */
+typedef struct
+{
+    long long start_ns;
+    long long end_ns;               /* when the last stage was reaped */
+    long long parse_ns;
+    long long prepare_ns;
+    long long start_span_ns;
+    long long launch_ns;
+    long long wait_ns;
+    int has_cgroup;
+    long long cgroup_memory_peak;
+    long long cgroup_cpu_usec;
+    TraceStage stages[MAX_PIPELINE_LEN];
+} TraceRecord;
+
+/* A JOB'S RECORD WITH WHAT IS NEEDED TO FORMAT IT LATER */
+typedef struct
+{
+    int in_use;                     /* parked: waiting for its stages */
+    int deferred;                   /* finished; parked only because the ring was full */
+    int background;
+    int num_stages;
+    char commands[MAX_PIPELINE_LEN][TRACE_CMD_LEN];
+    TraceRecord record;
+} TraceJob;
+
+/* FUNCTION DECLARATIONS */
+void trace_init(char *envp[]);
+int trace_enabled(void);
+long long trace_now(void);
+void trace_parse_done(long long parse_ns);
+void trace_job_begin(Job *job);
+void trace_stage_resolved(int stage_index, long long resolve_ns);
+void trace_stage_spawned(int stage_index, int pid, long long spawn_ns);
+void trace_stage_reaped(int stage_index, int status, struct rusage *usage);
+void trace_job_prepared(long long prepare_ns);
+void trace_job_started(long long start_span_ns);
+void trace_job_launched(long long launch_ns);
+void trace_job_waited(long long wait_ns);
+void trace_job_cgroup(long long memory_peak, long long cpu_usec);
+void trace_job_end(Job *job);
+void trace_proc_reaped(int pid, int status, struct rusage *usage);
+void trace_job_usage(int pid, long long memory_peak, long long cpu_usec);
+void trace_flush(void);
+void trace_close(void);
+
+/* STATIC HELPER FUNCTIONS */
+static TraceJob *find_parked(int pid);
+static int all_reaped(TraceJob *entry);
+static void format_record(TraceJob *entry);
+static void ring_put(const char *data, unsigned int len);
+static unsigned int ring_free(void);
+static void ring_drain(void);
+static void copy_command(char *dst, const char *src);
+static char *append_str(char *p, char *end, const char *s);
+static char *append_json_str(char *p, char *end, const char *s);
+static char *append_num(char *p, char *end, long long value);
+static char *append_field(char *p, char *end, const char *key, long long value);
+static long long timeval_to_us(struct timeval *tv);
+
+#endif